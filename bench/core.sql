@@ -0,0 +1,147 @@
+--
+-- Microbenchmarks of the core period operations, run through SQL on
+-- generated data of four shapes:
+--
+--   uniform      starts over ten years, an hour to a month long
+--   clustered    starts in the last month, skewed toward now, short
+--   long_tailed  starts over ten years, lengths from a power law
+--   open_ended   starts over ten years, ending at infinity
+--
+--   make bench
+--   psql -X -q -d bench -v rows=100000 -f bench/core.sql > bench/core.csv
+--
+-- in a database with temporal installed. Each row has a period p and
+-- a period q overlapping its end, so that union and minus are defined.
+-- Prints CSV with the shape, the operation, the number of rows or
+-- probes, and the nanoseconds per operation: the best of three runs,
+-- less the same scan without the operation.
+--
+
+\set ON_ERROR_STOP 1
+SET client_min_messages = warning;
+SELECT setseed(0.5) \gset
+
+CREATE TEMP TABLE bench_results (shape text, operation text, rows bigint, ns_per_op numeric);
+
+-- Create bench_<shape> from rows of starts f and lengths l, NULL for
+-- open ended periods.
+CREATE FUNCTION pg_temp.bench_data(shape text, n bigint, f text, l text) RETURNS void LANGUAGE plpgsql AS $$
+BEGIN
+  EXECUTE format($q$CREATE TEMP TABLE %I AS
+    SELECT p, q, p::text AS t
+      FROM (SELECT period(f, coalesce(f + l, 'infinity')) AS p,
+                   period(coalesce(f + l / 2, f + interval '1 hour'),
+                          coalesce(f + l + l / 2, 'infinity')) AS q
+              FROM (SELECT %s AS f, %s AS l FROM generate_series(1, %s)) g) s$q$,
+    'bench_' || shape, f, l, n);
+  EXECUTE format('ANALYZE %I', 'bench_' || shape);
+END;
+$$;
+
+SELECT pg_temp.bench_data('uniform', :rows,
+  $$'2000-01-01'::timestamptz + random() * interval '3650 days'$$,
+  $$interval '1 hour' + random() * interval '30 days'$$) \gset
+SELECT pg_temp.bench_data('clustered', :rows,
+  $$now() - power(random(), 4) * interval '30 days'$$,
+  $$interval '1 minute' + random() * interval '1 hour'$$) \gset
+SELECT pg_temp.bench_data('long_tailed', :rows,
+  $$'2000-01-01'::timestamptz + random() * interval '3650 days'$$,
+  $$interval '1 minute' * least(power(1 - random(), -2), 1e6)$$) \gset
+SELECT pg_temp.bench_data('open_ended', :rows,
+  $$'2000-01-01'::timestamptz + random() * interval '3650 days'$$,
+  $$NULL::interval$$) \gset
+
+-- The best time of three runs of query, in nanoseconds, running
+-- cleanup after each.
+CREATE FUNCTION pg_temp.bench_ns(query text, cleanup text DEFAULT NULL) RETURNS numeric LANGUAGE plpgsql AS $$
+DECLARE
+  best numeric;
+  started timestamptz;
+  elapsed numeric;
+BEGIN
+  FOR i IN 1..3 LOOP
+    started := clock_timestamp();
+    EXECUTE query;
+    elapsed := extract(epoch FROM clock_timestamp() - started) * 1e9;
+    IF best IS NULL OR elapsed < best THEN
+      best := elapsed;
+    END IF;
+    IF cleanup IS NOT NULL THEN
+      EXECUTE cleanup;
+    END IF;
+  END LOOP;
+  RETURN best;
+END;
+$$;
+
+DO $$
+DECLARE
+  shape text;
+  tab text;
+  op record;
+  n bigint;
+  base numeric;
+BEGIN
+  FOREACH shape IN ARRAY ARRAY['uniform', 'clustered', 'long_tailed', 'open_ended'] LOOP
+    tab := quote_ident('bench_' || shape);
+    EXECUTE 'SELECT count(*) FROM ' || tab INTO n;
+
+    -- the operations, each evaluated once per row
+    base := pg_temp.bench_ns('SELECT count(p) FROM ' || tab);
+    FOR op IN SELECT * FROM (VALUES
+        ('period_compare', 'btree_period_compare(p, q)'),
+        ('period_overlaps', 'p && q'),
+        ('period_intersect', 'period_intersect(p, q)'),
+        ('period_union', 'period_union(p, q)'),
+        ('period_minus', 'p - q'),
+        ('period_out', 'p::text'),
+        ('period_in', 't::period')) v(name, expr) LOOP
+      INSERT INTO bench_results VALUES (shape, op.name, n,
+        round((pg_temp.bench_ns(format('SELECT count(%s) FROM %s', op.expr, tab)) - base) / n, 1));
+    END LOOP;
+
+    -- the rows' periods as one array against one period, per element,
+    -- with period_array_count and with && on each element
+    EXECUTE format('CREATE TEMP TABLE bench_array AS SELECT array_agg(p) AS a, (SELECT q FROM %s LIMIT 1) AS q FROM %s',
+                   tab, tab);
+    INSERT INTO bench_results VALUES (shape, 'period_array_count', n,
+      round(pg_temp.bench_ns('SELECT period_array_count(a, q, ''&&'') FROM bench_array') / n, 1));
+    INSERT INTO bench_results VALUES (shape, 'unnest_overlaps', n,
+      round(pg_temp.bench_ns('SELECT count(*) FROM bench_array, unnest(a) e WHERE e && q') / n, 1));
+    DROP TABLE bench_array;
+
+    -- covered_length over a sliding frame of 100 rows, per row, which
+    -- takes each row out again rather than aggregating every frame;
+    -- open ended periods cover an infinite length
+    IF shape <> 'open_ended' THEN
+      INSERT INTO bench_results VALUES (shape, 'covered_length_window', n,
+        round(pg_temp.bench_ns(format(
+          'SELECT count(c) FROM (SELECT covered_length(p) OVER (ORDER BY p ROWS BETWEEN 99 PRECEDING AND CURRENT ROW) AS c FROM %s) w',
+          tab)) / n, 1));
+    END IF;
+
+    -- building a GiST index, which runs compress, penalty, picksplit
+    -- and union, per row
+    INSERT INTO bench_results VALUES (shape, 'gist_build', n,
+      round(pg_temp.bench_ns(format('CREATE INDEX bench_gist ON %s USING gist (p)', tab),
+                             'DROP INDEX bench_gist') / n, 1));
+
+    -- searches, which run consistent, per probe
+    EXECUTE format('CREATE INDEX bench_gist ON %s USING gist (p)', tab);
+    EXECUTE format('ANALYZE %s', tab);
+    SET LOCAL enable_seqscan = off;
+    INSERT INTO bench_results VALUES (shape, 'gist_overlaps', 1000,
+      round(pg_temp.bench_ns(format(
+        'SELECT sum((SELECT count(*) FROM %s d WHERE d.p && pr.q)) FROM (SELECT q FROM %s LIMIT 1000) pr',
+        tab, tab)) / 1000, 1));
+    INSERT INTO bench_results VALUES (shape, 'gist_contains', 1000,
+      round(pg_temp.bench_ns(format(
+        'SELECT sum((SELECT count(*) FROM %s d WHERE d.p @> first(pr.q))) FROM (SELECT q FROM %s LIMIT 1000) pr',
+        tab, tab)) / 1000, 1));
+    RESET enable_seqscan;
+    DROP INDEX bench_gist;
+  END LOOP;
+END;
+$$;
+
+COPY (SELECT shape, operation, rows, ns_per_op FROM bench_results) TO STDOUT WITH CSV HEADER;
@@ -0,0 +1,108 @@
+--
+-- The quality of GiST indexes on a period built by gist_period_penalty
+-- and gist_period_picksplit, for the data shapes of bench/core.sql each
+-- inserted in three orders:
+--
+--   random   shuffled
+--   sorted   by period, so by first
+--   reverse  by period, descending
+--
+--   make bench
+--   psql -X -q -d bench -v rows=100000 -f bench/gist_quality.sql > bench/gist_quality.csv
+--
+-- in a database with temporal installed (PostgreSQL 12 or later, for
+-- jsonb_path_query). Prints CSV with a row per level of each index, with
+-- period_gist_stats of it, and the mean index pages visited by searches
+-- of 100 probes with && and with @> timestamptz, which are the same on
+-- every row of an index.
+--
+
+\set ON_ERROR_STOP 1
+SET client_min_messages = warning;
+SELECT setseed(0.5) \gset
+
+CREATE TEMP TABLE bench_results (shape text, insert_order text, level integer, pages bigint,
+  tuples bigint, fill numeric, extent_mean numeric, overlap numeric, open_ended numeric,
+  overlaps_pages numeric, contains_pages numeric);
+
+-- Create bench_<shape> from rows of starts f and lengths l, NULL for
+-- open ended periods.
+CREATE FUNCTION pg_temp.bench_data(shape text, n bigint, f text, l text) RETURNS void LANGUAGE plpgsql AS $$
+BEGIN
+  EXECUTE format($q$CREATE TEMP TABLE %I AS
+    SELECT period(f, coalesce(f + l, 'infinity')) AS p
+      FROM (SELECT %s AS f, %s AS l FROM generate_series(1, %s)) g$q$,
+    'bench_' || shape, f, l, n);
+END;
+$$;
+
+SELECT pg_temp.bench_data('uniform', :rows,
+  $$'2000-01-01'::timestamptz + random() * interval '3650 days'$$,
+  $$interval '1 hour' + random() * interval '30 days'$$) \gset
+SELECT pg_temp.bench_data('clustered', :rows,
+  $$now() - power(random(), 4) * interval '30 days'$$,
+  $$interval '1 minute' + random() * interval '1 hour'$$) \gset
+SELECT pg_temp.bench_data('long_tailed', :rows,
+  $$'2000-01-01'::timestamptz + random() * interval '3650 days'$$,
+  $$interval '1 minute' * least(power(1 - random(), -2), 1e6)$$) \gset
+SELECT pg_temp.bench_data('open_ended', :rows,
+  $$'2000-01-01'::timestamptz + random() * interval '3650 days'$$,
+  $$NULL::interval$$) \gset
+
+-- The index pages a query visits, from its bitmap index scans. The
+-- tables are temporary, so their pages are in local buffers.
+CREATE FUNCTION pg_temp.index_pages(query text) RETURNS bigint LANGUAGE plpgsql AS $$
+DECLARE
+  plan json;
+BEGIN
+  EXECUTE 'EXPLAIN (ANALYZE, BUFFERS, FORMAT JSON) ' || query INTO plan;
+  RETURN (SELECT coalesce(sum((n->>'Local Hit Blocks')::bigint + (n->>'Local Read Blocks')::bigint +
+                              (n->>'Shared Hit Blocks')::bigint + (n->>'Shared Read Blocks')::bigint), 0)
+            FROM jsonb_path_query(plan::jsonb, 'strict $.** ? (@."Node Type" == "Bitmap Index Scan")') n);
+END;
+$$;
+
+DO $$
+DECLARE
+  shape text;
+  ord record;
+  tab text;
+  probe period;
+  overlaps_pages numeric;
+  contains_pages numeric;
+BEGIN
+  SET LOCAL enable_seqscan = off;
+  SET LOCAL enable_indexscan = off;
+  FOREACH shape IN ARRAY ARRAY['uniform', 'clustered', 'long_tailed', 'open_ended'] LOOP
+    FOR ord IN SELECT * FROM (VALUES
+        ('random', 'random()'),
+        ('sorted', 'p'),
+        ('reverse', 'p DESC')) v(name, expr) LOOP
+      tab := quote_ident('bench_' || shape || '_' || ord.name);
+      EXECUTE format('CREATE TEMP TABLE %s AS SELECT p FROM %I ORDER BY %s',
+                     tab, 'bench_' || shape, ord.expr);
+      EXECUTE format('CREATE INDEX ON %s USING gist (p)', tab);
+      EXECUTE format('ANALYZE %s', tab);
+
+      -- the same probes, from the table as generated, for every order
+      overlaps_pages := 0;
+      contains_pages := 0;
+      FOR probe IN EXECUTE format('SELECT p FROM %I LIMIT 100', 'bench_' || shape) LOOP
+        overlaps_pages := overlaps_pages + pg_temp.index_pages(
+          format('SELECT count(*) FROM %s WHERE p && %L::period', tab, probe));
+        contains_pages := contains_pages + pg_temp.index_pages(
+          format('SELECT count(*) FROM %s WHERE p @> %L::timestamptz', tab, first(probe)));
+      END LOOP;
+
+      INSERT INTO bench_results
+        SELECT shape, ord.name, s.level, s.pages, s.tuples, round(s.fill::numeric, 3),
+               round(s.extent_mean::numeric, 1), round(s.overlap::numeric, 3),
+               round(s.open_ended::numeric, 3), overlaps_pages / 100, contains_pages / 100
+          FROM period_gist_stats(format('%s_p_idx', tab)::regclass) s;
+      EXECUTE format('DROP TABLE %s', tab);
+    END LOOP;
+  END LOOP;
+END;
+$$;
+
+COPY (SELECT * FROM bench_results) TO STDOUT WITH CSV HEADER;
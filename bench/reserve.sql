@@ -0,0 +1,88 @@
+--
+-- Claiming hour long slots under contention: period_reserve, against
+-- inserts into a table with an exclusion constraint that retry on
+-- conflict.
+--
+--   make bench-reserve
+--
+-- or by hand
+--
+--   psql -X -q -d bench -f bench/reserve.sql
+--   pgbench -n -c 64 -j 8 -T 30 -f bench/reserve_exclude.pgbench bench
+--   pgbench -n -c 64 -j 8 -T 30 -f bench/reserve.pgbench bench
+--   psql -X -d bench -c 'TABLE bench_reserve_summary'
+--
+-- in a database with temporal and btree_gist installed (pgbench 9.6 or
+-- later). Each transaction books an hour in one of 10 rooms from a
+-- random half hour of a week, moving on when the time is taken, and
+-- gives up after 20 attempts; then it cancels the bookings of a random
+-- hour, so the rooms stay about half full. pgbench reports the
+-- throughput, and bench_reserve_summary the attempts per booking.
+--
+
+\set ON_ERROR_STOP 1
+
+DROP TABLE IF EXISTS bench_reserve_exclude, bench_reserve, bench_reserve_attempts CASCADE;
+
+CREATE TABLE bench_reserve_exclude (room int, during period,
+  EXCLUDE USING gist (room WITH =, during WITH &&));
+
+CREATE TABLE bench_reserve (room int, during period);
+CREATE INDEX bench_reserve_room_during ON bench_reserve (room, during);
+
+CREATE TABLE bench_reserve_attempts (method text, booked boolean, attempts int);
+
+CREATE VIEW bench_reserve_summary AS
+  SELECT method, count(*) AS bookings, round(avg(attempts), 2) AS attempts,
+         round(avg((NOT booked)::int), 3) AS gave_up
+    FROM bench_reserve_attempts GROUP BY method ORDER BY method;
+
+-- All a failed insert tells the client is that something overlaps, so
+-- it tries half an hour later.
+CREATE OR REPLACE FUNCTION bench_book_exclude(r int, start timestamptz) RETURNS void LANGUAGE plpgsql AS $$
+DECLARE
+  want period := period(start, start + interval '1 hour');
+  tries int := 0;
+BEGIN
+  LOOP
+    tries := tries + 1;
+    BEGIN
+      INSERT INTO bench_reserve_exclude VALUES (r, want);
+      INSERT INTO bench_reserve_attempts VALUES ('exclude', true, tries);
+      RETURN;
+    EXCEPTION WHEN exclusion_violation THEN
+      IF tries = 20 THEN
+        INSERT INTO bench_reserve_attempts VALUES ('exclude', false, tries);
+        RETURN;
+      END IF;
+      want := period(first(want) + interval '30 minutes', next(want) + interval '30 minutes');
+    END;
+  END LOOP;
+END;
+$$;
+
+-- period_reserve hands back the conflict, so the next try starts where it ends.
+CREATE OR REPLACE FUNCTION bench_book_reserve(r int, start timestamptz) RETURNS void LANGUAGE plpgsql AS $$
+DECLARE
+  want period := period(start, start + interval '1 hour');
+  res record;
+  tries int := 0;
+BEGIN
+  LOOP
+    tries := tries + 1;
+    SELECT * INTO res FROM period_reserve('bench_reserve', 'room', r, 'during', want, '1 hour');
+    IF res.reserved OR tries = 20 THEN
+      INSERT INTO bench_reserve_attempts VALUES ('reserve', res.reserved, tries);
+      RETURN;
+    END IF;
+    want := period(next(res.conflict), next(res.conflict) + interval '1 hour');
+  END LOOP;
+END;
+$$;
+
+CREATE OR REPLACE FUNCTION bench_cancel(tab regclass, r int, start timestamptz) RETURNS void LANGUAGE plpgsql AS $$
+BEGIN
+  EXECUTE format('DELETE FROM %s WHERE room = $1 AND during && $2', tab)
+    USING r, period(start, start + interval '1 hour');
+END;
+$$;
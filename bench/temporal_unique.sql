@@ -0,0 +1,83 @@
+--
+-- Compare temporal_unique() on a btree (key, period) index with an
+-- EXCLUDE USING gist constraint, which needs btree_gist for the key.
+--
+--   make bench-unique
+--   psql -X -q -d bench -f bench/temporal_unique.sql > bench/temporal_unique.csv
+--
+-- in a database with temporal and btree_gist installed. Each table gets
+-- 1000 keys with 200 consecutive non-overlapping day long periods, then
+-- 2000 inserts that all conflict. Prints CSV with the constraint, the
+-- measure, the number of rows, and the microseconds per row for the
+-- inserts, the conflicts caught, or the size of the index in bytes.
+--
+
+\set ON_ERROR_STOP 1
+SET client_min_messages = warning;
+SELECT setseed(0.5) \gset
+
+DROP TABLE IF EXISTS bench_unique_gist, bench_unique_btree;
+
+CREATE TABLE bench_unique_gist (k int, during period,
+  EXCLUDE USING gist (k WITH =, during WITH &&));
+
+CREATE TABLE bench_unique_btree (k int, during period);
+CREATE INDEX bench_unique_btree_k_during ON bench_unique_btree (k, during);
+CREATE CONSTRAINT TRIGGER bench_unique_btree AFTER INSERT OR UPDATE ON bench_unique_btree
+  FOR EACH ROW EXECUTE PROCEDURE temporal_unique('k', 'during');
+
+CREATE TEMP TABLE bench_rows AS
+  SELECT k, period('2000-01-01'::timestamptz + v * interval '1 day',
+                   '2000-01-01'::timestamptz + (v + 1) * interval '1 day') AS during
+    FROM generate_series(1, 1000) k, generate_series(0, 199) v
+   ORDER BY random();
+
+CREATE TEMP TABLE bench_results (constraint_kind text, measure text, rows bigint, value numeric);
+
+DO $$
+DECLARE
+  kind text;
+  tab text;
+  started timestamptz;
+  n bigint;
+  i int;
+  failed int;
+BEGIN
+  FOREACH kind IN ARRAY ARRAY['gist', 'btree'] LOOP
+    tab := quote_ident('bench_unique_' || kind);
+
+    -- inserts, in random order
+    started := clock_timestamp();
+    EXECUTE format('INSERT INTO %s SELECT * FROM bench_rows', tab);
+    GET DIAGNOSTICS n = ROW_COUNT;
+    INSERT INTO bench_results VALUES (kind, 'insert_us', n,
+      round(extract(epoch FROM clock_timestamp() - started)::numeric * 1000000 / n, 2));
+
+    -- conflicting inserts, one at a time
+    failed := 0;
+    started := clock_timestamp();
+    FOR i IN 1 .. 2000 LOOP
+      BEGIN
+        EXECUTE format('INSERT INTO %s VALUES ($1, $2)', tab) USING i % 1000 + 1,
+          period('2000-01-01'::timestamptz + (i % 200) * interval '1 day' + interval '1 hour',
+                 '2000-01-01'::timestamptz + (i % 200) * interval '1 day' + interval '2 hours');
+      EXCEPTION WHEN exclusion_violation THEN
+        failed := failed + 1;
+      END;
+    END LOOP;
+    INSERT INTO bench_results VALUES (kind, 'conflict_us', 2000,
+      round(extract(epoch FROM clock_timestamp() - started)::numeric * 1000000 / 2000, 2));
+    INSERT INTO bench_results VALUES (kind, 'conflicts', 2000, failed);
+  END LOOP;
+END;
+$$;
+
+INSERT INTO bench_results
+  SELECT CASE WHEN i.indrelid = 'bench_unique_gist'::regclass THEN 'gist' ELSE 'btree' END,
+         'index_bytes', c.reltuples::bigint, pg_relation_size(c.oid)
+    FROM pg_class c JOIN pg_index i ON i.indexrelid = c.oid
+   WHERE i.indrelid IN ('bench_unique_gist'::regclass, 'bench_unique_btree'::regclass);
+
+DROP TABLE bench_unique_gist, bench_unique_btree;
+
+COPY (SELECT * FROM bench_results) TO STDOUT WITH CSV HEADER;
@@ -2,52 +2,52 @@
 CREATE TABLE r1_since (
   k          text primary key,
   att1       text,
-  since      t_point,
-  log_since  t_point
+  since      timestamptz,
+  log_since  timestamptz
 );
 CREATE TABLE r1_during (
   k          text,
   att1       text,
-  during     t_interval,
-  log_since  t_point
+  during     period,
+  log_since  timestamptz
 );
 CREATE TABLE r1_since_log (
   k          text,
   att1       text,
-  since      t_point,
-  log_during t_interval
+  since      timestamptz,
+  log_during period
 );
 CREATE TABLE r1_during_log (
   k          text,
   att1       text,
-  during     t_interval,
-  log_during t_interval
+  during     period,
+  log_during period
 );
 
 
 CREATE TABLE r2_since (
   k          text primary key,
   att2       text,
-  since      t_point,
-  log_since  t_point
+  since      timestamptz,
+  log_since  timestamptz
 );
 CREATE TABLE r2_during (
   k          text,
   att2       text,
-  during     t_interval,
-  log_since  t_point
+  during     period,
+  log_since  timestamptz
 );
 CREATE TABLE r2_since_log (
   k          text,
   att2       text,
-  since      t_point,
-  log_during t_interval
+  since      timestamptz,
+  log_during period
 );
 CREATE TABLE r2_during_log (
   k          text,
   att2       text,
-  during     t_interval,
-  log_during t_interval
+  during     period,
+  log_during period
 );
 
 
@@ -61,12 +61,42 @@ CREATE VIEW r_during_log AS SELECT k, att1, att2, during, log_during FROM r1_dur
 
 CREATE VIEW r AS SELECT k, att1, att2 FROM r_since;
 
-CREATE OR REPLACE FUNCTION r1_since_ins_trfn() RETURNS TRIGGER
-  LANGUAGE plpgsql VOLATILE AS $$
-BEGIN
+-- r1_since holds the current rows. Replacing or deleting one logs the
+-- old version in r1_since_log, and closes its valid time into r1_during;
+-- rows of r1_during are logged in turn in r1_during_log.
 
+CREATE TRIGGER r1_since_log_stamp BEFORE UPDATE ON r1_since
+  FOR EACH ROW EXECUTE PROCEDURE temporal_history('r1_since_log', 'log_since', 'log_during');
+CREATE TRIGGER r1_since_log AFTER UPDATE OR DELETE ON r1_since
+  FOR EACH ROW EXECUTE PROCEDURE temporal_history('r1_since_log', 'log_since', 'log_during');
 
-$$;
+CREATE TRIGGER r1_during_stamp BEFORE UPDATE ON r1_since
+  FOR EACH ROW EXECUTE PROCEDURE temporal_history('r1_during', 'since', 'during', 'log_since');
+CREATE TRIGGER r1_during AFTER UPDATE OR DELETE ON r1_since
+  FOR EACH ROW EXECUTE PROCEDURE temporal_history('r1_during', 'since', 'during', 'log_since');
+
+CREATE TRIGGER r1_during_log_stamp BEFORE UPDATE ON r1_during
+  FOR EACH ROW EXECUTE PROCEDURE temporal_history('r1_during_log', 'log_since', 'log_during');
+CREATE TRIGGER r1_during_log AFTER UPDATE OR DELETE ON r1_during
+  FOR EACH ROW EXECUTE PROCEDURE temporal_history('r1_during_log', 'log_since', 'log_during');
+
+-- For large batches, the AFTER triggers can instead be FOR EACH
+-- STATEMENT, one for UPDATE and one for DELETE, each with
+-- REFERENCING OLD TABLE AS old_rows.
+
+-- r_current holds the rows of r, kept by triggers on the tables r reads,
+-- so reading the current state needs no join.
+
+CREATE TABLE r_current (
+  k          text primary key,
+  att1       text,
+  att2       text
+);
+
+CREATE TRIGGER r1_current AFTER INSERT OR UPDATE OR DELETE ON r1_since
+  FOR EACH ROW EXECUTE PROCEDURE temporal_current('r_current', 'r', 'k');
+CREATE TRIGGER r2_current AFTER INSERT OR UPDATE OR DELETE ON r2_since
+  FOR EACH ROW EXECUTE PROCEDURE temporal_current('r_current', 'r', 'k');
 
 
 
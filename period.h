@@ -25,6 +25,20 @@
 
 #include <string.h>
 
+/*
+ * PostgreSQL 10 dropped floating point timestamps, and with them the
+ * symbol that told us which kind we have.
+ */
+#if PG_VERSION_NUM >= 100000 && !defined(HAVE_INT64_TIMESTAMP)
+#define HAVE_INT64_TIMESTAMP
+#endif
+
+/* only used when HAVE_INT64_TIMESTAMP is not defined */
+#define DOUBLE_INF ((double)(1.0/0.0))
+
+/* larger than largest valid period input */
+#define MAX_REPR_SIZE 100
+
 typedef struct period {
 	/*
 	 * if this is an empty interval, we put it in the
@@ -36,6 +50,38 @@ typedef struct period {
 	TimestampTz next;
 } period;
 
+/*
+ * Support functions, shared by everything built on PERIOD. These work
+ * on period values directly rather than through fmgr.
+ */
+extern TimestampTz period_length(period *p);
+
+extern period *period_dup(period *src);
+extern period *period_copy(period *src, period *dst);
+
+extern bool period_equals(period *p1, period *p2);
+extern bool period_is_empty(period *p);
+extern TimestampTz prior_timestamptz(TimestampTz ts);
+extern TimestampTz next_timestamptz(TimestampTz ts);
+extern bool period_adjacent(period *p1, period *p2);
+extern bool period_contains(period *p1, period *p2);
+extern bool period_overlaps(period *p1, period *p2);
+extern bool period_overleft(period *p1, period *p2);
+extern bool period_overright(period *p1, period *p2);
+extern bool period_before(period *p1, period *p2);
+extern bool period_meets(period *p1, period *p2);
+extern bool period_leftoverlaps(period *p1, period *p2);
+extern bool period_starts(period *p1, period *p2);
+extern bool period_during(period *p1, period *p2);
+extern bool period_finishes(period *p1, period *p2);
+
+extern period *period_empty_period(period *result);
+extern period *period_minus(period *p1, period *p2, period *result);
+extern period *period_intersect(period *p1, period *p2, period *result);
+extern period *period_union(period *p1, period *p2, period *result, bool greedy);
+
+extern int period_compare(period *p1, period *p2);
+
 /* return SQL INTERVAL */
 Datum length_period(PG_FUNCTION_ARGS);
 Datum period_offset_period_timestamptz(PG_FUNCTION_ARGS);
@@ -57,11 +103,24 @@ Datum overlaps_period_period(PG_FUNCTION_ARGS);
 Datum overleft_period_period(PG_FUNCTION_ARGS);
 Datum overright_period_period(PG_FUNCTION_ARGS);
 Datum is_empty_period(PG_FUNCTION_ARGS);
+Datum is_open_ended_period(PG_FUNCTION_ARGS);
 Datum equals_period_period(PG_FUNCTION_ARGS);
 Datum nequals_period_period(PG_FUNCTION_ARGS);
 Datum before_period_period(PG_FUNCTION_ARGS);
 Datum after_period_period(PG_FUNCTION_ARGS);
 
+/* Allen's interval relations not covered above */
+Datum meets_period_period(PG_FUNCTION_ARGS);
+Datum met_by_period_period(PG_FUNCTION_ARGS);
+Datum leftoverlaps_period_period(PG_FUNCTION_ARGS);
+Datum rightoverlaps_period_period(PG_FUNCTION_ARGS);
+Datum starts_period_period(PG_FUNCTION_ARGS);
+Datum started_by_period_period(PG_FUNCTION_ARGS);
+Datum during_period_period(PG_FUNCTION_ARGS);
+Datum includes_period_period(PG_FUNCTION_ARGS);
+Datum finishes_period_period(PG_FUNCTION_ARGS);
+Datum finished_by_period_period(PG_FUNCTION_ARGS);
+
 /* Add operators for <, <=, >=, and > -djg */
 Datum lessthan_period_period(PG_FUNCTION_ARGS);
 Datum lessthan_period_timestamptz(PG_FUNCTION_ARGS);
@@ -81,6 +140,9 @@ Datum intersect_period_period(PG_FUNCTION_ARGS);
 Datum union_period_period(PG_FUNCTION_ARGS);
 
 /* input/output functions */
+extern bool period_parse_bounds(char *str, char *str1, char *str2,
+	bool *first_inc, bool *second_inc);
+extern period *period_parse_list(char *input, const char *typname, int *count);
 Datum period_in(PG_FUNCTION_ARGS);
 Datum period_out(PG_FUNCTION_ARGS);
 Datum period_oo_timestamptz_timestamptz(PG_FUNCTION_ARGS);
@@ -100,4 +162,123 @@ Datum gist_period_same(PG_FUNCTION_ARGS);
 
 /* btree support functions */
 Datum btree_period_compare(PG_FUNCTION_ARGS);
+
+/* period archives */
+Datum period_archive_in(PG_FUNCTION_ARGS);
+Datum period_archive_out(PG_FUNCTION_ARGS);
+Datum period_archive_from_array(PG_FUNCTION_ARGS);
+Datum period_archive_to_array(PG_FUNCTION_ARGS);
+Datum period_archive_unnest(PG_FUNCTION_ARGS);
+Datum period_archive_contains(PG_FUNCTION_ARGS);
+Datum period_archive_contains_timestamptz(PG_FUNCTION_ARGS);
+Datum period_archive_overlaps(PG_FUNCTION_ARGS);
+
+/* period sets */
+Datum period_set_in(PG_FUNCTION_ARGS);
+Datum period_set_out(PG_FUNCTION_ARGS);
+Datum period_set_from_array(PG_FUNCTION_ARGS);
+Datum period_set_to_array(PG_FUNCTION_ARGS);
+Datum period_set_add(PG_FUNCTION_ARGS);
+Datum period_set_remove(PG_FUNCTION_ARGS);
+Datum period_set_support(PG_FUNCTION_ARGS);
+Datum period_set_count(PG_FUNCTION_ARGS);
+Datum period_set_contains(PG_FUNCTION_ARGS);
+Datum period_set_contains_timestamptz(PG_FUNCTION_ARGS);
+Datum period_set_overlaps(PG_FUNCTION_ARGS);
+Datum period_set_containing(PG_FUNCTION_ARGS);
+Datum period_set_containing_timestamptz(PG_FUNCTION_ARGS);
+Datum period_set_overlapping(PG_FUNCTION_ARGS);
+
+/* period coverage */
+Datum period_coverage_in(PG_FUNCTION_ARGS);
+Datum period_coverage_out(PG_FUNCTION_ARGS);
+Datum period_coverage_new(PG_FUNCTION_ARGS);
+Datum period_coverage_add(PG_FUNCTION_ARGS);
+Datum period_coverage_agg(PG_FUNCTION_ARGS);
+Datum period_coverage_or(PG_FUNCTION_ARGS);
+Datum period_coverage_or_agg(PG_FUNCTION_ARGS);
+Datum period_coverage_covered(PG_FUNCTION_ARGS);
+Datum period_coverage_unnest(PG_FUNCTION_ARGS);
+Datum period_coverage_overlaps(PG_FUNCTION_ARGS);
+Datum period_coverage_contains(PG_FUNCTION_ARGS);
+Datum period_coverage_contains_timestamptz(PG_FUNCTION_ARGS);
+Datum period_coverage_overlaps_coverage(PG_FUNCTION_ARGS);
+Datum period_coverage_contains_coverage(PG_FUNCTION_ARGS);
+Datum period_covered_agg(PG_FUNCTION_ARGS);
+Datum period_covered_inv(PG_FUNCTION_ARGS);
+Datum period_covered_final(PG_FUNCTION_ARGS);
+
+/* period arrays */
+Datum period_array_overlaps(PG_FUNCTION_ARGS);
+Datum period_array_contains(PG_FUNCTION_ARGS);
+Datum period_array_contains_timestamptz(PG_FUNCTION_ARGS);
+Datum period_array_contained_by(PG_FUNCTION_ARGS);
+Datum period_array_filter(PG_FUNCTION_ARGS);
+Datum period_array_count(PG_FUNCTION_ARGS);
+Datum gist_period_array_consistent(PG_FUNCTION_ARGS);
+Datum gist_period_array_union(PG_FUNCTION_ARGS);
+Datum gist_period_array_compress(PG_FUNCTION_ARGS);
+Datum gist_period_array_decompress(PG_FUNCTION_ARGS);
+Datum gist_period_array_penalty(PG_FUNCTION_ARGS);
+Datum gist_period_array_picksplit(PG_FUNCTION_ARGS);
+Datum gist_period_array_same(PG_FUNCTION_ARGS);
+
+/* history triggers */
+Datum temporal_history(PG_FUNCTION_ARGS);
+Datum temporal_current(PG_FUNCTION_ARGS);
+
+/* temporal constraints */
+Datum temporal_unique(PG_FUNCTION_ARGS);
+Datum temporal_foreign_key(PG_FUNCTION_ARGS);
+
+/* FOR PORTION OF */
+Datum period_apply_portion(PG_FUNCTION_ARGS);
+
+/* reservations */
+Datum period_reserve(PG_FUNCTION_ARGS);
+
+/* history retention */
+extern void temporal_retention_init(void);
+Datum temporal_retention_apply(PG_FUNCTION_ARGS);
+
+/* partition pruning */
+extern void temporal_partition_init(void);
+
+/* AS OF */
+Datum period_as_of(PG_FUNCTION_ARGS);
+Datum period_lookup(PG_FUNCTION_ARGS);
+
+/* temporal alignment */
+Datum period_normalize(PG_FUNCTION_ARGS);
+Datum period_align(PG_FUNCTION_ARGS);
+
+/* GiST index inspection */
+Datum period_gist_stats(PG_FUNCTION_ARGS);
+
+/* instrumentation */
+extern bool temporal_track_stats;
+extern void temporal_stats_init(void);
+extern void temporal_stat_consistent(StrategyNumber strategy, bool leaf, Page page,
+									 OffsetNumber offset, bool result);
+extern void temporal_stat_picksplit(period *left, period *right);
+extern void temporal_stat_period_in(void);
+extern void temporal_stat_period_out(void);
+Datum temporal_stats(PG_FUNCTION_ARGS);
+Datum temporal_stats_reset(PG_FUNCTION_ARGS);
+
+/* tstzrange */
+extern period *period_from_tstzrange(FmgrInfo *flinfo, Datum range, period *result);
+Datum period_tstzrange(PG_FUNCTION_ARGS);
+Datum tstzrange_period(PG_FUNCTION_ARGS);
+Datum overlaps_period_tstzrange(PG_FUNCTION_ARGS);
+Datum overlaps_tstzrange_period(PG_FUNCTION_ARGS);
+Datum contains_period_tstzrange(PG_FUNCTION_ARGS);
+Datum contains_tstzrange_period(PG_FUNCTION_ARGS);
+Datum contained_by_period_tstzrange(PG_FUNCTION_ARGS);
+Datum contained_by_tstzrange_period(PG_FUNCTION_ARGS);
+Datum before_period_tstzrange(PG_FUNCTION_ARGS);
+Datum before_tstzrange_period(PG_FUNCTION_ARGS);
+Datum after_period_tstzrange(PG_FUNCTION_ARGS);
+Datum after_tstzrange_period(PG_FUNCTION_ARGS);
+
 #endif
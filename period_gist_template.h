@@ -0,0 +1,202 @@
+/*
+ * period_gist_template.h
+ *   The GiST penalty and picksplit functions of a period type.
+ *
+ * PERIOD, in src/temporal.c, and the types period_template.h generates
+ * all build their GiST trees the same way, so the code that decides
+ * the shape of the tree is written once here. The includer defines:
+ *
+ *   PT_TYPE                  the C type of the period, with bounds
+ *                            first and next
+ *   PT_GIST_FUNC(name)       the C name of a GiST support function
+ *   pt_from_datum(d, p)      copy a key into *p and return p
+ *   pt_to_datum(p)           make a key from *p
+ *   pt_union(p1, p2, r, g)   as period_union()
+ *   pt_equals(p1, p2)        as period_equals()
+ *
+ * and optionally:
+ *
+ *   PT_GIST_PICKSPLIT_HOOK(l, r)   called with the unions of each split
+ */
+
+#ifndef PT_TYPE
+#error "PT_TYPE must be defined before including period_gist_template.h"
+#endif
+
+#ifndef PT_CONCAT
+#define PT_CONCAT_(a,b) a##b
+#define PT_CONCAT(a,b) PT_CONCAT_(a,b)
+#endif
+
+/*
+ * Only used to rank candidates, so it's OK to approximate. Working in
+ * double avoids overflow when a bound is infinite.
+ */
+static double
+pt_size_approx(PT_TYPE *p)
+{
+	return (double) p->next - (double) p->first;
+}
+
+Datum PT_GIST_FUNC(penalty)(PG_FUNCTION_ARGS);
+PG_FUNCTION_INFO_V1(PT_GIST_FUNC(penalty));
+Datum
+PT_GIST_FUNC(penalty)(PG_FUNCTION_ARGS)
+{
+	GISTENTRY *origentry = (GISTENTRY*) PG_GETARG_POINTER(0);
+	GISTENTRY *newentry = (GISTENTRY*) PG_GETARG_POINTER(1);
+	float *penalty = (float*) PG_GETARG_POINTER(2);
+	PT_TYPE orig, new, union_p;
+
+	pt_from_datum(origentry->key, &orig);
+	pt_from_datum(newentry->key, &new);
+	pt_union(&orig, &new, &union_p, true);
+	*penalty = (float) (pt_size_approx(&union_p) - pt_size_approx(&orig));
+	PG_RETURN_POINTER(penalty);
+}
+
+/*
+ * Is p nearer the left end of the page union than the right? Returns
+ * -1, 0 or 1 for left, tied or right. Working in double keeps infinite
+ * bounds from overflowing.
+ */
+static int
+pt_gist_side(PT_TYPE *p, PT_TYPE *pageunion)
+{
+	double left = (double) p->first - (double) pageunion->first;
+	double right = (double) pageunion->next - (double) p->next;
+	return (left < right) ? -1 : ((left == right) ? 0 : 1);
+}
+
+struct pt_gist_sort
+{
+	PT_TYPE key;
+	OffsetNumber pos;
+};
+
+static int
+pt_gist_sort_compare(const void *a, const void *b)
+{
+	double sa = pt_size_approx(&((struct pt_gist_sort *)a)->key);
+	double sb = pt_size_approx(&((struct pt_gist_sort *)b)->key);
+	return (sa > sb) ? 1 : ((sa == sb) ? 0 : -1);
+}
+
+/*
+ * The algorithm of the ip4r module: send each key to the side of the
+ * page union it is nearest to, and if that puts everything on one
+ * side, resplit in order of ascending size.
+ */
+Datum PT_GIST_FUNC(picksplit)(PG_FUNCTION_ARGS);
+PG_FUNCTION_INFO_V1(PT_GIST_FUNC(picksplit));
+Datum
+PT_GIST_FUNC(picksplit)(PG_FUNCTION_ARGS)
+{
+	GistEntryVector *entryvec = (GistEntryVector *) PG_GETARG_POINTER(0);
+	GIST_SPLITVEC *v = (GIST_SPLITVEC *) PG_GETARG_POINTER(1);
+	OffsetNumber maxoff = entryvec->n - 1;
+	OffsetNumber i;
+	struct pt_gist_sort *arr;
+	PT_TYPE pageunion, unionL, unionR;
+	PT_TYPE *cur;
+	bool allisequal = true;
+	int nbytes;
+
+	arr = (struct pt_gist_sort *) palloc(sizeof(struct pt_gist_sort) * (maxoff + 1));
+	for (i = FirstOffsetNumber; i <= maxoff; i = OffsetNumberNext(i))
+	{
+		pt_from_datum(entryvec->vector[i].key, &arr[i].key);
+		arr[i].pos = i;
+	}
+
+	/* find MBR */
+	pageunion = arr[FirstOffsetNumber].key;
+	for (i = OffsetNumberNext(FirstOffsetNumber); i <= maxoff; i = OffsetNumberNext(i))
+	{
+		cur = &arr[i].key;
+		if (allisequal && !pt_equals(cur, &pageunion))
+			allisequal = false;
+		if (cur->first < pageunion.first)
+			pageunion.first = cur->first;
+		if (cur->next > pageunion.next)
+			pageunion.next = cur->next;
+	}
+
+	nbytes = (maxoff + 2) * sizeof(OffsetNumber);
+	v->spl_left = (OffsetNumber *) palloc(nbytes);
+	v->spl_right = (OffsetNumber *) palloc(nbytes);
+	v->spl_nleft = v->spl_nright = 0;
+
+#define PT_ADDLIST(side_, u_, num_) do { \
+	if (v->PT_CONCAT(spl_n, side_)) { \
+		if ((u_).next < cur->next) (u_).next = cur->next; \
+		if ((u_).first > cur->first) (u_).first = cur->first; \
+	} else { \
+		(u_) = *cur; \
+	} \
+	v->PT_CONCAT(spl_, side_)[v->PT_CONCAT(spl_n, side_)++] = (num_); \
+} while(0)
+
+	if (allisequal)
+	{
+		OffsetNumber split_at = FirstOffsetNumber + (maxoff - FirstOffsetNumber + 1)/2;
+
+		for (i = FirstOffsetNumber; i < split_at; i = OffsetNumberNext(i))
+			v->spl_left[v->spl_nleft++] = i;
+		for (; i <= maxoff; i = OffsetNumberNext(i))
+			v->spl_right[v->spl_nright++] = i;
+		unionL = unionR = pageunion;
+	}
+	else
+	{
+		for (i = FirstOffsetNumber; i <= maxoff; i = OffsetNumberNext(i))
+		{
+			cur = &arr[i].key;
+			if (pt_gist_side(cur, &pageunion) < 0)
+				PT_ADDLIST(left, unionL, i);
+			else
+				PT_ADDLIST(right, unionR, i);
+		}
+
+		/* bad disposition, sort by ascending size and resplit */
+		if (v->spl_nleft == 0 || v->spl_nright == 0)
+		{
+			qsort(arr + FirstOffsetNumber,
+				  maxoff - FirstOffsetNumber + 1,
+				  sizeof(struct pt_gist_sort),
+				  pt_gist_sort_compare);
+
+			v->spl_nleft = v->spl_nright = 0;
+			for (i = FirstOffsetNumber; i <= maxoff; i = OffsetNumberNext(i))
+			{
+				int side;
+
+				cur = &arr[i].key;
+				side = pt_gist_side(cur, &pageunion);
+				if (side < 0)
+					PT_ADDLIST(left, unionL, arr[i].pos);
+				else if (side == 0)
+				{
+					if (v->spl_nleft > v->spl_nright)
+						PT_ADDLIST(right, unionR, arr[i].pos);
+					else
+						PT_ADDLIST(left, unionL, arr[i].pos);
+				}
+				else
+					PT_ADDLIST(right, unionR, arr[i].pos);
+			}
+		}
+	}
+
+#undef PT_ADDLIST
+
+	v->spl_ldatum = pt_to_datum(&unionL);
+	v->spl_rdatum = pt_to_datum(&unionR);
+	pfree(arr);
+
+#ifdef PT_GIST_PICKSPLIT_HOOK
+	PT_GIST_PICKSPLIT_HOOK(&unionL, &unionR);
+#endif
+
+	PG_RETURN_POINTER(v);
+}
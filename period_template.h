@@ -0,0 +1,757 @@
+/*
+ * period_template.h
+ *   Generates a period data type over a discrete bound type.
+ *
+ * PERIOD itself is implemented in src/temporal.c and is fixed to
+ * TIMESTAMPTZ. This file holds the same operations -- comparisons, set
+ * operations, Allen's relations, and GiST and btree support -- written
+ * once against a generic bound, so that other bound types don't need a
+ * copy of their own. Each instantiation lives in its own source file,
+ * which defines the following and then includes this file:
+ *
+ *   PT_NAME                  name of the type, e.g. dperiod
+ *   PT_BOUND                 C type of the bounds
+ *   PT_GETARG_BOUND(n)       fetch a bound argument
+ *   PT_BOUND_GET_DATUM(x)    convert a bound to a Datum
+ *   PT_BOUND_IN(str)         parse a bound from a C string
+ *   PT_BOUND_OUT(x)          format a bound as a C string
+ *   PT_BOUND_NOT_FINITE(x)   is the bound -infinity or infinity?
+ *   PT_BOUND_MAX             largest finite bound
+ *   PT_BOUND_MIN             smallest finite bound
+ *
+ * and optionally:
+ *
+ *   PT_BOUND_SUCC(x)         the next bound after x; default x + 1
+ *   PT_BOUND_PRED(x)         the bound just before x; default x - 1
+ *   PT_BYVAL                 the bounds are 32 bits wide, and the period
+ *                            is passed by value packed into a Datum
+ *
+ * As with PERIOD, the empty period has the canonical form [0,0).
+ *
+ * The C functions are named after the type, e.g. dperiod_overlaps();
+ * see temporal.sql.in for the SQL-level names.
+ */
+
+#ifndef PT_NAME
+#error "PT_NAME must be defined before including period_template.h"
+#endif
+
+#ifndef PT_BOUND_SUCC
+#define PT_BOUND_SUCC(x) ((x) + 1)
+#endif
+#ifndef PT_BOUND_PRED
+#define PT_BOUND_PRED(x) ((x) - 1)
+#endif
+
+#define PT_CONCAT_(a,b) a##b
+#define PT_CONCAT(a,b) PT_CONCAT_(a,b)
+#define PT_FUNC(name) PT_CONCAT(PT_NAME, PT_CONCAT(_, name))
+#define PT_GIST_FUNC(name) PT_CONCAT(gist_, PT_FUNC(name))
+
+#define PT_TYPE PT_NAME
+
+typedef struct PT_TYPE {
+	/* the first value included in the period */
+	PT_BOUND first;
+	/* the next value after the last value included in the period */
+	PT_BOUND next;
+} PT_TYPE;
+
+/*
+ * Arguments are always copied into a local PT_TYPE, so that the support
+ * functions below don't need to know how the type is passed.
+ */
+static PT_TYPE *
+pt_from_datum(Datum d, PT_TYPE *p)
+{
+#ifdef PT_BYVAL
+	uint64 v = (uint64) d;
+	p->first = (PT_BOUND) (int32) (v >> 32);
+	p->next = (PT_BOUND) (int32) (v & 0xFFFFFFFF);
+#else
+	*p = *(PT_TYPE*) DatumGetPointer(d);
+#endif
+	return p;
+}
+
+static Datum
+pt_to_datum(PT_TYPE *p)
+{
+#ifdef PT_BYVAL
+	return (Datum) (((uint64) (uint32) p->first << 32) | (uint32) p->next);
+#else
+	PT_TYPE *result = (PT_TYPE*) palloc(sizeof(PT_TYPE));
+	*result = *p;
+	return PointerGetDatum(result);
+#endif
+}
+
+#define PT_GETARG(n, p) pt_from_datum(PG_GETARG_DATUM(n), (p))
+#define PT_RETURN(p) return pt_to_datum(p)
+
+/************************************************
+ * Support functions
+ ************************************************/
+
+static PT_BOUND
+pt_succ(PT_BOUND x)
+{
+	/* Any modification of infinity or -infinity returns the original value */
+	if(PT_BOUND_NOT_FINITE(x))
+		return x;
+	if(x >= PT_BOUND_MAX)
+		elog(ERROR,"Overflow!");
+	return PT_BOUND_SUCC(x);
+}
+
+static PT_BOUND
+pt_pred(PT_BOUND x)
+{
+	if(PT_BOUND_NOT_FINITE(x))
+		return x;
+	if(x <= PT_BOUND_MIN)
+		elog(ERROR,"Overflow!");
+	return PT_BOUND_PRED(x);
+}
+
+static PT_TYPE *
+pt_set_empty(PT_TYPE *p)
+{
+	p->first = (PT_BOUND) 0;
+	p->next = (PT_BOUND) 0;
+	return p;
+}
+
+static bool
+pt_is_empty(PT_TYPE *p)
+{
+	return (p->first == 0) && (p->next == 0);
+}
+
+/*
+ * Return -1, 0 or 1 if the first argument is less than, equal to, or
+ * greater than the second. Empty periods are less than anything else.
+ */
+static int
+pt_compare(PT_TYPE *p1, PT_TYPE *p2)
+{
+	if(pt_is_empty(p1))
+		return pt_is_empty(p2) ? 0 : -1;
+	if(pt_is_empty(p2))
+		return 1;
+
+	if(p1->first == p2->first) {
+		if(p1->next == p2->next)
+			return 0;
+		return p1->next < p2->next ? -1 : 1;
+	}
+	return p1->first < p2->first ? -1 : 1;
+}
+
+static bool
+pt_equals(PT_TYPE *p1, PT_TYPE *p2)
+{
+	return pt_compare(p1, p2) == 0;
+}
+
+/* Does p1 contain p2? */
+static bool
+pt_contains(PT_TYPE *p1, PT_TYPE *p2)
+{
+	if(pt_is_empty(p2))
+		return true;
+	return (p1->first <= p2->first && p2->next <= p1->next);
+}
+
+static bool
+pt_overlaps(PT_TYPE *p1, PT_TYPE *p2)
+{
+	if(pt_is_empty(p1) || pt_is_empty(p2))
+		return false;
+	return (p1->first < p2->next) && (p2->first < p1->next);
+}
+
+static bool
+pt_adjacent(PT_TYPE *p1, PT_TYPE *p2)
+{
+	if(pt_is_empty(p1) || pt_is_empty(p2))
+		elog(ERROR,"Interval is empty");
+	return (p2->first == p1->next || p1->first == p2->next);
+}
+
+static bool
+pt_overleft(PT_TYPE *p1, PT_TYPE *p2)
+{
+	if(pt_is_empty(p1) || pt_is_empty(p2))
+		elog(ERROR,"Interval is empty");
+	return (p1->next <= p2->next);
+}
+
+static bool
+pt_overright(PT_TYPE *p1, PT_TYPE *p2)
+{
+	if(pt_is_empty(p1) || pt_is_empty(p2))
+		elog(ERROR,"Interval is empty");
+	return (p1->first >= p2->first);
+}
+
+static bool
+pt_before(PT_TYPE *p1, PT_TYPE *p2)
+{
+	if(pt_is_empty(p1) || pt_is_empty(p2))
+		elog(ERROR,"Interval is empty");
+	return (p1->next <= p2->first);
+}
+
+/*
+ * Allen's relations, as for PERIOD. Each is false if either period is
+ * empty; the inverse relations are obtained by swapping the arguments.
+ */
+static bool
+pt_meets(PT_TYPE *p1, PT_TYPE *p2)
+{
+	if(pt_is_empty(p1) || pt_is_empty(p2))
+		return false;
+	return (p1->next == p2->first);
+}
+
+static bool
+pt_leftoverlaps(PT_TYPE *p1, PT_TYPE *p2)
+{
+	if(pt_is_empty(p1) || pt_is_empty(p2))
+		return false;
+	return (p1->first < p2->first && p2->first < p1->next &&
+			p1->next < p2->next);
+}
+
+static bool
+pt_starts(PT_TYPE *p1, PT_TYPE *p2)
+{
+	if(pt_is_empty(p1) || pt_is_empty(p2))
+		return false;
+	return (p1->first == p2->first && p1->next < p2->next);
+}
+
+static bool
+pt_during(PT_TYPE *p1, PT_TYPE *p2)
+{
+	if(pt_is_empty(p1) || pt_is_empty(p2))
+		return false;
+	return (p2->first < p1->first && p1->next < p2->next);
+}
+
+static bool
+pt_finishes(PT_TYPE *p1, PT_TYPE *p2)
+{
+	if(pt_is_empty(p1) || pt_is_empty(p2))
+		return false;
+	return (p1->next == p2->next && p2->first < p1->first);
+}
+
+static PT_TYPE *
+pt_intersect(PT_TYPE *p1, PT_TYPE *p2, PT_TYPE *result)
+{
+	result->first = (p1->first > p2->first) ? p1->first : p2->first;
+	result->next  = (p1->next  < p2->next ) ? p1->next  : p2->next;
+	if(result->first >= result->next)
+		return pt_set_empty(result);
+	return result;
+}
+
+/*
+ * Union p1 and p2. If the periods do not overlap and are not adjacent,
+ * raise an error unless 'greedy' is true, in which case the result
+ * also covers the gap between them.
+ */
+static PT_TYPE *
+pt_union(PT_TYPE *p1, PT_TYPE *p2, PT_TYPE *result, bool greedy)
+{
+	if(pt_is_empty(p1)) {
+		*result = *p2;
+		return result;
+	}
+	if(pt_is_empty(p2)) {
+		*result = *p1;
+		return result;
+	}
+	if(!greedy && !pt_overlaps(p1,p2) && !pt_adjacent(p1,p2))
+		elog(ERROR,"Can only union overlapping, empty, or adjacent intervals");
+
+	result->first = (p1->first < p2->first) ? p1->first : p2->first;
+	result->next  = (p1->next  > p2->next ) ? p1->next  : p2->next;
+	return result;
+}
+
+static PT_TYPE *
+pt_minus(PT_TYPE *p1, PT_TYPE *p2, PT_TYPE *result)
+{
+	PT_TYPE intersection;
+
+	if(pt_is_empty(p1))
+		return pt_set_empty(result);
+
+	pt_intersect(p1, p2, &intersection);
+
+	if(pt_is_empty(p2) || pt_is_empty(&intersection)) {
+		*result = *p1;
+		return result;
+	}
+	else if(intersection.first == p1->first) {
+		// RHS is before
+		result->first = intersection.next;
+		result->next = p1->next;
+	}
+	else if(intersection.next == p1->next) {
+		// RHS is after
+		result->first = p1->first;
+		result->next = intersection.first;
+	}
+	else
+		elog(ERROR,"Can't subtract periods: RHS is contained inside LHS");
+
+	if(result->first >= result->next)
+		return pt_set_empty(result);
+	return result;
+}
+
+/*
+ * Build [first, next), failing if the bounds are out of order and
+ * canonicalizing a zero-length result to the empty period.
+ */
+static PT_TYPE *
+pt_make(PT_BOUND first, PT_BOUND next, PT_TYPE *result)
+{
+	if(first > next)
+		elog(ERROR,"invalid period: first > last");
+	if(first == next)
+		return pt_set_empty(result);
+	result->first = first;
+	result->next = next;
+	return result;
+}
+
+/************************************************
+ * Input/output and constructors
+ ************************************************/
+
+Datum PT_FUNC(in)(PG_FUNCTION_ARGS);
+PG_FUNCTION_INFO_V1(PT_FUNC(in));
+Datum
+PT_FUNC(in)(PG_FUNCTION_ARGS)
+{
+	char *str = PG_GETARG_CSTRING(0);
+	char str1[MAX_REPR_SIZE];
+	char str2[MAX_REPR_SIZE];
+	bool first_inc, second_inc;
+	PT_BOUND b1, b2;
+	PT_TYPE result;
+
+	if(period_parse_bounds(str, str1, str2, &first_inc, &second_inc))
+		PT_RETURN(pt_set_empty(&result));
+
+	b1 = PT_BOUND_IN(str1);
+	b2 = PT_BOUND_IN(str2);
+
+	/* interpret inclusive/exclusive notation */
+	result.first = first_inc ? b1 : pt_succ(b1);
+	result.next = second_inc ? pt_succ(b2) : b2;
+
+	if(result.first >= result.next)
+		elog(ERROR,"invalid period: first > last");
+
+	PT_RETURN(&result);
+}
+
+Datum PT_FUNC(out)(PG_FUNCTION_ARGS);
+PG_FUNCTION_INFO_V1(PT_FUNC(out));
+Datum
+PT_FUNC(out)(PG_FUNCTION_ARGS)
+{
+	PT_TYPE p;
+	char *result;
+
+	PT_GETARG(0, &p);
+	result = (char*) palloc(MAX_REPR_SIZE);
+	if(pt_is_empty(&p))
+		snprintf(result,MAX_REPR_SIZE,"-EMPTY-");
+	else
+		snprintf(result,MAX_REPR_SIZE,"[%s, %s)",
+				 PT_BOUND_OUT(p.first), PT_BOUND_OUT(p.next));
+	PG_RETURN_CSTRING(result);
+}
+
+/* [b1, b2) */
+Datum PT_FUNC(make)(PG_FUNCTION_ARGS);
+PG_FUNCTION_INFO_V1(PT_FUNC(make));
+Datum
+PT_FUNC(make)(PG_FUNCTION_ARGS)
+{
+	PT_TYPE result;
+	PT_RETURN(pt_make(PT_GETARG_BOUND(0), PT_GETARG_BOUND(1), &result));
+}
+
+/* [b, b] */
+Datum PT_FUNC(from_bound)(PG_FUNCTION_ARGS);
+PG_FUNCTION_INFO_V1(PT_FUNC(from_bound));
+Datum
+PT_FUNC(from_bound)(PG_FUNCTION_ARGS)
+{
+	PT_BOUND b = PT_GETARG_BOUND(0);
+	PT_TYPE result;
+	PT_RETURN(pt_make(b, pt_succ(b), &result));
+}
+
+Datum PT_FUNC(empty)(PG_FUNCTION_ARGS);
+PG_FUNCTION_INFO_V1(PT_FUNC(empty));
+Datum
+PT_FUNC(empty)(PG_FUNCTION_ARGS)
+{
+	PT_TYPE result;
+	PT_RETURN(pt_set_empty(&result));
+}
+
+/************************************************
+ * Bound accessors
+ ************************************************/
+
+#define PT_ACCESSOR(name, expr) \
+Datum PT_FUNC(name)(PG_FUNCTION_ARGS); \
+PG_FUNCTION_INFO_V1(PT_FUNC(name)); \
+Datum \
+PT_FUNC(name)(PG_FUNCTION_ARGS) \
+{ \
+	PT_TYPE p; \
+	PT_GETARG(0, &p); \
+	if(pt_is_empty(&p)) \
+		elog(ERROR,"Interval is empty"); \
+	PG_RETURN_DATUM(PT_BOUND_GET_DATUM(expr)); \
+}
+
+PT_ACCESSOR(first, p.first)
+PT_ACCESSOR(last, pt_pred(p.next))
+PT_ACCESSOR(prior, pt_pred(p.first))
+PT_ACCESSOR(next, p.next)
+
+/************************************************
+ * BOOLEAN functions
+ ************************************************/
+
+/* a function of two periods, p1 and p2, returning expr */
+#define PT_PREDICATE(name, expr) \
+Datum PT_FUNC(name)(PG_FUNCTION_ARGS); \
+PG_FUNCTION_INFO_V1(PT_FUNC(name)); \
+Datum \
+PT_FUNC(name)(PG_FUNCTION_ARGS) \
+{ \
+	PT_TYPE a, b; \
+	PT_TYPE *p1 = PT_GETARG(0, &a); \
+	PT_TYPE *p2 = PT_GETARG(1, &b); \
+	PG_RETURN_BOOL(expr); \
+}
+
+PT_PREDICATE(equals, pt_equals(p1,p2))
+PT_PREDICATE(nequals, !pt_equals(p1,p2))
+PT_PREDICATE(lessthan, pt_compare(p1,p2) < 0)
+PT_PREDICATE(lessthanequals, pt_compare(p1,p2) <= 0)
+PT_PREDICATE(greaterthan, pt_compare(p1,p2) > 0)
+PT_PREDICATE(greaterthanequals, pt_compare(p1,p2) >= 0)
+PT_PREDICATE(contains, pt_contains(p1,p2))
+PT_PREDICATE(contained_by, pt_contains(p2,p1))
+PT_PREDICATE(overlaps, pt_overlaps(p1,p2))
+PT_PREDICATE(overleft, pt_overleft(p1,p2))
+PT_PREDICATE(overright, pt_overright(p1,p2))
+PT_PREDICATE(before, pt_before(p1,p2))
+PT_PREDICATE(after, pt_before(p2,p1))
+PT_PREDICATE(adjacent, pt_adjacent(p1,p2))
+PT_PREDICATE(meets, pt_meets(p1,p2))
+PT_PREDICATE(met_by, pt_meets(p2,p1))
+PT_PREDICATE(leftoverlaps, pt_leftoverlaps(p1,p2))
+PT_PREDICATE(rightoverlaps, pt_leftoverlaps(p2,p1))
+PT_PREDICATE(starts, pt_starts(p1,p2))
+PT_PREDICATE(started_by, pt_starts(p2,p1))
+PT_PREDICATE(during, pt_during(p1,p2))
+PT_PREDICATE(includes, pt_during(p2,p1))
+PT_PREDICATE(finishes, pt_finishes(p1,p2))
+PT_PREDICATE(finished_by, pt_finishes(p2,p1))
+
+Datum PT_FUNC(is_empty)(PG_FUNCTION_ARGS);
+PG_FUNCTION_INFO_V1(PT_FUNC(is_empty));
+Datum
+PT_FUNC(is_empty)(PG_FUNCTION_ARGS)
+{
+	PT_TYPE p;
+	PG_RETURN_BOOL(pt_is_empty(PT_GETARG(0, &p)));
+}
+
+/* contains(period, bound) */
+Datum PT_FUNC(contains_bound)(PG_FUNCTION_ARGS);
+PG_FUNCTION_INFO_V1(PT_FUNC(contains_bound));
+Datum
+PT_FUNC(contains_bound)(PG_FUNCTION_ARGS)
+{
+	PT_TYPE p;
+	PT_BOUND b = PT_GETARG_BOUND(1);
+
+	PT_GETARG(0, &p);
+	if(pt_is_empty(&p))
+		PG_RETURN_BOOL(false);
+	PG_RETURN_BOOL(p.first <= b && b < p.next);
+}
+
+/* contained_by(bound, period) */
+Datum PT_FUNC(bound_contained_by)(PG_FUNCTION_ARGS);
+PG_FUNCTION_INFO_V1(PT_FUNC(bound_contained_by));
+Datum
+PT_FUNC(bound_contained_by)(PG_FUNCTION_ARGS)
+{
+	PT_BOUND b = PT_GETARG_BOUND(0);
+	PT_TYPE p;
+
+	PT_GETARG(1, &p);
+	if(pt_is_empty(&p))
+		PG_RETURN_BOOL(false);
+	PG_RETURN_BOOL(p.first <= b && b < p.next);
+}
+
+/************************************************
+ * Set operations
+ ************************************************/
+
+Datum PT_FUNC(intersect)(PG_FUNCTION_ARGS);
+PG_FUNCTION_INFO_V1(PT_FUNC(intersect));
+Datum
+PT_FUNC(intersect)(PG_FUNCTION_ARGS)
+{
+	PT_TYPE p1, p2, result;
+	PT_GETARG(0, &p1);
+	PT_GETARG(1, &p2);
+	PT_RETURN(pt_intersect(&p1, &p2, &result));
+}
+
+Datum PT_FUNC(union)(PG_FUNCTION_ARGS);
+PG_FUNCTION_INFO_V1(PT_FUNC(union));
+Datum
+PT_FUNC(union)(PG_FUNCTION_ARGS)
+{
+	PT_TYPE p1, p2, result;
+	PT_GETARG(0, &p1);
+	PT_GETARG(1, &p2);
+	PT_RETURN(pt_union(&p1, &p2, &result, false));
+}
+
+Datum PT_FUNC(minus)(PG_FUNCTION_ARGS);
+PG_FUNCTION_INFO_V1(PT_FUNC(minus));
+Datum
+PT_FUNC(minus)(PG_FUNCTION_ARGS)
+{
+	PT_TYPE p1, p2, result;
+	PT_GETARG(0, &p1);
+	PT_GETARG(1, &p2);
+	PT_RETURN(pt_minus(&p1, &p2, &result));
+}
+
+/************************************************
+ * btree Support Functions
+ ************************************************/
+
+Datum PT_CONCAT(btree_, PT_FUNC(compare))(PG_FUNCTION_ARGS);
+PG_FUNCTION_INFO_V1(PT_CONCAT(btree_, PT_FUNC(compare)));
+Datum
+PT_CONCAT(btree_, PT_FUNC(compare))(PG_FUNCTION_ARGS)
+{
+	PT_TYPE p1, p2;
+	PT_GETARG(0, &p1);
+	PT_GETARG(1, &p2);
+	PG_RETURN_INT32(pt_compare(&p1, &p2));
+}
+
+/************************************************
+ * GiST Support Functions
+ *
+ * The strategy numbers are the same as for gist_period_ops.
+ ************************************************/
+
+static bool
+pt_gist_int_consistent(PT_TYPE *key, PT_TYPE *query, StrategyNumber strategy)
+{
+	switch(strategy) {
+	case 1:  //strictly before
+		return ! pt_overright(key,query);
+	case 2:  //overleft
+		return ! pt_before(query,key);
+	case 3:  //overlaps
+		return pt_overlaps(key,query);
+	case 4:  //overright
+		return ! pt_before(key,query);
+	case 5:  //strictly after
+		return ! pt_overleft(key,query);
+	case 6:  //same
+	case 7:  //contains
+	case 27: //contains(period,bound)
+		return pt_contains(key,query);
+	case 8:  //contained by
+	case 28: //contained by(bound,period)
+		return pt_overlaps(key,query);
+	}
+
+	/* Allen's relations never hold for an empty period */
+	if(pt_is_empty(key) || pt_is_empty(query))
+		return false;
+
+	switch(strategy) {
+	case 30: //meets
+		return key->first < query->first && query->first <= key->next;
+	case 31: //met by
+		return key->first <= query->next && query->next < key->next;
+	case 32: //adjacent
+		return (key->first < query->first && query->first <= key->next) ||
+			(key->first <= query->next && query->next < key->next);
+	case 33: //overlaps, from the left
+		return key->first < query->first && query->first < key->next;
+	case 34: //overlaps, from the right
+		return key->first < query->next && query->next < key->next;
+	case 35: //starts
+		return key->first <= query->first && query->first < key->next;
+	case 36: //started by
+		return key->first <= query->first && query->next < key->next;
+	case 37: //during
+		return pt_overlaps(key,query);
+	case 38: //includes
+		return key->first < query->first && query->next < key->next;
+	case 39: //finishes
+		return key->first < query->next && query->next <= key->next;
+	case 40: //finished by
+		return key->first < query->first && query->next <= key->next;
+	default:
+		elog(ERROR,"unrecognized strategy number: %d",strategy);
+		return false;
+	}
+}
+
+static bool
+pt_gist_leaf_consistent(PT_TYPE *key, PT_TYPE *query, StrategyNumber strategy)
+{
+	switch(strategy) {
+	case 1:  //strictly before
+		return pt_before(key,query);
+	case 2:  //overleft
+		return pt_overleft(key,query);
+	case 3:  //overlaps
+		return pt_overlaps(key,query);
+	case 4:  //overright
+		return pt_overright(key,query);
+	case 5:  //strictly after
+		return pt_before(query,key);
+	case 6:  //same
+		return pt_equals(key,query);
+	case 7:  //contains
+	case 27: //contains(period,bound)
+		return pt_contains(key,query);
+	case 8:  //contained by
+	case 28: //contained by(bound,period)
+		return pt_contains(query,key);
+	case 30: //meets
+		return pt_meets(key,query);
+	case 31: //met by
+		return pt_meets(query,key);
+	case 32: //adjacent
+		return pt_meets(key,query) || pt_meets(query,key);
+	case 33: //overlaps, from the left
+		return pt_leftoverlaps(key,query);
+	case 34: //overlaps, from the right
+		return pt_leftoverlaps(query,key);
+	case 35: //starts
+		return pt_starts(key,query);
+	case 36: //started by
+		return pt_starts(query,key);
+	case 37: //during
+		return pt_during(key,query);
+	case 38: //includes
+		return pt_during(query,key);
+	case 39: //finishes
+		return pt_finishes(key,query);
+	case 40: //finished by
+		return pt_finishes(query,key);
+	default:
+		elog(ERROR,"unrecognized strategy number: %d",strategy);
+		return false;
+	}
+}
+
+Datum PT_GIST_FUNC(consistent)(PG_FUNCTION_ARGS);
+PG_FUNCTION_INFO_V1(PT_GIST_FUNC(consistent));
+Datum
+PT_GIST_FUNC(consistent)(PG_FUNCTION_ARGS)
+{
+	GISTENTRY *entry = (GISTENTRY*) PG_GETARG_POINTER(0);
+	StrategyNumber strategy = (StrategyNumber) PG_GETARG_UINT16(2);
+	PT_TYPE key, query;
+
+	pt_from_datum(entry->key, &key);
+
+	if(strategy == 27 || strategy == 28) {
+		// convert the bound to a period for the query
+		PT_BOUND b = PT_GETARG_BOUND(1);
+		query.first = b;
+		query.next = pt_succ(b);
+	}
+	else
+		PT_GETARG(1, &query);
+
+	if(GIST_LEAF(entry))
+		PG_RETURN_BOOL(pt_gist_leaf_consistent(&key, &query, strategy));
+	else
+		PG_RETURN_BOOL(pt_gist_int_consistent(&key, &query, strategy));
+}
+
+Datum PT_GIST_FUNC(union)(PG_FUNCTION_ARGS);
+PG_FUNCTION_INFO_V1(PT_GIST_FUNC(union));
+Datum
+PT_GIST_FUNC(union)(PG_FUNCTION_ARGS)
+{
+	GistEntryVector *entries = (GistEntryVector*) PG_GETARG_POINTER(0);
+	int *size = (int*) PG_GETARG_POINTER(1);
+	PT_TYPE result, cur;
+	int i;
+
+	pt_set_empty(&result);
+	for(i = 0; i < entries->n; i++) {
+		pt_from_datum(entries->vector[i].key, &cur);
+		pt_union(&result, &cur, &result, true);
+	}
+	*size = sizeof(PT_TYPE);
+	PT_RETURN(&result);
+}
+
+Datum PT_GIST_FUNC(compress)(PG_FUNCTION_ARGS);
+PG_FUNCTION_INFO_V1(PT_GIST_FUNC(compress));
+Datum
+PT_GIST_FUNC(compress)(PG_FUNCTION_ARGS)
+{
+	PG_RETURN_POINTER(PG_GETARG_POINTER(0));
+}
+
+Datum PT_GIST_FUNC(decompress)(PG_FUNCTION_ARGS);
+PG_FUNCTION_INFO_V1(PT_GIST_FUNC(decompress));
+Datum
+PT_GIST_FUNC(decompress)(PG_FUNCTION_ARGS)
+{
+	PG_RETURN_POINTER(PG_GETARG_POINTER(0));
+}
+
+/* penalty and picksplit, shared with PERIOD */
+#include "period_gist_template.h"
+
+Datum PT_GIST_FUNC(same)(PG_FUNCTION_ARGS);
+PG_FUNCTION_INFO_V1(PT_GIST_FUNC(same));
+Datum
+PT_GIST_FUNC(same)(PG_FUNCTION_ARGS)
+{
+	PT_TYPE p1, p2;
+	bool *result = (bool*) PG_GETARG_POINTER(2);
+
+	PT_GETARG(0, &p1);
+	PT_GETARG(1, &p2);
+	*result = pt_equals(&p1, &p2);
+	PG_RETURN_POINTER(result);
+}
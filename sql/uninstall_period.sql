@@ -1,3 +1,22 @@
 
 DROP TYPE PERIOD CASCADE;
+DROP TYPE DPERIOD CASCADE;
+DROP TYPE TSPERIOD CASCADE;
+DROP TYPE IPERIOD CASCADE;
+DROP TYPE PERIOD_ARCHIVE CASCADE;
+DROP TYPE PERIOD_SET CASCADE;
+DROP TYPE PERIOD_COVERAGE CASCADE;
 
+DROP FUNCTION temporal_current();
+DROP VIEW temporal_retention_progress;
+DROP TABLE temporal_retention;
+DROP FUNCTION temporal_retention_apply(regclass);
+DROP FUNCTION period_partitions(regclass, timestamptz, timestamptz, interval);
+DROP FUNCTION period_as_of(anyelement, text, timestamptz);
+DROP FUNCTION period_lookup(anyelement, text, timestamptz[]);
+DROP FUNCTION period_normalize(anyelement, regclass, text, text);
+DROP FUNCTION period_align(anyelement, regclass, text, text);
+DROP FUNCTION period_gist_stats(regclass);
+DROP VIEW pg_stat_temporal;
+DROP FUNCTION temporal_stats();
+DROP FUNCTION temporal_stats_reset();
@@ -0,0 +1,593 @@
+/*
+ * align.c
+ *   Implements period_align and period_normalize, which split the rows
+ *   of one table at the periods of the matching rows of another.
+ *
+ * A sequenced operation, one that applies at every instant, pairs each
+ * row with the rows of the other table that share its key and overlap
+ * it, and needs each of its periods cut where the others begin and
+ * end. Cut that way, pieces that meet at an instant have equal periods,
+ * so sequenced joins, differences and aggregations become ordinary
+ * ones on (key, period). Rather than joining each row to its matches,
+ * both tables are read once ordered by (key, period), and merged with
+ * an active list of the other table's periods for the current key, as
+ * period_lookup does for timestamps.
+ *
+ * period_normalize cuts each row at every bound of its matches that
+ * falls inside it. period_align gives each row once per distinct
+ * intersection with its matches, and once per stretch covered by none
+ * of them; the aligned pieces of the two tables then pair up exactly
+ * when they meet.
+ */
+
+#include "period.h"
+#include "access/htup_details.h"
+#include "catalog/pg_type.h"
+#include "executor/executor.h"
+#include "executor/spi.h"
+#include "funcapi.h"
+#include "utils/datum.h"
+#include "utils/lsyscache.h"
+#include "utils/memutils.h"
+#include "utils/syscache.h"
+#include "utils/typcache.h"
+
+/* the rows fetched from each cursor at a time */
+#define ALIGN_FETCH 1000
+
+typedef struct
+{
+	Datum row;			/* only read from the table being split */
+	Datum key;
+	bool keynull;
+	bool pernull;
+	period per;
+} AlignRow;
+
+typedef struct
+{
+	char *portal_name;		/* or NULL once exhausted */
+	MemoryContext batch_context;
+	AlignRow *rows;
+	int nrows;
+	int next_row;
+} AlignCursor;
+
+typedef struct
+{
+	const char *fname;
+	bool normalize;			/* period_normalize, else period_align */
+
+	AlignCursor r;			/* the table being split */
+	AlignCursor s;			/* the table it is split by */
+
+	bool keyed;
+	FmgrInfo *key_cmp;
+	Oid key_collation;
+	int16 key_len;
+	bool key_byval;
+	bool have_group;
+	Datum group_key;		/* the key of the active periods */
+
+	period *active;			/* periods of s for the group key */
+	int nactive;
+	int maxactive;
+
+	AlignRow *current;		/* the row being split */
+	period *pieces;
+	int npieces;
+	int maxpieces;
+	int next_piece;
+
+	TupleDesc tupdesc;
+	AttrNumber attnum;		/* of the period column */
+	Datum *values;
+	bool *nulls;
+} AlignState;
+
+static void
+align_close(AlignCursor *cursor)
+{
+	Portal portal;
+
+	if(cursor->portal_name == NULL)
+		return;
+	portal = SPI_cursor_find(cursor->portal_name);
+	if(portal != NULL)
+		SPI_cursor_close(portal);
+	cursor->portal_name = NULL;
+}
+
+/* close the cursors if we are shut down before reading all of them */
+static void
+align_shutdown(Datum arg)
+{
+	AlignState *state = (AlignState *) DatumGetPointer(arg);
+
+	align_close(&state->r);
+	align_close(&state->s);
+}
+
+/*
+ * Read the next batch of rows of cursor into its batch context. The
+ * columns are the row, if with_row, then the period, then the key, if
+ * keyed. Returns false when there are no more.
+ */
+static bool
+align_fetch(AlignState *state, AlignCursor *cursor, bool with_row)
+{
+	MemoryContext oldcontext;
+	Portal portal;
+	int percol = with_row ? 2 : 1;
+	uint64 i;
+
+	MemoryContextReset(cursor->batch_context);
+	cursor->nrows = 0;
+	cursor->next_row = 0;
+	if(cursor->portal_name == NULL)
+		return false;
+
+	if(SPI_connect() != SPI_OK_CONNECT)
+		elog(ERROR,"%s: SPI_connect failed", state->fname);
+	portal = SPI_cursor_find(cursor->portal_name);
+	if(portal == NULL)
+		elog(ERROR,"%s: cursor \"%s\" does not exist", state->fname, cursor->portal_name);
+	SPI_cursor_fetch(portal, true, ALIGN_FETCH);
+
+	oldcontext = MemoryContextSwitchTo(cursor->batch_context);
+	cursor->rows = (AlignRow *) palloc(Max(SPI_processed, 1) * sizeof(AlignRow));
+	for(i = 0; i < SPI_processed; i++) {
+		HeapTuple tuple = SPI_tuptable->vals[i];
+		TupleDesc tupdesc = SPI_tuptable->tupdesc;
+		AlignRow *row = &cursor->rows[cursor->nrows++];
+		bool isnull;
+		Datum d;
+
+		row->row = (Datum) 0;
+		if(with_row)
+			row->row = datumCopy(SPI_getbinval(tuple, tupdesc, 1, &isnull), false, -1);
+		d = SPI_getbinval(tuple, tupdesc, percol, &row->pernull);
+		if(!row->pernull)
+			period_copy((period *) DatumGetPointer(d), &row->per);
+		row->keynull = false;
+		row->key = (Datum) 0;
+		if(state->keyed) {
+			d = SPI_getbinval(tuple, tupdesc, percol + 1, &row->keynull);
+			if(!row->keynull)
+				row->key = datumCopy(d, state->key_byval, state->key_len);
+		}
+	}
+	MemoryContextSwitchTo(oldcontext);
+
+	if(SPI_processed == 0)
+		align_close(cursor);
+	SPI_finish();
+	return cursor->nrows > 0;
+}
+
+/* The next row of cursor, without taking it, or NULL at the end */
+static AlignRow *
+align_peek(AlignState *state, AlignCursor *cursor, bool with_row)
+{
+	if(cursor->next_row == cursor->nrows && !align_fetch(state, cursor, with_row))
+		return NULL;
+	return &cursor->rows[cursor->next_row];
+}
+
+static int
+align_key_cmp(AlignState *state, Datum a, Datum b)
+{
+	if(!state->keyed)
+		return 0;
+	return DatumGetInt32(FunctionCall2Coll(state->key_cmp, state->key_collation, a, b));
+}
+
+static int
+align_cmp_timestamptz(const void *a, const void *b)
+{
+	TimestampTz ta = *(const TimestampTz *) a;
+	TimestampTz tb = *(const TimestampTz *) b;
+
+	return ta < tb ? -1 : (ta > tb ? 1 : 0);
+}
+
+static int
+align_cmp_period(const void *a, const void *b)
+{
+	return period_compare((period *) a, (period *) b);
+}
+
+static void
+align_add_piece(AlignState *state, TimestampTz first, TimestampTz next)
+{
+	if(state->npieces == state->maxpieces) {
+		state->maxpieces *= 2;
+		state->pieces = (period *) repalloc(state->pieces,
+											state->maxpieces * sizeof(period));
+	}
+	state->pieces[state->npieces].first = first;
+	state->pieces[state->npieces].next = next;
+	state->npieces++;
+}
+
+/*
+ * Bring the active list up to date for row, which has a key and a
+ * period that is not empty: start a new one if its key differs from
+ * the last, add the periods of s starting before it ends, and drop the
+ * ones ending at or before it starts. The rows of r come in order of
+ * the start of their periods, so no later row of the key could meet
+ * the dropped ones.
+ */
+static void
+align_sweep(AlignState *state, AlignRow *row)
+{
+	AlignRow *srow;
+	int i, n;
+
+	if(!state->have_group || align_key_cmp(state, state->group_key, row->key) != 0) {
+		if(state->have_group && state->keyed && !state->key_byval)
+			pfree(DatumGetPointer(state->group_key));
+		state->group_key = state->keyed ?
+			datumCopy(row->key, state->key_byval, state->key_len) : (Datum) 0;
+		state->have_group = true;
+		state->nactive = 0;
+
+		/* skip the rows of s for keys that r has gone past */
+		while((srow = align_peek(state, &state->s, false)) != NULL &&
+			  align_key_cmp(state, srow->key, row->key) < 0)
+			state->s.next_row++;
+	}
+
+	while((srow = align_peek(state, &state->s, false)) != NULL &&
+		  align_key_cmp(state, srow->key, row->key) == 0 &&
+		  srow->per.first < row->per.next) {
+		state->s.next_row++;
+		if(srow->per.next <= row->per.first)
+			continue;
+		if(state->nactive == state->maxactive) {
+			state->maxactive *= 2;
+			state->active = (period *) repalloc(state->active,
+												state->maxactive * sizeof(period));
+		}
+		state->active[state->nactive++] = srow->per;
+	}
+
+	for(i = 0, n = 0; i < state->nactive; i++)
+		if(state->active[i].next > row->per.first)
+			state->active[n++] = state->active[i];
+	state->nactive = n;
+}
+
+/*
+ * Cut the period of row into pieces, ordered by their start. A row
+ * without a key or a period, or with an empty one, matches nothing and
+ * is its own piece.
+ */
+static void
+align_split(AlignState *state, AlignRow *row)
+{
+	period *p = &row->per;
+	int nmatches = 0;
+	int i;
+
+	state->npieces = 0;
+	if(row->keynull || row->pernull || period_is_empty(p)) {
+		if(row->pernull)
+			period_empty_period(&state->pieces[state->npieces++]);
+		else
+			state->pieces[state->npieces++] = *p;
+		return;
+	}
+
+	align_sweep(state, row);
+
+	if(state->normalize) {
+		/* the bounds of the matches inside p, then the pieces between them */
+		TimestampTz *bounds = (TimestampTz *) palloc((2 * state->nactive + 2) * sizeof(TimestampTz));
+		int nbounds = 0;
+
+		bounds[nbounds++] = p->first;
+		for(i = 0; i < state->nactive; i++) {
+			period *a = &state->active[i];
+
+			if(!period_overlaps(a, p))
+				continue;
+			if(a->first > p->first)
+				bounds[nbounds++] = a->first;
+			if(a->next < p->next)
+				bounds[nbounds++] = a->next;
+		}
+		bounds[nbounds++] = p->next;
+		qsort(bounds, nbounds, sizeof(TimestampTz), align_cmp_timestamptz);
+		for(i = 1; i < nbounds; i++)
+			if(bounds[i] > bounds[i - 1])
+				align_add_piece(state, bounds[i - 1], bounds[i]);
+		pfree(bounds);
+		return;
+	}
+
+	/* the distinct intersections with the matches */
+	for(i = 0; i < state->nactive; i++) {
+		period piece;
+
+		period_intersect(p, &state->active[i], &piece);
+		if(period_is_empty(&piece))
+			continue;
+		align_add_piece(state, piece.first, piece.next);
+		nmatches++;
+	}
+	qsort(state->pieces, nmatches, sizeof(period), align_cmp_period);
+	for(i = 1, state->npieces = Min(nmatches, 1); i < nmatches; i++)
+		if(!period_equals(&state->pieces[i], &state->pieces[state->npieces - 1]))
+			state->pieces[state->npieces++] = state->pieces[i];
+	nmatches = state->npieces;
+
+	/* and what is left of p once they are taken away */
+	{
+		period rest;
+
+		period_copy(p, &rest);
+		for(i = 0; i < nmatches && !period_is_empty(&rest); i++) {
+			period taken = state->pieces[i];
+
+			if(taken.first > rest.first)
+				align_add_piece(state, rest.first, taken.first);
+			if(taken.next >= rest.next)
+				period_empty_period(&rest);
+			else if(taken.next > rest.first) {
+				taken.first = rest.first;
+				period_minus(&rest, &taken, &rest);
+			}
+		}
+		if(!period_is_empty(&rest))
+			align_add_piece(state, rest.first, rest.next);
+	}
+	qsort(state->pieces, state->npieces, sizeof(period), align_cmp_period);
+}
+
+/* The row with its period replaced by piece */
+static Datum
+align_form(AlignState *state, AlignRow *row, period *piece)
+{
+	HeapTupleHeader header;
+	HeapTupleData tuple;
+	period *per;
+
+	if(row->pernull || period_equals(&row->per, piece))
+		return row->row;
+
+	header = DatumGetHeapTupleHeader(row->row);
+	tuple.t_len = HeapTupleHeaderGetDatumLength(header);
+	ItemPointerSetInvalid(&tuple.t_self);
+	tuple.t_tableOid = InvalidOid;
+	tuple.t_data = header;
+	heap_deform_tuple(&tuple, state->tupdesc, state->values, state->nulls);
+
+	per = (period *) palloc(sizeof(period));
+	period_copy(piece, per);
+	state->values[state->attnum - 1] = PointerGetDatum(per);
+	state->nulls[state->attnum - 1] = false;
+	return HeapTupleGetDatum(heap_form_tuple(state->tupdesc, state->values, state->nulls));
+}
+
+/* The name of the period type's schema, checking that column is a period */
+static char *
+align_period_schema(const char *fname, Oid relid, const char *column)
+{
+	AttrNumber attnum = get_attnum(relid, column);
+	HeapTuple typtup;
+	Form_pg_type typform;
+	char *nsp;
+
+	if(attnum == InvalidAttrNumber)
+		elog(ERROR,"%s: column \"%s\" does not exist in \"%s\"",
+			 fname, column, get_rel_name(relid));
+	typtup = SearchSysCache1(TYPEOID, ObjectIdGetDatum(get_atttype(relid, attnum)));
+	if(!HeapTupleIsValid(typtup))
+		elog(ERROR,"cache lookup failed for type %u", get_atttype(relid, attnum));
+	typform = (Form_pg_type) GETSTRUCT(typtup);
+	if(strcmp(NameStr(typform->typname), "period") != 0)
+		elog(ERROR,"%s: column \"%s\" must be of type period", fname, column);
+	nsp = quote_identifier(get_namespace_name(typform->typnamespace));
+	ReleaseSysCache(typtup);
+	return nsp;
+}
+
+static char *
+align_relname(Oid relid)
+{
+	return quote_qualified_identifier(get_namespace_name(get_rel_namespace(relid)),
+									  get_rel_name(relid));
+}
+
+static Portal
+align_open(AlignState *state, char *query)
+{
+	Portal portal = SPI_cursor_open_with_args(NULL, query, 0, NULL, NULL, NULL, true, 0);
+
+	if(portal == NULL)
+		elog(ERROR,"%s: SPI_cursor_open failed for \"%s\"", state->fname, query);
+	return portal;
+}
+
+/*
+ * period_align(NULL::r, s, key_column, period_column)
+ * period_normalize(NULL::r, s, key_column, period_column)
+ *
+ * Return the rows of r split at the rows of s with the same key_column,
+ * with their period_column replaced by the pieces. key_column may be
+ * NULL to match every row of s.
+ */
+static Datum
+align_common(FunctionCallInfo fcinfo, const char *fname, bool normalize)
+{
+	FuncCallContext *funcctx;
+	AlignState *state;
+	MemoryContext oldcontext;
+
+	if(SRF_IS_FIRSTCALL()) {
+		ReturnSetInfo *rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
+		Oid rowtype;
+		Oid relid;
+		Oid srelid;
+		char *key_column = NULL;
+		char *period_column;
+		char *nsp;
+		char *per;
+		char *key = NULL;
+		char *query;
+		TupleDesc tupdesc;
+
+		if(PG_ARGISNULL(1) || PG_ARGISNULL(3))
+			elog(ERROR,"%s: table and period_column must not be NULL", fname);
+
+		rowtype = get_fn_expr_argtype(fcinfo->flinfo, 0);
+		relid = get_typ_typrelid(rowtype);
+		if(!OidIsValid(relid))
+			elog(ERROR,"%s: first argument must be a row of a table", fname);
+		srelid = PG_GETARG_OID(1);
+		period_column = text_to_cstring(PG_GETARG_TEXT_PP(3));
+		nsp = align_period_schema(fname, relid, period_column);
+		align_period_schema(fname, srelid, period_column);
+		per = quote_identifier(period_column);
+
+		funcctx = SRF_FIRSTCALL_INIT();
+		oldcontext = MemoryContextSwitchTo(funcctx->multi_call_memory_ctx);
+
+		state = (AlignState *) palloc0(sizeof(AlignState));
+		state->fname = fname;
+		state->normalize = normalize;
+		state->attnum = get_attnum(relid, period_column);
+
+		/* the key, which must sort the same way in both tables */
+		if(!PG_ARGISNULL(2)) {
+			AttrNumber attnum, sattnum;
+			Oid keytype, skeytype;
+			int32 typmod;
+			Oid collation, scollation;
+			TypeCacheEntry *typcache;
+
+			key_column = text_to_cstring(PG_GETARG_TEXT_PP(2));
+			attnum = get_attnum(relid, key_column);
+			sattnum = get_attnum(srelid, key_column);
+			if(attnum == InvalidAttrNumber)
+				elog(ERROR,"%s: column \"%s\" does not exist in \"%s\"",
+					 fname, key_column, get_rel_name(relid));
+			if(sattnum == InvalidAttrNumber)
+				elog(ERROR,"%s: column \"%s\" does not exist in \"%s\"",
+					 fname, key_column, get_rel_name(srelid));
+			get_atttypetypmodcoll(relid, attnum, &keytype, &typmod, &collation);
+			get_atttypetypmodcoll(srelid, sattnum, &skeytype, &typmod, &scollation);
+			if(keytype != skeytype || collation != scollation)
+				elog(ERROR,"%s: column \"%s\" must have the same type and collation in both tables",
+					 fname, key_column);
+			typcache = lookup_type_cache(keytype, TYPECACHE_CMP_PROC_FINFO);
+			if(!OidIsValid(typcache->cmp_proc_finfo.fn_oid))
+				elog(ERROR,"%s: column \"%s\" has no btree ordering", fname, key_column);
+
+			state->keyed = true;
+			state->key_cmp = &typcache->cmp_proc_finfo;
+			state->key_collation = collation;
+			get_typlenbyval(keytype, &state->key_len, &state->key_byval);
+			key = quote_identifier(key_column);
+		}
+
+		tupdesc = lookup_rowtype_tupdesc(rowtype, -1);
+		state->tupdesc = CreateTupleDescCopy(tupdesc);
+		ReleaseTupleDesc(tupdesc);
+		state->values = (Datum *) palloc(state->tupdesc->natts * sizeof(Datum));
+		state->nulls = (bool *) palloc(state->tupdesc->natts * sizeof(bool));
+
+		state->maxactive = 64;
+		state->active = (period *) palloc(state->maxactive * sizeof(period));
+		state->maxpieces = 64;
+		state->pieces = (period *) palloc(state->maxpieces * sizeof(period));
+		state->r.batch_context = AllocSetContextCreate(funcctx->multi_call_memory_ctx,
+													   fname,
+													   ALLOCSET_DEFAULT_MINSIZE,
+													   ALLOCSET_DEFAULT_INITSIZE,
+													   ALLOCSET_DEFAULT_MAXSIZE);
+		state->s.batch_context = AllocSetContextCreate(funcctx->multi_call_memory_ctx,
+													   fname,
+													   ALLOCSET_DEFAULT_MINSIZE,
+													   ALLOCSET_DEFAULT_INITSIZE,
+													   ALLOCSET_DEFAULT_MAXSIZE);
+
+		if(SPI_connect() != SPI_OK_CONNECT)
+			elog(ERROR,"%s: SPI_connect failed", fname);
+
+		/*
+		 * Both in order of key then period, which btree_period_ops sorts
+		 * by start. Rows of s that can match nothing are left out.
+		 */
+		if(key != NULL)
+			query = psprintf("SELECT t, t.%s, t.%s FROM %s t ORDER BY t.%s, t.%s",
+							 per, key, align_relname(relid), key, per);
+		else
+			query = psprintf("SELECT t, t.%s FROM %s t ORDER BY t.%s",
+							 per, align_relname(relid), per);
+		state->r.portal_name = pstrdup(align_open(state, query)->name);
+
+		if(key != NULL)
+			query = psprintf("SELECT s.%s, s.%s FROM %s s"
+							 " WHERE s.%s IS NOT NULL AND NOT %s.is_empty(s.%s)"
+							 " AND s.%s IS NOT NULL ORDER BY s.%s, s.%s",
+							 per, key, align_relname(srelid),
+							 per, nsp, per, key, key, per);
+		else
+			query = psprintf("SELECT s.%s FROM %s s"
+							 " WHERE s.%s IS NOT NULL AND NOT %s.is_empty(s.%s)"
+							 " ORDER BY s.%s",
+							 per, align_relname(srelid), per, nsp, per, per);
+		state->s.portal_name = pstrdup(align_open(state, query)->name);
+		SPI_finish();
+
+		funcctx->user_fctx = state;
+		if(rsinfo != NULL && IsA(rsinfo, ReturnSetInfo))
+			RegisterExprContextCallback(rsinfo->econtext, align_shutdown,
+										PointerGetDatum(state));
+		MemoryContextSwitchTo(oldcontext);
+	}
+
+	funcctx = SRF_PERCALL_SETUP();
+	state = (AlignState *) funcctx->user_fctx;
+
+	for(;;) {
+		if(state->current != NULL && state->next_piece < state->npieces)
+			SRF_RETURN_NEXT(funcctx, align_form(state, state->current,
+												&state->pieces[state->next_piece++]));
+
+		/* the last row is done with; split the next */
+		if(state->current != NULL)
+			state->r.next_row++;
+		oldcontext = MemoryContextSwitchTo(funcctx->multi_call_memory_ctx);
+		state->current = align_peek(state, &state->r, true);
+		if(state->current != NULL)
+			align_split(state, state->current);
+		MemoryContextSwitchTo(oldcontext);
+		if(state->current == NULL)
+			break;
+		state->next_piece = 0;
+	}
+
+	align_close(&state->r);
+	align_close(&state->s);
+	if(fcinfo->resultinfo != NULL && IsA(fcinfo->resultinfo, ReturnSetInfo))
+		UnregisterExprContextCallback(((ReturnSetInfo *) fcinfo->resultinfo)->econtext,
+									  align_shutdown, PointerGetDatum(state));
+	SRF_RETURN_DONE(funcctx);
+}
+
+PG_FUNCTION_INFO_V1(period_align);
+Datum
+period_align(PG_FUNCTION_ARGS)
+{
+	return align_common(fcinfo, "period_align", false);
+}
+
+PG_FUNCTION_INFO_V1(period_normalize);
+Datum
+period_normalize(PG_FUNCTION_ARGS)
+{
+	return align_common(fcinfo, "period_normalize", true);
+}
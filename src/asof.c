@@ -0,0 +1,193 @@
+/*
+ * asof.c
+ *   Implements period_as_of, the rows of a table as of a point in time.
+ *
+ * "As of T" is just period @> T, but in a transaction time table the
+ * current rows' periods are open ended, and they stretch the bounding
+ * period of every GiST page they land on to infinity, so a stabbing
+ * search into the past descends nearly everywhere. period_as_of asks
+ * for the open ended rows and the closed ones separately, so that each
+ * half can use its own partial index: a small one holding just the
+ * current rows, and one holding the history, whose pages stay tight.
+ */
+
+#include "period.h"
+#include "access/htup_details.h"
+#include "catalog/pg_type.h"
+#include "executor/executor.h"
+#include "executor/spi.h"
+#include "funcapi.h"
+#include "utils/datum.h"
+#include "utils/lsyscache.h"
+#include "utils/memutils.h"
+#include "utils/syscache.h"
+
+/* the rows fetched from the cursor at a time */
+#define AS_OF_FETCH 1000
+
+typedef struct
+{
+	char *portal_name;		/* or NULL once closed */
+	MemoryContext batch_context;
+	Datum *rows;
+	uint64 nrows;
+	uint64 next_row;
+} AsOfState;
+
+static void
+as_of_close(AsOfState *state)
+{
+	Portal portal;
+
+	if(state->portal_name == NULL)
+		return;
+	portal = SPI_cursor_find(state->portal_name);
+	if(portal != NULL)
+		SPI_cursor_close(portal);
+	state->portal_name = NULL;
+}
+
+/* close the cursor if we are shut down before reading all of it */
+static void
+as_of_shutdown(Datum arg)
+{
+	as_of_close((AsOfState *) DatumGetPointer(arg));
+}
+
+/* Read the next batch of rows into the batch context */
+static void
+as_of_fetch(AsOfState *state)
+{
+	MemoryContext oldcontext;
+	Portal portal;
+	uint64 i;
+
+	MemoryContextReset(state->batch_context);
+	state->nrows = 0;
+	state->next_row = 0;
+
+	if(SPI_connect() != SPI_OK_CONNECT)
+		elog(ERROR,"period_as_of: SPI_connect failed");
+	portal = SPI_cursor_find(state->portal_name);
+	if(portal == NULL)
+		elog(ERROR,"period_as_of: cursor \"%s\" does not exist", state->portal_name);
+	SPI_cursor_fetch(portal, true, AS_OF_FETCH);
+
+	oldcontext = MemoryContextSwitchTo(state->batch_context);
+	state->rows = (Datum *) palloc(Max(SPI_processed, 1) * sizeof(Datum));
+	for(i = 0; i < SPI_processed; i++) {
+		bool isnull;
+		Datum row = SPI_getbinval(SPI_tuptable->vals[i], SPI_tuptable->tupdesc, 1, &isnull);
+
+		if(!isnull)
+			state->rows[state->nrows++] = datumCopy(row, false, -1);
+	}
+	MemoryContextSwitchTo(oldcontext);
+
+	if(SPI_processed == 0)
+		as_of_close(state);
+	SPI_finish();
+}
+
+/*
+ * period_as_of(NULL::table, period_column, ts)
+ *
+ * Returns the rows of table whose period_column contains ts.
+ */
+PG_FUNCTION_INFO_V1(period_as_of);
+Datum
+period_as_of(PG_FUNCTION_ARGS)
+{
+	FuncCallContext *funcctx;
+	AsOfState *state;
+
+	if(SRF_IS_FIRSTCALL()) {
+		MemoryContext oldcontext;
+		ReturnSetInfo *rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
+		Oid rowtype;
+		Oid relid;
+		char *period_column;
+		AttrNumber attnum;
+		HeapTuple typtup;
+		Form_pg_type typform;
+		char *relname;
+		char *per;
+		char *nsp;
+		char *query;
+		Oid argtypes[1] = { TIMESTAMPTZOID };
+		Datum values[1];
+		Portal portal;
+
+		if(PG_ARGISNULL(1) || PG_ARGISNULL(2))
+			elog(ERROR,"period_as_of: period_column and timestamp must not be NULL");
+
+		rowtype = get_fn_expr_argtype(fcinfo->flinfo, 0);
+		relid = get_typ_typrelid(rowtype);
+		if(!OidIsValid(relid))
+			elog(ERROR,"period_as_of: first argument must be a row of a table");
+		period_column = text_to_cstring(PG_GETARG_TEXT_PP(1));
+		attnum = get_attnum(relid, period_column);
+		if(attnum == InvalidAttrNumber)
+			elog(ERROR,"period_as_of: column \"%s\" does not exist in \"%s\"",
+				 period_column, get_rel_name(relid));
+
+		/* the period functions, from the schema of the period type */
+		typtup = SearchSysCache1(TYPEOID, ObjectIdGetDatum(get_atttype(relid, attnum)));
+		if(!HeapTupleIsValid(typtup))
+			elog(ERROR,"cache lookup failed for type %u", get_atttype(relid, attnum));
+		typform = (Form_pg_type) GETSTRUCT(typtup);
+		if(strcmp(NameStr(typform->typname), "period") != 0)
+			elog(ERROR,"period_as_of: column \"%s\" must be of type period",
+				 period_column);
+		nsp = quote_identifier(get_namespace_name(typform->typnamespace));
+		ReleaseSysCache(typtup);
+
+		relname = quote_qualified_identifier(get_namespace_name(get_rel_namespace(relid)),
+											 get_rel_name(relid));
+		per = quote_identifier(period_column);
+		query = psprintf(
+			"SELECT t FROM %s t WHERE t.%s OPERATOR(%s.@>) $1 AND %s.is_open_ended(t.%s)"
+			" UNION ALL"
+			" SELECT t FROM %s t WHERE t.%s OPERATOR(%s.@>) $1 AND NOT %s.is_open_ended(t.%s)",
+			relname, per, nsp, nsp, per,
+			relname, per, nsp, nsp, per);
+
+		funcctx = SRF_FIRSTCALL_INIT();
+		oldcontext = MemoryContextSwitchTo(funcctx->multi_call_memory_ctx);
+
+		state = (AsOfState *) palloc0(sizeof(AsOfState));
+		state->batch_context = AllocSetContextCreate(funcctx->multi_call_memory_ctx,
+													 "period_as_of",
+													 ALLOCSET_DEFAULT_MINSIZE,
+													 ALLOCSET_DEFAULT_INITSIZE,
+													 ALLOCSET_DEFAULT_MAXSIZE);
+
+		values[0] = PG_GETARG_DATUM(2);
+		if(SPI_connect() != SPI_OK_CONNECT)
+			elog(ERROR,"period_as_of: SPI_connect failed");
+		portal = SPI_cursor_open_with_args(NULL, query, 1, argtypes, values, NULL, true, 0);
+		if(portal == NULL)
+			elog(ERROR,"period_as_of: SPI_cursor_open failed for \"%s\"", query);
+		state->portal_name = pstrdup(portal->name);
+		SPI_finish();
+
+		funcctx->user_fctx = state;
+		if(rsinfo != NULL && IsA(rsinfo, ReturnSetInfo))
+			RegisterExprContextCallback(rsinfo->econtext, as_of_shutdown,
+										PointerGetDatum(state));
+		MemoryContextSwitchTo(oldcontext);
+	}
+
+	funcctx = SRF_PERCALL_SETUP();
+	state = (AsOfState *) funcctx->user_fctx;
+
+	if(state->next_row == state->nrows && state->portal_name != NULL)
+		as_of_fetch(state);
+	if(state->next_row < state->nrows)
+		SRF_RETURN_NEXT(funcctx, state->rows[state->next_row++]);
+
+	if(fcinfo->resultinfo != NULL && IsA(fcinfo->resultinfo, ReturnSetInfo))
+		UnregisterExprContextCallback(((ReturnSetInfo *) fcinfo->resultinfo)->econtext,
+									  as_of_shutdown, PointerGetDatum(state));
+	SRF_RETURN_DONE(funcctx);
+}
@@ -0,0 +1,730 @@
+/*
+ * constraints.c
+ *   Implements temporal constraint triggers.
+ *
+ * temporal_unique(key_column, period_column) enforces that no two rows
+ * with equal keys have overlapping periods, without a GiST exclusion
+ * constraint. It relies on a btree index on (key_column, period_column):
+ * btree_period_ops orders periods by (first, next), so if the other
+ * rows for a key don't overlap each other, a new period can only
+ * overlap its predecessor or its successor in that order, and the
+ * check is two index probes.
+ *
+ * Concurrent inserts for the same key are serialized by a transaction
+ * advisory lock on (table, hash of the key), and the probes use the
+ * latest snapshot, so a conflicting row committed by a transaction we
+ * waited for is seen even in REPEATABLE READ.
+ *
+ * temporal_foreign_key(key_column, period_column, parent_table,
+ * parent_key_column, parent_period_column) enforces that each row's
+ * period is covered by the union of the periods of the parent rows with
+ * the same key. The parent's history may be split into many adjacent
+ * pieces, so the pieces are read in (first, next) order from a btree on
+ * (parent_key_column, parent_period_column), coalescing them until the
+ * row is covered or there is a gap. The pieces may overlap, so a gap
+ * found that way is only trusted once the check has been redone from the
+ * piece before the row that reaches furthest. Fired for each statement,
+ * it checks all the new rows with one sorted merge against the parent.
+ */
+
+#include "period.h"
+#include "access/heapam.h"
+#include "access/htup_details.h"
+#include "catalog/pg_type.h"
+#include "commands/trigger.h"
+#include "executor/spi.h"
+#include "utils/datum.h"
+#include "utils/hsearch.h"
+#include "utils/inval.h"
+#include "utils/lsyscache.h"
+#include "utils/memutils.h"
+#include "utils/rel.h"
+#include "utils/snapmgr.h"
+#include "utils/syscache.h"
+#include "utils/typcache.h"
+
+#if PG_VERSION_NUM < 100000
+#define TupleDescAttr(tupdesc, i) ((tupdesc)->attrs[(i)])
+#endif
+
+/* how foreign key checks lock the parent rows they rely on */
+#if PG_VERSION_NUM >= 90300
+#define FOREIGN_KEY_LOCK "KEY SHARE"
+#else
+#define FOREIGN_KEY_LOCK "SHARE"
+#endif
+
+/* parent pieces fetched at a time; most rows are covered by one or two */
+#define FOREIGN_KEY_ROW_FETCH 8
+#define FOREIGN_KEY_STATEMENT_FETCH 1000
+
+/*
+ * What a constraint trigger needs, worked out from its arguments on
+ * first use, and kept until the table changes.
+ */
+typedef struct
+{
+	Oid tgoid;				/* hash key */
+	bool valid;
+	Oid relid;
+	int key_attnum;
+	int period_attnum;
+	Oid key_type;
+	Oid key_collation;
+	Oid period_type;
+	TypeCacheEntry *key_typcache;	/* for the key's hash function, if any */
+	Oid parent_relid;		/* foreign keys only */
+	SPIPlanPtr plan;		/* the uniqueness probes, or the parent predecessor */
+	SPIPlanPtr next_plan;	/* the parent successors */
+	SPIPlanPtr reach_plan;	/* the parent predecessor reaching furthest */
+} ConstraintConfig;
+
+static HTAB *constraint_configs = NULL;
+
+static ConstraintConfig *constraint_config(TriggerData *trigdata, int nargs,
+										   const char *usage);
+static void constraint_invalidate(Datum arg, Oid relid);
+static int constraint_attnum(Relation rel, const char *name);
+static char *constraint_operator(Oid typid, const char *oprname);
+static char *constraint_function(Oid typid, const char *fname);
+static void constraint_check_period(Relation rel, int attnum);
+static void constraint_lock_key(ConstraintConfig *config, Datum key);
+static bool period_extend(period *covered, period *piece);
+static bool coverage_add(period *covered, bool *started, period *want,
+						 period *piece);
+static char *foreign_key_parent(ConstraintConfig *config, TriggerData *trigdata);
+static void foreign_key_prepare(ConstraintConfig *config, TriggerData *trigdata);
+static bool foreign_key_covers(ConstraintConfig *config, SPIPlanPtr first_plan,
+							   Datum *values, period *want);
+static void foreign_key_check_row(ConstraintConfig *config, TriggerData *trigdata);
+static void foreign_key_check_statement(ConstraintConfig *config,
+										TriggerData *trigdata);
+static void foreign_key_violation(TriggerData *trigdata, const char *key);
+
+/************************************************
+ * Configuration
+ ************************************************/
+
+static ConstraintConfig *
+constraint_config(TriggerData *trigdata, int nargs, const char *usage)
+{
+	Trigger *trigger = trigdata->tg_trigger;
+	Relation rel = trigdata->tg_relation;
+	TupleDesc tupdesc = RelationGetDescr(rel);
+	ConstraintConfig *config;
+	bool found;
+
+	if(constraint_configs == NULL) {
+		HASHCTL ctl;
+
+		memset(&ctl, 0, sizeof(ctl));
+		ctl.keysize = sizeof(Oid);
+		ctl.entrysize = sizeof(ConstraintConfig);
+#if PG_VERSION_NUM >= 90500
+		constraint_configs = hash_create("temporal constraint configurations",
+										 16, &ctl, HASH_ELEM | HASH_BLOBS);
+#else
+		ctl.hash = tag_hash;
+		constraint_configs = hash_create("temporal constraint configurations",
+										 16, &ctl, HASH_ELEM | HASH_FUNCTION);
+#endif
+		CacheRegisterRelcacheCallback(constraint_invalidate, (Datum) 0);
+	}
+
+	config = (ConstraintConfig *) hash_search(constraint_configs,
+		&trigger->tgoid, HASH_ENTER, &found);
+	if(found && config->valid)
+		return config;
+
+	if(found && config->plan)
+		SPI_freeplan(config->plan);
+	if(found && config->next_plan)
+		SPI_freeplan(config->next_plan);
+	if(found && config->reach_plan)
+		SPI_freeplan(config->reach_plan);
+	memset(config, 0, sizeof(ConstraintConfig));
+	config->tgoid = trigger->tgoid;
+
+	if(trigger->tgnargs != nargs)
+		elog(ERROR,"%s: expected arguments %s", trigger->tgname, usage);
+
+	config->relid = RelationGetRelid(rel);
+	config->key_attnum = constraint_attnum(rel, trigger->tgargs[0]);
+	config->period_attnum = constraint_attnum(rel, trigger->tgargs[1]);
+	config->key_type = TupleDescAttr(tupdesc, config->key_attnum - 1)->atttypid;
+	config->key_collation = TupleDescAttr(tupdesc, config->key_attnum - 1)->attcollation;
+	config->period_type = TupleDescAttr(tupdesc, config->period_attnum - 1)->atttypid;
+	config->key_typcache = lookup_type_cache(config->key_type,
+											 TYPECACHE_HASH_PROC_FINFO);
+	if(nargs > 2)
+		config->parent_relid = DatumGetObjectId(DirectFunctionCall1(regclassin,
+			CStringGetDatum(trigger->tgargs[2])));
+
+	config->valid = true;
+	return config;
+}
+
+/* Forget what we know about triggers on, or referencing, a table that changed */
+static void
+constraint_invalidate(Datum arg, Oid relid)
+{
+	HASH_SEQ_STATUS status;
+	ConstraintConfig *config;
+
+	hash_seq_init(&status, constraint_configs);
+	while((config = (ConstraintConfig *) hash_seq_search(&status)) != NULL) {
+		if(relid == InvalidOid || config->relid == relid ||
+		   config->parent_relid == relid)
+			config->valid = false;
+	}
+}
+
+static int
+constraint_attnum(Relation rel, const char *name)
+{
+	TupleDesc tupdesc = RelationGetDescr(rel);
+	int i;
+
+	for(i = 0; i < tupdesc->natts; i++) {
+		Form_pg_attribute att = TupleDescAttr(tupdesc, i);
+
+		if(!att->attisdropped && strcmp(NameStr(att->attname), name) == 0)
+			return i + 1;
+	}
+	elog(ERROR,"column \"%s\" does not exist in \"%s\"", name,
+		 RelationGetRelationName(rel));
+	return 0;					/* keep compiler quiet */
+}
+
+/*
+ * Return the operator oprname, qualified with the schema of the type
+ * typid, so that the queries don't depend on search_path.
+ */
+static char *
+constraint_operator(Oid typid, const char *oprname)
+{
+	HeapTuple typtup;
+	char *result;
+
+	typtup = SearchSysCache1(TYPEOID, ObjectIdGetDatum(typid));
+	if(!HeapTupleIsValid(typtup))
+		elog(ERROR,"cache lookup failed for type %u", typid);
+	result = psprintf("OPERATOR(%s.%s)", quote_identifier(get_namespace_name(
+		((Form_pg_type) GETSTRUCT(typtup))->typnamespace)), oprname);
+	ReleaseSysCache(typtup);
+	return result;
+}
+
+/* The same for the function fname */
+static char *
+constraint_function(Oid typid, const char *fname)
+{
+	HeapTuple typtup;
+	char *result;
+
+	typtup = SearchSysCache1(TYPEOID, ObjectIdGetDatum(typid));
+	if(!HeapTupleIsValid(typtup))
+		elog(ERROR,"cache lookup failed for type %u", typid);
+	result = quote_qualified_identifier(get_namespace_name(
+		((Form_pg_type) GETSTRUCT(typtup))->typnamespace), fname);
+	ReleaseSysCache(typtup);
+	return result;
+}
+
+/* The coverage checks read period values directly, so insist on them */
+static void
+constraint_check_period(Relation rel, int attnum)
+{
+	Form_pg_attribute att = TupleDescAttr(RelationGetDescr(rel), attnum - 1);
+	HeapTuple typtup;
+	bool is_period;
+
+	typtup = SearchSysCache1(TYPEOID, ObjectIdGetDatum(att->atttypid));
+	if(!HeapTupleIsValid(typtup))
+		elog(ERROR,"cache lookup failed for type %u", att->atttypid);
+	is_period = strcmp(NameStr(((Form_pg_type) GETSTRUCT(typtup))->typname),
+					   "period") == 0;
+	ReleaseSysCache(typtup);
+	if(!is_period)
+		elog(ERROR,"column \"%s\" of \"%s\" must be of type period",
+			 NameStr(att->attname), RelationGetRelationName(rel));
+}
+
+/*
+ * Take a transaction advisory lock on (table, hash of the key), or on
+ * the whole table if the key type has no hash function.
+ */
+static void
+constraint_lock_key(ConstraintConfig *config, Datum key)
+{
+	int32 hash = 0;
+
+	if(OidIsValid(config->key_typcache->hash_proc_finfo.fn_oid))
+		hash = DatumGetInt32(FunctionCall1Coll(
+			&config->key_typcache->hash_proc_finfo, config->key_collation, key));
+
+	DirectFunctionCall2(pg_advisory_xact_lock_int4,
+						Int32GetDatum((int32) config->relid),
+						Int32GetDatum(hash));
+}
+
+/************************************************
+ * Temporal uniqueness
+ ************************************************/
+
+PG_FUNCTION_INFO_V1(temporal_unique);
+Datum
+temporal_unique(PG_FUNCTION_ARGS)
+{
+	TriggerData *trigdata = (TriggerData *) fcinfo->context;
+	Relation rel;
+	TupleDesc tupdesc;
+	ConstraintConfig *config;
+	HeapTuple tuple;
+	Datum values[3];
+	bool isnull;
+
+	if(!CALLED_AS_TRIGGER(fcinfo))
+		elog(ERROR,"temporal_unique: not called by trigger manager");
+	if(!TRIGGER_FIRED_AFTER(trigdata->tg_event) ||
+	   !TRIGGER_FIRED_FOR_ROW(trigdata->tg_event) ||
+	   TRIGGER_FIRED_BY_DELETE(trigdata->tg_event))
+		elog(ERROR,"temporal_unique: must be fired AFTER INSERT OR UPDATE FOR EACH ROW");
+
+	rel = trigdata->tg_relation;
+	tupdesc = RelationGetDescr(rel);
+	config = constraint_config(trigdata, 2, "key_column, period_column");
+	tuple = TRIGGER_FIRED_BY_UPDATE(trigdata->tg_event) ?
+		trigdata->tg_newtuple : trigdata->tg_trigtuple;
+
+	// like a unique index, NULLs never conflict
+	values[0] = heap_getattr(tuple, config->key_attnum, tupdesc, &isnull);
+	if(isnull)
+		return PointerGetDatum(NULL);
+	values[1] = heap_getattr(tuple, config->period_attnum, tupdesc, &isnull);
+	if(isnull)
+		return PointerGetDatum(NULL);
+	values[2] = PointerGetDatum(&tuple->t_self);
+
+	constraint_lock_key(config, values[0]);
+
+	if(SPI_connect() != SPI_OK_CONNECT)
+		elog(ERROR,"temporal_unique: SPI_connect failed");
+
+	if(config->plan == NULL) {
+		char *key = quote_identifier(trigdata->tg_trigger->tgargs[0]);
+		char *per = quote_identifier(trigdata->tg_trigger->tgargs[1]);
+		char *relname = quote_qualified_identifier(
+			get_namespace_name(RelationGetNamespace(rel)),
+			RelationGetRelationName(rel));
+		Oid argtypes[3];
+		SPIPlanPtr plan;
+		char *query;
+
+		/* the predecessor, other than this row, and the successor */
+		query = psprintf(
+			"SELECT 1 FROM ("
+			"(SELECT x.%s AS p FROM ONLY %s x WHERE x.%s = $1 AND x.%s %s $2 AND x.ctid <> $3"
+			" ORDER BY x.%s DESC LIMIT 1)"
+			" UNION ALL "
+			"(SELECT x.%s AS p FROM ONLY %s x WHERE x.%s = $1 AND x.%s %s $2"
+			" ORDER BY x.%s LIMIT 1)) n"
+			" WHERE n.p %s $2",
+			per, relname, key, per, constraint_operator(config->period_type, "<="), per,
+			per, relname, key, per, constraint_operator(config->period_type, ">"), per,
+			constraint_operator(config->period_type, "&&"));
+
+		argtypes[0] = config->key_type;
+		argtypes[1] = config->period_type;
+		argtypes[2] = TIDOID;
+		plan = SPI_prepare(query, 3, argtypes);
+		if(plan == NULL)
+			elog(ERROR,"temporal_unique: SPI_prepare failed for \"%s\"", query);
+		SPI_keepplan(plan);
+		config->plan = plan;
+	}
+
+	if(SPI_execute_snapshot(config->plan, values, NULL, GetLatestSnapshot(),
+							InvalidSnapshot, false, false, 1) != SPI_OK_SELECT)
+		elog(ERROR,"temporal_unique: SPI_execute_snapshot failed");
+
+	if(SPI_processed > 0) {
+		Oid typoutput;
+		bool typisvarlena;
+
+		getTypeOutputInfo(config->key_type, &typoutput, &typisvarlena);
+		ereport(ERROR,
+				(errcode(ERRCODE_EXCLUSION_VIOLATION),
+				 errmsg("conflicting key value violates temporal uniqueness constraint \"%s\"",
+						trigdata->tg_trigger->tgname),
+				 errdetail("Key (%s)=(%s) has another row with an overlapping %s.",
+						   trigdata->tg_trigger->tgargs[0],
+						   OidOutputFunctionCall(typoutput, values[0]),
+						   trigdata->tg_trigger->tgargs[1])));
+	}
+
+	SPI_finish();
+	return PointerGetDatum(NULL);
+}
+
+/************************************************
+ * Temporal foreign keys
+ ************************************************/
+
+/*
+ * Add piece to covered if it overlaps or meets it. Pieces come in
+ * (first, next) order, so one that doesn't lies past a gap.
+ */
+static bool
+period_extend(period *covered, period *piece)
+{
+	if(!period_overlaps(covered, piece) && !period_adjacent(covered, piece))
+		return false;
+	period_union(covered, piece, covered, false);
+	return true;
+}
+
+/*
+ * Feed the next parent piece, in (first, next) order, to the coverage
+ * of want. Returns false once there is a gap; want is covered when
+ * *started and covered->next >= want->next.
+ */
+static bool
+coverage_add(period *covered, bool *started, period *want, period *piece)
+{
+	if(period_is_empty(piece) || piece->next <= want->first)
+		return true;
+	if(!*started) {
+		if(piece->first > want->first)
+			return false;
+		*covered = *piece;
+		*started = true;
+		return true;
+	}
+	return period_extend(covered, piece);
+}
+
+/* Check the parent's columns, and return its qualified name */
+static char *
+foreign_key_parent(ConstraintConfig *config, TriggerData *trigdata)
+{
+	Trigger *trigger = trigdata->tg_trigger;
+	Relation parent;
+	char *result;
+
+	constraint_check_period(trigdata->tg_relation, config->period_attnum);
+
+	parent = relation_open(config->parent_relid, AccessShareLock);
+	constraint_attnum(parent, trigger->tgargs[3]);
+	constraint_check_period(parent, constraint_attnum(parent, trigger->tgargs[4]));
+	result = quote_qualified_identifier(
+		get_namespace_name(RelationGetNamespace(parent)),
+		RelationGetRelationName(parent));
+	relation_close(parent, AccessShareLock);
+	return result;
+}
+
+static void
+foreign_key_prepare(ConstraintConfig *config, TriggerData *trigdata)
+{
+	Trigger *trigger = trigdata->tg_trigger;
+	char *parent = foreign_key_parent(config, trigdata);
+	char *pkey = quote_identifier(trigger->tgargs[3]);
+	char *pper = quote_identifier(trigger->tgargs[4]);
+	Oid argtypes[2];
+	SPIPlanPtr plan;
+	char *query;
+
+	argtypes[0] = config->key_type;
+	argtypes[1] = config->period_type;
+
+	/* the last piece that sorts before the row, which may cover its start */
+	query = psprintf(
+		"SELECT p.%s FROM ONLY %s p WHERE p.%s = $1 AND p.%s %s $2"
+		" ORDER BY p.%s DESC LIMIT 1 FOR " FOREIGN_KEY_LOCK " OF p",
+		pper, parent, pkey, pper, constraint_operator(config->period_type, "<="),
+		pper);
+	plan = SPI_prepare(query, 2, argtypes);
+	if(plan == NULL)
+		elog(ERROR,"temporal_foreign_key: SPI_prepare failed for \"%s\"", query);
+	SPI_keepplan(plan);
+	config->plan = plan;
+
+	/* and the pieces after it, read only as far as needed */
+	query = psprintf(
+		"SELECT p.%s FROM ONLY %s p WHERE p.%s = $1 AND p.%s %s $2"
+		" ORDER BY p.%s FOR " FOREIGN_KEY_LOCK " OF p",
+		pper, parent, pkey, pper, constraint_operator(config->period_type, ">"),
+		pper);
+	plan = SPI_prepare(query, 2, argtypes);
+	if(plan == NULL)
+		elog(ERROR,"temporal_foreign_key: SPI_prepare failed for \"%s\"", query);
+	SPI_keepplan(plan);
+	config->next_plan = plan;
+
+	/*
+	 * the piece before the row that ends last, for when the pieces
+	 * overlap; it reads all the pieces before the row
+	 */
+	query = psprintf(
+		"SELECT p.%s FROM ONLY %s p WHERE p.%s = $1 AND p.%s %s $2"
+		" AND %s(p.%s) > %s($2)"
+		" ORDER BY %s(p.%s) DESC LIMIT 1 FOR " FOREIGN_KEY_LOCK " OF p",
+		pper, parent, pkey, pper, constraint_operator(config->period_type, "<="),
+		constraint_function(config->period_type, "next"), pper,
+		constraint_function(config->period_type, "first"),
+		constraint_function(config->period_type, "next"), pper);
+	plan = SPI_prepare(query, 2, argtypes);
+	if(plan == NULL)
+		elog(ERROR,"temporal_foreign_key: SPI_prepare failed for \"%s\"", query);
+	SPI_keepplan(plan);
+	config->reach_plan = plan;
+}
+
+static void
+foreign_key_violation(TriggerData *trigdata, const char *key)
+{
+	Trigger *trigger = trigdata->tg_trigger;
+
+	ereport(ERROR,
+			(errcode(ERRCODE_FOREIGN_KEY_VIOLATION),
+			 errmsg("insert or update on table \"%s\" violates temporal foreign key constraint \"%s\"",
+					RelationGetRelationName(trigdata->tg_relation), trigger->tgname),
+			 errdetail("Key (%s)=(%s) is not present in \"%s\" for the whole of %s.",
+					   trigger->tgargs[0], key, trigger->tgargs[2],
+					   trigger->tgargs[1])));
+}
+
+/*
+ * Is want covered by the parent pieces for the key in values, coalesced
+ * from the one first_plan finds before the row through those after it?
+ */
+static bool
+foreign_key_covers(ConstraintConfig *config, SPIPlanPtr first_plan,
+				   Datum *values, period *want)
+{
+	period covered;
+	bool started = false;
+	bool ok = true;
+	bool isnull;
+
+	if(SPI_execute_plan(first_plan, values, NULL, false, 1) != SPI_OK_SELECT)
+		elog(ERROR,"temporal_foreign_key: SPI_execute_plan failed");
+	if(SPI_processed > 0) {
+		Datum piece = SPI_getbinval(SPI_tuptable->vals[0],
+									SPI_tuptable->tupdesc, 1, &isnull);
+
+		if(!isnull)
+			ok = coverage_add(&covered, &started, want,
+							  (period *) DatumGetPointer(piece));
+	}
+
+	if(ok && !(started && covered.next >= want->next)) {
+		Portal portal = SPI_cursor_open(NULL, config->next_plan, values, NULL,
+										false);
+
+		while(ok && !(started && covered.next >= want->next)) {
+			uint64 i;
+
+			SPI_cursor_fetch(portal, true, FOREIGN_KEY_ROW_FETCH);
+			if(SPI_processed == 0)
+				break;
+			for(i = 0; i < SPI_processed && ok; i++) {
+				Datum piece = SPI_getbinval(SPI_tuptable->vals[i],
+											SPI_tuptable->tupdesc, 1, &isnull);
+
+				if(!isnull)
+					ok = coverage_add(&covered, &started, want,
+									  (period *) DatumGetPointer(piece));
+				if(started && covered.next >= want->next)
+					break;
+			}
+			SPI_freetuptable(SPI_tuptable);
+		}
+		SPI_cursor_close(portal);
+	}
+
+	return started && covered.next >= want->next;
+}
+
+/*
+ * Check one row. The last piece before the row reaches furthest when
+ * the parent's pieces for a key don't overlap, so the coverage is
+ * usually settled starting from it. When they overlap, a longer piece
+ * further back may cover what it leaves out, so before reporting a gap
+ * the check is redone from the piece before the row that ends last.
+ */
+static void
+foreign_key_check_row(ConstraintConfig *config, TriggerData *trigdata)
+{
+	TupleDesc tupdesc = RelationGetDescr(trigdata->tg_relation);
+	HeapTuple tuple;
+	Datum values[2];
+	bool isnull;
+	period *want;
+
+	tuple = TRIGGER_FIRED_BY_UPDATE(trigdata->tg_event) ?
+		trigdata->tg_newtuple : trigdata->tg_trigtuple;
+
+	// like MATCH SIMPLE, a row with a NULL key or period is not checked
+	values[0] = heap_getattr(tuple, config->key_attnum, tupdesc, &isnull);
+	if(isnull)
+		return;
+	values[1] = heap_getattr(tuple, config->period_attnum, tupdesc, &isnull);
+	if(isnull)
+		return;
+	want = (period *) DatumGetPointer(values[1]);
+	if(period_is_empty(want))
+		return;
+
+	/* an update that keeps the key and the period was already checked */
+	if(TRIGGER_FIRED_BY_UPDATE(trigdata->tg_event)) {
+		HeapTuple old = trigdata->tg_trigtuple;
+		Datum oldkey, oldper;
+		bool keynull, pernull;
+
+		oldkey = heap_getattr(old, config->key_attnum, tupdesc, &keynull);
+		oldper = heap_getattr(old, config->period_attnum, tupdesc, &pernull);
+		if(!keynull && !pernull &&
+		   datumIsEqual(oldkey, values[0], config->key_typcache->typbyval,
+						config->key_typcache->typlen) &&
+		   period_equals((period *) DatumGetPointer(oldper), want))
+			return;
+	}
+
+	if(SPI_connect() != SPI_OK_CONNECT)
+		elog(ERROR,"temporal_foreign_key: SPI_connect failed");
+	if(config->plan == NULL)
+		foreign_key_prepare(config, trigdata);
+
+	if(!foreign_key_covers(config, config->plan, values, want) &&
+	   !foreign_key_covers(config, config->reach_plan, values, want)) {
+		Oid typoutput;
+		bool typisvarlena;
+
+		getTypeOutputInfo(config->key_type, &typoutput, &typisvarlena);
+		foreign_key_violation(trigdata, OidOutputFunctionCall(typoutput, values[0]));
+	}
+
+	SPI_finish();
+}
+
+/*
+ * Check all the rows a statement inserted or updated at once: sort them
+ * with the parent pieces for their keys, parents first within a key, so
+ * that each key's pieces can be coalesced into runs and each new row
+ * matched against the run containing its start, in one pass.
+ */
+static void
+foreign_key_check_statement(ConstraintConfig *config, TriggerData *trigdata)
+{
+#if PG_VERSION_NUM >= 100000
+	Trigger *trigger = trigdata->tg_trigger;
+	const char *newtable = trigger->tgnewtable;
+	char *key = quote_identifier(trigger->tgargs[0]);
+	char *per = quote_identifier(trigger->tgargs[1]);
+	char *pkey = quote_identifier(trigger->tgargs[3]);
+	char *pper = quote_identifier(trigger->tgargs[4]);
+	period *runs;
+	int nruns = 0;
+	int maxruns = 16;
+	int r = 0;
+	Portal portal;
+	char *query;
+
+	if(newtable == NULL)
+		elog(ERROR,"temporal_foreign_key: statement triggers need REFERENCING NEW TABLE");
+
+	if(SPI_connect() != SPI_OK_CONNECT)
+		elog(ERROR,"temporal_foreign_key: SPI_connect failed");
+	if(SPI_register_trigger_data(trigdata) != SPI_OK_TD_REGISTER)
+		elog(ERROR,"temporal_foreign_key: SPI_register_trigger_data failed");
+
+	query = psprintf(
+		"WITH parent AS (SELECT p.%s AS k, p.%s AS d FROM ONLY %s p"
+		" WHERE p.%s IN (SELECT n.%s FROM %s n) FOR " FOREIGN_KEY_LOCK " OF p)"
+		" SELECT s.k, s.d, s.parent, s.k IS DISTINCT FROM lag(s.k) OVER w FROM ("
+		"SELECT n.%s AS k, n.%s AS d, false AS parent FROM %s n"
+		" WHERE n.%s IS NOT NULL AND n.%s IS NOT NULL"
+		" UNION ALL SELECT k, d, true FROM parent) s"
+		" WINDOW w AS (ORDER BY s.k, s.parent DESC, s.d)"
+		" ORDER BY s.k, s.parent DESC, s.d",
+		pkey, pper, foreign_key_parent(config, trigdata), pkey, key,
+		quote_identifier(newtable),
+		key, per, quote_identifier(newtable), key, per);
+
+	portal = SPI_cursor_open_with_args(NULL, query, 0, NULL, NULL, NULL, false, 0);
+	if(portal == NULL)
+		elog(ERROR,"temporal_foreign_key: SPI_cursor_open failed for \"%s\"", query);
+
+	runs = (period *) palloc(maxruns * sizeof(period));
+	for(;;) {
+		uint64 i;
+
+		SPI_cursor_fetch(portal, true, FOREIGN_KEY_STATEMENT_FETCH);
+		if(SPI_processed == 0)
+			break;
+		for(i = 0; i < SPI_processed; i++) {
+			HeapTuple tuple = SPI_tuptable->vals[i];
+			TupleDesc tupdesc = SPI_tuptable->tupdesc;
+			period *d;
+			bool isnull;
+
+			if(DatumGetBool(SPI_getbinval(tuple, tupdesc, 4, &isnull))) {
+				nruns = 0;
+				r = 0;
+			}
+			d = (period *) DatumGetPointer(SPI_getbinval(tuple, tupdesc, 2, &isnull));
+			if(isnull || period_is_empty(d))
+				continue;
+
+			if(DatumGetBool(SPI_getbinval(tuple, tupdesc, 3, &isnull))) {
+				/* a parent piece extends the last run, or starts a new one */
+				if(nruns > 0 && period_extend(&runs[nruns - 1], d))
+					continue;
+				if(nruns == maxruns) {
+					maxruns *= 2;
+					runs = (period *) repalloc(runs, maxruns * sizeof(period));
+				}
+				runs[nruns++] = *d;
+			} else {
+				/* new rows come in first order, so r only moves forward */
+				while(r < nruns && runs[r].next <= d->first)
+					r++;
+				if(r == nruns || !period_contains(&runs[r], d))
+					foreign_key_violation(trigdata, SPI_getvalue(tuple, tupdesc, 1));
+			}
+		}
+		SPI_freetuptable(SPI_tuptable);
+	}
+	SPI_cursor_close(portal);
+
+	SPI_finish();
+#else
+	elog(ERROR,"temporal_foreign_key: statement triggers require PostgreSQL 10");
+#endif
+}
+
+PG_FUNCTION_INFO_V1(temporal_foreign_key);
+Datum
+temporal_foreign_key(PG_FUNCTION_ARGS)
+{
+	TriggerData *trigdata = (TriggerData *) fcinfo->context;
+	ConstraintConfig *config;
+
+	if(!CALLED_AS_TRIGGER(fcinfo))
+		elog(ERROR,"temporal_foreign_key: not called by trigger manager");
+	if(!TRIGGER_FIRED_AFTER(trigdata->tg_event) ||
+	   TRIGGER_FIRED_BY_DELETE(trigdata->tg_event))
+		elog(ERROR,"temporal_foreign_key: must be fired AFTER INSERT OR UPDATE");
+
+	config = constraint_config(trigdata, 5,
+		"key_column, period_column, parent_table, parent_key_column, parent_period_column");
+
+	if(TRIGGER_FIRED_FOR_ROW(trigdata->tg_event))
+		foreign_key_check_row(config, trigdata);
+	else
+		foreign_key_check_statement(config, trigdata);
+
+	return PointerGetDatum(NULL);
+}
@@ -0,0 +1,539 @@
+/*
+ * current.c
+ *   Implements temporal_current(), a trigger that keeps a table of the
+ *   current state of a relation split across several since tables.
+ *
+ * In doc/schema.sql the current state of r is the view r1_since NATURAL
+ * JOIN r2_since, so every read of it joins the components again. The
+ * trigger keeps a plain table with the rows of such a view instead, and
+ * is attached to each of the tables the view reads:
+ *
+ *   temporal_current(current_table, view, key_column [, key_column ...])
+ *
+ * When rows of a component change, only the keys they had and have are
+ * refreshed: the current table's rows for each key are deleted and the
+ * view's rows for it inserted, which for a join on the key is a lookup
+ * in each component's primary key. The columns of current_table are
+ * taken from the same-named columns of the view, and the key columns
+ * must exist in the trigger's table too.
+ *
+ * What the trigger does depends on how it is fired:
+ *
+ *   AFTER INSERT OR UPDATE OR DELETE FOR EACH ROW: refresh the key of
+ *     the old row and of the new one, with plans prepared once per
+ *     trigger.
+ *   AFTER INSERT, UPDATE or DELETE FOR EACH STATEMENT, REFERENCING NEW
+ *     TABLE or OLD TABLE or both: refresh the keys of all the rows the
+ *     statement changed with one DELETE and one INSERT ... SELECT
+ *     (PostgreSQL 10 and later).
+ *
+ * Refreshes of the same key are serialized by a transaction advisory
+ * lock on (current table, hash of the key), taken before the DELETE.
+ * Without it, two transactions changing different components of a key
+ * each insert the view's rows as their own snapshot sees them: a new key
+ * is missed by both, and a changed one is inserted twice. The second
+ * refresh waits for the first to commit, and then runs with a snapshot
+ * taken after the lock, as temporal_unique's probes do, rather than the
+ * transaction's: under REPEATABLE READ or SERIALIZABLE the transaction's
+ * snapshot can predate the other commit, so the view would miss its rows
+ * and the key would be dropped with no error.
+ */
+
+#include "period.h"
+#include "access/heapam.h"
+#include "access/htup_details.h"
+#include "catalog/pg_type.h"
+#include "commands/trigger.h"
+#include "executor/spi.h"
+#include "lib/stringinfo.h"
+#include "utils/datum.h"
+#include "utils/hsearch.h"
+#include "utils/inval.h"
+#include "utils/lsyscache.h"
+#include "utils/memutils.h"
+#include "utils/rel.h"
+#include "utils/snapmgr.h"
+#include "utils/typcache.h"
+
+#if PG_VERSION_NUM < 100000
+#define TupleDescAttr(tupdesc, i) ((tupdesc)->attrs[(i)])
+#endif
+
+/*
+ * What a trigger needs, worked out from its arguments and the tables
+ * on first use, and kept until any of them changes.
+ */
+typedef struct
+{
+	Oid tgoid;				/* hash key */
+	bool valid;
+	Oid relid;
+	Oid currelid;
+	Oid viewrelid;
+	int nkeys;
+	int *key_attnums;		/* in the trigger's table */
+	Oid *argtypes;			/* of the key columns */
+	Oid *collations;
+	TypeCacheEntry **typcaches;	/* for their hash functions, if any */
+	char *delete_query;		/* DELETE for one key, for row triggers */
+	char *insert_query;		/* INSERT ... SELECT for one key */
+	SPIPlanPtr delete_plan;
+	SPIPlanPtr insert_plan;
+	char *delete_keys;		/* DELETE and INSERT ... SELECT for the keys */
+	char *insert_keys;		/* of a list, for statement triggers */
+	char *key_list;
+} CurrentConfig;
+
+static HTAB *current_configs = NULL;
+
+static CurrentConfig *current_config(TriggerData *trigdata);
+static void current_build_config(CurrentConfig *config, TriggerData *trigdata);
+static void current_invalidate(Datum arg, Oid relid);
+static void current_refresh_row(CurrentConfig *config, TriggerData *trigdata);
+static void current_refresh_statement(CurrentConfig *config,
+	TriggerData *trigdata);
+
+PG_FUNCTION_INFO_V1(temporal_current);
+Datum
+temporal_current(PG_FUNCTION_ARGS)
+{
+	TriggerData *trigdata = (TriggerData *) fcinfo->context;
+	CurrentConfig *config;
+
+	if(!CALLED_AS_TRIGGER(fcinfo))
+		elog(ERROR,"temporal_current: not called by trigger manager");
+	if(!TRIGGER_FIRED_AFTER(trigdata->tg_event))
+		elog(ERROR,"temporal_current: must be fired AFTER");
+	if(!TRIGGER_FIRED_BY_INSERT(trigdata->tg_event) &&
+	   !TRIGGER_FIRED_BY_UPDATE(trigdata->tg_event) &&
+	   !TRIGGER_FIRED_BY_DELETE(trigdata->tg_event))
+		elog(ERROR,"temporal_current: must be fired for INSERT, UPDATE or DELETE");
+
+	config = current_config(trigdata);
+
+	if(TRIGGER_FIRED_FOR_ROW(trigdata->tg_event))
+		current_refresh_row(config, trigdata);
+	else
+		current_refresh_statement(config, trigdata);
+
+	return PointerGetDatum(NULL);
+}
+
+/************************************************
+ * Configuration
+ ************************************************/
+
+static CurrentConfig *
+current_config(TriggerData *trigdata)
+{
+	Oid tgoid = trigdata->tg_trigger->tgoid;
+	CurrentConfig *config;
+	bool found;
+
+	if(current_configs == NULL) {
+		HASHCTL ctl;
+
+		memset(&ctl, 0, sizeof(ctl));
+		ctl.keysize = sizeof(Oid);
+		ctl.entrysize = sizeof(CurrentConfig);
+#if PG_VERSION_NUM >= 90500
+		current_configs = hash_create("temporal_current configurations", 16,
+									  &ctl, HASH_ELEM | HASH_BLOBS);
+#else
+		ctl.hash = tag_hash;
+		current_configs = hash_create("temporal_current configurations", 16,
+									  &ctl, HASH_ELEM | HASH_FUNCTION);
+#endif
+		CacheRegisterRelcacheCallback(current_invalidate, (Datum) 0);
+	}
+
+	config = (CurrentConfig *) hash_search(current_configs, &tgoid,
+										   HASH_ENTER, &found);
+	if(found && config->valid)
+		return config;
+
+	if(found) {
+		if(config->key_attnums)
+			pfree(config->key_attnums);
+		if(config->argtypes)
+			pfree(config->argtypes);
+		if(config->collations)
+			pfree(config->collations);
+		if(config->typcaches)
+			pfree(config->typcaches);
+		if(config->delete_query)
+			pfree(config->delete_query);
+		if(config->insert_query)
+			pfree(config->insert_query);
+		if(config->delete_plan)
+			SPI_freeplan(config->delete_plan);
+		if(config->insert_plan)
+			SPI_freeplan(config->insert_plan);
+		if(config->delete_keys)
+			pfree(config->delete_keys);
+		if(config->insert_keys)
+			pfree(config->insert_keys);
+		if(config->key_list)
+			pfree(config->key_list);
+	}
+	memset(config, 0, sizeof(CurrentConfig));
+	config->tgoid = tgoid;
+
+	current_build_config(config, trigdata);
+	config->valid = true;
+	return config;
+}
+
+/* Forget what we know about triggers involving a table that changed */
+static void
+current_invalidate(Datum arg, Oid relid)
+{
+	HASH_SEQ_STATUS status;
+	CurrentConfig *config;
+
+	hash_seq_init(&status, current_configs);
+	while((config = (CurrentConfig *) hash_seq_search(&status)) != NULL) {
+		if(relid == InvalidOid || config->relid == relid ||
+		   config->currelid == relid || config->viewrelid == relid)
+			config->valid = false;
+	}
+}
+
+static int
+current_attnum(TupleDesc tupdesc, const char *name)
+{
+	int i;
+
+	for(i = 0; i < tupdesc->natts; i++) {
+		Form_pg_attribute att = TupleDescAttr(tupdesc, i);
+
+		if(!att->attisdropped && strcmp(NameStr(att->attname), name) == 0)
+			return i + 1;
+	}
+	return 0;
+}
+
+static char *
+current_relname(Relation rel)
+{
+	return quote_qualified_identifier(get_namespace_name(RelationGetNamespace(rel)),
+									  RelationGetRelationName(rel));
+}
+
+static void
+current_build_config(CurrentConfig *config, TriggerData *trigdata)
+{
+	Trigger *trigger = trigdata->tg_trigger;
+	TupleDesc tupdesc = RelationGetDescr(trigdata->tg_relation);
+	MemoryContext oldcontext;
+	Relation currel, viewrel;
+	TupleDesc curdesc, viewdesc;
+	char *curname, *viewname;
+	StringInfoData cols, sels, keys, ckeys, vkeys, ccond, vcond;
+	int i;
+
+	if(trigger->tgnargs < 3)
+		elog(ERROR,"temporal_current: expected arguments current_table, view, key_column [, key_column ...]");
+
+	config->relid = RelationGetRelid(trigdata->tg_relation);
+	config->currelid = DatumGetObjectId(DirectFunctionCall1(regclassin,
+		CStringGetDatum(trigger->tgargs[0])));
+	config->viewrelid = DatumGetObjectId(DirectFunctionCall1(regclassin,
+		CStringGetDatum(trigger->tgargs[1])));
+
+	currel = relation_open(config->currelid, AccessShareLock);
+	viewrel = relation_open(config->viewrelid, AccessShareLock);
+	curdesc = RelationGetDescr(currel);
+	viewdesc = RelationGetDescr(viewrel);
+	curname = current_relname(currel);
+	viewname = current_relname(viewrel);
+
+	oldcontext = MemoryContextSwitchTo(CacheMemoryContext);
+	config->nkeys = trigger->tgnargs - 2;
+	config->key_attnums = (int *) palloc(config->nkeys * sizeof(int));
+	config->argtypes = (Oid *) palloc(config->nkeys * sizeof(Oid));
+	config->collations = (Oid *) palloc(config->nkeys * sizeof(Oid));
+	config->typcaches = (TypeCacheEntry **) palloc(config->nkeys * sizeof(TypeCacheEntry *));
+	MemoryContextSwitchTo(oldcontext);
+
+	initStringInfo(&cols);
+	initStringInfo(&sels);
+	initStringInfo(&keys);
+	initStringInfo(&ckeys);
+	initStringInfo(&vkeys);
+	initStringInfo(&ccond);
+	initStringInfo(&vcond);
+
+	/* the key columns are parameters $1 .. $n */
+	for(i = 0; i < config->nkeys; i++) {
+		const char *name = trigger->tgargs[i + 2];
+		const char *qname = quote_identifier(name);
+		const char *sep = i > 0 ? ", " : "";
+		const char *conj = i > 0 ? " AND " : "";
+		int attnum = current_attnum(tupdesc, name);
+
+		if(attnum == 0)
+			elog(ERROR,"temporal_current: column \"%s\" does not exist in \"%s\"",
+				 name, RelationGetRelationName(trigdata->tg_relation));
+		if(current_attnum(curdesc, name) == 0)
+			elog(ERROR,"temporal_current: column \"%s\" does not exist in \"%s\"",
+				 name, RelationGetRelationName(currel));
+		if(current_attnum(viewdesc, name) == 0)
+			elog(ERROR,"temporal_current: column \"%s\" does not exist in \"%s\"",
+				 name, RelationGetRelationName(viewrel));
+		config->key_attnums[i] = attnum;
+		config->argtypes[i] = TupleDescAttr(tupdesc, attnum - 1)->atttypid;
+		config->collations[i] = TupleDescAttr(tupdesc, attnum - 1)->attcollation;
+		config->typcaches[i] = lookup_type_cache(config->argtypes[i],
+												 TYPECACHE_HASH_PROC_FINFO);
+		appendStringInfo(&keys, "%s%s", sep, qname);
+		appendStringInfo(&ckeys, "%sc.%s", sep, qname);
+		appendStringInfo(&vkeys, "%sv.%s", sep, qname);
+		appendStringInfo(&ccond, "%sc.%s = $%d", conj, qname, i + 1);
+		appendStringInfo(&vcond, "%sv.%s = $%d", conj, qname, i + 1);
+	}
+
+	/* the current table's columns, from the view */
+	for(i = 0; i < curdesc->natts; i++) {
+		Form_pg_attribute att = TupleDescAttr(curdesc, i);
+		const char *name = NameStr(att->attname);
+
+		if(att->attisdropped)
+			continue;
+		if(current_attnum(viewdesc, name) == 0)
+			elog(ERROR,"temporal_current: column \"%s\" does not exist in \"%s\"",
+				 name, RelationGetRelationName(viewrel));
+		appendStringInfo(&cols, "%s%s", cols.len > 0 ? ", " : "",
+						 quote_identifier(name));
+		appendStringInfo(&sels, "%sv.%s", sels.len > 0 ? ", " : "",
+						 quote_identifier(name));
+	}
+
+	relation_close(viewrel, AccessShareLock);
+	relation_close(currel, AccessShareLock);
+
+	oldcontext = MemoryContextSwitchTo(CacheMemoryContext);
+	config->delete_query = psprintf("DELETE FROM %s c WHERE %s",
+		curname, ccond.data);
+	config->insert_query = psprintf("INSERT INTO %s (%s) SELECT %s FROM %s v WHERE %s",
+		curname, cols.data, sels.data, viewname, vcond.data);
+	config->delete_keys = psprintf("DELETE FROM %s c WHERE (%s) IN",
+		curname, ckeys.data);
+	config->insert_keys = psprintf("INSERT INTO %s (%s) SELECT %s FROM %s v WHERE (%s) IN",
+		curname, cols.data, sels.data, viewname, vkeys.data);
+	config->key_list = pstrdup(keys.data);
+	MemoryContextSwitchTo(oldcontext);
+}
+
+/************************************************
+ * Trigger actions
+ ************************************************/
+
+/* Prepare query once, keeping the plan for the life of the config */
+static SPIPlanPtr
+current_prepare(CurrentConfig *config, SPIPlanPtr *plan, const char *query)
+{
+	if(*plan == NULL) {
+		SPIPlanPtr p = SPI_prepare(query, config->nkeys, config->argtypes);
+
+		if(p == NULL)
+			elog(ERROR,"temporal_current: SPI_prepare failed for \"%s\"", query);
+		SPI_keepplan(p);
+		*plan = p;
+	}
+	return *plan;
+}
+
+/*
+ * Run plan with a snapshot taken now, so that it sees what was committed
+ * before we got the key's lock, whatever the isolation level.
+ */
+static void
+current_execute(SPIPlanPtr plan, Datum *values, const char *nulls,
+				int expected, const char *query)
+{
+	if(SPI_execute_snapshot(plan, values, nulls, GetLatestSnapshot(),
+							InvalidSnapshot, false, true, 0) != expected)
+		elog(ERROR,"temporal_current: SPI_execute_snapshot failed for \"%s\"", query);
+}
+
+/*
+ * The hash of a key, combining those of its columns; a column whose type
+ * has no hash function adds nothing, so its keys share a lock.
+ */
+static int32
+current_key_hash(CurrentConfig *config, Datum *values)
+{
+	uint32 hash = 0;
+	int i;
+
+	for(i = 0; i < config->nkeys; i++) {
+		hash = (hash << 5) - hash;
+		if(OidIsValid(config->typcaches[i]->hash_proc_finfo.fn_oid))
+			hash += DatumGetUInt32(FunctionCall1Coll(&config->typcaches[i]->hash_proc_finfo,
+													 config->collations[i], values[i]));
+	}
+	return (int32) hash;
+}
+
+/* Take the transaction advisory lock on (current table, hash) */
+static void
+current_lock_key(CurrentConfig *config, int32 hash)
+{
+	DirectFunctionCall2(pg_advisory_xact_lock_int4,
+						Int32GetDatum((int32) config->currelid),
+						Int32GetDatum(hash));
+}
+
+static int
+current_hash_cmp(const void *a, const void *b)
+{
+	int32 x = *(const int32 *) a;
+	int32 y = *(const int32 *) b;
+
+	return x < y ? -1 : x > y ? 1 : 0;
+}
+
+/*
+ * Replace the current rows for the key of tuple with the view's, holding
+ * the key's lock until the end of the transaction.
+ */
+static void
+current_refresh_key(CurrentConfig *config, TriggerData *trigdata,
+					HeapTuple tuple)
+{
+	TupleDesc tupdesc = RelationGetDescr(trigdata->tg_relation);
+	Datum *values;
+	char *nulls;
+	bool isnull;
+	int i;
+
+	values = (Datum *) palloc(config->nkeys * sizeof(Datum));
+	nulls = (char *) palloc(config->nkeys * sizeof(char));
+	for(i = 0; i < config->nkeys; i++) {
+		values[i] = heap_getattr(tuple, config->key_attnums[i], tupdesc, &isnull);
+		if(isnull)		/* a NULL key joins nothing */
+			return;
+		nulls[i] = ' ';
+	}
+
+	current_lock_key(config, current_key_hash(config, values));
+	current_execute(current_prepare(config, &config->delete_plan, config->delete_query),
+					values, nulls, SPI_OK_DELETE, config->delete_query);
+	current_execute(current_prepare(config, &config->insert_plan, config->insert_query),
+					values, nulls, SPI_OK_INSERT, config->insert_query);
+}
+
+/* Are the keys of the two rows the same? */
+static bool
+current_same_key(CurrentConfig *config, TriggerData *trigdata)
+{
+	TupleDesc tupdesc = RelationGetDescr(trigdata->tg_relation);
+	int i;
+
+	for(i = 0; i < config->nkeys; i++) {
+		Form_pg_attribute att = TupleDescAttr(tupdesc, config->key_attnums[i] - 1);
+		bool oldnull, newnull;
+		Datum oldval = heap_getattr(trigdata->tg_trigtuple, config->key_attnums[i],
+									tupdesc, &oldnull);
+		Datum newval = heap_getattr(trigdata->tg_newtuple, config->key_attnums[i],
+									tupdesc, &newnull);
+
+		if(oldnull != newnull)
+			return false;
+		if(!oldnull && !datumIsEqual(oldval, newval, att->attbyval, att->attlen))
+			return false;
+	}
+	return true;
+}
+
+static void
+current_refresh_row(CurrentConfig *config, TriggerData *trigdata)
+{
+	if(SPI_connect() != SPI_OK_CONNECT)
+		elog(ERROR,"temporal_current: SPI_connect failed");
+
+	if(TRIGGER_FIRED_BY_INSERT(trigdata->tg_event))
+		current_refresh_key(config, trigdata, trigdata->tg_trigtuple);
+	else if(TRIGGER_FIRED_BY_DELETE(trigdata->tg_event))
+		current_refresh_key(config, trigdata, trigdata->tg_trigtuple);
+	else {
+		current_refresh_key(config, trigdata, trigdata->tg_newtuple);
+		if(!current_same_key(config, trigdata))
+			current_refresh_key(config, trigdata, trigdata->tg_trigtuple);
+	}
+
+	SPI_finish();
+}
+
+static void
+current_refresh_statement(CurrentConfig *config, TriggerData *trigdata)
+{
+#if PG_VERSION_NUM >= 100000
+	const char *oldtable = trigdata->tg_trigger->tgoldtable;
+	const char *newtable = trigdata->tg_trigger->tgnewtable;
+	char *changed;
+	char *query;
+	SPIPlanPtr plan;
+	Datum *values;
+	int32 *hashes;
+	uint64 n;
+	uint64 i;
+	int j;
+
+	if(oldtable == NULL && newtable == NULL)
+		elog(ERROR,"temporal_current: statement triggers need REFERENCING OLD TABLE or NEW TABLE");
+
+	/* the keys the statement changed */
+	if(oldtable != NULL && newtable != NULL)
+		changed = psprintf("(SELECT %s FROM %s UNION SELECT %s FROM %s)",
+						   config->key_list, quote_identifier(oldtable),
+						   config->key_list, quote_identifier(newtable));
+	else
+		changed = psprintf("(SELECT DISTINCT %s FROM %s)", config->key_list,
+						   quote_identifier(oldtable != NULL ? oldtable : newtable));
+
+	if(SPI_connect() != SPI_OK_CONNECT)
+		elog(ERROR,"temporal_current: SPI_connect failed");
+	if(SPI_register_trigger_data(trigdata) != SPI_OK_TD_REGISTER)
+		elog(ERROR,"temporal_current: SPI_register_trigger_data failed");
+
+	/*
+	 * Lock the keys as the row trigger does, in the order of their hashes
+	 * so that two statements locking several keys can't deadlock. Keys
+	 * with a NULL column join nothing and aren't locked.
+	 */
+	query = psprintf("SELECT * FROM %s k", changed);
+	if(SPI_execute(query, false, 0) != SPI_OK_SELECT)
+		elog(ERROR,"temporal_current: SPI_execute failed for \"%s\"", query);
+	values = (Datum *) palloc(config->nkeys * sizeof(Datum));
+	hashes = (int32 *) palloc(Max(SPI_processed, 1) * sizeof(int32));
+	n = 0;
+	for(i = 0; i < SPI_processed; i++) {
+		bool isnull = false;
+
+		for(j = 0; j < config->nkeys && !isnull; j++)
+			values[j] = SPI_getbinval(SPI_tuptable->vals[i], SPI_tuptable->tupdesc,
+									  j + 1, &isnull);
+		if(!isnull)
+			hashes[n++] = current_key_hash(config, values);
+	}
+	qsort(hashes, n, sizeof(int32), current_hash_cmp);
+	for(i = 0; i < n; i++)
+		if(i == 0 || hashes[i] != hashes[i - 1])
+			current_lock_key(config, hashes[i]);
+
+	query = psprintf("%s %s", config->delete_keys, changed);
+	if((plan = SPI_prepare(query, 0, NULL)) == NULL)
+		elog(ERROR,"temporal_current: SPI_prepare failed for \"%s\"", query);
+	current_execute(plan, NULL, NULL, SPI_OK_DELETE, query);
+	query = psprintf("%s %s", config->insert_keys, changed);
+	if((plan = SPI_prepare(query, 0, NULL)) == NULL)
+		elog(ERROR,"temporal_current: SPI_prepare failed for \"%s\"", query);
+	current_execute(plan, NULL, NULL, SPI_OK_INSERT, query);
+
+	SPI_finish();
+#else
+	elog(ERROR,"temporal_current: statement triggers require PostgreSQL 10");
+#endif
+}
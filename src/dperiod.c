@@ -0,0 +1,29 @@
+/*
+ * dperiod.c
+ *   Implements the DPERIOD data type, a period of DATE values.
+ *
+ * Both bounds are 32-bit day numbers, so a DPERIOD fits in 8 bytes and,
+ * where int8 is passed by value, is too; none of its operators need to
+ * allocate then. Elsewhere, as on 32-bit servers, it is passed by
+ * reference like the other period types.
+ */
+
+#include "period.h"
+#include "utils/date.h"
+
+#define PT_NAME dperiod
+#define PT_BOUND DateADT
+#define PT_GETARG_BOUND(n) PG_GETARG_DATEADT(n)
+#define PT_BOUND_GET_DATUM(x) DateADTGetDatum(x)
+#define PT_BOUND_IN(str) DatumGetDateADT(DirectFunctionCall1( \
+	date_in, CStringGetDatum(str)))
+#define PT_BOUND_OUT(x) DatumGetCString(DirectFunctionCall1( \
+	date_out, DateADTGetDatum(x)))
+#define PT_BOUND_NOT_FINITE(x) DATE_NOT_FINITE(x)
+#define PT_BOUND_MAX (DATEVAL_NOEND - 1)
+#define PT_BOUND_MIN (DATEVAL_NOBEGIN + 1)
+#ifdef USE_FLOAT8_BYVAL
+#define PT_BYVAL
+#endif
+
+#include "period_template.h"
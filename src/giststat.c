@@ -0,0 +1,279 @@
+/*
+ * giststat.c
+ *   Implements period_gist_stats, which describes the shape of a GiST
+ *   index on a period column, level by level.
+ *
+ * The quality of picksplit and penalty shows in the internal keys: the
+ * wider they are, and the more siblings overlap, the more pages a search
+ * has to visit. Open ended keys stretch every key above them to
+ * infinity, so they are counted apart and left out of the extents.
+ */
+
+#include "period.h"
+#include "access/genam.h"
+#include "access/gist_private.h"
+#include "access/itup.h"
+#include "catalog/index.h"
+#include "catalog/pg_am.h"
+#include "catalog/pg_type.h"
+#include "funcapi.h"
+#include "miscadmin.h"
+#include "storage/bufmgr.h"
+#include "utils/acl.h"
+#include "utils/lsyscache.h"
+#include "utils/rel.h"
+#include "utils/syscache.h"
+#include "access/htup_details.h"
+
+#if PG_VERSION_NUM < 100000
+#define TupleDescAttr(tupdesc, i) ((tupdesc)->attrs[(i)])
+#endif
+
+#ifdef HAVE_INT64_TIMESTAMP
+#define GIST_STAT_SECONDS(ts) ((double) (ts) / USECS_PER_SEC)
+#else
+#define GIST_STAT_SECONDS(ts) ((double) (ts))
+#endif
+
+typedef struct
+{
+	int64 pages;
+	int64 tuples;
+	double free;			/* bytes free on the pages */
+	int64 bounded;			/* non-empty keys that end */
+	int64 open_ended;
+	double extent;			/* seconds, summed over the bounded keys */
+	double union_extent;	/* seconds, summed over each page's union of them */
+} GistLevelStats;
+
+typedef struct
+{
+	GistLevelStats *levels;	/* by depth, root first */
+	int nlevels;
+	int next;
+	TupleDesc tupdesc;
+} GistStatsState;
+
+static int
+gist_stat_cmp_first(const void *a, const void *b)
+{
+	const period *pa = (const period *) a;
+	const period *pb = (const period *) b;
+
+	return pa->first < pb->first ? -1 : (pa->first > pb->first ? 1 : 0);
+}
+
+/*
+ * Add the keys of one page to stats, and the children of an internal
+ * page to *children.
+ */
+static void
+gist_stat_page(Relation index, Page page, GistLevelStats *stats,
+			   BlockNumber **children, int *nchildren, int *maxchildren)
+{
+	OffsetNumber off, maxoff = PageGetMaxOffsetNumber(page);
+	period *keys = (period *) palloc(Max(maxoff, 1) * sizeof(period));
+	int nkeys = 0;
+	bool leaf = GistPageIsLeaf(page);
+	TimestampTz union_first = 0, union_next = 0;
+	int i;
+
+	stats->pages++;
+	stats->free += PageGetFreeSpace(page);
+
+	for(off = FirstOffsetNumber; off <= maxoff; off = OffsetNumberNext(off)) {
+		ItemId iid = PageGetItemId(page, off);
+		IndexTuple itup;
+		bool isnull;
+		period *key;
+
+		if(!ItemIdIsUsed(iid) || ItemIdIsDead(iid))
+			continue;
+		itup = (IndexTuple) PageGetItem(page, iid);
+		stats->tuples++;
+
+		if(!leaf) {
+			if(*nchildren == *maxchildren) {
+				*maxchildren *= 2;
+				*children = (BlockNumber *) repalloc(*children,
+													 *maxchildren * sizeof(BlockNumber));
+			}
+			(*children)[(*nchildren)++] = ItemPointerGetBlockNumber(&itup->t_tid);
+		}
+
+		key = (period *) DatumGetPointer(index_getattr(itup, 1, RelationGetDescr(index),
+													   &isnull));
+		if(isnull || period_is_empty(key))
+			continue;
+		if(TIMESTAMP_IS_NOEND(key->next)) {
+			stats->open_ended++;
+			continue;
+		}
+		stats->bounded++;
+		stats->extent += GIST_STAT_SECONDS(key->next - key->first);
+		keys[nkeys++] = *key;
+	}
+
+	/* the length of the union of the bounded keys, sweeping in order */
+	qsort(keys, nkeys, sizeof(period), gist_stat_cmp_first);
+	for(i = 0; i < nkeys; i++) {
+		if(i == 0 || keys[i].first > union_next) {
+			if(i > 0)
+				stats->union_extent += GIST_STAT_SECONDS(union_next - union_first);
+			union_first = keys[i].first;
+			union_next = keys[i].next;
+		} else if(keys[i].next > union_next)
+			union_next = keys[i].next;
+	}
+	if(nkeys > 0)
+		stats->union_extent += GIST_STAT_SECONDS(union_next - union_first);
+	pfree(keys);
+}
+
+/*
+ * Walk the index from the root a level at a time.
+ */
+static int
+gist_stat_walk(Relation index, GistLevelStats **levels)
+{
+	BufferAccessStrategy strategy = GetAccessStrategy(BAS_BULKREAD);
+	BlockNumber *blocks;
+	int nblocks = 1;
+	int maxlevels = 8;
+	int nlevels = 0;
+
+	blocks = (BlockNumber *) palloc(sizeof(BlockNumber));
+	blocks[0] = GIST_ROOT_BLKNO;
+	*levels = (GistLevelStats *) palloc0(maxlevels * sizeof(GistLevelStats));
+
+	while(nblocks > 0) {
+		int maxchildren = 64;
+		int nchildren = 0;
+		BlockNumber *children = (BlockNumber *) palloc(maxchildren * sizeof(BlockNumber));
+		int i;
+
+		if(nlevels == maxlevels) {
+			maxlevels *= 2;
+			*levels = (GistLevelStats *) repalloc(*levels, maxlevels * sizeof(GistLevelStats));
+			memset(*levels + nlevels, 0, (maxlevels - nlevels) * sizeof(GistLevelStats));
+		}
+
+		for(i = 0; i < nblocks; i++) {
+			Buffer buf = ReadBufferExtended(index, MAIN_FORKNUM, blocks[i], RBM_NORMAL,
+											strategy);
+			Page page;
+
+			LockBuffer(buf, GIST_SHARE);
+			page = BufferGetPage(buf);
+			if(!PageIsNew(page) && !GistPageIsDeleted(page))
+				gist_stat_page(index, page, &(*levels)[nlevels],
+							   &children, &nchildren, &maxchildren);
+			UnlockReleaseBuffer(buf);
+		}
+
+		pfree(blocks);
+		blocks = children;
+		nblocks = nchildren;
+		nlevels++;
+	}
+
+	pfree(blocks);
+	FreeAccessStrategy(strategy);
+	return nlevels;
+}
+
+/*
+ * period_gist_stats(index)
+ *
+ * Returns a row per level of a GiST index on a period, leaves at 0:
+ * the pages, the tuples, how full the pages are, the sum and mean
+ * length in seconds of the keys that end, the overlap among keys on
+ * the same page (the fraction of their summed length that isn't in
+ * their union), and the fraction of keys that are open ended. The keys
+ * are the table's data, so the caller needs SELECT on the table.
+ */
+PG_FUNCTION_INFO_V1(period_gist_stats);
+Datum
+period_gist_stats(PG_FUNCTION_ARGS)
+{
+	FuncCallContext *funcctx;
+	GistStatsState *state;
+
+	if(SRF_IS_FIRSTCALL()) {
+		MemoryContext oldcontext;
+		Oid indexid = PG_GETARG_OID(0);
+		Oid heapid;
+		Relation index;
+		HeapTuple typtup;
+		Form_pg_type typform;
+		TupleDesc tupdesc;
+
+		funcctx = SRF_FIRSTCALL_INIT();
+		oldcontext = MemoryContextSwitchTo(funcctx->multi_call_memory_ctx);
+
+		if(get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+			elog(ERROR,"period_gist_stats: return type must be a row type");
+		state = (GistStatsState *) palloc0(sizeof(GistStatsState));
+		state->tupdesc = BlessTupleDesc(tupdesc);
+
+#if PG_VERSION_NUM >= 90200
+		heapid = IndexGetRelation(indexid, true);
+		if(!OidIsValid(heapid))
+			elog(ERROR,"period_gist_stats: \"%s\" is not an index", get_rel_name(indexid));
+#else
+		heapid = IndexGetRelation(indexid);
+#endif
+		if(pg_class_aclcheck(heapid, GetUserId(), ACL_SELECT) != ACLCHECK_OK)
+			elog(ERROR,"period_gist_stats: permission denied for table \"%s\"",
+				 get_rel_name(heapid));
+
+		index = index_open(indexid, AccessShareLock);
+		if(index->rd_rel->relam != GIST_AM_OID)
+			elog(ERROR,"period_gist_stats: \"%s\" is not a GiST index",
+				 RelationGetRelationName(index));
+		typtup = SearchSysCache1(TYPEOID,
+			ObjectIdGetDatum(TupleDescAttr(RelationGetDescr(index), 0)->atttypid));
+		if(!HeapTupleIsValid(typtup))
+			elog(ERROR,"cache lookup failed for type %u",
+				 TupleDescAttr(RelationGetDescr(index), 0)->atttypid);
+		typform = (Form_pg_type) GETSTRUCT(typtup);
+		if(strcmp(NameStr(typform->typname), "period") != 0)
+			elog(ERROR,"period_gist_stats: \"%s\" is not an index on a period",
+				 RelationGetRelationName(index));
+		ReleaseSysCache(typtup);
+
+		state->nlevels = gist_stat_walk(index, &state->levels);
+		index_close(index, AccessShareLock);
+
+		funcctx->user_fctx = state;
+		MemoryContextSwitchTo(oldcontext);
+	}
+
+	funcctx = SRF_PERCALL_SETUP();
+	state = (GistStatsState *) funcctx->user_fctx;
+
+	if(state->next < state->nlevels) {
+		/* report the leaves first */
+		GistLevelStats *stats = &state->levels[state->nlevels - 1 - state->next];
+		double usable = BLCKSZ - SizeOfPageHeaderData - MAXALIGN(sizeof(GISTPageOpaqueData));
+		int64 keys = stats->bounded + stats->open_ended;
+		Datum values[8];
+		bool nulls[8] = { false, false, false, false, false, false, false, false };
+
+		values[0] = Int32GetDatum(state->next);
+		values[1] = Int64GetDatum(stats->pages);
+		values[2] = Int64GetDatum(stats->tuples);
+		values[3] = Float8GetDatum(stats->pages > 0 ?
+								   1.0 - stats->free / (stats->pages * usable) : 0.0);
+		values[4] = Float8GetDatum(stats->extent);
+		values[5] = Float8GetDatum(stats->bounded > 0 ? stats->extent / stats->bounded : 0.0);
+		values[6] = Float8GetDatum(stats->extent > 0 ?
+								   1.0 - stats->union_extent / stats->extent : 0.0);
+		values[7] = Float8GetDatum(keys > 0 ? (double) stats->open_ended / keys : 0.0);
+
+		state->next++;
+		SRF_RETURN_NEXT(funcctx, HeapTupleGetDatum(heap_form_tuple(state->tupdesc,
+																   values, nulls)));
+	}
+	SRF_RETURN_DONE(funcctx);
+}
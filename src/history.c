@@ -0,0 +1,432 @@
+/*
+ * history.c
+ *   Implements temporal_history(), a trigger that keeps the history
+ *   of a table, as in the since/during/log design of doc/schema.sql.
+ *
+ * The trigger is attached to a table of current rows, whose TIMESTAMPTZ
+ * column says since when each row has been current. When a row is
+ * updated or deleted, the old row is copied into a history table, with
+ * that column turned into the PERIOD from it to the start of the
+ * current transaction:
+ *
+ *   temporal_history(history_table, since_column, period_column
+ *                    [, stamp_column ...])
+ *
+ * Columns of the history table are copied from same-named columns of
+ * the old row, except period_column, and each stamp_column, which is
+ * set to the transaction timestamp. Nothing is copied for a row that
+ * became current in this transaction, since its period would be empty.
+ *
+ * What the trigger does depends on how it is fired:
+ *
+ *   BEFORE UPDATE FOR EACH ROW: set since_column of the new row to the
+ *     transaction timestamp, unless the UPDATE sets it explicitly.
+ *   AFTER UPDATE OR DELETE FOR EACH ROW: insert the history row, with a
+ *     plan prepared once per trigger.
+ *   AFTER UPDATE OR DELETE FOR EACH STATEMENT, REFERENCING OLD TABLE:
+ *     insert the history of every row the statement changed with a
+ *     single INSERT ... SELECT (PostgreSQL 10 and later).
+ *
+ * The BEFORE trigger needs no SPI call at all; use it with one of the
+ * AFTER forms.
+ */
+
+#include "period.h"
+#include "access/heapam.h"
+#include "access/htup_details.h"
+#include "access/xact.h"
+#include "catalog/pg_type.h"
+#include "commands/trigger.h"
+#include "executor/spi.h"
+#include "utils/hsearch.h"
+#include "utils/inval.h"
+#include "utils/lsyscache.h"
+#include "utils/memutils.h"
+#include "utils/rel.h"
+#include "utils/syscache.h"
+
+#if PG_VERSION_NUM < 100000
+#define TupleDescAttr(tupdesc, i) ((tupdesc)->attrs[(i)])
+#endif
+
+/*
+ * What a trigger needs, worked out from its arguments and the two
+ * tables on first use, and kept until either table changes.
+ */
+typedef struct
+{
+	Oid tgoid;				/* hash key */
+	bool valid;
+	Oid relid;
+	Oid histrelid;
+	int since_attnum;		/* in the trigger's table */
+	Oid period_type;		/* of period_column */
+	int ncopied;
+	int *copied_attnums;	/* in the trigger's table */
+	Oid *argtypes;			/* copied columns, the period, the timestamp */
+	char *row_query;		/* INSERT ... VALUES, for row triggers */
+	SPIPlanPtr row_plan;
+	char *statement_query;	/* INSERT ... SELECT, less the FROM item */
+} HistoryConfig;
+
+static HTAB *history_configs = NULL;
+
+static HistoryConfig *history_config(TriggerData *trigdata);
+static void history_build_config(HistoryConfig *config, TriggerData *trigdata);
+static void history_invalidate(Datum arg, Oid relid);
+static HeapTuple history_stamp(HistoryConfig *config, TriggerData *trigdata,
+	TimestampTz now);
+static void history_insert_row(HistoryConfig *config, TriggerData *trigdata,
+	TimestampTz now);
+static void history_insert_statement(HistoryConfig *config,
+	TriggerData *trigdata, TimestampTz now);
+
+PG_FUNCTION_INFO_V1(temporal_history);
+Datum
+temporal_history(PG_FUNCTION_ARGS)
+{
+	TriggerData *trigdata = (TriggerData *) fcinfo->context;
+	TimestampTz now = GetCurrentTransactionStartTimestamp();
+	HistoryConfig *config;
+
+	if(!CALLED_AS_TRIGGER(fcinfo))
+		elog(ERROR,"temporal_history: not called by trigger manager");
+	if(!TRIGGER_FIRED_BY_UPDATE(trigdata->tg_event) &&
+	   !TRIGGER_FIRED_BY_DELETE(trigdata->tg_event))
+		elog(ERROR,"temporal_history: must be fired for UPDATE or DELETE");
+
+	config = history_config(trigdata);
+
+	if(TRIGGER_FIRED_BEFORE(trigdata->tg_event)) {
+		if(!TRIGGER_FIRED_FOR_ROW(trigdata->tg_event))
+			elog(ERROR,"temporal_history: BEFORE triggers must be FOR EACH ROW");
+		if(TRIGGER_FIRED_BY_UPDATE(trigdata->tg_event))
+			return PointerGetDatum(history_stamp(config, trigdata, now));
+		return PointerGetDatum(trigdata->tg_trigtuple);
+	}
+
+	if(TRIGGER_FIRED_FOR_ROW(trigdata->tg_event))
+		history_insert_row(config, trigdata, now);
+	else
+		history_insert_statement(config, trigdata, now);
+
+	return PointerGetDatum(NULL);
+}
+
+/************************************************
+ * Configuration
+ ************************************************/
+
+static HistoryConfig *
+history_config(TriggerData *trigdata)
+{
+	Oid tgoid = trigdata->tg_trigger->tgoid;
+	HistoryConfig *config;
+	bool found;
+
+	if(history_configs == NULL) {
+		HASHCTL ctl;
+
+		memset(&ctl, 0, sizeof(ctl));
+		ctl.keysize = sizeof(Oid);
+		ctl.entrysize = sizeof(HistoryConfig);
+#if PG_VERSION_NUM >= 90500
+		history_configs = hash_create("temporal_history configurations", 16,
+									  &ctl, HASH_ELEM | HASH_BLOBS);
+#else
+		ctl.hash = tag_hash;
+		history_configs = hash_create("temporal_history configurations", 16,
+									  &ctl, HASH_ELEM | HASH_FUNCTION);
+#endif
+		CacheRegisterRelcacheCallback(history_invalidate, (Datum) 0);
+	}
+
+	config = (HistoryConfig *) hash_search(history_configs, &tgoid,
+										   HASH_ENTER, &found);
+	if(found && config->valid)
+		return config;
+
+	if(found) {
+		if(config->copied_attnums)
+			pfree(config->copied_attnums);
+		if(config->argtypes)
+			pfree(config->argtypes);
+		if(config->row_query)
+			pfree(config->row_query);
+		if(config->row_plan)
+			SPI_freeplan(config->row_plan);
+		if(config->statement_query)
+			pfree(config->statement_query);
+	}
+	memset(config, 0, sizeof(HistoryConfig));
+	config->tgoid = tgoid;
+
+	history_build_config(config, trigdata);
+	config->valid = true;
+	return config;
+}
+
+/* Forget what we know about triggers on or into a table that changed */
+static void
+history_invalidate(Datum arg, Oid relid)
+{
+	HASH_SEQ_STATUS status;
+	HistoryConfig *config;
+
+	hash_seq_init(&status, history_configs);
+	while((config = (HistoryConfig *) hash_seq_search(&status)) != NULL) {
+		if(relid == InvalidOid || config->relid == relid ||
+		   config->histrelid == relid)
+			config->valid = false;
+	}
+}
+
+static int
+history_attnum(TupleDesc tupdesc, const char *name)
+{
+	int i;
+
+	for(i = 0; i < tupdesc->natts; i++) {
+		Form_pg_attribute att = TupleDescAttr(tupdesc, i);
+
+		if(!att->attisdropped && strcmp(NameStr(att->attname), name) == 0)
+			return i + 1;
+	}
+	return 0;
+}
+
+static void
+history_build_config(HistoryConfig *config, TriggerData *trigdata)
+{
+	Trigger *trigger = trigdata->tg_trigger;
+	TupleDesc tupdesc = RelationGetDescr(trigdata->tg_relation);
+	MemoryContext oldcontext;
+	Relation histrel;
+	TupleDesc histdesc;
+	HeapTuple typtup;
+	Form_pg_type typform;
+	char *period_func;
+	char *histname;
+	StringInfoData cols, vals, sels;
+	int period_attnum;
+	int nparams = 0;
+	int i, j;
+
+	if(trigger->tgnargs < 3)
+		elog(ERROR,"temporal_history: expected arguments history_table, since_column, period_column [, stamp_column ...]");
+
+	config->relid = RelationGetRelid(trigdata->tg_relation);
+	config->histrelid = DatumGetObjectId(DirectFunctionCall1(regclassin,
+		CStringGetDatum(trigger->tgargs[0])));
+
+	config->since_attnum = history_attnum(tupdesc, trigger->tgargs[1]);
+	if(config->since_attnum == 0)
+		elog(ERROR,"temporal_history: column \"%s\" does not exist in \"%s\"",
+			 trigger->tgargs[1], RelationGetRelationName(trigdata->tg_relation));
+	if(TupleDescAttr(tupdesc, config->since_attnum - 1)->atttypid != TIMESTAMPTZOID)
+		elog(ERROR,"temporal_history: column \"%s\" must be of type timestamptz",
+			 trigger->tgargs[1]);
+
+	histrel = relation_open(config->histrelid, AccessShareLock);
+	histdesc = RelationGetDescr(histrel);
+	histname = quote_qualified_identifier(
+		get_namespace_name(RelationGetNamespace(histrel)),
+		RelationGetRelationName(histrel));
+
+	period_attnum = history_attnum(histdesc, trigger->tgargs[2]);
+	if(period_attnum == 0)
+		elog(ERROR,"temporal_history: column \"%s\" does not exist in \"%s\"",
+			 trigger->tgargs[2], RelationGetRelationName(histrel));
+	config->period_type = TupleDescAttr(histdesc, period_attnum - 1)->atttypid;
+
+	/* the statement form calls the constructor in the period type's schema */
+	typtup = SearchSysCache1(TYPEOID, ObjectIdGetDatum(config->period_type));
+	if(!HeapTupleIsValid(typtup))
+		elog(ERROR,"cache lookup failed for type %u", config->period_type);
+	typform = (Form_pg_type) GETSTRUCT(typtup);
+	if(strcmp(NameStr(typform->typname), "period") != 0)
+		elog(ERROR,"temporal_history: column \"%s\" must be of type period",
+			 trigger->tgargs[2]);
+	period_func = quote_qualified_identifier(
+		get_namespace_name(typform->typnamespace), "period");
+	ReleaseSysCache(typtup);
+
+	oldcontext = MemoryContextSwitchTo(CacheMemoryContext);
+	config->copied_attnums = (int *) palloc(histdesc->natts * sizeof(int));
+	config->argtypes = (Oid *) palloc((histdesc->natts + 2) * sizeof(Oid));
+	MemoryContextSwitchTo(oldcontext);
+
+	initStringInfo(&cols);
+	initStringInfo(&vals);
+	initStringInfo(&sels);
+
+	/* copied columns are parameters $1 .. $n, then the period and the timestamp */
+	for(i = 0; i < histdesc->natts; i++) {
+		Form_pg_attribute att = TupleDescAttr(histdesc, i);
+		const char *name = NameStr(att->attname);
+		bool stamp = false;
+		int attnum;
+
+		if(att->attisdropped || i + 1 == period_attnum)
+			continue;
+		for(j = 3; j < trigger->tgnargs; j++)
+			if(strcmp(trigger->tgargs[j], name) == 0)
+				stamp = true;
+		if(stamp)
+			continue;
+
+		attnum = history_attnum(tupdesc, name);
+		if(attnum == 0)
+			continue;
+
+		config->copied_attnums[nparams] = attnum;
+		config->argtypes[nparams] = TupleDescAttr(tupdesc, attnum - 1)->atttypid;
+		nparams++;
+		appendStringInfo(&cols, "%s, ", quote_identifier(name));
+		appendStringInfo(&vals, "$%d, ", nparams);
+		appendStringInfo(&sels, "o.%s, ", quote_identifier(name));
+	}
+	config->ncopied = nparams;
+	config->argtypes[nparams] = config->period_type;
+	config->argtypes[nparams + 1] = TIMESTAMPTZOID;
+
+	appendStringInfoString(&cols, quote_identifier(trigger->tgargs[2]));
+	appendStringInfo(&vals, "$%d", nparams + 1);
+	appendStringInfo(&sels, "%s(o.%s, $1)", period_func,
+					 quote_identifier(trigger->tgargs[1]));
+	for(j = 3; j < trigger->tgnargs; j++) {
+		if(history_attnum(histdesc, trigger->tgargs[j]) == 0)
+			elog(ERROR,"temporal_history: column \"%s\" does not exist in \"%s\"",
+				 trigger->tgargs[j], RelationGetRelationName(histrel));
+		appendStringInfo(&cols, ", %s", quote_identifier(trigger->tgargs[j]));
+		appendStringInfo(&vals, ", $%d", nparams + 2);
+		appendStringInfoString(&sels, ", $1");
+	}
+
+	relation_close(histrel, AccessShareLock);
+
+	oldcontext = MemoryContextSwitchTo(CacheMemoryContext);
+	config->row_query = psprintf("INSERT INTO %s (%s) VALUES (%s)",
+		histname, cols.data, vals.data);
+	config->statement_query = psprintf("INSERT INTO %s (%s) SELECT %s",
+		histname, cols.data, sels.data);
+	MemoryContextSwitchTo(oldcontext);
+}
+
+/************************************************
+ * Trigger actions
+ ************************************************/
+
+static HeapTuple
+history_stamp(HistoryConfig *config, TriggerData *trigdata, TimestampTz now)
+{
+	TupleDesc tupdesc = RelationGetDescr(trigdata->tg_relation);
+	HeapTuple oldtup = trigdata->tg_trigtuple;
+	HeapTuple newtup = trigdata->tg_newtuple;
+	Datum oldval, newval;
+	bool oldnull, newnull;
+	Datum *values;
+	bool *nulls;
+	bool *replace;
+
+	oldval = heap_getattr(oldtup, config->since_attnum, tupdesc, &oldnull);
+	newval = heap_getattr(newtup, config->since_attnum, tupdesc, &newnull);
+
+	// the UPDATE set it explicitly
+	if(oldnull != newnull ||
+	   (!oldnull && DatumGetTimestampTz(oldval) != DatumGetTimestampTz(newval)))
+		return newtup;
+
+	values = (Datum *) palloc0(tupdesc->natts * sizeof(Datum));
+	nulls = (bool *) palloc0(tupdesc->natts * sizeof(bool));
+	replace = (bool *) palloc0(tupdesc->natts * sizeof(bool));
+	values[config->since_attnum - 1] = TimestampTzGetDatum(now);
+	replace[config->since_attnum - 1] = true;
+
+	return heap_modify_tuple(newtup, tupdesc, values, nulls, replace);
+}
+
+static void
+history_insert_row(HistoryConfig *config, TriggerData *trigdata,
+				   TimestampTz now)
+{
+	TupleDesc tupdesc = RelationGetDescr(trigdata->tg_relation);
+	HeapTuple oldtup = trigdata->tg_trigtuple;
+	Datum *values;
+	char *nulls;
+	period *p;
+	Datum since;
+	bool isnull;
+	int i;
+
+	since = heap_getattr(oldtup, config->since_attnum, tupdesc, &isnull);
+	if(isnull || DatumGetTimestampTz(since) >= now)
+		return;
+
+	values = (Datum *) palloc((config->ncopied + 2) * sizeof(Datum));
+	nulls = (char *) palloc((config->ncopied + 2) * sizeof(char));
+	for(i = 0; i < config->ncopied; i++) {
+		values[i] = heap_getattr(oldtup, config->copied_attnums[i], tupdesc,
+								 &isnull);
+		nulls[i] = isnull ? 'n' : ' ';
+	}
+	p = (period *) palloc(sizeof(period));
+	p->first = DatumGetTimestampTz(since);
+	p->next = now;
+	values[i] = PointerGetDatum(p);
+	nulls[i] = ' ';
+	values[i + 1] = TimestampTzGetDatum(now);
+	nulls[i + 1] = ' ';
+
+	if(SPI_connect() != SPI_OK_CONNECT)
+		elog(ERROR,"temporal_history: SPI_connect failed");
+
+	if(config->row_plan == NULL) {
+		SPIPlanPtr plan = SPI_prepare(config->row_query, config->ncopied + 2,
+									  config->argtypes);
+
+		if(plan == NULL)
+			elog(ERROR,"temporal_history: SPI_prepare failed for \"%s\"",
+				 config->row_query);
+		SPI_keepplan(plan);
+		config->row_plan = plan;
+	}
+
+	if(SPI_execute_plan(config->row_plan, values, nulls, false, 0) != SPI_OK_INSERT)
+		elog(ERROR,"temporal_history: SPI_execute_plan failed for \"%s\"",
+			 config->row_query);
+
+	SPI_finish();
+}
+
+static void
+history_insert_statement(HistoryConfig *config, TriggerData *trigdata,
+						 TimestampTz now)
+{
+#if PG_VERSION_NUM >= 100000
+	const char *oldtable = trigdata->tg_trigger->tgoldtable;
+	const char *since = quote_identifier(trigdata->tg_trigger->tgargs[1]);
+	Oid argtypes[1] = { TIMESTAMPTZOID };
+	Datum values[1];
+	char *query;
+
+	if(oldtable == NULL)
+		elog(ERROR,"temporal_history: statement triggers need REFERENCING OLD TABLE");
+
+	query = psprintf("%s FROM %s o WHERE o.%s < $1", config->statement_query,
+					 quote_identifier(oldtable), since);
+	values[0] = TimestampTzGetDatum(now);
+
+	if(SPI_connect() != SPI_OK_CONNECT)
+		elog(ERROR,"temporal_history: SPI_connect failed");
+	if(SPI_register_trigger_data(trigdata) != SPI_OK_TD_REGISTER)
+		elog(ERROR,"temporal_history: SPI_register_trigger_data failed");
+
+	if(SPI_execute_with_args(query, 1, argtypes, values, NULL, false, 0) != SPI_OK_INSERT)
+		elog(ERROR,"temporal_history: SPI_execute failed for \"%s\"", query);
+
+	SPI_finish();
+#else
+	elog(ERROR,"temporal_history: statement triggers require PostgreSQL 10");
+#endif
+}
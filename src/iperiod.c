@@ -0,0 +1,26 @@
+/*
+ * iperiod.c
+ *   Implements the IPERIOD data type, a period of BIGINT values.
+ */
+
+#include "period.h"
+#if PG_VERSION_NUM >= 100000
+#include "utils/fmgrprotos.h"
+#else
+#include "utils/int8.h"
+#endif
+
+#define PT_NAME iperiod
+#define PT_BOUND int64
+#define PT_GETARG_BOUND(n) PG_GETARG_INT64(n)
+#define PT_BOUND_GET_DATUM(x) Int64GetDatum(x)
+#define PT_BOUND_IN(str) DatumGetInt64(DirectFunctionCall1( \
+	int8in, CStringGetDatum(str)))
+#define PT_BOUND_OUT(x) DatumGetCString(DirectFunctionCall1( \
+	int8out, Int64GetDatum(x)))
+/* there is no infinite BIGINT */
+#define PT_BOUND_NOT_FINITE(x) false
+#define PT_BOUND_MAX INT64CONST(0x7FFFFFFFFFFFFFFF)
+#define PT_BOUND_MIN (-INT64CONST(0x7FFFFFFFFFFFFFFF) - 1)
+
+#include "period_template.h"
@@ -0,0 +1,322 @@
+/*
+ * lookup.c
+ *   Implements period_lookup, which finds the rows containing each of
+ *   many timestamps in one pass.
+ *
+ * Joining a million timestamps to the rows whose period contains them
+ * (timestamptz <@ period, strategy 28 of gist_period_ops) with a nested
+ * loop costs a million index descents. Instead, period_lookup sorts the
+ * timestamps, then sweeps them against the rows read once in period
+ * order, which a btree on the period column (btree_period_ops sorts by
+ * first) can supply. The rows whose period has started but not ended
+ * are kept in an active list; for each timestamp, rows starting at or
+ * before it join the list, rows ending at or before it leave, and the
+ * rest are its matches.
+ */
+
+#include "period.h"
+#include "access/htup_details.h"
+#include "catalog/pg_type.h"
+#include "executor/executor.h"
+#include "executor/spi.h"
+#include "funcapi.h"
+#include "utils/array.h"
+#include "utils/datum.h"
+#include "utils/lsyscache.h"
+#include "utils/memutils.h"
+#include "utils/syscache.h"
+
+/* the rows fetched from the cursor at a time */
+#define LOOKUP_FETCH 1000
+
+typedef struct
+{
+	TimestampTz first;
+	TimestampTz next;
+	Datum row;
+} LookupRow;
+
+typedef struct
+{
+	TimestampTz *probes;
+	int nprobes;
+	int probe;			/* the current probe */
+	bool swept;			/* whether the active list is up to date for it */
+
+	char *portal_name;	/* or NULL once exhausted */
+	LookupRow *pending;	/* rows read from the cursor, not yet active */
+	int npending;
+	int next_pending;
+
+	LookupRow *active;
+	int nactive;
+	int maxactive;
+	int next_active;	/* the next match to return for the probe */
+	TupleDesc tupdesc;
+} LookupState;
+
+static int
+lookup_cmp_timestamptz(const void *a, const void *b)
+{
+	TimestampTz ta = *(const TimestampTz *) a;
+	TimestampTz tb = *(const TimestampTz *) b;
+
+	return ta < tb ? -1 : (ta > tb ? 1 : 0);
+}
+
+static void
+lookup_close(LookupState *state)
+{
+	Portal portal;
+
+	if(state->portal_name == NULL)
+		return;
+	portal = SPI_cursor_find(state->portal_name);
+	if(portal != NULL)
+		SPI_cursor_close(portal);
+	state->portal_name = NULL;
+}
+
+/* close the cursor if we are shut down before reading all of it */
+static void
+lookup_shutdown(Datum arg)
+{
+	lookup_close((LookupState *) DatumGetPointer(arg));
+}
+
+/*
+ * Read the next batch of rows from the cursor into pending, in the
+ * caller's memory context. Returns false when there are no more.
+ */
+static bool
+lookup_fetch(LookupState *state)
+{
+	MemoryContext oldcontext = CurrentMemoryContext;
+	Portal portal;
+	uint64 i;
+
+	if(state->portal_name == NULL)
+		return false;
+
+	if(SPI_connect() != SPI_OK_CONNECT)
+		elog(ERROR,"period_lookup: SPI_connect failed");
+	portal = SPI_cursor_find(state->portal_name);
+	if(portal == NULL)
+		elog(ERROR,"period_lookup: cursor \"%s\" does not exist", state->portal_name);
+	SPI_cursor_fetch(portal, true, LOOKUP_FETCH);
+
+	state->npending = 0;
+	state->next_pending = 0;
+	for(i = 0; i < SPI_processed; i++) {
+		HeapTuple tuple = SPI_tuptable->vals[i];
+		bool isnull;
+		Datum row = SPI_getbinval(tuple, SPI_tuptable->tupdesc, 1, &isnull);
+		period *p = (period *) DatumGetPointer(SPI_getbinval(tuple, SPI_tuptable->tupdesc, 2, &isnull));
+		LookupRow *pending = &state->pending[state->npending++];
+		MemoryContext spicontext = MemoryContextSwitchTo(oldcontext);
+
+		pending->first = p->first;
+		pending->next = p->next;
+		pending->row = datumCopy(row, false, -1);
+		MemoryContextSwitchTo(spicontext);
+	}
+
+	if(SPI_processed == 0)
+		lookup_close(state);
+	SPI_finish();
+	return state->npending > 0;
+}
+
+/*
+ * Bring the active list up to date for probe ts: add the rows starting
+ * at or before it, and drop the rows ending at or before it.
+ */
+static void
+lookup_sweep(LookupState *state, TimestampTz ts)
+{
+	int i, n;
+
+	for(;;) {
+		LookupRow *row;
+
+		if(state->next_pending == state->npending && !lookup_fetch(state))
+			break;
+		row = &state->pending[state->next_pending];
+		if(row->first > ts)
+			break;
+		state->next_pending++;
+		if(row->next <= ts) {
+			pfree(DatumGetPointer(row->row));
+			continue;
+		}
+		if(state->nactive == state->maxactive) {
+			state->maxactive *= 2;
+			state->active = (LookupRow *) repalloc(state->active,
+												   state->maxactive * sizeof(LookupRow));
+		}
+		state->active[state->nactive++] = *row;
+	}
+
+	for(i = 0, n = 0; i < state->nactive; i++) {
+		if(state->active[i].next <= ts)
+			pfree(DatumGetPointer(state->active[i].row));
+		else
+			state->active[n++] = state->active[i];
+	}
+	state->nactive = n;
+}
+
+/*
+ * period_lookup(NULL::table, period_column, probes)
+ *
+ * Returns (probe, row) for each of the timestamps probes and each row
+ * of table whose period_column contains it, ordered by probe.
+ */
+PG_FUNCTION_INFO_V1(period_lookup);
+Datum
+period_lookup(PG_FUNCTION_ARGS)
+{
+	FuncCallContext *funcctx;
+	LookupState *state;
+	MemoryContext oldcontext;
+
+	if(SRF_IS_FIRSTCALL()) {
+		ReturnSetInfo *rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
+		Oid rowtype;
+		Oid relid;
+		char *period_column;
+		AttrNumber attnum;
+		HeapTuple typtup;
+		Form_pg_type typform;
+		char *relname;
+		char *per;
+		char *nsp;
+		char *query;
+		ArrayType *array;
+		Datum *elems;
+		bool *nulls;
+		int n, i;
+		period *bounds;
+		Oid argtypes[1];
+		Datum values[1];
+		Portal portal;
+		TupleDesc tupdesc;
+
+		if(PG_ARGISNULL(1))
+			elog(ERROR,"period_lookup: period_column must not be NULL");
+
+		rowtype = get_fn_expr_argtype(fcinfo->flinfo, 0);
+		relid = get_typ_typrelid(rowtype);
+		if(!OidIsValid(relid))
+			elog(ERROR,"period_lookup: first argument must be a row of a table");
+		period_column = text_to_cstring(PG_GETARG_TEXT_PP(1));
+		attnum = get_attnum(relid, period_column);
+		if(attnum == InvalidAttrNumber)
+			elog(ERROR,"period_lookup: column \"%s\" does not exist in \"%s\"",
+				 period_column, get_rel_name(relid));
+
+		/* the period operators, from the schema of the period type */
+		argtypes[0] = get_atttype(relid, attnum);
+		typtup = SearchSysCache1(TYPEOID, ObjectIdGetDatum(argtypes[0]));
+		if(!HeapTupleIsValid(typtup))
+			elog(ERROR,"cache lookup failed for type %u", argtypes[0]);
+		typform = (Form_pg_type) GETSTRUCT(typtup);
+		if(strcmp(NameStr(typform->typname), "period") != 0)
+			elog(ERROR,"period_lookup: column \"%s\" must be of type period",
+				 period_column);
+		nsp = quote_identifier(get_namespace_name(typform->typnamespace));
+		ReleaseSysCache(typtup);
+
+		if(get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+			elog(ERROR,"period_lookup: return type must be a row type");
+
+		funcctx = SRF_FIRSTCALL_INIT();
+		oldcontext = MemoryContextSwitchTo(funcctx->multi_call_memory_ctx);
+
+		state = (LookupState *) palloc0(sizeof(LookupState));
+		state->tupdesc = BlessTupleDesc(CreateTupleDescCopy(tupdesc));
+		state->pending = (LookupRow *) palloc(LOOKUP_FETCH * sizeof(LookupRow));
+		state->maxactive = 64;
+		state->active = (LookupRow *) palloc(state->maxactive * sizeof(LookupRow));
+		funcctx->user_fctx = state;
+
+		/* the probes, sorted, without NULLs, which match nothing */
+		if(!PG_ARGISNULL(2)) {
+			array = PG_GETARG_ARRAYTYPE_P(2);
+			deconstruct_array(array, TIMESTAMPTZOID, sizeof(TimestampTz),
+							  FLOAT8PASSBYVAL, 'd', &elems, &nulls, &n);
+			state->probes = (TimestampTz *) palloc(Max(n, 1) * sizeof(TimestampTz));
+			for(i = 0; i < n; i++)
+				if(!nulls[i])
+					state->probes[state->nprobes++] = DatumGetTimestampTz(elems[i]);
+			qsort(state->probes, state->nprobes, sizeof(TimestampTz),
+				  lookup_cmp_timestamptz);
+		}
+
+		/*
+		 * Read the rows overlapping the probes in order of their periods.
+		 * No period contains infinity, so probes that are all infinity
+		 * need no rows.
+		 */
+		if(state->nprobes > 0 && !TIMESTAMP_IS_NOEND(state->probes[0])) {
+			bounds = (period *) palloc(sizeof(period));
+			bounds->first = state->probes[0];
+			bounds->next = next_timestamptz(state->probes[state->nprobes - 1]);
+			if(bounds->first == bounds->next)	/* -infinity */
+				bounds->next = bounds->first + 1;
+			values[0] = PointerGetDatum(bounds);
+
+			relname = quote_qualified_identifier(get_namespace_name(get_rel_namespace(relid)),
+												 get_rel_name(relid));
+			per = quote_identifier(period_column);
+			query = psprintf("SELECT t, t.%s FROM %s t WHERE t.%s OPERATOR(%s.&&) $1"
+							 " ORDER BY t.%s",
+							 per, relname, per, nsp, per);
+
+			if(SPI_connect() != SPI_OK_CONNECT)
+				elog(ERROR,"period_lookup: SPI_connect failed");
+			portal = SPI_cursor_open_with_args(NULL, query, 1, argtypes, values, NULL, true, 0);
+			if(portal == NULL)
+				elog(ERROR,"period_lookup: SPI_cursor_open failed for \"%s\"", query);
+			state->portal_name = pstrdup(portal->name);
+			SPI_finish();
+
+			if(rsinfo != NULL && IsA(rsinfo, ReturnSetInfo))
+				RegisterExprContextCallback(rsinfo->econtext, lookup_shutdown,
+											PointerGetDatum(state));
+		}
+		MemoryContextSwitchTo(oldcontext);
+	}
+
+	funcctx = SRF_PERCALL_SETUP();
+	state = (LookupState *) funcctx->user_fctx;
+
+	while(state->probe < state->nprobes) {
+		TimestampTz ts = state->probes[state->probe];
+
+		if(!state->swept) {
+			oldcontext = MemoryContextSwitchTo(funcctx->multi_call_memory_ctx);
+			lookup_sweep(state, ts);
+			MemoryContextSwitchTo(oldcontext);
+			state->swept = true;
+			state->next_active = 0;
+		}
+		if(state->next_active < state->nactive) {
+			Datum values[2];
+			bool nulls[2] = { false, false };
+
+			values[0] = TimestampTzGetDatum(ts);
+			values[1] = state->active[state->next_active++].row;
+			SRF_RETURN_NEXT(funcctx, HeapTupleGetDatum(heap_form_tuple(state->tupdesc,
+																	   values, nulls)));
+		}
+		state->probe++;
+		state->swept = false;
+	}
+
+	lookup_close(state);
+	if(fcinfo->resultinfo != NULL && IsA(fcinfo->resultinfo, ReturnSetInfo))
+		UnregisterExprContextCallback(((ReturnSetInfo *) fcinfo->resultinfo)->econtext,
+									  lookup_shutdown, PointerGetDatum(state));
+	SRF_RETURN_DONE(funcctx);
+}
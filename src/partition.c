@@ -0,0 +1,316 @@
+/*
+ * partition.c
+ *   Implements partition pruning for tables partitioned on the bounds
+ *   of a period.
+ *
+ * A table can be range partitioned by first(during) or next(during),
+ * but queries filter on during itself, with && or @>, which tells the
+ * planner nothing about first(during). Before planning, for each
+ * clause comparing a period column of such a table with a constant,
+ * we add the clauses it implies about first() and next() of the
+ * column, which the planner can prune partitions with. They are only
+ * derived when the partition key uses first() or next() of the column,
+ * since then it can't hold empty periods, for which those functions
+ * raise an error.
+ */
+
+#include "period.h"
+#include "catalog/namespace.h"
+#include "catalog/pg_class.h"
+#include "catalog/pg_type.h"
+#include "nodes/makefuncs.h"
+#include "nodes/nodeFuncs.h"
+#include "optimizer/clauses.h"
+#include "optimizer/planner.h"
+#include "parser/parse_func.h"
+#include "parser/parsetree.h"
+#include "rewrite/rewriteManip.h"
+#include "utils/guc.h"
+#include "utils/lsyscache.h"
+#include "utils/rel.h"
+#include "utils/syscache.h"
+#include "access/htup_details.h"
+#if PG_VERSION_NUM >= 120000
+#include "access/table.h"
+#include "optimizer/optimizer.h"
+#include "utils/partcache.h"
+#else
+#include "optimizer/var.h"
+#endif
+
+static bool partition_pruning = true;
+
+#if PG_VERSION_NUM >= 100000
+
+static planner_hook_type prev_planner_hook = NULL;
+
+/* what we need to build the derived clauses for one period column */
+typedef struct
+{
+	Var *var;
+	Oid first_func;
+	Oid next_func;
+	List *derived;
+} PeriodBounds;
+
+/*
+ * If typid is our period type, return its namespace, else InvalidOid.
+ */
+static Oid
+partition_period_namespace(Oid typid)
+{
+	HeapTuple typtup;
+	Form_pg_type typform;
+	Oid result = InvalidOid;
+
+	typtup = SearchSysCache1(TYPEOID, ObjectIdGetDatum(typid));
+	if(!HeapTupleIsValid(typtup))
+		return InvalidOid;
+	typform = (Form_pg_type) GETSTRUCT(typtup);
+	if(strcmp(NameStr(typform->typname), "period") == 0)
+		result = typform->typnamespace;
+	ReleaseSysCache(typtup);
+	return result;
+}
+
+/*
+ * Is relid partitioned by an expression first(attno) or next(attno)?
+ */
+static bool
+partition_period_key(Oid relid, AttrNumber attno, Oid first_func, Oid next_func)
+{
+	Relation rel;
+	PartitionKey key;
+	ListCell *lc;
+	bool result = false;
+
+	if(get_rel_relkind(relid) != RELKIND_PARTITIONED_TABLE)
+		return false;
+
+	rel = relation_open(relid, NoLock);
+	key = RelationGetPartitionKey(rel);
+	foreach(lc, key->partexprs) {
+		FuncExpr *expr = (FuncExpr *) lfirst(lc);
+
+		if(IsA(expr, FuncExpr) &&
+		   (expr->funcid == first_func || expr->funcid == next_func) &&
+		   list_length(expr->args) == 1 && IsA(linitial(expr->args), Var) &&
+		   ((Var *) linitial(expr->args))->varattno == attno)
+			result = true;
+	}
+	relation_close(rel, NoLock);
+	return result;
+}
+
+/* Add the clause func(var) op bound */
+static void
+partition_bound(PeriodBounds *bounds, Oid func, const char *op, Expr *bound)
+{
+	Oid opno;
+	Expr *arg;
+
+	opno = OpernameGetOprid(list_make2(makeString("pg_catalog"), makeString((char *) op)),
+							TIMESTAMPTZOID, TIMESTAMPTZOID);
+	arg = (Expr *) makeFuncExpr(func, TIMESTAMPTZOID,
+								list_make1(copyObject(bounds->var)),
+								InvalidOid, InvalidOid, COERCE_EXPLICIT_CALL);
+	bounds->derived = lappend(bounds->derived,
+		make_opclause(opno, BOOLOID, false, arg, (Expr *) copyObject(bound),
+					  InvalidOid, InvalidOid));
+}
+
+static Expr *
+partition_timestamptz(TimestampTz ts)
+{
+	return (Expr *) makeConst(TIMESTAMPTZOID, -1, InvalidOid, sizeof(TimestampTz),
+							  TimestampTzGetDatum(ts), false, FLOAT8PASSBYVAL);
+}
+
+/*
+ * Derive the clauses implied by var op value, with var on the left.
+ * var is not empty, being part of the partition key.
+ */
+static void
+partition_derive_clause(PeriodBounds *bounds, const char *op, Node *value,
+						Oid valuetype)
+{
+	Oid first = bounds->first_func;
+	Oid next = bounds->next_func;
+
+	if(valuetype == TIMESTAMPTZOID) {
+		/* any expression without our Vars or volatility will do */
+		if(strcmp(op, "@>") != 0 || contain_var_clause(value) ||
+		   contain_volatile_functions(value) || checkExprHasSubLink(value))
+			return;
+		partition_bound(bounds, first, "<=", (Expr *) value);
+		partition_bound(bounds, next, ">", (Expr *) value);
+	} else {
+		/* but first() and next() of an empty period would be an error */
+		period *p;
+		Expr *pfirst, *pnext;
+
+		value = eval_const_expressions(NULL, value);
+		if(!IsA(value, Const) || ((Const *) value)->constisnull)
+			return;
+		p = (period *) DatumGetPointer(((Const *) value)->constvalue);
+		if(period_is_empty(p))
+			return;
+		pfirst = partition_timestamptz(p->first);
+		pnext = partition_timestamptz(p->next);
+
+		if(strcmp(op, "&&") == 0) {
+			partition_bound(bounds, first, "<", pnext);
+			partition_bound(bounds, next, ">", pfirst);
+		} else if(strcmp(op, "@>") == 0) {
+			partition_bound(bounds, first, "<=", pfirst);
+			partition_bound(bounds, next, ">=", pnext);
+		} else if(strcmp(op, "<@") == 0) {
+			partition_bound(bounds, first, ">=", pfirst);
+			partition_bound(bounds, first, "<", pnext);
+			partition_bound(bounds, next, ">", pfirst);
+			partition_bound(bounds, next, "<=", pnext);
+		} else if(strcmp(op, "<<") == 0) {
+			partition_bound(bounds, first, "<", pfirst);
+			partition_bound(bounds, next, "<=", pfirst);
+		} else if(strcmp(op, ">>") == 0) {
+			partition_bound(bounds, first, ">=", pnext);
+			partition_bound(bounds, next, ">", pnext);
+		}
+	}
+}
+
+/*
+ * If clause compares a period column of a table partitioned on its
+ * bounds with something else, add what it implies to *derived.
+ */
+static void
+partition_derive(Query *query, Node *clause, List **derived)
+{
+	OpExpr *opexpr = (OpExpr *) clause;
+	Node *left, *right;
+	Oid lefttype, righttype;
+	const char *op;
+	PeriodBounds bounds;
+	RangeTblEntry *rte;
+	Oid nsp;
+	Oid argtype;
+
+	if(!IsA(clause, OpExpr) || list_length(opexpr->args) != 2)
+		return;
+	left = linitial(opexpr->args);
+	right = lsecond(opexpr->args);
+	op = get_opname(opexpr->opno);
+	if(op == NULL)
+		return;
+	op_input_types(opexpr->opno, &lefttype, &righttype);
+
+	/* put the column on the left */
+	if(!(IsA(left, Var) && ((Var *) left)->varlevelsup == 0)) {
+		Node *tmp = left;
+		Oid tmptype = lefttype;
+
+		left = right;
+		right = tmp;
+		lefttype = righttype;
+		righttype = tmptype;
+		if(strcmp(op, "@>") == 0)
+			op = "<@";
+		else if(strcmp(op, "<@") == 0)
+			op = "@>";
+		else if(strcmp(op, "<<") == 0)
+			op = ">>";
+		else if(strcmp(op, ">>") == 0)
+			op = "<<";
+	}
+	if(!IsA(left, Var) || ((Var *) left)->varlevelsup != 0 ||
+	   ((Var *) left)->varattno <= 0)
+		return;
+
+	nsp = partition_period_namespace(lefttype);
+	if(!OidIsValid(nsp) || ((Var *) left)->vartype != lefttype)
+		return;
+	rte = rt_fetch(((Var *) left)->varno, query->rtable);
+	if(rte->rtekind != RTE_RELATION)
+		return;
+
+	argtype = lefttype;
+	bounds.var = (Var *) left;
+	bounds.first_func = LookupFuncName(list_make2(makeString(get_namespace_name(nsp)),
+		makeString("first")), 1, &argtype, true);
+	bounds.next_func = LookupFuncName(list_make2(makeString(get_namespace_name(nsp)),
+		makeString("next")), 1, &argtype, true);
+	bounds.derived = NIL;
+	if(!partition_period_key(rte->relid, bounds.var->varattno,
+							 bounds.first_func, bounds.next_func))
+		return;
+
+	partition_derive_clause(&bounds, op, right, righttype);
+	*derived = list_concat(*derived, bounds.derived);
+}
+
+static void
+partition_derive_query(Query *query)
+{
+	ListCell *lc;
+	List *conjuncts;
+	List *derived = NIL;
+
+	foreach(lc, query->cteList) {
+		CommonTableExpr *cte = (CommonTableExpr *) lfirst(lc);
+
+		if(IsA(cte->ctequery, Query))
+			partition_derive_query((Query *) cte->ctequery);
+	}
+	foreach(lc, query->rtable) {
+		RangeTblEntry *rte = (RangeTblEntry *) lfirst(lc);
+
+		if(rte->rtekind == RTE_SUBQUERY)
+			partition_derive_query(rte->subquery);
+	}
+
+	if(query->jointree == NULL || query->jointree->quals == NULL)
+		return;
+	conjuncts = make_ands_implicit((Expr *) query->jointree->quals);
+	foreach(lc, conjuncts)
+		partition_derive(query, (Node *) lfirst(lc), &derived);
+	if(derived != NIL)
+		query->jointree->quals = (Node *) make_ands_explicit(
+			list_concat(conjuncts, derived));
+}
+
+static PlannedStmt *
+partition_planner(Query *parse,
+#if PG_VERSION_NUM >= 130000
+				  const char *query_string,
+#endif
+				  int cursorOptions, ParamListInfo boundParams)
+{
+	if(partition_pruning)
+		partition_derive_query(parse);
+
+#if PG_VERSION_NUM >= 130000
+	if(prev_planner_hook)
+		return prev_planner_hook(parse, query_string, cursorOptions, boundParams);
+	return standard_planner(parse, query_string, cursorOptions, boundParams);
+#else
+	if(prev_planner_hook)
+		return prev_planner_hook(parse, cursorOptions, boundParams);
+	return standard_planner(parse, cursorOptions, boundParams);
+#endif
+}
+
+#endif
+
+void
+temporal_partition_init(void)
+{
+	DefineCustomBoolVariable("temporal.partition_pruning",
+							 "Derive clauses on first() and next() of period partition keys.",
+							 NULL, &partition_pruning, true, PGC_USERSET, 0,
+							 NULL, NULL, NULL);
+
+#if PG_VERSION_NUM >= 100000
+	prev_planner_hook = planner_hook;
+	planner_hook = partition_planner;
+#endif
+}
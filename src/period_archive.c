@@ -0,0 +1,486 @@
+/*
+ * period_archive.c
+ *   Implements the PERIOD_ARCHIVE data type, a compressed, read-only
+ *   collection of periods for cold history.
+ *
+ * The periods are sorted by period_compare() and split into blocks of
+ * PERIOD_ARCHIVE_BLOCK_SIZE. Each block has a fixed-size header with the
+ * smallest 'first' and the largest 'next' in the block, followed
+ * (after all the headers) by a byte stream holding each period's
+ * 'first' and length as zigzag varints of their delta-of-delta. A run
+ * of contiguous periods of equal length encodes as two zero bytes per
+ * period.
+ *
+ * Periods are decoded one block at a time by a PeriodArchiveIter, so
+ * nothing needs the whole collection expanded in memory, and searches
+ * skip any block whose header shows it can't match.
+ *
+ * Empty periods are not stored in the stream, only counted.
+ */
+
+#include "period.h"
+#include "funcapi.h"
+#include "utils/array.h"
+#include "utils/lsyscache.h"
+
+#define PERIOD_ARCHIVE_BLOCK_SIZE 128
+
+/* largest encoding of one period: two 64-bit varints */
+#define PERIOD_ARCHIVE_MAX_ENCODED 20
+
+typedef struct
+{
+	TimestampTz first;		/* 'first' of the block's first period */
+	TimestampTz max_next;	/* largest 'next' of any period in the block */
+	uint32 offset;			/* of the block's stream, from the start of it */
+	uint32 count;			/* number of periods in the block */
+} PeriodArchiveBlock;
+
+typedef struct
+{
+	int32 vl_len_;			/* varlena header (do not touch directly!) */
+	int32 nperiods;			/* number of non-empty periods */
+	int32 nempty;			/* number of empty periods */
+	int32 nblocks;
+	PeriodArchiveBlock blocks[1];	/* VARIABLE LENGTH ARRAY */
+	/* the byte stream follows the last block header */
+} PeriodArchive;
+
+#define PERIOD_ARCHIVE_HDRSZ offsetof(PeriodArchive, blocks)
+#define PERIOD_ARCHIVE_STREAM(a) ((unsigned char *) &(a)->blocks[(a)->nblocks])
+
+#define PG_GETARG_PERIOD_ARCHIVE(n) ((PeriodArchive *) PG_DETOAST_DATUM(PG_GETARG_DATUM(n)))
+
+/*
+ * Decoding state. All arithmetic is done in uint64, so that deltas
+ * involving infinite bounds wrap around and decode exactly.
+ */
+typedef struct
+{
+	PeriodArchive *archive;
+	int block;				/* current block */
+	uint32 remaining;		/* periods not yet decoded in the block */
+	unsigned char *ptr;		/* next byte of the stream */
+	uint64 first;
+	uint64 dfirst;
+	uint64 length;
+	uint64 dlength;
+} PeriodArchiveIter;
+
+static PeriodArchive *period_archive_build(period *periods, int n);
+static bool period_archive_search(PeriodArchive *archive, period *query,
+	bool contains);
+
+/************************************************
+ * Encoding
+ ************************************************/
+
+static unsigned char *
+varint_encode(unsigned char *ptr, uint64 v)
+{
+	while(v >= 0x80) {
+		*ptr++ = (unsigned char) (v | 0x80);
+		v >>= 7;
+	}
+	*ptr++ = (unsigned char) v;
+	return ptr;
+}
+
+static unsigned char *
+varint_decode(unsigned char *ptr, uint64 *v)
+{
+	uint64 result = 0;
+	int shift = 0;
+
+	while(*ptr & 0x80) {
+		result |= (uint64) (*ptr++ & 0x7F) << shift;
+		shift += 7;
+	}
+	result |= (uint64) *ptr++ << shift;
+	*v = result;
+	return ptr;
+}
+
+/* map small negative and positive deltas to small unsigned values */
+static uint64
+zigzag_encode(uint64 v)
+{
+	return (v << 1) ^ (uint64) ((int64) v >> 63);
+}
+
+static uint64
+zigzag_decode(uint64 v)
+{
+	return (v >> 1) ^ (~(v & 1) + 1);
+}
+
+static int
+period_archive_sort_compare(const void *a, const void *b)
+{
+	return period_compare((period *) a, (period *) b);
+}
+
+/*
+ * Build an archive from n periods. The array is sorted in place.
+ */
+static PeriodArchive *
+period_archive_build(period *periods, int n)
+{
+	PeriodArchive *archive;
+	unsigned char *start;
+	unsigned char *ptr;
+	int nempty = 0;
+	int nblocks;
+	int i, b;
+	Size maxsize;
+
+	qsort(periods, n, sizeof(period), period_archive_sort_compare);
+
+	/* empty periods sort first; count them and leave them out */
+	while(nempty < n && period_is_empty(&periods[nempty]))
+		nempty++;
+	periods += nempty;
+	n -= nempty;
+
+	nblocks = (n + PERIOD_ARCHIVE_BLOCK_SIZE - 1) / PERIOD_ARCHIVE_BLOCK_SIZE;
+	maxsize = PERIOD_ARCHIVE_HDRSZ + nblocks * sizeof(PeriodArchiveBlock) +
+		(Size) n * PERIOD_ARCHIVE_MAX_ENCODED;
+
+	archive = (PeriodArchive *) palloc0(maxsize);
+	archive->nperiods = n;
+	archive->nempty = nempty;
+	archive->nblocks = nblocks;
+
+	start = ptr = PERIOD_ARCHIVE_STREAM(archive);
+	for(b = 0; b < nblocks; b++) {
+		PeriodArchiveBlock *block = &archive->blocks[b];
+		int lo = b * PERIOD_ARCHIVE_BLOCK_SIZE;
+		int hi = Min(lo + PERIOD_ARCHIVE_BLOCK_SIZE, n);
+		uint64 first = (uint64) periods[lo].first;
+		uint64 dfirst = 0, length = 0, dlength = 0;
+
+		block->first = periods[lo].first;
+		block->max_next = periods[lo].next;
+		block->offset = ptr - start;
+		block->count = hi - lo;
+
+		for(i = lo; i < hi; i++) {
+			uint64 f = (uint64) periods[i].first;
+			uint64 l = (uint64) periods[i].next - f;
+
+			ptr = varint_encode(ptr, zigzag_encode((f - first) - dfirst));
+			ptr = varint_encode(ptr, zigzag_encode((l - length) - dlength));
+			dfirst = f - first;
+			first = f;
+			dlength = l - length;
+			length = l;
+
+			if(periods[i].next > block->max_next)
+				block->max_next = periods[i].next;
+		}
+	}
+
+	SET_VARSIZE(archive, ptr - (unsigned char *) archive);
+	return archive;
+}
+
+/************************************************
+ * Decoding
+ ************************************************/
+
+static void
+period_archive_iter_seek(PeriodArchiveIter *it, int block)
+{
+	PeriodArchiveBlock *b = &it->archive->blocks[block];
+
+	it->block = block;
+	it->remaining = b->count;
+	it->ptr = PERIOD_ARCHIVE_STREAM(it->archive) + b->offset;
+	it->first = (uint64) b->first;
+	it->dfirst = it->length = it->dlength = 0;
+}
+
+static void
+period_archive_iter_init(PeriodArchiveIter *it, PeriodArchive *archive)
+{
+	it->archive = archive;
+	if(archive->nblocks > 0)
+		period_archive_iter_seek(it, 0);
+	else {
+		it->block = 0;
+		it->remaining = 0;
+	}
+}
+
+/*
+ * Decode the next period of the current block into *p. Returns false
+ * at the end of the block; the caller decides whether to move on.
+ */
+static bool
+period_archive_iter_next_in_block(PeriodArchiveIter *it, period *p)
+{
+	uint64 v;
+
+	if(it->remaining == 0)
+		return false;
+
+	it->ptr = varint_decode(it->ptr, &v);
+	it->dfirst += zigzag_decode(v);
+	it->first += it->dfirst;
+	it->ptr = varint_decode(it->ptr, &v);
+	it->dlength += zigzag_decode(v);
+	it->length += it->dlength;
+	it->remaining--;
+
+	p->first = (TimestampTz) it->first;
+	p->next = (TimestampTz) (it->first + it->length);
+	return true;
+}
+
+/* Decode the next period of the archive into *p */
+static bool
+period_archive_iter_next(PeriodArchiveIter *it, period *p)
+{
+	while(!period_archive_iter_next_in_block(it, p)) {
+		if(it->block + 1 >= it->archive->nblocks)
+			return false;
+		period_archive_iter_seek(it, it->block + 1);
+	}
+	return true;
+}
+
+/*
+ * Does any period in the archive contain (or, if !contains, overlap)
+ * the query? Blocks are in order of 'first', so the scan stops at the
+ * first block that starts too late, and skips any block whose largest
+ * 'next' ends too early.
+ */
+static bool
+period_archive_search(PeriodArchive *archive, period *query, bool contains)
+{
+	PeriodArchiveIter it;
+	period p;
+	int b;
+
+	if(period_is_empty(query))
+		return contains && (archive->nperiods + archive->nempty > 0);
+
+	it.archive = archive;
+	for(b = 0; b < archive->nblocks; b++) {
+		PeriodArchiveBlock *block = &archive->blocks[b];
+
+		if(contains) {
+			if(block->first > query->first)
+				break;
+			if(block->max_next < query->next)
+				continue;
+		}
+		else {
+			if(block->first >= query->next)
+				break;
+			if(block->max_next <= query->first)
+				continue;
+		}
+
+		period_archive_iter_seek(&it, b);
+		while(period_archive_iter_next_in_block(&it, &p)) {
+			if(contains) {
+				if(p.first > query->first)
+					break;
+				if(period_contains(&p, query))
+					return true;
+			}
+			else {
+				if(p.first >= query->next)
+					break;
+				if(period_overlaps(&p, query))
+					return true;
+			}
+		}
+	}
+	return false;
+}
+
+/************************************************
+ * Input/output
+ ************************************************/
+
+PG_FUNCTION_INFO_V1(period_archive_in);
+Datum
+period_archive_in(PG_FUNCTION_ARGS)
+{
+	int n;
+	period *periods = period_parse_list(PG_GETARG_CSTRING(0),
+		"period_archive", &n);
+
+	PG_RETURN_POINTER(period_archive_build(periods, n));
+}
+
+PG_FUNCTION_INFO_V1(period_archive_out);
+Datum
+period_archive_out(PG_FUNCTION_ARGS)
+{
+	PeriodArchive *archive = PG_GETARG_PERIOD_ARCHIVE(0);
+	PeriodArchiveIter it;
+	StringInfoData buf;
+	period p;
+	int i;
+
+	initStringInfo(&buf);
+	appendStringInfoChar(&buf, '{');
+	for(i = 0; i < archive->nempty; i++)
+		appendStringInfo(&buf, "%s-EMPTY-", i ? ", " : "");
+
+	period_archive_iter_init(&it, archive);
+	while(period_archive_iter_next(&it, &p)) {
+		if(buf.len > 1)
+			appendStringInfoString(&buf, ", ");
+		appendStringInfoString(&buf, DatumGetCString(DirectFunctionCall1(
+			period_out, PointerGetDatum(&p))));
+	}
+	appendStringInfoChar(&buf, '}');
+
+	PG_RETURN_CSTRING(buf.data);
+}
+
+/************************************************
+ * Conversion to and from period[]
+ ************************************************/
+
+PG_FUNCTION_INFO_V1(period_archive_from_array);
+Datum
+period_archive_from_array(PG_FUNCTION_ARGS)
+{
+	ArrayType *array = PG_GETARG_ARRAYTYPE_P(0);
+	Datum *elems;
+	bool *nulls;
+	period *periods;
+	int n, i;
+
+	deconstruct_array(array, ARR_ELEMTYPE(array), sizeof(period), false, 'd',
+					  &elems, &nulls, &n);
+
+	periods = (period *) palloc(Max(n, 1) * sizeof(period));
+	for(i = 0; i < n; i++) {
+		if(nulls[i])
+			elog(ERROR,"period_archive cannot contain NULL periods");
+		period_copy((period *) DatumGetPointer(elems[i]), &periods[i]);
+	}
+
+	PG_RETURN_POINTER(period_archive_build(periods, n));
+}
+
+PG_FUNCTION_INFO_V1(period_archive_to_array);
+Datum
+period_archive_to_array(PG_FUNCTION_ARGS)
+{
+	PeriodArchive *archive = PG_GETARG_PERIOD_ARCHIVE(0);
+	Oid elemtype = get_element_type(get_fn_expr_rettype(fcinfo->flinfo));
+	int n = archive->nempty + archive->nperiods;
+	period *periods = (period *) palloc(Max(n, 1) * sizeof(period));
+	Datum *elems = (Datum *) palloc(Max(n, 1) * sizeof(Datum));
+	PeriodArchiveIter it;
+	int i;
+
+	if(!OidIsValid(elemtype))
+		elog(ERROR,"could not determine the element type of period[]");
+
+	for(i = 0; i < archive->nempty; i++)
+		period_empty_period(&periods[i]);
+	period_archive_iter_init(&it, archive);
+	for(; i < n && period_archive_iter_next(&it, &periods[i]); i++)
+		;
+
+	for(i = 0; i < n; i++)
+		elems[i] = PointerGetDatum(&periods[i]);
+
+	PG_RETURN_ARRAYTYPE_P(construct_array(elems, n, elemtype,
+										  sizeof(period), false, 'd'));
+}
+
+/************************************************
+ * Streaming access
+ ************************************************/
+
+typedef struct
+{
+	PeriodArchiveIter it;
+	int nempty;				/* empty periods still to be returned */
+} PeriodArchiveUnnestState;
+
+PG_FUNCTION_INFO_V1(period_archive_unnest);
+Datum
+period_archive_unnest(PG_FUNCTION_ARGS)
+{
+	FuncCallContext *funcctx;
+	PeriodArchiveUnnestState *state;
+	period *result;
+
+	if(SRF_IS_FIRSTCALL()) {
+		MemoryContext oldcontext;
+		PeriodArchive *archive;
+
+		funcctx = SRF_FIRSTCALL_INIT();
+		oldcontext = MemoryContextSwitchTo(funcctx->multi_call_memory_ctx);
+
+		/* detoast into the multi-call context, since we decode it lazily */
+		archive = PG_GETARG_PERIOD_ARCHIVE(0);
+		state = (PeriodArchiveUnnestState *) palloc(sizeof(PeriodArchiveUnnestState));
+		state->nempty = archive->nempty;
+		period_archive_iter_init(&state->it, archive);
+		funcctx->user_fctx = state;
+
+		MemoryContextSwitchTo(oldcontext);
+	}
+
+	funcctx = SRF_PERCALL_SETUP();
+	state = (PeriodArchiveUnnestState *) funcctx->user_fctx;
+
+	result = (period *) palloc(sizeof(period));
+	if(state->nempty > 0) {
+		state->nempty--;
+		SRF_RETURN_NEXT(funcctx, PointerGetDatum(period_empty_period(result)));
+	}
+	if(period_archive_iter_next(&state->it, result))
+		SRF_RETURN_NEXT(funcctx, PointerGetDatum(result));
+
+	SRF_RETURN_DONE(funcctx);
+}
+
+/************************************************
+ * BOOLEAN functions
+ ************************************************/
+
+PG_FUNCTION_INFO_V1(period_archive_contains);
+Datum
+period_archive_contains(PG_FUNCTION_ARGS)
+{
+	PeriodArchive *archive = PG_GETARG_PERIOD_ARCHIVE(0);
+	period *query = (period*)PG_GETARG_POINTER(1);
+
+	PG_RETURN_BOOL(period_archive_search(archive, query, true));
+}
+
+PG_FUNCTION_INFO_V1(period_archive_contains_timestamptz);
+Datum
+period_archive_contains_timestamptz(PG_FUNCTION_ARGS)
+{
+	PeriodArchive *archive = PG_GETARG_PERIOD_ARCHIVE(0);
+	TimestampTz arg = PG_GETARG_TIMESTAMPTZ(1);
+	period query;
+
+	query.first = arg;
+	query.next = next_timestamptz(arg);
+
+	PG_RETURN_BOOL(period_archive_search(archive, &query, true));
+}
+
+PG_FUNCTION_INFO_V1(period_archive_overlaps);
+Datum
+period_archive_overlaps(PG_FUNCTION_ARGS)
+{
+	PeriodArchive *archive = PG_GETARG_PERIOD_ARCHIVE(0);
+	period *query = (period*)PG_GETARG_POINTER(1);
+
+	PG_RETURN_BOOL(period_archive_search(archive, query, false));
+}
@@ -0,0 +1,452 @@
+/*
+ * period_array.c
+ *   Implements the operators between period[] and period, which are true
+ *   if some element of the array overlaps, contains or is contained by
+ *   the period, and the GiST operator class gist_period_array_ops for
+ *   period[] columns.
+ *
+ * An index key is itself a period[] of at most PERIOD_ARRAY_KEY_MAX
+ * sorted, disjoint periods bounding the elements below it, so a sparse
+ * array (opening hours, maintenance windows) isn't summarised by one
+ * period spanning every gap. An array is reduced to that many by merging
+ * its periods across the smallest gaps; an empty period is kept apart,
+ * first, when there is an empty element below, since it is contained by
+ * everything. Keys are lossy at the leaves too, so every match is
+ * rechecked against the array.
+ */
+
+#include "period.h"
+#include "utils/array.h"
+
+#define PERIOD_ARRAY_KEY_MAX 4
+
+/* strategies, numbered as in gist_period_ops */
+#define PERIOD_ARRAY_OVERLAPS 3
+#define PERIOD_ARRAY_CONTAINS 7
+#define PERIOD_ARRAY_CONTAINED_BY 8
+#define PERIOD_ARRAY_CONTAINS_TIMESTAMPTZ 27
+
+typedef struct
+{
+	TimestampTz gap;
+	int pos;
+} PeriodArrayGap;
+
+static int
+period_array_cmp_first(const void *a, const void *b)
+{
+	const period *pa = (const period *) a;
+	const period *pb = (const period *) b;
+
+	return pa->first < pb->first ? -1 : (pa->first > pb->first ? 1 : 0);
+}
+
+static int
+period_array_cmp_gap(const void *a, const void *b)
+{
+	const PeriodArrayGap *ga = (const PeriodArrayGap *) a;
+	const PeriodArrayGap *gb = (const PeriodArrayGap *) b;
+
+	/* widest first, then in order */
+	if(ga->gap != gb->gap)
+		return ga->gap > gb->gap ? -1 : 1;
+	return ga->pos - gb->pos;
+}
+
+static int
+period_array_cmp_pos(const void *a, const void *b)
+{
+	return ((const PeriodArrayGap *) a)->pos - ((const PeriodArrayGap *) b)->pos;
+}
+
+/*
+ * Reduce the n periods of ps, which has room for n + 1, to a key: at
+ * most PERIOD_ARRAY_KEY_MAX sorted, disjoint periods covering them, after
+ * an empty period if one of them is empty. Returns the length of the key.
+ */
+static int
+period_array_reduce(period *ps, int n)
+{
+	bool empty = false;
+	int m = 0;
+	int k, i;
+
+	for(i = 0; i < n; i++) {
+		if(period_is_empty(&ps[i]))
+			empty = true;
+		else
+			ps[m++] = ps[i];
+	}
+
+	/* merge the periods that overlap or meet */
+	qsort(ps, m, sizeof(period), period_array_cmp_first);
+	k = 0;
+	for(i = 0; i < m; i++) {
+		if(k > 0 && ps[i].first <= ps[k - 1].next) {
+			if(ps[i].next > ps[k - 1].next)
+				ps[k - 1].next = ps[i].next;
+		} else
+			ps[k++] = ps[i];
+	}
+
+	/* then keep only the widest gaps */
+	if(k > PERIOD_ARRAY_KEY_MAX) {
+		PeriodArrayGap *gaps = (PeriodArrayGap *) palloc((k - 1) * sizeof(PeriodArrayGap));
+		int j = 0;
+
+		for(i = 0; i < k - 1; i++) {
+			gaps[i].gap = ps[i + 1].first - ps[i].next;
+			gaps[i].pos = i;
+		}
+		qsort(gaps, k - 1, sizeof(PeriodArrayGap), period_array_cmp_gap);
+		qsort(gaps, PERIOD_ARRAY_KEY_MAX - 1, sizeof(PeriodArrayGap), period_array_cmp_pos);
+
+		/* each kept gap ends a run of periods merged into one */
+		for(i = 0; i < PERIOD_ARRAY_KEY_MAX; i++) {
+			int last = i < PERIOD_ARRAY_KEY_MAX - 1 ? gaps[i].pos : k - 1;
+			TimestampTz first = ps[j].first;
+
+			j = last + 1;
+			ps[i].first = first;
+			ps[i].next = ps[last].next;
+		}
+		pfree(gaps);
+		k = PERIOD_ARRAY_KEY_MAX;
+	}
+
+	if(empty) {
+		memmove(&ps[1], &ps[0], k * sizeof(period));
+		period_empty_period(&ps[0]);
+		k++;
+	}
+	return k;
+}
+
+/* The periods of a key, which has no NULLs */
+#define PERIOD_ARRAY_KEY(a) ((period *) ARR_DATA_PTR(a))
+#define PERIOD_ARRAY_KEY_LENGTH(a) ArrayGetNItems(ARR_NDIM(a), ARR_DIMS(a))
+
+static ArrayType *
+period_array_key(period *ps, int n, Oid elemtype)
+{
+	Datum *elems = (Datum *) palloc(Max(n, 1) * sizeof(Datum));
+	int i;
+
+	for(i = 0; i < n; i++)
+		elems[i] = PointerGetDatum(&ps[i]);
+	return construct_array(elems, n, elemtype, sizeof(period), false, 'd');
+}
+
+/*
+ * The non-NULL elements of array, with room for one more.
+ */
+static period *
+period_array_elements(ArrayType *array, int *n)
+{
+	Datum *elems;
+	bool *nulls;
+	period *ps;
+	int nelems, i;
+
+	deconstruct_array(array, ARR_ELEMTYPE(array), sizeof(period), false, 'd',
+					  &elems, &nulls, &nelems);
+	ps = (period *) palloc((nelems + 1) * sizeof(period));
+	*n = 0;
+	for(i = 0; i < nelems; i++)
+		if(!nulls[i])
+			ps[(*n)++] = *(period *) DatumGetPointer(elems[i]);
+	return ps;
+}
+
+/*
+ * Does some period of ps answer query for strategy? With exact, ps are
+ * the elements, otherwise a key covering them.
+ */
+static bool
+period_array_match(period *ps, int n, period *query, StrategyNumber strategy, bool exact)
+{
+	int i;
+
+	for(i = 0; i < n; i++) {
+		switch(strategy) {
+		case PERIOD_ARRAY_OVERLAPS:
+			if(period_overlaps(&ps[i], query))
+				return true;
+			break;
+		case PERIOD_ARRAY_CONTAINS:
+		case PERIOD_ARRAY_CONTAINS_TIMESTAMPTZ:
+			if(period_contains(&ps[i], query))
+				return true;
+			break;
+		case PERIOD_ARRAY_CONTAINED_BY:
+			if(exact ? period_contains(query, &ps[i]) :
+			   period_is_empty(&ps[i]) || period_overlaps(&ps[i], query))
+				return true;
+			break;
+		default:
+			elog(ERROR,"gist_period_array_consistent: unknown strategy %d", strategy);
+		}
+	}
+	return false;
+}
+
+/************************************************
+ * BOOLEAN functions
+ ************************************************/
+
+#define PERIOD_ARRAY_OPERATOR(name, strategy) \
+PG_FUNCTION_INFO_V1(name); \
+Datum \
+name(PG_FUNCTION_ARGS) \
+{ \
+	int n; \
+	period *ps = period_array_elements(PG_GETARG_ARRAYTYPE_P(0), &n); \
+	PG_RETURN_BOOL(period_array_match(ps, n, (period*)PG_GETARG_POINTER(1), strategy, true)); \
+}
+
+PERIOD_ARRAY_OPERATOR(period_array_overlaps, PERIOD_ARRAY_OVERLAPS)
+PERIOD_ARRAY_OPERATOR(period_array_contains, PERIOD_ARRAY_CONTAINS)
+PERIOD_ARRAY_OPERATOR(period_array_contained_by, PERIOD_ARRAY_CONTAINED_BY)
+
+PG_FUNCTION_INFO_V1(period_array_contains_timestamptz);
+Datum
+period_array_contains_timestamptz(PG_FUNCTION_ARGS)
+{
+	TimestampTz ts = PG_GETARG_TIMESTAMPTZ(1);
+	period query;
+	period *ps;
+	int n;
+
+	query.first = ts;
+	query.next = next_timestamptz(ts);
+	ps = period_array_elements(PG_GETARG_ARRAYTYPE_P(0), &n);
+	PG_RETURN_BOOL(period_array_match(ps, n, &query, PERIOD_ARRAY_CONTAINS, true));
+}
+
+/************************************************
+ * GiST support functions
+ ************************************************/
+
+PG_FUNCTION_INFO_V1(gist_period_array_consistent);
+Datum
+gist_period_array_consistent(PG_FUNCTION_ARGS)
+{
+	GISTENTRY *entry = (GISTENTRY*) PG_GETARG_POINTER(0);
+	ArrayType *key = DatumGetArrayTypeP(entry->key);
+	StrategyNumber strategy = (StrategyNumber) PG_GETARG_UINT16(2);
+	bool *recheck = (bool *) PG_GETARG_POINTER(4);
+	period query;
+
+	if(strategy == PERIOD_ARRAY_CONTAINS_TIMESTAMPTZ) {
+		query.first = PG_GETARG_TIMESTAMPTZ(1);
+		query.next = next_timestamptz(query.first);
+	} else
+		query = *(period*)PG_GETARG_POINTER(1);
+
+	*recheck = true;
+	PG_RETURN_BOOL(period_array_match(PERIOD_ARRAY_KEY(key), PERIOD_ARRAY_KEY_LENGTH(key),
+									  &query, strategy, false));
+}
+
+/*
+ * Reduce each array to its key, and pass internal keys through.
+ */
+PG_FUNCTION_INFO_V1(gist_period_array_compress);
+Datum
+gist_period_array_compress(PG_FUNCTION_ARGS)
+{
+	GISTENTRY *entry = (GISTENTRY*) PG_GETARG_POINTER(0);
+	GISTENTRY *result;
+	ArrayType *array;
+	period *ps;
+	int n;
+
+	if(!entry->leafkey)
+		PG_RETURN_POINTER(entry);
+
+	array = DatumGetArrayTypeP(entry->key);
+	ps = period_array_elements(array, &n);
+	n = period_array_reduce(ps, n);
+
+	result = (GISTENTRY *) palloc(sizeof(GISTENTRY));
+	gistentryinit(*result, PointerGetDatum(period_array_key(ps, n, ARR_ELEMTYPE(array))),
+				  entry->rel, entry->page, entry->offset, false);
+	PG_RETURN_POINTER(result);
+}
+
+/*
+ * Detoast the key, which may have been stored with a short header, so
+ * its periods can be read in place.
+ */
+PG_FUNCTION_INFO_V1(gist_period_array_decompress);
+Datum
+gist_period_array_decompress(PG_FUNCTION_ARGS)
+{
+	GISTENTRY *entry = (GISTENTRY*) PG_GETARG_POINTER(0);
+	GISTENTRY *result;
+	ArrayType *key = DatumGetArrayTypeP(entry->key);
+
+	if(PointerGetDatum(key) == entry->key)
+		PG_RETURN_POINTER(entry);
+
+	result = (GISTENTRY *) palloc(sizeof(GISTENTRY));
+	gistentryinit(*result, PointerGetDatum(key), entry->rel, entry->page, entry->offset,
+				  false);
+	PG_RETURN_POINTER(result);
+}
+
+/* The keys of entries from..to (inclusive) reduced to one */
+static ArrayType *
+gist_period_array_union_keys(GISTENTRY *entries, int from, int to)
+{
+	ArrayType *key = DatumGetArrayTypeP(entries[from].key);
+	period *ps;
+	int n = 0;
+	int i;
+
+	for(i = from; i <= to; i++)
+		n += PERIOD_ARRAY_KEY_LENGTH(DatumGetArrayTypeP(entries[i].key));
+	ps = (period *) palloc((n + 1) * sizeof(period));
+	n = 0;
+	for(i = from; i <= to; i++) {
+		ArrayType *k = DatumGetArrayTypeP(entries[i].key);
+		int len = PERIOD_ARRAY_KEY_LENGTH(k);
+
+		memcpy(&ps[n], PERIOD_ARRAY_KEY(k), len * sizeof(period));
+		n += len;
+	}
+	n = period_array_reduce(ps, n);
+	return period_array_key(ps, n, ARR_ELEMTYPE(key));
+}
+
+PG_FUNCTION_INFO_V1(gist_period_array_union);
+Datum
+gist_period_array_union(PG_FUNCTION_ARGS)
+{
+	GistEntryVector *entries = (GistEntryVector*) PG_GETARG_POINTER(0);
+	int *size = (int*) PG_GETARG_POINTER(1);
+	ArrayType *result = gist_period_array_union_keys(entries->vector, 0, entries->n - 1);
+
+	*size = VARSIZE(result);
+	PG_RETURN_POINTER(result);
+}
+
+/* The total length of a key's periods, divided by 10ish to avoid overflow */
+static double
+period_array_key_size(period *ps, int n)
+{
+	double size = 0;
+	int i;
+
+	for(i = 0; i < n; i++)
+		size += (double) (ps[i].next / 10) - (double) (ps[i].first / 10);
+	return size;
+}
+
+/*
+ * The growth of the time the key covers.
+ */
+PG_FUNCTION_INFO_V1(gist_period_array_penalty);
+Datum
+gist_period_array_penalty(PG_FUNCTION_ARGS)
+{
+	ArrayType *orig = DatumGetArrayTypeP(((GISTENTRY *) PG_GETARG_POINTER(0))->key);
+	ArrayType *new = DatumGetArrayTypeP(((GISTENTRY *) PG_GETARG_POINTER(1))->key);
+	float *penalty = (float *) PG_GETARG_POINTER(2);
+	int norig = PERIOD_ARRAY_KEY_LENGTH(orig);
+	int nnew = PERIOD_ARRAY_KEY_LENGTH(new);
+	period *ps = (period *) palloc((norig + nnew + 1) * sizeof(period));
+	int n;
+
+	memcpy(ps, PERIOD_ARRAY_KEY(orig), norig * sizeof(period));
+	memcpy(&ps[norig], PERIOD_ARRAY_KEY(new), nnew * sizeof(period));
+	n = period_array_reduce(ps, norig + nnew);
+
+	*penalty = (float) (period_array_key_size(ps, n) -
+						period_array_key_size(PERIOD_ARRAY_KEY(orig), norig));
+	pfree(ps);
+	PG_RETURN_POINTER(penalty);
+}
+
+typedef struct
+{
+	TimestampTz first;		/* of the key's first non-empty period */
+	OffsetNumber pos;
+} PeriodArraySort;
+
+static int
+period_array_cmp_sort(const void *a, const void *b)
+{
+	const PeriodArraySort *sa = (const PeriodArraySort *) a;
+	const PeriodArraySort *sb = (const PeriodArraySort *) b;
+
+	return sa->first < sb->first ? -1 : (sa->first > sb->first ? 1 : 0);
+}
+
+/*
+ * Split the keys in half by where they start, keys without a non-empty
+ * period first.
+ */
+PG_FUNCTION_INFO_V1(gist_period_array_picksplit);
+Datum
+gist_period_array_picksplit(PG_FUNCTION_ARGS)
+{
+	GistEntryVector *entryvec = (GistEntryVector *) PG_GETARG_POINTER(0);
+	GIST_SPLITVEC *v = (GIST_SPLITVEC *) PG_GETARG_POINTER(1);
+	OffsetNumber maxoff = entryvec->n - 1;
+	int nentries = maxoff - FirstOffsetNumber + 1;
+	PeriodArraySort *sorted = (PeriodArraySort *) palloc(nentries * sizeof(PeriodArraySort));
+	GISTENTRY *ordered = (GISTENTRY *) palloc(nentries * sizeof(GISTENTRY));
+	OffsetNumber i;
+	int half;
+
+	for(i = FirstOffsetNumber; i <= maxoff; i = OffsetNumberNext(i)) {
+		ArrayType *key = DatumGetArrayTypeP(entryvec->vector[i].key);
+		period *ps = PERIOD_ARRAY_KEY(key);
+		int n = PERIOD_ARRAY_KEY_LENGTH(key);
+		PeriodArraySort *s = &sorted[i - FirstOffsetNumber];
+
+		TIMESTAMP_NOBEGIN(s->first);
+		if(n > 0 && period_is_empty(&ps[0])) {
+			ps++;
+			n--;
+		}
+		if(n > 0)
+			s->first = ps[0].first;
+		s->pos = i;
+	}
+	qsort(sorted, nentries, sizeof(PeriodArraySort), period_array_cmp_sort);
+
+	half = nentries / 2;
+	v->spl_left = (OffsetNumber *) palloc(nentries * sizeof(OffsetNumber));
+	v->spl_right = (OffsetNumber *) palloc(nentries * sizeof(OffsetNumber));
+	v->spl_nleft = v->spl_nright = 0;
+	for(i = 0; i < nentries; i++) {
+		ordered[i] = entryvec->vector[sorted[i].pos];
+		if(i < half)
+			v->spl_left[v->spl_nleft++] = sorted[i].pos;
+		else
+			v->spl_right[v->spl_nright++] = sorted[i].pos;
+	}
+
+	v->spl_ldatum = PointerGetDatum(gist_period_array_union_keys(ordered, 0, half - 1));
+	v->spl_rdatum = PointerGetDatum(gist_period_array_union_keys(ordered, half, nentries - 1));
+
+	pfree(sorted);
+	pfree(ordered);
+	PG_RETURN_POINTER(v);
+}
+
+PG_FUNCTION_INFO_V1(gist_period_array_same);
+Datum
+gist_period_array_same(PG_FUNCTION_ARGS)
+{
+	ArrayType *a = PG_GETARG_ARRAYTYPE_P(0);
+	ArrayType *b = PG_GETARG_ARRAYTYPE_P(1);
+	bool *result = (bool *) PG_GETARG_POINTER(2);
+	int n = PERIOD_ARRAY_KEY_LENGTH(a);
+
+	*result = n == PERIOD_ARRAY_KEY_LENGTH(b) &&
+		memcmp(PERIOD_ARRAY_KEY(a), PERIOD_ARRAY_KEY(b), n * sizeof(period)) == 0;
+	PG_RETURN_POINTER(result);
+}
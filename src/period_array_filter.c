@@ -0,0 +1,334 @@
+/*
+ * period_array_filter.c
+ *   Implements period_array_filter and period_array_count, which test
+ *   every element of a period[] against one period in a batch.
+ *
+ * Testing a large unsorted array element by element from SQL costs a
+ * function call per element. These read the elements straight from the
+ * array, and on x86-64 compare several at once: the firsts and nexts of
+ * a few periods are gathered into one vector each, and compared with
+ * the query's as 64-bit integers, four periods at a time with AVX2 or
+ * two with SSE4.2, whichever the CPU has. Each answer is the same as
+ * period_overlaps or period_contains on the element, which the scalar
+ * path, used for the tail and elsewhere, calls directly.
+ *
+ * The vector paths need integer timestamps, and a compiler that can
+ * build functions for an instruction set the rest of the module isn't
+ * built for (GCC or Clang).
+ */
+
+#include "period.h"
+#include "catalog/pg_type.h"
+#include "utils/array.h"
+
+#if defined(__x86_64__) && defined(__GNUC__) && defined(HAVE_INT64_TIMESTAMP)
+#define PERIOD_ARRAY_SIMD
+#include <immintrin.h>
+#endif
+
+/* the operators, as in e op query for each element e */
+typedef enum
+{
+	PERIOD_ARRAY_OP_OVERLAPS,		/* && */
+	PERIOD_ARRAY_OP_CONTAINS,		/* @> */
+	PERIOD_ARRAY_OP_CONTAINED_BY	/* <@ */
+} PeriodArrayOp;
+
+/*
+ * Test the n periods of ps against query, setting matches[i], if
+ * matches isn't NULL, and returning how many match.
+ */
+typedef int (*PeriodArrayKernel)(const period *ps, int n, period *query,
+								 PeriodArrayOp op, bool *matches);
+
+static PeriodArrayKernel period_array_kernel = NULL;
+
+static inline bool
+period_array_test(const period *p, period *query, PeriodArrayOp op)
+{
+	switch(op) {
+	case PERIOD_ARRAY_OP_OVERLAPS:
+		return period_overlaps((period *) p, query);
+	case PERIOD_ARRAY_OP_CONTAINS:
+		return period_contains((period *) p, query);
+	case PERIOD_ARRAY_OP_CONTAINED_BY:
+		return period_contains(query, (period *) p);
+	}
+	return false;
+}
+
+static int
+period_array_kernel_scalar(const period *ps, int n, period *query,
+						   PeriodArrayOp op, bool *matches)
+{
+	int count = 0;
+	int i;
+
+	for(i = 0; i < n; i++) {
+		bool match = period_array_test(&ps[i], query, op);
+
+		if(matches != NULL)
+			matches[i] = match;
+		count += match;
+	}
+	return count;
+}
+
+#ifdef PERIOD_ARRAY_SIMD
+
+/*
+ * In each, firsts and nexts hold the elements' bounds, lane by lane,
+ * and the result has all bits set in the lanes that match. For the
+ * empty period [0,0), && is false and <@ is true. @> needs no test for
+ * it: an empty element contains only an empty query, which is answered
+ * before the elements are looked at.
+ */
+
+__attribute__((target("avx2")))
+static inline __m256i
+period_array_match_avx2(__m256i firsts, __m256i nexts, __m256i qfirst,
+						__m256i qnext, PeriodArrayOp op)
+{
+	__m256i zero = _mm256_setzero_si256();
+	__m256i empty = _mm256_and_si256(_mm256_cmpeq_epi64(firsts, zero),
+									 _mm256_cmpeq_epi64(nexts, zero));
+
+	switch(op) {
+	case PERIOD_ARRAY_OP_OVERLAPS:
+		/* first < qnext && qfirst < next, and not empty */
+		return _mm256_andnot_si256(empty,
+			_mm256_and_si256(_mm256_cmpgt_epi64(qnext, firsts),
+							 _mm256_cmpgt_epi64(nexts, qfirst)));
+	case PERIOD_ARRAY_OP_CONTAINS:
+		/* not (first > qfirst || qnext > next) */
+		return _mm256_xor_si256(_mm256_cmpeq_epi64(zero, zero),
+			_mm256_or_si256(_mm256_cmpgt_epi64(firsts, qfirst),
+							_mm256_cmpgt_epi64(qnext, nexts)));
+	case PERIOD_ARRAY_OP_CONTAINED_BY:
+		/* empty, or not (qfirst > first || next > qnext) */
+		return _mm256_or_si256(empty,
+			_mm256_xor_si256(_mm256_cmpeq_epi64(zero, zero),
+				_mm256_or_si256(_mm256_cmpgt_epi64(qfirst, firsts),
+								_mm256_cmpgt_epi64(nexts, qnext))));
+	}
+	return zero;
+}
+
+__attribute__((target("avx2")))
+static int
+period_array_kernel_avx2(const period *ps, int n, period *query,
+						 PeriodArrayOp op, bool *matches)
+{
+	__m256i qfirst = _mm256_set1_epi64x(query->first);
+	__m256i qnext = _mm256_set1_epi64x(query->next);
+	int count = 0;
+	int i;
+
+	for(i = 0; i + 4 <= n; i += 4) {
+		/* a = f0 n0 f1 n1, b = f2 n2 f3 n3, so the lanes are 0 2 1 3 */
+		__m256i a = _mm256_loadu_si256((const __m256i *) &ps[i]);
+		__m256i b = _mm256_loadu_si256((const __m256i *) &ps[i + 2]);
+		__m256i match = period_array_match_avx2(_mm256_unpacklo_epi64(a, b),
+												_mm256_unpackhi_epi64(a, b),
+												qfirst, qnext, op);
+		int mask = _mm256_movemask_pd(_mm256_castsi256_pd(match));
+
+		count += __builtin_popcount(mask);
+		if(matches != NULL) {
+			matches[i] = mask & 1;
+			matches[i + 1] = (mask >> 2) & 1;
+			matches[i + 2] = (mask >> 1) & 1;
+			matches[i + 3] = (mask >> 3) & 1;
+		}
+	}
+	return count + period_array_kernel_scalar(&ps[i], n - i, query, op,
+											  matches != NULL ? &matches[i] : NULL);
+}
+
+__attribute__((target("sse4.2")))
+static inline __m128i
+period_array_match_sse42(__m128i firsts, __m128i nexts, __m128i qfirst,
+						 __m128i qnext, PeriodArrayOp op)
+{
+	__m128i zero = _mm_setzero_si128();
+	__m128i empty = _mm_and_si128(_mm_cmpeq_epi64(firsts, zero),
+								  _mm_cmpeq_epi64(nexts, zero));
+
+	switch(op) {
+	case PERIOD_ARRAY_OP_OVERLAPS:
+		return _mm_andnot_si128(empty,
+			_mm_and_si128(_mm_cmpgt_epi64(qnext, firsts),
+						  _mm_cmpgt_epi64(nexts, qfirst)));
+	case PERIOD_ARRAY_OP_CONTAINS:
+		return _mm_xor_si128(_mm_cmpeq_epi64(zero, zero),
+			_mm_or_si128(_mm_cmpgt_epi64(firsts, qfirst),
+						 _mm_cmpgt_epi64(qnext, nexts)));
+	case PERIOD_ARRAY_OP_CONTAINED_BY:
+		return _mm_or_si128(empty,
+			_mm_xor_si128(_mm_cmpeq_epi64(zero, zero),
+				_mm_or_si128(_mm_cmpgt_epi64(qfirst, firsts),
+							 _mm_cmpgt_epi64(nexts, qnext))));
+	}
+	return zero;
+}
+
+__attribute__((target("sse4.2")))
+static int
+period_array_kernel_sse42(const period *ps, int n, period *query,
+						  PeriodArrayOp op, bool *matches)
+{
+	__m128i qfirst = _mm_set1_epi64x(query->first);
+	__m128i qnext = _mm_set1_epi64x(query->next);
+	int count = 0;
+	int i;
+
+	for(i = 0; i + 2 <= n; i += 2) {
+		__m128i a = _mm_loadu_si128((const __m128i *) &ps[i]);
+		__m128i b = _mm_loadu_si128((const __m128i *) &ps[i + 1]);
+		__m128i match = period_array_match_sse42(_mm_unpacklo_epi64(a, b),
+												 _mm_unpackhi_epi64(a, b),
+												 qfirst, qnext, op);
+		int mask = _mm_movemask_pd(_mm_castsi128_pd(match));
+
+		count += (mask & 1) + (mask >> 1);
+		if(matches != NULL) {
+			matches[i] = mask & 1;
+			matches[i + 1] = mask >> 1;
+		}
+	}
+	return count + period_array_kernel_scalar(&ps[i], n - i, query, op,
+											  matches != NULL ? &matches[i] : NULL);
+}
+
+#endif	/* PERIOD_ARRAY_SIMD */
+
+/* The widest kernel this CPU can run, chosen on first use */
+static PeriodArrayKernel
+period_array_choose_kernel(void)
+{
+#ifdef PERIOD_ARRAY_SIMD
+	__builtin_cpu_init();
+	if(__builtin_cpu_supports("avx2"))
+		return period_array_kernel_avx2;
+	if(__builtin_cpu_supports("sse4.2"))
+		return period_array_kernel_sse42;
+#endif
+	return period_array_kernel_scalar;
+}
+
+static PeriodArrayOp
+period_array_op(const char *fname, text *op)
+{
+	char *name = text_to_cstring(op);
+
+	if(strcmp(name, "&&") == 0)
+		return PERIOD_ARRAY_OP_OVERLAPS;
+	if(strcmp(name, "@>") == 0)
+		return PERIOD_ARRAY_OP_CONTAINS;
+	if(strcmp(name, "<@") == 0)
+		return PERIOD_ARRAY_OP_CONTAINED_BY;
+	elog(ERROR,"%s: operator must be &&, @> or <@, not \"%s\"", fname, name);
+	return PERIOD_ARRAY_OP_OVERLAPS;
+}
+
+/*
+ * The non-NULL elements of array, in place if it has no NULLs, and, if
+ * it has, their positions, counting from 1 in storage order.
+ */
+static const period *
+period_array_batch(ArrayType *array, int *n, int **positions)
+{
+	int nitems = ArrayGetNItems(ARR_NDIM(array), ARR_DIMS(array));
+	bits8 *bitmap = ARR_NULLBITMAP(array);
+	const period *data = (const period *) ARR_DATA_PTR(array);
+	period *ps;
+	int i;
+
+	*positions = NULL;
+	*n = nitems;
+	if(bitmap == NULL)
+		return data;
+
+	ps = (period *) palloc(Max(nitems, 1) * sizeof(period));
+	*positions = (int *) palloc(Max(nitems, 1) * sizeof(int));
+	*n = 0;
+	for(i = 0; i < nitems; i++) {
+		if(bitmap[i / 8] & (1 << (i % 8))) {
+			ps[*n] = *data++;
+			(*positions)[*n] = i + 1;
+			(*n)++;
+		}
+	}
+	return ps;
+}
+
+/*
+ * Test the elements of array against query. Answers for an empty query
+ * without looking at them: it overlaps nothing, and is contained by
+ * everything.
+ */
+static int
+period_array_run(const period *ps, int n, period *query, PeriodArrayOp op,
+				 bool *matches)
+{
+	if(period_is_empty(query) && op != PERIOD_ARRAY_OP_CONTAINED_BY) {
+		bool match = op == PERIOD_ARRAY_OP_CONTAINS;
+
+		if(matches != NULL)
+			memset(matches, match, n * sizeof(bool));
+		return match ? n : 0;
+	}
+	if(period_array_kernel == NULL)
+		period_array_kernel = period_array_choose_kernel();
+	return period_array_kernel(ps, n, query, op, matches);
+}
+
+/*
+ * period_array_filter(array, query, op)
+ *
+ * Returns the positions in array, from 1, of the elements e for which
+ * e op query holds, op being &&, @> or <@. NULL elements match nothing.
+ */
+PG_FUNCTION_INFO_V1(period_array_filter);
+Datum
+period_array_filter(PG_FUNCTION_ARGS)
+{
+	ArrayType *array = PG_GETARG_ARRAYTYPE_P(0);
+	period *query = (period *) PG_GETARG_POINTER(1);
+	PeriodArrayOp op = period_array_op("period_array_filter", PG_GETARG_TEXT_PP(2));
+	const period *ps;
+	int *positions;
+	bool *matches;
+	Datum *result;
+	int n, count, i, j;
+
+	ps = period_array_batch(array, &n, &positions);
+	matches = (bool *) palloc(Max(n, 1) * sizeof(bool));
+	count = period_array_run(ps, n, query, op, matches);
+
+	result = (Datum *) palloc(Max(count, 1) * sizeof(Datum));
+	for(i = 0, j = 0; i < n; i++)
+		if(matches[i])
+			result[j++] = Int32GetDatum(positions != NULL ? positions[i] : i + 1);
+	PG_RETURN_ARRAYTYPE_P(construct_array(result, count, INT4OID, sizeof(int32), true, 'i'));
+}
+
+/*
+ * period_array_count(array, query, op)
+ *
+ * Returns how many elements e of array e op query holds for.
+ */
+PG_FUNCTION_INFO_V1(period_array_count);
+Datum
+period_array_count(PG_FUNCTION_ARGS)
+{
+	ArrayType *array = PG_GETARG_ARRAYTYPE_P(0);
+	period *query = (period *) PG_GETARG_POINTER(1);
+	PeriodArrayOp op = period_array_op("period_array_count", PG_GETARG_TEXT_PP(2));
+	const period *ps;
+	int *positions;
+	int n;
+
+	ps = period_array_batch(array, &n, &positions);
+	PG_RETURN_INT32(period_array_run(ps, n, query, op, NULL));
+}
@@ -0,0 +1,541 @@
+/*
+ * period_coverage.c
+ *   Implements the PERIOD_COVERAGE data type, a bitmap of which
+ *   fixed-length buckets of a window of time some period touches.
+ *
+ * A coverage has a window, a resolution and a bit per bucket of that
+ * length from the start of the window; the last bucket may run past its
+ * end. Adding a period sets the bits of every bucket it touches, a word
+ * at a time, and the searches mask and test whole words. Since a bucket
+ * is set when any part of it is covered, && and @> against a coverage
+ * can be true when the periods it summarises don't overlap or contain
+ * the argument, but never false when they do: the coverage is a
+ * prefilter to put in front of the exact test, for periods inside the
+ * window: nothing is recorded outside it.
+ *
+ * Coverages of the same window and resolution can be combined and
+ * compared with each other, so they can be kept per key in a rollup
+ * table.
+ */
+
+#include "period.h"
+#include "funcapi.h"
+#include "lib/stringinfo.h"
+#if PG_VERSION_NUM >= 120000
+#include "port/pg_bitutils.h"
+#endif
+
+/* 2 MB of bitmap */
+#define COVERAGE_MAX_BUCKETS (1 << 24)
+
+typedef struct
+{
+	int32 vl_len_;			/* varlena header (do not touch directly!) */
+	int32 nbuckets;
+	TimestampTz first;		/* the window */
+	TimestampTz next;
+	TimestampTz resolution;	/* the length of a bucket */
+	uint64 words[1];		/* VARIABLE LENGTH ARRAY, bucket i is bit i % 64 of word i / 64 */
+} PeriodCoverage;
+
+#define COVERAGE_HDRSZ offsetof(PeriodCoverage, words)
+#define COVERAGE_NWORDS(n) (((n) + 63) / 64)
+#define COVERAGE_SIZE(n) (COVERAGE_HDRSZ + COVERAGE_NWORDS(n) * sizeof(uint64))
+
+#define PG_GETARG_PERIOD_COVERAGE(n) ((PeriodCoverage *) PG_DETOAST_DATUM(PG_GETARG_DATUM(n)))
+
+#if PG_VERSION_NUM >= 120000
+#define coverage_popcount(w) pg_popcount64(w)
+#else
+static int
+coverage_popcount(uint64 w)
+{
+	w = w - ((w >> 1) & UINT64CONST(0x5555555555555555));
+	w = (w & UINT64CONST(0x3333333333333333)) + ((w >> 2) & UINT64CONST(0x3333333333333333));
+	w = (w + (w >> 4)) & UINT64CONST(0x0F0F0F0F0F0F0F0F);
+	return (int) ((w * UINT64CONST(0x0101010101010101)) >> 56);
+}
+#endif
+
+/************************************************
+ * Buckets
+ ************************************************/
+
+static PeriodCoverage *
+coverage_new(period *window, TimestampTz resolution)
+{
+	PeriodCoverage *coverage;
+	TimestampTz length;
+	int64 nbuckets;
+
+	if(period_is_empty(window) || TIMESTAMP_NOT_FINITE(window->first) ||
+	   TIMESTAMP_NOT_FINITE(window->next))
+		elog(ERROR,"period_coverage: the window must be finite and not empty");
+	if(resolution <= 0)
+		elog(ERROR,"period_coverage: the resolution must be positive");
+
+	length = window->next - window->first;
+	nbuckets = (int64) (length / resolution);
+	if(nbuckets * resolution < length)
+		nbuckets++;
+	if(nbuckets > COVERAGE_MAX_BUCKETS)
+		elog(ERROR,"period_coverage: more than %d buckets", COVERAGE_MAX_BUCKETS);
+
+	coverage = (PeriodCoverage *) palloc0(COVERAGE_SIZE(nbuckets));
+	SET_VARSIZE(coverage, COVERAGE_SIZE(nbuckets));
+	coverage->nbuckets = (int32) nbuckets;
+	coverage->first = window->first;
+	coverage->next = window->next;
+	coverage->resolution = resolution;
+	return coverage;
+}
+
+/*
+ * The buckets [*lo, *hi) that p touches within the window. Returns false
+ * if there are none.
+ */
+static bool
+coverage_buckets(PeriodCoverage *coverage, period *p, int64 *lo, int64 *hi)
+{
+	TimestampTz first, next;
+
+	if(period_is_empty(p))
+		return false;
+	first = Max(p->first, coverage->first);
+	next = Min(p->next, coverage->next);
+	if(first >= next)
+		return false;
+
+	*lo = (int64) ((first - coverage->first) / coverage->resolution);
+	*hi = (int64) ((next - coverage->first) / coverage->resolution);
+	if(coverage->first + *hi * coverage->resolution < next)
+		(*hi)++;
+	return true;
+}
+
+/* the bits of word w within buckets [lo, hi) */
+static uint64
+coverage_mask(int64 w, int64 lo, int64 hi)
+{
+	uint64 mask = ~UINT64CONST(0);
+
+	if(w == lo / 64)
+		mask &= ~UINT64CONST(0) << (lo % 64);
+	if(w == (hi - 1) / 64)
+		mask &= ~UINT64CONST(0) >> (63 - (hi - 1) % 64);
+	return mask;
+}
+
+static void
+coverage_fill(PeriodCoverage *coverage, int64 lo, int64 hi)
+{
+	int64 w;
+
+	for(w = lo / 64; w <= (hi - 1) / 64; w++)
+		coverage->words[w] |= coverage_mask(w, lo, hi);
+}
+
+static void
+coverage_add(PeriodCoverage *coverage, period *p)
+{
+	int64 lo, hi;
+
+	if(coverage_buckets(coverage, p, &lo, &hi))
+		coverage_fill(coverage, lo, hi);
+}
+
+/* Are any (or all) of the buckets p touches set? */
+static bool
+coverage_test(PeriodCoverage *coverage, period *p, bool all)
+{
+	int64 lo, hi, w;
+
+	if(!coverage_buckets(coverage, p, &lo, &hi))
+		return all && period_is_empty(p);
+	/* the parts outside the window aren't covered */
+	if(all && (p->first < coverage->first || p->next > coverage->next))
+		return false;
+
+	for(w = lo / 64; w <= (hi - 1) / 64; w++) {
+		uint64 mask = coverage_mask(w, lo, hi);
+
+		if(all ? (coverage->words[w] & mask) != mask : (coverage->words[w] & mask) != 0)
+			return !all;
+	}
+	return all;
+}
+
+static void
+coverage_check_same(PeriodCoverage *c1, PeriodCoverage *c2)
+{
+	if(c1->first != c2->first || c1->next != c2->next || c1->resolution != c2->resolution)
+		elog(ERROR,"period_coverage: the coverages have different windows or resolutions");
+}
+
+static TimestampTz
+coverage_resolution(Interval *span)
+{
+	if(span->month != 0)
+		elog(ERROR,"period_coverage: the resolution must not be in months or years");
+#ifdef HAVE_INT64_TIMESTAMP
+	return span->time + span->day * USECS_PER_DAY;
+#else
+	return span->time + span->day * (double) SECS_PER_DAY;
+#endif
+}
+
+/************************************************
+ * Input and output
+ ************************************************/
+
+/*
+ * The text form is the window, the resolution and the buckets in hex,
+ * separated by slashes. Each hex digit is four buckets, the first in its
+ * lowest bit: [2011-01-01, 2011-01-02)/01:00:00/000ff0
+ */
+PG_FUNCTION_INFO_V1(period_coverage_in);
+Datum
+period_coverage_in(PG_FUNCTION_ARGS)
+{
+	char *str = pstrdup(PG_GETARG_CSTRING(0));
+	char *end = strpbrk(str, ")]");
+	char *slash;
+	char *hex;
+	period *window;
+	Interval *span;
+	PeriodCoverage *coverage;
+	int64 i, ndigits;
+
+	if(end == NULL || end[1] != '/' || (slash = strchr(end + 2, '/')) == NULL)
+		elog(ERROR,"invalid period_coverage input: expected \"window/resolution/buckets\"");
+	end[1] = '\0';
+	*slash = '\0';
+	hex = slash + 1;
+
+	window = (period *) DatumGetPointer(DirectFunctionCall1(period_in, CStringGetDatum(str)));
+	span = DatumGetIntervalP(DirectFunctionCall3(interval_in, CStringGetDatum(end + 2),
+												 ObjectIdGetDatum(InvalidOid), Int32GetDatum(-1)));
+	coverage = coverage_new(window, coverage_resolution(span));
+
+	ndigits = (coverage->nbuckets + 3) / 4;
+	if((int64) strlen(hex) != ndigits)
+		elog(ERROR,"invalid period_coverage input: %d hex digits for %d buckets",
+			 (int) strlen(hex), coverage->nbuckets);
+	for(i = 0; i < ndigits; i++) {
+		int digit;
+
+		if(hex[i] >= '0' && hex[i] <= '9')
+			digit = hex[i] - '0';
+		else if(hex[i] >= 'a' && hex[i] <= 'f')
+			digit = hex[i] - 'a' + 10;
+		else if(hex[i] >= 'A' && hex[i] <= 'F')
+			digit = hex[i] - 'A' + 10;
+		else
+			elog(ERROR,"invalid period_coverage input: \"%c\" is not a hex digit", hex[i]);
+		coverage->words[i / 16] |= (uint64) digit << (4 * (i % 16));
+	}
+	if(coverage->nbuckets % 64 != 0 &&
+	   (coverage->words[(coverage->nbuckets - 1) / 64] >> (coverage->nbuckets % 64)) != 0)
+		elog(ERROR,"invalid period_coverage input: buckets past the end of the window");
+
+	PG_RETURN_POINTER(coverage);
+}
+
+PG_FUNCTION_INFO_V1(period_coverage_out);
+Datum
+period_coverage_out(PG_FUNCTION_ARGS)
+{
+	PeriodCoverage *coverage = PG_GETARG_PERIOD_COVERAGE(0);
+	static const char digits[] = "0123456789abcdef";
+	StringInfoData buf;
+	period window;
+	Interval span;
+	int64 i;
+
+	window.first = coverage->first;
+	window.next = coverage->next;
+	span.month = 0;
+	span.day = 0;
+	span.time = coverage->resolution;
+
+	initStringInfo(&buf);
+	appendStringInfo(&buf, "%s/%s/",
+		DatumGetCString(DirectFunctionCall1(period_out, PointerGetDatum(&window))),
+		DatumGetCString(DirectFunctionCall1(interval_out, IntervalPGetDatum(&span))));
+	for(i = 0; i < (coverage->nbuckets + 3) / 4; i++)
+		appendStringInfoChar(&buf, digits[(coverage->words[i / 16] >> (4 * (i % 16))) & 0xF]);
+
+	PG_RETURN_CSTRING(buf.data);
+}
+
+/************************************************
+ * Building
+ ************************************************/
+
+/*
+ * period_coverage(window, resolution)
+ *
+ * Returns a coverage of window with buckets of resolution, none set.
+ */
+PG_FUNCTION_INFO_V1(period_coverage_new);
+Datum
+period_coverage_new(PG_FUNCTION_ARGS)
+{
+	period *window = (period*)PG_GETARG_POINTER(0);
+	Interval *span = PG_GETARG_INTERVAL_P(1);
+
+	PG_RETURN_POINTER(coverage_new(window, coverage_resolution(span)));
+}
+
+PG_FUNCTION_INFO_V1(period_coverage_add);
+Datum
+period_coverage_add(PG_FUNCTION_ARGS)
+{
+	PeriodCoverage *coverage = (PeriodCoverage *) PG_DETOAST_DATUM_COPY(PG_GETARG_DATUM(0));
+
+	coverage_add(coverage, (period*)PG_GETARG_POINTER(1));
+	PG_RETURN_POINTER(coverage);
+}
+
+/*
+ * The transition function of coverage(period, window, resolution),
+ * which makes the coverage on the first row and then sets the buckets
+ * of each period in place.
+ */
+PG_FUNCTION_INFO_V1(period_coverage_agg);
+Datum
+period_coverage_agg(PG_FUNCTION_ARGS)
+{
+	MemoryContext aggcontext;
+	PeriodCoverage *coverage;
+
+	if(!AggCheckCallContext(fcinfo, &aggcontext))
+		elog(ERROR,"period_coverage_agg called in non-aggregate context");
+
+	if(PG_ARGISNULL(0)) {
+		MemoryContext oldcontext;
+
+		if(PG_ARGISNULL(2) || PG_ARGISNULL(3))
+			elog(ERROR,"coverage: the window and resolution must not be NULL");
+		oldcontext = MemoryContextSwitchTo(aggcontext);
+		coverage = coverage_new((period*)PG_GETARG_POINTER(2),
+								coverage_resolution(PG_GETARG_INTERVAL_P(3)));
+		MemoryContextSwitchTo(oldcontext);
+	} else
+		coverage = (PeriodCoverage *) PG_GETARG_POINTER(0);
+
+	if(!PG_ARGISNULL(1))
+		coverage_add(coverage, (period*)PG_GETARG_POINTER(1));
+	PG_RETURN_POINTER(coverage);
+}
+
+PG_FUNCTION_INFO_V1(period_coverage_or);
+Datum
+period_coverage_or(PG_FUNCTION_ARGS)
+{
+	PeriodCoverage *c1 = (PeriodCoverage *) PG_DETOAST_DATUM_COPY(PG_GETARG_DATUM(0));
+	PeriodCoverage *c2 = PG_GETARG_PERIOD_COVERAGE(1);
+	int64 w;
+
+	coverage_check_same(c1, c2);
+	for(w = 0; w < COVERAGE_NWORDS(c1->nbuckets); w++)
+		c1->words[w] |= c2->words[w];
+	PG_RETURN_POINTER(c1);
+}
+
+/*
+ * The transition function of coverage(period_coverage), which ORs each
+ * coverage into the first in place.
+ */
+PG_FUNCTION_INFO_V1(period_coverage_or_agg);
+Datum
+period_coverage_or_agg(PG_FUNCTION_ARGS)
+{
+	MemoryContext aggcontext;
+	PeriodCoverage *coverage;
+	PeriodCoverage *arg;
+	int64 w;
+
+	if(!AggCheckCallContext(fcinfo, &aggcontext))
+		elog(ERROR,"period_coverage_or_agg called in non-aggregate context");
+
+	if(PG_ARGISNULL(1)) {
+		if(PG_ARGISNULL(0))
+			PG_RETURN_NULL();
+		PG_RETURN_DATUM(PG_GETARG_DATUM(0));
+	}
+	arg = PG_GETARG_PERIOD_COVERAGE(1);
+
+	if(PG_ARGISNULL(0)) {
+		coverage = (PeriodCoverage *) MemoryContextAlloc(aggcontext, VARSIZE(arg));
+		memcpy(coverage, arg, VARSIZE(arg));
+		PG_RETURN_POINTER(coverage);
+	}
+
+	coverage = (PeriodCoverage *) PG_GETARG_POINTER(0);
+	coverage_check_same(coverage, arg);
+	for(w = 0; w < COVERAGE_NWORDS(coverage->nbuckets); w++)
+		coverage->words[w] |= arg->words[w];
+	PG_RETURN_POINTER(coverage);
+}
+
+/************************************************
+ * Reading
+ ************************************************/
+
+/*
+ * covered(coverage)
+ *
+ * Returns the total length of the buckets set.
+ */
+PG_FUNCTION_INFO_V1(period_coverage_covered);
+Datum
+period_coverage_covered(PG_FUNCTION_ARGS)
+{
+	PeriodCoverage *coverage = PG_GETARG_PERIOD_COVERAGE(0);
+	Interval *result = (Interval *) palloc(sizeof(Interval));
+	int64 count = 0;
+	int64 w;
+
+	for(w = 0; w < COVERAGE_NWORDS(coverage->nbuckets); w++)
+		count += coverage_popcount(coverage->words[w]);
+
+	result->month = 0;
+	result->day = 0;
+	result->time = count * coverage->resolution;
+	PG_RETURN_INTERVAL_P(result);
+}
+
+typedef struct
+{
+	PeriodCoverage *coverage;
+	int64 bucket;			/* the next bucket to look at */
+} CoverageUnnestState;
+
+static bool
+coverage_bit(PeriodCoverage *coverage, int64 bucket)
+{
+	return (coverage->words[bucket / 64] >> (bucket % 64)) & 1;
+}
+
+/*
+ * unnest(coverage)
+ *
+ * Returns the runs of buckets set, as periods, in order and ending no
+ * later than the window.
+ */
+PG_FUNCTION_INFO_V1(period_coverage_unnest);
+Datum
+period_coverage_unnest(PG_FUNCTION_ARGS)
+{
+	FuncCallContext *funcctx;
+	CoverageUnnestState *state;
+	PeriodCoverage *coverage;
+	int64 lo;
+
+	if(SRF_IS_FIRSTCALL()) {
+		MemoryContext oldcontext;
+
+		funcctx = SRF_FIRSTCALL_INIT();
+		oldcontext = MemoryContextSwitchTo(funcctx->multi_call_memory_ctx);
+		state = (CoverageUnnestState *) palloc(sizeof(CoverageUnnestState));
+		state->coverage = PG_GETARG_PERIOD_COVERAGE(0);
+		state->bucket = 0;
+		funcctx->user_fctx = state;
+		MemoryContextSwitchTo(oldcontext);
+	}
+
+	funcctx = SRF_PERCALL_SETUP();
+	state = (CoverageUnnestState *) funcctx->user_fctx;
+	coverage = state->coverage;
+
+	/* skip to the next bucket set, a word at a time where they are empty */
+	while(state->bucket < coverage->nbuckets && !coverage_bit(coverage, state->bucket)) {
+		if(state->bucket % 64 == 0 && coverage->words[state->bucket / 64] == 0)
+			state->bucket += 64;
+		else
+			state->bucket++;
+	}
+
+	if(state->bucket < coverage->nbuckets) {
+		period *result = (period *) palloc(sizeof(period));
+
+		lo = state->bucket;
+		while(state->bucket < coverage->nbuckets && coverage_bit(coverage, state->bucket)) {
+			if(state->bucket % 64 == 0 && coverage->words[state->bucket / 64] == ~UINT64CONST(0))
+				state->bucket += 64;
+			else
+				state->bucket++;
+		}
+		result->first = coverage->first + lo * coverage->resolution;
+		result->next = Min(coverage->first + Min(state->bucket, coverage->nbuckets) *
+						   coverage->resolution, coverage->next);
+		SRF_RETURN_NEXT(funcctx, PointerGetDatum(result));
+	}
+	SRF_RETURN_DONE(funcctx);
+}
+
+/************************************************
+ * BOOLEAN functions
+ ************************************************/
+
+PG_FUNCTION_INFO_V1(period_coverage_overlaps);
+Datum
+period_coverage_overlaps(PG_FUNCTION_ARGS)
+{
+	PeriodCoverage *coverage = PG_GETARG_PERIOD_COVERAGE(0);
+
+	PG_RETURN_BOOL(coverage_test(coverage, (period*)PG_GETARG_POINTER(1), false));
+}
+
+PG_FUNCTION_INFO_V1(period_coverage_contains);
+Datum
+period_coverage_contains(PG_FUNCTION_ARGS)
+{
+	PeriodCoverage *coverage = PG_GETARG_PERIOD_COVERAGE(0);
+
+	PG_RETURN_BOOL(coverage_test(coverage, (period*)PG_GETARG_POINTER(1), true));
+}
+
+PG_FUNCTION_INFO_V1(period_coverage_contains_timestamptz);
+Datum
+period_coverage_contains_timestamptz(PG_FUNCTION_ARGS)
+{
+	PeriodCoverage *coverage = PG_GETARG_PERIOD_COVERAGE(0);
+	TimestampTz arg = PG_GETARG_TIMESTAMPTZ(1);
+	period query;
+
+	query.first = arg;
+	query.next = next_timestamptz(arg);
+	PG_RETURN_BOOL(coverage_test(coverage, &query, true));
+}
+
+PG_FUNCTION_INFO_V1(period_coverage_overlaps_coverage);
+Datum
+period_coverage_overlaps_coverage(PG_FUNCTION_ARGS)
+{
+	PeriodCoverage *c1 = PG_GETARG_PERIOD_COVERAGE(0);
+	PeriodCoverage *c2 = PG_GETARG_PERIOD_COVERAGE(1);
+	int64 w;
+
+	coverage_check_same(c1, c2);
+	for(w = 0; w < COVERAGE_NWORDS(c1->nbuckets); w++)
+		if((c1->words[w] & c2->words[w]) != 0)
+			PG_RETURN_BOOL(true);
+	PG_RETURN_BOOL(false);
+}
+
+PG_FUNCTION_INFO_V1(period_coverage_contains_coverage);
+Datum
+period_coverage_contains_coverage(PG_FUNCTION_ARGS)
+{
+	PeriodCoverage *c1 = PG_GETARG_PERIOD_COVERAGE(0);
+	PeriodCoverage *c2 = PG_GETARG_PERIOD_COVERAGE(1);
+	int64 w;
+
+	coverage_check_same(c1, c2);
+	for(w = 0; w < COVERAGE_NWORDS(c1->nbuckets); w++)
+		if((c2->words[w] & ~c1->words[w]) != 0)
+			PG_RETURN_BOOL(false);
+	PG_RETURN_BOOL(true);
+}
@@ -0,0 +1,290 @@
+/*
+ * period_covered.c
+ *   Implements covered_length(period), the length of the union of the
+ *   periods aggregated, as a moving aggregate.
+ *
+ * The state is the sorted list of the distinct bounds of the periods in
+ * the aggregate, with how many of those periods cover the span from each
+ * bound to the next and how many periods start or end on it, and the
+ * total length of the spans covered at least once. Adding a period finds
+ * its bounds by binary search, inserting them if they are new, and counts
+ * it on the spans between them, adding the length of those going from
+ * uncovered to covered; removing it does the reverse, and drops the bounds
+ * no other period starts or ends on. The bounds are a flat array, so
+ * inserting or removing one moves those after it: a row entering or
+ * leaving a window frame costs O(b) in the distinct bounds of the frame,
+ * a memmove rather than a step per row of the frame, and no more
+ * aggregating the whole frame again for every row.
+ *
+ * Spans with an infinite bound have no length; they are counted apart,
+ * and the result is NULL while one of them is covered, rather than an
+ * error that would end a window query at the first frame holding an
+ * open-ended period.
+ */
+
+#include "period.h"
+#include "utils/memutils.h"
+
+typedef struct
+{
+	int nbounds;
+	int maxbounds;
+	TimestampTz *bounds;	/* ascending */
+	int64 *counts;			/* the periods covering [bounds[i], bounds[i+1]), 0 for the last */
+	int64 *refs;			/* the periods starting or ending on bounds[i] */
+	int64 covered;			/* the length of the spans with counts > 0 */
+	int64 unbounded;		/* the spans with counts > 0 and an infinite bound */
+} CoveredState;
+
+static CoveredState *
+covered_new(MemoryContext aggcontext)
+{
+	CoveredState *state = (CoveredState *) MemoryContextAllocZero(aggcontext, sizeof(CoveredState));
+
+	state->maxbounds = 16;
+	state->bounds = (TimestampTz *) MemoryContextAlloc(aggcontext, state->maxbounds * sizeof(TimestampTz));
+	state->counts = (int64 *) MemoryContextAlloc(aggcontext, state->maxbounds * sizeof(int64));
+	state->refs = (int64 *) MemoryContextAlloc(aggcontext, state->maxbounds * sizeof(int64));
+	return state;
+}
+
+/*
+ * The first i with bounds[i] >= t, or nbounds.
+ */
+static int
+covered_search(CoveredState *state, TimestampTz t)
+{
+	int lo = 0;
+	int hi = state->nbounds;
+
+	while(lo < hi) {
+		int mid = lo + (hi - lo) / 2;
+
+		if(state->bounds[mid] < t)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+static bool
+covered_span_unbounded(CoveredState *state, int i)
+{
+	return TIMESTAMP_IS_NOBEGIN(state->bounds[i]) || TIMESTAMP_IS_NOEND(state->bounds[i + 1]);
+}
+
+/*
+ * Count the span from bounds[i] to bounds[i + 1], if it is covered, in
+ * the covered length or the unbounded spans, or take it out when sign
+ * is -1.
+ */
+static void
+covered_span_count(CoveredState *state, int i, int sign)
+{
+	if(state->counts[i] == 0)
+		return;
+	if(covered_span_unbounded(state, i))
+		state->unbounded += sign;
+	else
+		state->covered += sign * (state->bounds[i + 1] - state->bounds[i]);
+}
+
+/*
+ * Reference the bound t, inserting it if it is new, and return its
+ * position. A new bound splits the span it falls in into two with the
+ * count of the span. The covered length only changes when that span has
+ * an infinite bound: splitting [a, infinity) at b makes [a, b) finite.
+ */
+static int
+covered_ref(CoveredState *state, TimestampTz t)
+{
+	int i = covered_search(state, t);
+	int tail;
+
+	if(i < state->nbounds && state->bounds[i] == t) {
+		state->refs[i]++;
+		return i;
+	}
+
+	/* the span being split, recounted as its two halves below */
+	if(i > 0 && i < state->nbounds)
+		covered_span_count(state, i - 1, -1);
+
+	if(state->nbounds == state->maxbounds) {
+		state->maxbounds *= 2;
+		state->bounds = (TimestampTz *) repalloc(state->bounds, state->maxbounds * sizeof(TimestampTz));
+		state->counts = (int64 *) repalloc(state->counts, state->maxbounds * sizeof(int64));
+		state->refs = (int64 *) repalloc(state->refs, state->maxbounds * sizeof(int64));
+	}
+	tail = state->nbounds - i;
+	memmove(&state->bounds[i + 1], &state->bounds[i], tail * sizeof(TimestampTz));
+	memmove(&state->counts[i + 1], &state->counts[i], tail * sizeof(int64));
+	memmove(&state->refs[i + 1], &state->refs[i], tail * sizeof(int64));
+	state->bounds[i] = t;
+	state->counts[i] = i > 0 ? state->counts[i - 1] : 0;
+	state->refs[i] = 1;
+	state->nbounds++;
+	if(i > 0 && i < state->nbounds - 1) {
+		covered_span_count(state, i - 1, 1);
+		covered_span_count(state, i, 1);
+	}
+	return i;
+}
+
+/*
+ * Drop a reference to the bound at i, removing the bound when it was the
+ * last. No period starts or ends on it then, so the spans on either side
+ * have the same count and merge into the one before it, which is
+ * recounted like a split in covered_ref in reverse.
+ */
+static void
+covered_unref(CoveredState *state, int i)
+{
+	int tail;
+
+	if(--state->refs[i] > 0)
+		return;
+
+	if(i > 0 && i < state->nbounds - 1) {
+		covered_span_count(state, i - 1, -1);
+		covered_span_count(state, i, -1);
+	}
+	tail = state->nbounds - i - 1;
+	memmove(&state->bounds[i], &state->bounds[i + 1], tail * sizeof(TimestampTz));
+	memmove(&state->counts[i], &state->counts[i + 1], tail * sizeof(int64));
+	memmove(&state->refs[i], &state->refs[i + 1], tail * sizeof(int64));
+	state->nbounds--;
+	if(i > 0 && i < state->nbounds)
+		covered_span_count(state, i - 1, 1);
+}
+
+static void
+covered_add(CoveredState *state, period *p)
+{
+	int first;
+	int next;
+	int i;
+
+	if(period_is_empty(p))
+		return;
+
+	first = covered_ref(state, p->first);
+	next = covered_ref(state, p->next);
+	for(i = first; i < next; i++) {
+		if(state->counts[i]++ > 0)
+			continue;
+		if(covered_span_unbounded(state, i))
+			state->unbounded++;
+		else
+			state->covered += state->bounds[i + 1] - state->bounds[i];
+	}
+}
+
+static void
+covered_remove(CoveredState *state, period *p)
+{
+	int first;
+	int next;
+	int i;
+
+	if(period_is_empty(p))
+		return;
+
+	first = covered_search(state, p->first);
+	next = covered_search(state, p->next);
+	if(next >= state->nbounds || state->bounds[first] != p->first || state->bounds[next] != p->next)
+		elog(ERROR,"covered_length: removing a period that was not added");
+
+	for(i = first; i < next; i++) {
+		if(--state->counts[i] > 0)
+			continue;
+		if(covered_span_unbounded(state, i))
+			state->unbounded--;
+		else
+			state->covered -= state->bounds[i + 1] - state->bounds[i];
+	}
+	/* the later bound first, so removing it leaves first where it is */
+	covered_unref(state, next);
+	covered_unref(state, first);
+}
+
+/*
+ * The transition function of covered_length(period), as a plain and as
+ * a moving aggregate. NULL periods are skipped, and the state is made on
+ * the first period that isn't.
+ */
+PG_FUNCTION_INFO_V1(period_covered_agg);
+Datum
+period_covered_agg(PG_FUNCTION_ARGS)
+{
+	MemoryContext aggcontext;
+	CoveredState *state;
+
+	if(!AggCheckCallContext(fcinfo, &aggcontext))
+		elog(ERROR,"period_covered_agg called in non-aggregate context");
+
+	if(PG_ARGISNULL(1)) {
+		if(PG_ARGISNULL(0))
+			PG_RETURN_NULL();
+		PG_RETURN_POINTER(PG_GETARG_POINTER(0));
+	}
+
+	if(PG_ARGISNULL(0))
+		state = covered_new(aggcontext);
+	else
+		state = (CoveredState *) PG_GETARG_POINTER(0);
+
+	covered_add(state, (period*)PG_GETARG_POINTER(1));
+	PG_RETURN_POINTER(state);
+}
+
+/*
+ * The inverse transition function, taking out a period that left the
+ * window frame.
+ */
+PG_FUNCTION_INFO_V1(period_covered_inv);
+Datum
+period_covered_inv(PG_FUNCTION_ARGS)
+{
+	CoveredState *state;
+
+	if(!AggCheckCallContext(fcinfo, NULL))
+		elog(ERROR,"period_covered_inv called in non-aggregate context");
+
+	if(PG_ARGISNULL(0)) {
+		if(!PG_ARGISNULL(1))
+			elog(ERROR,"covered_length: removing a period that was not added");
+		PG_RETURN_NULL();
+	}
+	state = (CoveredState *) PG_GETARG_POINTER(0);
+
+	if(!PG_ARGISNULL(1))
+		covered_remove(state, (period*)PG_GETARG_POINTER(1));
+	PG_RETURN_POINTER(state);
+}
+
+/*
+ * The length of the spans covered, NULL when every period was NULL or
+ * the length is infinite.
+ */
+PG_FUNCTION_INFO_V1(period_covered_final);
+Datum
+period_covered_final(PG_FUNCTION_ARGS)
+{
+	CoveredState *state;
+	Interval *result;
+
+	if(PG_ARGISNULL(0))
+		PG_RETURN_NULL();
+	state = (CoveredState *) PG_GETARG_POINTER(0);
+
+	if(state->unbounded > 0)
+		PG_RETURN_NULL();
+
+	result = (Interval *) palloc(sizeof(Interval));
+	result->month = 0;
+	result->day = 0;
+	result->time = state->covered;
+	PG_RETURN_INTERVAL_P(result);
+}
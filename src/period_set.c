@@ -0,0 +1,767 @@
+/*
+ * period_set.c
+ *   Implements the PERIOD_SET data type, a set of periods meant to be
+ *   built up and searched in procedural code.
+ *
+ * The periods are kept sorted by period_compare(), without duplicates,
+ * along with the running maximum of 'next' (a flattened interval tree).
+ * Any period that could contain or overlap a query starts early enough,
+ * and those periods are a prefix of the array found by binary search.
+ * Whether one matches is then answered by the largest 'next' in the
+ * prefix, in O(log n). Finding every match also skips, by a second
+ * binary search, the leading periods whose running maximum is too
+ * small, and scans the rest of the prefix.
+ *
+ * On PostgreSQL 9.5 and later, a PERIOD_SET in a PL/pgSQL variable is
+ * kept as an expanded object. It is only flattened when it is stored,
+ * so adding, removing and searching don't detoast and copy the whole
+ * value on every call. period_set_add and period_set_remove modify
+ * the object in place when they are given a read/write pointer to it;
+ * PL/pgSQL does that on PostgreSQL 18 and later, through
+ * period_set_support. Otherwise they return a modified copy.
+ */
+
+#include "period.h"
+#include "funcapi.h"
+#include "utils/array.h"
+#include "utils/lsyscache.h"
+#if PG_VERSION_NUM >= 90500
+#include "utils/expandeddatum.h"
+#include "utils/memutils.h"
+#endif
+#if PG_VERSION_NUM >= 180000
+#include "nodes/supportnodes.h"
+#endif
+
+typedef struct
+{
+	int32 vl_len_;			/* varlena header (do not touch directly!) */
+	int32 nperiods;			/* number of non-empty periods */
+	int32 nempty;			/* 1 if the empty period is a member */
+	int32 unused;			/* keeps the periods 8-byte aligned */
+	period periods[1];		/* VARIABLE LENGTH ARRAY, sorted */
+	/* followed by the running maximum of 'next', one per period */
+} PeriodSet;
+
+#define PERIOD_SET_HDRSZ offsetof(PeriodSet, periods)
+#define PERIOD_SET_MAX_NEXT(s) ((TimestampTz *) &(s)->periods[(s)->nperiods])
+
+/*
+ * The in-memory form. It is also used to read a flat value in place,
+ * with nalloc 0 and every running maximum valid.
+ */
+typedef struct
+{
+#if PG_VERSION_NUM >= 90500
+	ExpandedObjectHeader hdr;
+#endif
+	int nperiods;
+	int nempty;
+	int nalloc;				/* allocated length of the arrays below */
+	period *periods;
+	TimestampTz *max_next;	/* largest 'next' of periods[0..i] */
+	int nvalid;				/* number of valid max_next entries */
+} ExpandedPeriodSet;
+
+static ExpandedPeriodSet *period_set_expand(Datum d, bool copy);
+static ExpandedPeriodSet *period_set_reader(Datum d, ExpandedPeriodSet *tmp);
+static ExpandedPeriodSet *period_set_modifiable(FunctionCallInfo fcinfo, int argno);
+static Datum period_set_result(ExpandedPeriodSet *eps);
+static PeriodSet *period_set_build(period *periods, int n);
+static void period_set_fill_max_next(ExpandedPeriodSet *eps, int k);
+
+/************************************************
+ * Flat form and expansion
+ ************************************************/
+
+static Size
+period_set_flat_size(ExpandedPeriodSet *eps)
+{
+	return PERIOD_SET_HDRSZ +
+		eps->nperiods * (sizeof(period) + sizeof(TimestampTz));
+}
+
+static void
+period_set_flatten(ExpandedPeriodSet *eps, PeriodSet *result, Size size)
+{
+	memset(result, 0, PERIOD_SET_HDRSZ);
+	SET_VARSIZE(result, size);
+	result->nperiods = eps->nperiods;
+	result->nempty = eps->nempty;
+	memcpy(result->periods, eps->periods, eps->nperiods * sizeof(period));
+	period_set_fill_max_next(eps, eps->nperiods);
+	memcpy(PERIOD_SET_MAX_NEXT(result), eps->max_next,
+		   eps->nperiods * sizeof(TimestampTz));
+}
+
+#if PG_VERSION_NUM >= 90500
+static Size
+period_set_get_flat_size(ExpandedObjectHeader *eohptr)
+{
+	return period_set_flat_size((ExpandedPeriodSet *) eohptr);
+}
+
+static void
+period_set_flatten_into(ExpandedObjectHeader *eohptr, void *result,
+						Size allocated_size)
+{
+	period_set_flatten((ExpandedPeriodSet *) eohptr, (PeriodSet *) result,
+					   allocated_size);
+}
+
+static const ExpandedObjectMethods period_set_methods =
+{
+	period_set_get_flat_size,
+	period_set_flatten_into
+};
+#endif
+
+/* allocate memory that lives as long as the set does */
+static void *
+period_set_alloc(ExpandedPeriodSet *eps, Size size)
+{
+#if PG_VERSION_NUM >= 90500
+	return MemoryContextAlloc(eps->hdr.eoh_context, size);
+#else
+	return palloc(size);
+#endif
+}
+
+/*
+ * Return the set in d in its in-memory form. Unless copy is false and
+ * d already is an expanded object, this is a new one.
+ */
+static ExpandedPeriodSet *
+period_set_expand(Datum d, bool copy)
+{
+	ExpandedPeriodSet tmp;
+	ExpandedPeriodSet *src;
+	ExpandedPeriodSet *eps;
+
+#if PG_VERSION_NUM >= 90500
+	MemoryContext objcxt;
+
+	if(!copy && VARATT_IS_EXTERNAL_EXPANDED(DatumGetPointer(d)))
+		return (ExpandedPeriodSet *) DatumGetEOHP(d);
+
+	src = period_set_reader(d, &tmp);
+	objcxt = AllocSetContextCreate(CurrentMemoryContext, "period_set",
+								   ALLOCSET_SMALL_MINSIZE,
+								   ALLOCSET_SMALL_INITSIZE,
+								   ALLOCSET_DEFAULT_MAXSIZE);
+	eps = (ExpandedPeriodSet *) MemoryContextAlloc(objcxt, sizeof(ExpandedPeriodSet));
+	EOH_init_header(&eps->hdr, &period_set_methods, objcxt);
+#else
+	src = period_set_reader(d, &tmp);
+	eps = (ExpandedPeriodSet *) palloc(sizeof(ExpandedPeriodSet));
+#endif
+
+	eps->nperiods = src->nperiods;
+	eps->nempty = src->nempty;
+	eps->nalloc = Max(src->nperiods, 8);
+	eps->periods = (period *) period_set_alloc(eps, eps->nalloc * sizeof(period));
+	eps->max_next = (TimestampTz *) period_set_alloc(eps, eps->nalloc * sizeof(TimestampTz));
+	eps->nvalid = src->nvalid;
+	memcpy(eps->periods, src->periods, src->nperiods * sizeof(period));
+	memcpy(eps->max_next, src->max_next, src->nvalid * sizeof(TimestampTz));
+
+	return eps;
+}
+
+/*
+ * Return a set that can be read, but not modified: the expanded object
+ * itself, or tmp pointed at the detoasted flat value.
+ */
+static ExpandedPeriodSet *
+period_set_reader(Datum d, ExpandedPeriodSet *tmp)
+{
+	PeriodSet *flat;
+
+#if PG_VERSION_NUM >= 90500
+	if(VARATT_IS_EXTERNAL_EXPANDED(DatumGetPointer(d)))
+		return (ExpandedPeriodSet *) DatumGetEOHP(d);
+#endif
+
+	flat = (PeriodSet *) PG_DETOAST_DATUM(d);
+	tmp->nperiods = flat->nperiods;
+	tmp->nempty = flat->nempty;
+	tmp->nalloc = 0;
+	tmp->periods = flat->periods;
+	tmp->max_next = PERIOD_SET_MAX_NEXT(flat);
+	tmp->nvalid = flat->nperiods;
+	return tmp;
+}
+
+/*
+ * Return the set in argument argno in a form that may be modified:
+ * the argument itself if the caller handed us a read/write expanded
+ * object, otherwise a copy.
+ */
+static ExpandedPeriodSet *
+period_set_modifiable(FunctionCallInfo fcinfo, int argno)
+{
+	Datum d = PG_GETARG_DATUM(argno);
+
+#if PG_VERSION_NUM >= 90500
+	return period_set_expand(d, !DatumIsReadWriteExpandedObject(d, false, -1));
+#else
+	return period_set_expand(d, true);
+#endif
+}
+
+static Datum
+period_set_result(ExpandedPeriodSet *eps)
+{
+#if PG_VERSION_NUM >= 90500
+	return EOHPGetRWDatum(&eps->hdr);
+#else
+	Size size = period_set_flat_size(eps);
+	PeriodSet *result = (PeriodSet *) palloc(size);
+
+	period_set_flatten(eps, result, size);
+	return PointerGetDatum(result);
+#endif
+}
+
+static int
+period_set_sort_compare(const void *a, const void *b)
+{
+	return period_compare((period *) a, (period *) b);
+}
+
+/*
+ * Build a flat set from n periods. The array is sorted in place.
+ */
+static PeriodSet *
+period_set_build(period *periods, int n)
+{
+	PeriodSet *result;
+	TimestampTz *max_next;
+	int nempty = 0;
+	int i, j;
+
+	qsort(periods, n, sizeof(period), period_set_sort_compare);
+
+	/* empty periods sort first */
+	while(nempty < n && period_is_empty(&periods[nempty]))
+		nempty++;
+
+	/* sized as if there were no duplicates */
+	result = (PeriodSet *) palloc0(PERIOD_SET_HDRSZ +
+		(n - nempty) * (sizeof(period) + sizeof(TimestampTz)));
+	for(i = nempty, j = 0; i < n; i++) {
+		if(j > 0 && period_equals(&result->periods[j - 1], &periods[i]))
+			continue;
+		period_copy(&periods[i], &result->periods[j++]);
+	}
+	result->nperiods = j;
+	result->nempty = nempty ? 1 : 0;
+	SET_VARSIZE(result, PERIOD_SET_HDRSZ +
+		j * (sizeof(period) + sizeof(TimestampTz)));
+
+	max_next = PERIOD_SET_MAX_NEXT(result);
+	for(i = 0; i < j; i++)
+		max_next[i] = (i > 0 && max_next[i - 1] > result->periods[i].next) ?
+			max_next[i - 1] : result->periods[i].next;
+
+	return result;
+}
+
+/************************************************
+ * Searching and updating
+ ************************************************/
+
+/*
+ * Return the position of the first period not less than p, and set
+ * *found if it is equal. p must not be empty.
+ */
+static int
+period_set_search(ExpandedPeriodSet *eps, period *p, bool *found)
+{
+	int lo = 0;
+	int hi = eps->nperiods;
+
+	while(lo < hi) {
+		int mid = lo + (hi - lo) / 2;
+
+		if(period_compare(&eps->periods[mid], p) < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	*found = (lo < eps->nperiods && period_equals(&eps->periods[lo], p));
+	return lo;
+}
+
+/*
+ * Return the number of periods whose 'first' is less than ts, or, if
+ * inclusive, not greater than ts. These are a prefix of the array.
+ */
+static int
+period_set_prefix(ExpandedPeriodSet *eps, TimestampTz ts, bool inclusive)
+{
+	int lo = 0;
+	int hi = eps->nperiods;
+
+	while(lo < hi) {
+		int mid = lo + (hi - lo) / 2;
+
+		if(eps->periods[mid].first < ts ||
+		   (inclusive && eps->periods[mid].first == ts))
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+/*
+ * Make the first k running maxima valid. Those that were invalidated by
+ * an update are recomputed only as far as needed.
+ */
+static void
+period_set_fill_max_next(ExpandedPeriodSet *eps, int k)
+{
+	int i;
+
+	for(i = eps->nvalid; i < k; i++) {
+		TimestampTz next = eps->periods[i].next;
+
+		eps->max_next[i] = (i > 0 && eps->max_next[i - 1] > next) ?
+			eps->max_next[i - 1] : next;
+	}
+	if(k > eps->nvalid)
+		eps->nvalid = k;
+}
+
+/* Return the largest 'next' of the first k periods; k must be positive */
+static TimestampTz
+period_set_max_next(ExpandedPeriodSet *eps, int k)
+{
+	period_set_fill_max_next(eps, k);
+	return eps->max_next[k - 1];
+}
+
+static bool
+period_set_contains_internal(ExpandedPeriodSet *eps, period *query)
+{
+	int k;
+
+	if(period_is_empty(query))
+		return eps->nperiods + eps->nempty > 0;
+
+	k = period_set_prefix(eps, query->first, true);
+	return k > 0 && period_set_max_next(eps, k) >= query->next;
+}
+
+static bool
+period_set_overlaps_internal(ExpandedPeriodSet *eps, period *query)
+{
+	int k;
+
+	if(period_is_empty(query))
+		return false;
+
+	k = period_set_prefix(eps, query->next, false);
+	return k > 0 && period_set_max_next(eps, k) > query->first;
+}
+
+/*
+ * Store in matches the positions of the periods, among the first k,
+ * whose 'next' is greater than ts, or, if inclusive, not less than ts.
+ * Returns the number found.
+ *
+ * The running maxima never decrease, so the periods before the first
+ * maximum that passes ts are skipped by binary search. The remaining
+ * periods are compared without branching, so that mispredictions don't
+ * dominate when the matches are scattered and the compiler can
+ * pipeline the loop. It tests one bound against a timestamp and writes
+ * positions, so it doesn't go through the vector kernels of
+ * period_array_filter.c, which test both bounds of each period against
+ * a period and write a flag per element.
+ */
+static int
+period_set_stab(ExpandedPeriodSet *eps, int k, TimestampTz ts, bool inclusive,
+				int *matches)
+{
+	int lo = 0;
+	int hi = k;
+	int m = 0;
+	int i;
+
+	period_set_fill_max_next(eps, k);
+	while(lo < hi) {
+		int mid = lo + (hi - lo) / 2;
+
+		if(eps->max_next[mid] > ts || (inclusive && eps->max_next[mid] == ts))
+			hi = mid;
+		else
+			lo = mid + 1;
+	}
+
+	if(inclusive) {
+		for(i = lo; i < k; i++) {
+			matches[m] = i;
+			m += (eps->periods[i].next >= ts);
+		}
+	}
+	else {
+		for(i = lo; i < k; i++) {
+			matches[m] = i;
+			m += (eps->periods[i].next > ts);
+		}
+	}
+	return m;
+}
+
+static void
+period_set_insert(ExpandedPeriodSet *eps, period *p)
+{
+	bool found;
+	int pos;
+
+	if(period_is_empty(p)) {
+		eps->nempty = 1;
+		return;
+	}
+
+	pos = period_set_search(eps, p, &found);
+	if(found)
+		return;
+
+	/*
+	 * Grow both arrays before recording the new length, so that if either
+	 * repalloc fails, a set changed in place still describes what it has.
+	 */
+	if(eps->nperiods >= eps->nalloc) {
+		int nalloc = eps->nalloc * 2;
+
+		eps->periods = (period *) repalloc(eps->periods,
+			nalloc * sizeof(period));
+		eps->max_next = (TimestampTz *) repalloc(eps->max_next,
+			nalloc * sizeof(TimestampTz));
+		eps->nalloc = nalloc;
+	}
+
+	memmove(&eps->periods[pos + 1], &eps->periods[pos],
+			(eps->nperiods - pos) * sizeof(period));
+	period_copy(p, &eps->periods[pos]);
+	eps->nperiods++;
+
+	if(eps->nvalid > pos)
+		eps->nvalid = pos;
+}
+
+static void
+period_set_delete(ExpandedPeriodSet *eps, period *p)
+{
+	bool found;
+	int pos;
+
+	if(period_is_empty(p)) {
+		eps->nempty = 0;
+		return;
+	}
+
+	pos = period_set_search(eps, p, &found);
+	if(!found)
+		return;
+
+	memmove(&eps->periods[pos], &eps->periods[pos + 1],
+			(eps->nperiods - pos - 1) * sizeof(period));
+	eps->nperiods--;
+
+	if(eps->nvalid > pos)
+		eps->nvalid = pos;
+}
+
+/************************************************
+ * Input/output
+ ************************************************/
+
+PG_FUNCTION_INFO_V1(period_set_in);
+Datum
+period_set_in(PG_FUNCTION_ARGS)
+{
+	int n;
+	period *periods = period_parse_list(PG_GETARG_CSTRING(0), "period_set", &n);
+
+	PG_RETURN_POINTER(period_set_build(periods, n));
+}
+
+PG_FUNCTION_INFO_V1(period_set_out);
+Datum
+period_set_out(PG_FUNCTION_ARGS)
+{
+	ExpandedPeriodSet tmp;
+	ExpandedPeriodSet *eps = period_set_reader(PG_GETARG_DATUM(0), &tmp);
+	StringInfoData buf;
+	int i;
+
+	initStringInfo(&buf);
+	appendStringInfoChar(&buf, '{');
+	if(eps->nempty)
+		appendStringInfoString(&buf, "-EMPTY-");
+	for(i = 0; i < eps->nperiods; i++) {
+		if(buf.len > 1)
+			appendStringInfoString(&buf, ", ");
+		appendStringInfoString(&buf, DatumGetCString(DirectFunctionCall1(
+			period_out, PointerGetDatum(&eps->periods[i]))));
+	}
+	appendStringInfoChar(&buf, '}');
+
+	PG_RETURN_CSTRING(buf.data);
+}
+
+/************************************************
+ * Conversion to and from period[]
+ ************************************************/
+
+PG_FUNCTION_INFO_V1(period_set_from_array);
+Datum
+period_set_from_array(PG_FUNCTION_ARGS)
+{
+	ArrayType *array = PG_GETARG_ARRAYTYPE_P(0);
+	Datum *elems;
+	bool *nulls;
+	period *periods;
+	int n, i;
+
+	deconstruct_array(array, ARR_ELEMTYPE(array), sizeof(period), false, 'd',
+					  &elems, &nulls, &n);
+
+	periods = (period *) palloc(Max(n, 1) * sizeof(period));
+	for(i = 0; i < n; i++) {
+		if(nulls[i])
+			elog(ERROR,"period_set cannot contain NULL periods");
+		period_copy((period *) DatumGetPointer(elems[i]), &periods[i]);
+	}
+
+	PG_RETURN_POINTER(period_set_build(periods, n));
+}
+
+PG_FUNCTION_INFO_V1(period_set_to_array);
+Datum
+period_set_to_array(PG_FUNCTION_ARGS)
+{
+	ExpandedPeriodSet tmp;
+	ExpandedPeriodSet *eps = period_set_reader(PG_GETARG_DATUM(0), &tmp);
+	Oid elemtype = get_element_type(get_fn_expr_rettype(fcinfo->flinfo));
+	int n = eps->nempty + eps->nperiods;
+	period *periods = (period *) palloc(Max(n, 1) * sizeof(period));
+	Datum *elems = (Datum *) palloc(Max(n, 1) * sizeof(Datum));
+	int i;
+
+	if(!OidIsValid(elemtype))
+		elog(ERROR,"could not determine the element type of period[]");
+
+	if(eps->nempty)
+		period_empty_period(&periods[0]);
+	memcpy(&periods[eps->nempty], eps->periods, eps->nperiods * sizeof(period));
+
+	for(i = 0; i < n; i++)
+		elems[i] = PointerGetDatum(&periods[i]);
+
+	PG_RETURN_ARRAYTYPE_P(construct_array(elems, n, elemtype,
+										  sizeof(period), false, 'd'));
+}
+
+/************************************************
+ * Updates
+ ************************************************/
+
+PG_FUNCTION_INFO_V1(period_set_add);
+Datum
+period_set_add(PG_FUNCTION_ARGS)
+{
+	ExpandedPeriodSet *eps = period_set_modifiable(fcinfo, 0);
+	period *p = (period*)PG_GETARG_POINTER(1);
+
+	period_set_insert(eps, p);
+	PG_RETURN_DATUM(period_set_result(eps));
+}
+
+PG_FUNCTION_INFO_V1(period_set_remove);
+Datum
+period_set_remove(PG_FUNCTION_ARGS)
+{
+	ExpandedPeriodSet *eps = period_set_modifiable(fcinfo, 0);
+	period *p = (period*)PG_GETARG_POINTER(1);
+
+	period_set_delete(eps, p);
+	PG_RETURN_DATUM(period_set_result(eps));
+}
+
+/*
+ * Planner support for period_set_add and period_set_remove: tell
+ * PL/pgSQL that in "s := period_set_add(s, p)" the variable s may be
+ * passed as a read/write pointer and updated in place.
+ */
+PG_FUNCTION_INFO_V1(period_set_support);
+Datum
+period_set_support(PG_FUNCTION_ARGS)
+{
+#if PG_VERSION_NUM >= 180000
+	Node *rawreq = (Node *) PG_GETARG_POINTER(0);
+
+	if(IsA(rawreq, SupportRequestModifyInPlace)) {
+		SupportRequestModifyInPlace *req = (SupportRequestModifyInPlace *) rawreq;
+		Param *arg = (Param *) linitial(req->args);
+
+		if(arg && IsA(arg, Param) && arg->paramkind == PARAM_EXTERN &&
+		   arg->paramid == req->paramid)
+			PG_RETURN_POINTER(arg);
+	}
+#endif
+	PG_RETURN_POINTER(NULL);
+}
+
+/************************************************
+ * Other functions
+ ************************************************/
+
+PG_FUNCTION_INFO_V1(period_set_count);
+Datum
+period_set_count(PG_FUNCTION_ARGS)
+{
+	ExpandedPeriodSet tmp;
+	ExpandedPeriodSet *eps = period_set_reader(PG_GETARG_DATUM(0), &tmp);
+
+	PG_RETURN_INT32(eps->nperiods + eps->nempty);
+}
+
+PG_FUNCTION_INFO_V1(period_set_contains);
+Datum
+period_set_contains(PG_FUNCTION_ARGS)
+{
+	ExpandedPeriodSet tmp;
+	ExpandedPeriodSet *eps = period_set_reader(PG_GETARG_DATUM(0), &tmp);
+	period *query = (period*)PG_GETARG_POINTER(1);
+
+	PG_RETURN_BOOL(period_set_contains_internal(eps, query));
+}
+
+PG_FUNCTION_INFO_V1(period_set_contains_timestamptz);
+Datum
+period_set_contains_timestamptz(PG_FUNCTION_ARGS)
+{
+	ExpandedPeriodSet tmp;
+	ExpandedPeriodSet *eps = period_set_reader(PG_GETARG_DATUM(0), &tmp);
+	TimestampTz arg = PG_GETARG_TIMESTAMPTZ(1);
+	period query;
+
+	query.first = arg;
+	query.next = next_timestamptz(arg);
+
+	PG_RETURN_BOOL(period_set_contains_internal(eps, &query));
+}
+
+PG_FUNCTION_INFO_V1(period_set_overlaps);
+Datum
+period_set_overlaps(PG_FUNCTION_ARGS)
+{
+	ExpandedPeriodSet tmp;
+	ExpandedPeriodSet *eps = period_set_reader(PG_GETARG_DATUM(0), &tmp);
+	period *query = (period*)PG_GETARG_POINTER(1);
+
+	PG_RETURN_BOOL(period_set_overlaps_internal(eps, query));
+}
+
+/************************************************
+ * Stabbing queries
+ ************************************************/
+
+/*
+ * Return, one per call, the periods in the set that contain (or, if
+ * !contains, overlap) the query.
+ */
+static Datum
+period_set_stab_srf(FunctionCallInfo fcinfo, period *query, bool contains)
+{
+	FuncCallContext *funcctx;
+	period *result;
+
+	if(SRF_IS_FIRSTCALL()) {
+		MemoryContext oldcontext;
+		ExpandedPeriodSet tmp;
+		ExpandedPeriodSet *eps;
+		int *matches;
+		int nmatches = 0;
+		int k, i;
+
+		funcctx = SRF_FIRSTCALL_INIT();
+		oldcontext = MemoryContextSwitchTo(funcctx->multi_call_memory_ctx);
+
+		eps = period_set_reader(PG_GETARG_DATUM(0), &tmp);
+		result = (period *) palloc((eps->nperiods + 1) * sizeof(period));
+		matches = (int *) palloc(Max(eps->nperiods, 1) * sizeof(int));
+
+		if(period_is_empty(query)) {
+			// everything contains the empty period, and nothing overlaps it
+			if(contains) {
+				if(eps->nempty)
+					period_empty_period(&result[nmatches++]);
+				memcpy(&result[nmatches], eps->periods,
+					   eps->nperiods * sizeof(period));
+				nmatches += eps->nperiods;
+			}
+		}
+		else {
+			int nfound;
+
+			if(contains) {
+				k = period_set_prefix(eps, query->first, true);
+				nfound = period_set_stab(eps, k, query->next, true, matches);
+			}
+			else {
+				k = period_set_prefix(eps, query->next, false);
+				nfound = period_set_stab(eps, k, query->first, false, matches);
+			}
+			for(i = 0; i < nfound; i++)
+				period_copy(&eps->periods[matches[i]], &result[nmatches++]);
+		}
+
+		funcctx->user_fctx = result;
+		funcctx->max_calls = nmatches;
+		MemoryContextSwitchTo(oldcontext);
+	}
+
+	funcctx = SRF_PERCALL_SETUP();
+	result = (period *) funcctx->user_fctx;
+
+	if(funcctx->call_cntr < funcctx->max_calls)
+		SRF_RETURN_NEXT(funcctx, PointerGetDatum(&result[funcctx->call_cntr]));
+
+	SRF_RETURN_DONE(funcctx);
+}
+
+PG_FUNCTION_INFO_V1(period_set_containing);
+Datum
+period_set_containing(PG_FUNCTION_ARGS)
+{
+	period *query = (period*)PG_GETARG_POINTER(1);
+
+	return period_set_stab_srf(fcinfo, query, true);
+}
+
+PG_FUNCTION_INFO_V1(period_set_containing_timestamptz);
+Datum
+period_set_containing_timestamptz(PG_FUNCTION_ARGS)
+{
+	TimestampTz arg = PG_GETARG_TIMESTAMPTZ(1);
+	period query;
+
+	query.first = arg;
+	query.next = next_timestamptz(arg);
+
+	return period_set_stab_srf(fcinfo, &query, true);
+}
+
+PG_FUNCTION_INFO_V1(period_set_overlapping);
+Datum
+period_set_overlapping(PG_FUNCTION_ARGS)
+{
+	period *query = (period*)PG_GETARG_POINTER(1);
+
+	return period_set_stab_srf(fcinfo, query, false);
+}
@@ -0,0 +1,199 @@
+/*
+ * portion.c
+ *   Implements period_apply_portion, UPDATE and DELETE FOR PORTION OF.
+ *
+ * Changing a row for only part of its period splits it into up to three
+ * pieces: the part inside the portion, which is changed or deleted, and
+ * the leftovers before and after it, which keep the old values.
+ * period_minus can't express the case where both leftovers exist, and
+ * doing this row by row is slow, so period_apply_portion builds a single
+ * statement that locks the affected rows and reads their old values,
+ * updates or deletes them by ctid, and inserts every leftover piece from
+ * the rows it read, each as one set-based executor node.
+ * Running it all as one statement also means constraint triggers such
+ * as temporal_unique only see the finished result.
+ */
+
+#include "period.h"
+#include "access/heapam.h"
+#include "access/htup_details.h"
+#include "catalog/pg_type.h"
+#include "executor/spi.h"
+#include "lib/stringinfo.h"
+#include "utils/lsyscache.h"
+#include "utils/rel.h"
+#include "utils/syscache.h"
+
+#if PG_VERSION_NUM < 100000
+#define TupleDescAttr(tupdesc, i) ((tupdesc)->attrs[(i)])
+#endif
+
+/*
+ * period_apply_portion(table, key_column, key, period_column, portion, changes)
+ *
+ * For the rows of table with key_column = key (or all rows, if key is
+ * NULL) whose period_column overlaps portion, apply the SET list changes
+ * to the part inside portion, or delete that part if changes is NULL.
+ * Returns the number of rows changed or deleted.
+ */
+PG_FUNCTION_INFO_V1(period_apply_portion);
+Datum
+period_apply_portion(PG_FUNCTION_ARGS)
+{
+	Oid relid;
+	char *key_column;
+	char *period_column;
+	period *portion;
+	Relation rel;
+	TupleDesc tupdesc;
+	HeapTuple typtup;
+	Form_pg_type typform;
+	char *relname;
+	char *key;
+	char *per;
+	char *nsp;
+	char *where;
+	char *change;
+	StringInfoData cols, before, after;
+	Oid argtypes[2];
+	Datum values[2];
+	char nulls[2] = { ' ', ' ' };
+	int period_attnum;
+	int64 result;
+	bool isnull;
+	char *query;
+	int i;
+
+	if(PG_ARGISNULL(0) || PG_ARGISNULL(1) || PG_ARGISNULL(3) || PG_ARGISNULL(4))
+		elog(ERROR,"period_apply_portion: table, key_column, period_column and portion must not be NULL");
+
+	relid = PG_GETARG_OID(0);
+	key_column = text_to_cstring(PG_GETARG_TEXT_PP(1));
+	period_column = text_to_cstring(PG_GETARG_TEXT_PP(3));
+	portion = (period*)PG_GETARG_POINTER(4);
+	if(period_is_empty(portion))
+		PG_RETURN_INT64(0);
+
+	rel = relation_open(relid, RowExclusiveLock);
+	tupdesc = RelationGetDescr(rel);
+	relname = quote_qualified_identifier(
+		get_namespace_name(RelationGetNamespace(rel)),
+		RelationGetRelationName(rel));
+
+	if(get_attnum(relid, key_column) == InvalidAttrNumber)
+		elog(ERROR,"period_apply_portion: column \"%s\" does not exist in \"%s\"",
+			 key_column, RelationGetRelationName(rel));
+	period_attnum = get_attnum(relid, period_column);
+	if(period_attnum == InvalidAttrNumber)
+		elog(ERROR,"period_apply_portion: column \"%s\" does not exist in \"%s\"",
+			 period_column, RelationGetRelationName(rel));
+	if(TupleDescAttr(tupdesc, period_attnum - 1)->atttypid !=
+	   get_fn_expr_argtype(fcinfo->flinfo, 4))
+		elog(ERROR,"period_apply_portion: column \"%s\" must be of type period",
+			 period_column);
+
+	/* the period functions, from the schema of the period type */
+	typtup = SearchSysCache1(TYPEOID,
+		ObjectIdGetDatum(TupleDescAttr(tupdesc, period_attnum - 1)->atttypid));
+	if(!HeapTupleIsValid(typtup))
+		elog(ERROR,"cache lookup failed for type %u",
+			 TupleDescAttr(tupdesc, period_attnum - 1)->atttypid);
+	typform = (Form_pg_type) GETSTRUCT(typtup);
+	nsp = quote_identifier(get_namespace_name(typform->typnamespace));
+	ReleaseSysCache(typtup);
+
+	key = quote_identifier(key_column);
+	per = quote_identifier(period_column);
+
+	/*
+	 * The leftovers copy every stored column, with the period cut down,
+	 * except identity columns: they are surrogate keys, so each piece
+	 * gets a new one.
+	 */
+	initStringInfo(&cols);
+	initStringInfo(&before);
+	initStringInfo(&after);
+	for(i = 0; i < tupdesc->natts; i++) {
+		Form_pg_attribute att = TupleDescAttr(tupdesc, i);
+		const char *name;
+
+		if(att->attisdropped)
+			continue;
+#if PG_VERSION_NUM >= 120000
+		if(att->attgenerated)
+			continue;
+#endif
+#if PG_VERSION_NUM >= 100000
+		if(att->attidentity)
+			continue;
+#endif
+		name = quote_identifier(NameStr(att->attname));
+		if(cols.len > 0) {
+			appendStringInfoString(&cols, ", ");
+			appendStringInfoString(&before, ", ");
+			appendStringInfoString(&after, ", ");
+		}
+		appendStringInfoString(&cols, name);
+		if(i + 1 == period_attnum) {
+			appendStringInfo(&before, "%s.period(%s.first(a.%s), %s.first($1))",
+							 nsp, nsp, per, nsp);
+			appendStringInfo(&after, "%s.period(%s.next($1), %s.next(a.%s))",
+							 nsp, nsp, nsp, per);
+		} else {
+			appendStringInfo(&before, "a.%s", name);
+			appendStringInfo(&after, "a.%s", name);
+		}
+	}
+
+	argtypes[0] = get_fn_expr_argtype(fcinfo->flinfo, 4);
+	values[0] = PointerGetDatum(portion);
+	argtypes[1] = get_fn_expr_argtype(fcinfo->flinfo, 2);
+	values[1] = (Datum) 0;
+	if(PG_ARGISNULL(2)) {
+		nulls[1] = 'n';
+		where = psprintf("t.%s OPERATOR(%s.&&) $1", per, nsp);
+	} else {
+		values[1] = PG_GETARG_DATUM(2);
+		where = psprintf("t.%s = $2 AND t.%s OPERATOR(%s.&&) $1", key, per, nsp);
+	}
+
+	/*
+	 * The change finds its rows through affected, so the rows are locked
+	 * and their old values read before any of them is changed: the
+	 * executor only runs a CTE when something reads it, and leftover, the
+	 * other reader, isn't run until after changed. Locking afterwards
+	 * would skip the rows this command had already changed.
+	 */
+	if(PG_ARGISNULL(5))
+		change = psprintf("DELETE FROM ONLY %s t"
+						  " WHERE t.ctid = ANY (ARRAY(SELECT a.portion_ctid FROM affected a))",
+						  relname);
+	else
+		change = psprintf("UPDATE ONLY %s t SET %s = %s.period_intersect(t.%s, $1), %s"
+						  " WHERE t.ctid = ANY (ARRAY(SELECT a.portion_ctid FROM affected a))",
+						  relname, per, nsp, per, text_to_cstring(PG_GETARG_TEXT_PP(5)));
+
+	query = psprintf(
+		"WITH affected AS (SELECT t.ctid AS portion_ctid, t.* FROM ONLY %s t WHERE %s FOR UPDATE),"
+		" changed AS (%s RETURNING 1),"
+		" leftover AS (INSERT INTO %s (%s)"
+		" SELECT %s FROM affected a WHERE %s.first(a.%s) < %s.first($1)"
+		" UNION ALL"
+		" SELECT %s FROM affected a WHERE %s.next(a.%s) > %s.next($1)"
+		" RETURNING 1)"
+		" SELECT count(*) FROM changed",
+		relname, where, change, relname, cols.data,
+		before.data, nsp, per, nsp,
+		after.data, nsp, per, nsp);
+
+	if(SPI_connect() != SPI_OK_CONNECT)
+		elog(ERROR,"period_apply_portion: SPI_connect failed");
+	if(SPI_execute_with_args(query, 2, argtypes, values, nulls, false, 0) != SPI_OK_SELECT)
+		elog(ERROR,"period_apply_portion: SPI_execute failed for \"%s\"", query);
+	result = DatumGetInt64(SPI_getbinval(SPI_tuptable->vals[0],
+										 SPI_tuptable->tupdesc, 1, &isnull));
+	SPI_finish();
+
+	relation_close(rel, NoLock);
+	PG_RETURN_INT64(result);
+}
@@ -0,0 +1,142 @@
+/*
+ * range.c
+ *   Implements the casts between period and tstzrange, and the
+ *   operators comparing one with the other.
+ *
+ * Both are a pair of timestamps, so the conversions read and write the
+ * bounds directly rather than going through text. A range's exclusive
+ * lower bound and inclusive upper bound become the next microsecond,
+ * and its missing bounds become -infinity and infinity, which a period
+ * uses for "no end"; a period's infinite bounds become missing ones.
+ * The operators convert the range and apply the period operator, so
+ * their meaning is the period one, and gist_period_ops answers them as
+ * strategies 41 to 45 the same way.
+ *
+ * Range types appeared in PostgreSQL 9.2.
+ */
+
+#include "period.h"
+#include "catalog/pg_type.h"
+#include "utils/typcache.h"
+#if PG_VERSION_NUM >= 90200
+#include "utils/rangetypes.h"
+#endif
+
+#if PG_VERSION_NUM >= 90200
+
+#if PG_VERSION_NUM < 110000
+#define DatumGetRangeTypeP(d) DatumGetRangeType(d)
+#define RangeTypePGetDatum(r) RangeTypeGetDatum(r)
+#endif
+
+/* The type cache entry of tstzrange, kept in flinfo */
+static TypeCacheEntry *
+range_typcache(FmgrInfo *flinfo)
+{
+	if(flinfo->fn_extra == NULL)
+		flinfo->fn_extra = lookup_type_cache(TSTZRANGEOID, TYPECACHE_RANGE_INFO);
+	return (TypeCacheEntry *) flinfo->fn_extra;
+}
+
+/*
+ * Convert the tstzrange range into result, and return it.
+ */
+period *
+period_from_tstzrange(FmgrInfo *flinfo, Datum range, period *result)
+{
+	RangeType *r = DatumGetRangeTypeP(range);
+	RangeBound lower, upper;
+	bool empty;
+
+	if(result == NULL)
+		result = (period *) palloc(sizeof(period));
+	range_deserialize(range_typcache(flinfo), r, &lower, &upper, &empty);
+	if(empty)
+		return period_empty_period(result);
+
+	if(lower.infinite)
+		TIMESTAMP_NOBEGIN(result->first);
+	else if(lower.inclusive)
+		result->first = DatumGetTimestampTz(lower.val);
+	else
+		result->first = next_timestamptz(DatumGetTimestampTz(lower.val));
+	if(upper.infinite)
+		TIMESTAMP_NOEND(result->next);
+	else if(upper.inclusive)
+		result->next = next_timestamptz(DatumGetTimestampTz(upper.val));
+	else
+		result->next = DatumGetTimestampTz(upper.val);
+
+	if(result->first >= result->next)
+		return period_empty_period(result);
+	return result;
+}
+
+PG_FUNCTION_INFO_V1(period_tstzrange);
+Datum
+period_tstzrange(PG_FUNCTION_ARGS)
+{
+	PG_RETURN_POINTER(period_from_tstzrange(fcinfo->flinfo, PG_GETARG_DATUM(0), NULL));
+}
+
+PG_FUNCTION_INFO_V1(tstzrange_period);
+Datum
+tstzrange_period(PG_FUNCTION_ARGS)
+{
+	period *p = (period*)PG_GETARG_POINTER(0);
+	TypeCacheEntry *typcache = range_typcache(fcinfo->flinfo);
+	RangeBound lower, upper;
+
+	if(period_is_empty(p))
+		PG_RETURN_DATUM(RangeTypePGetDatum(make_empty_range(typcache)));
+
+	lower.val = TimestampTzGetDatum(p->first);
+	lower.infinite = TIMESTAMP_IS_NOBEGIN(p->first);
+	lower.inclusive = !lower.infinite;
+	lower.lower = true;
+	upper.val = TimestampTzGetDatum(p->next);
+	upper.infinite = TIMESTAMP_IS_NOEND(p->next);
+	upper.inclusive = false;
+	upper.lower = false;
+
+#if PG_VERSION_NUM >= 160000
+	PG_RETURN_DATUM(RangeTypePGetDatum(make_range(typcache, &lower, &upper, false, NULL)));
+#else
+	PG_RETURN_DATUM(RangeTypePGetDatum(make_range(typcache, &lower, &upper, false)));
+#endif
+}
+
+/*
+ * The operators, with the period first and then with the range first.
+ * Each converts the range and calls the period function.
+ */
+#define RANGE_OPERATOR(name, test) \
+PG_FUNCTION_INFO_V1(name##_period_tstzrange); \
+Datum \
+name##_period_tstzrange(PG_FUNCTION_ARGS) \
+{ \
+	period *p1 = (period*)PG_GETARG_POINTER(0); \
+	period p2; \
+	period_from_tstzrange(fcinfo->flinfo, PG_GETARG_DATUM(1), &p2); \
+	PG_RETURN_BOOL(test(p1, &p2)); \
+} \
+PG_FUNCTION_INFO_V1(name##_tstzrange_period); \
+Datum \
+name##_tstzrange_period(PG_FUNCTION_ARGS) \
+{ \
+	period p1; \
+	period *p2 = (period*)PG_GETARG_POINTER(1); \
+	period_from_tstzrange(fcinfo->flinfo, PG_GETARG_DATUM(0), &p1); \
+	PG_RETURN_BOOL(test(&p1, p2)); \
+}
+
+#define RANGE_CONTAINED_BY(p1, p2) period_contains(p2, p1)
+#define RANGE_AFTER(p1, p2) period_before(p2, p1)
+
+RANGE_OPERATOR(overlaps, period_overlaps)
+RANGE_OPERATOR(contains, period_contains)
+RANGE_OPERATOR(contained_by, RANGE_CONTAINED_BY)
+RANGE_OPERATOR(before, period_before)
+RANGE_OPERATOR(after, RANGE_AFTER)
+
+#endif
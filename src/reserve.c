@@ -0,0 +1,312 @@
+/*
+ * reserve.c
+ *   Implements period_reserve, which claims a period for a key if no
+ *   other row of the key overlaps it.
+ *
+ * Under an exclusion constraint, concurrent claims for the same key only
+ * find out about each other when one of them fails to insert, and the
+ * losers retry, often into the same conflict. period_reserve instead
+ * serializes only the claims whose periods could overlap, then checks
+ * and inserts, and hands back the conflicting period rather than
+ * raising an error.
+ *
+ * Time is cut into buckets of a given width, and a claim takes a
+ * transaction advisory lock on (table and key, bucket) for each bucket
+ * its period touches, in order, after a shared lock on the table and
+ * key. Claims whose periods share no bucket don't wait for each other.
+ * Open ended claims, and those touching more than RESERVE_MAX_BUCKETS
+ * buckets, lock the table and key exclusively instead. Having waited,
+ * the check reads the latest snapshot, so it sees what the transactions
+ * it waited for committed. It probes the predecessor and successor of
+ * the period in a btree on (key_column, period_column), as
+ * temporal_unique does, which finds the overlap as long as the rows of
+ * a key don't overlap each other.
+ */
+
+#include "period.h"
+#include <math.h>
+#include "access/htup_details.h"
+#include "catalog/pg_type.h"
+#include "executor/spi.h"
+#include "funcapi.h"
+#include "utils/hsearch.h"
+#include "utils/inval.h"
+#include "utils/lsyscache.h"
+#include "utils/rel.h"
+#include "utils/snapmgr.h"
+#include "utils/syscache.h"
+#include "utils/typcache.h"
+
+#if PG_VERSION_NUM < 100000
+#define TupleDescAttr(tupdesc, i) ((tupdesc)->attrs[(i)])
+#endif
+
+#define RESERVE_MAX_BUCKETS 16
+
+/*
+ * The plans for a table and its columns, kept until the table changes.
+ */
+typedef struct
+{
+	Oid relid;
+	int16 key_attnum;
+	int16 period_attnum;
+} ReserveTarget;
+
+typedef struct
+{
+	ReserveTarget target;	/* hash key */
+	bool valid;
+	Oid key_type;
+	Oid key_collation;
+	TypeCacheEntry *key_typcache;	/* for the key's hash function, if any */
+	SPIPlanPtr probe_plan;
+	SPIPlanPtr insert_plan;
+} ReserveConfig;
+
+static HTAB *reserve_configs = NULL;
+
+/* Forget the plans for a table that changed */
+static void
+reserve_invalidate(Datum arg, Oid relid)
+{
+	HASH_SEQ_STATUS status;
+	ReserveConfig *config;
+
+	hash_seq_init(&status, reserve_configs);
+	while((config = (ReserveConfig *) hash_seq_search(&status)) != NULL) {
+		if(relid == InvalidOid || config->target.relid == relid)
+			config->valid = false;
+	}
+}
+
+static ReserveConfig *
+reserve_config(Relation rel, const char *key_column, const char *period_column,
+			   Oid key_type, Oid period_type)
+{
+	TupleDesc tupdesc = RelationGetDescr(rel);
+	ReserveTarget target;
+	ReserveConfig *config;
+	char *relname, *key, *per;
+	HeapTuple typtup;
+	char *nsp;
+	char *query;
+	Oid argtypes[2];
+	bool found;
+
+	if(reserve_configs == NULL) {
+		HASHCTL ctl;
+
+		memset(&ctl, 0, sizeof(ctl));
+		ctl.keysize = sizeof(ReserveTarget);
+		ctl.entrysize = sizeof(ReserveConfig);
+#if PG_VERSION_NUM >= 90500
+		reserve_configs = hash_create("period_reserve plans", 16, &ctl,
+									  HASH_ELEM | HASH_BLOBS);
+#else
+		ctl.hash = tag_hash;
+		reserve_configs = hash_create("period_reserve plans", 16, &ctl,
+									  HASH_ELEM | HASH_FUNCTION);
+#endif
+		CacheRegisterRelcacheCallback(reserve_invalidate, (Datum) 0);
+	}
+
+	memset(&target, 0, sizeof(target));
+	target.relid = RelationGetRelid(rel);
+	target.key_attnum = get_attnum(target.relid, key_column);
+	if(target.key_attnum == InvalidAttrNumber)
+		elog(ERROR,"period_reserve: column \"%s\" does not exist in \"%s\"",
+			 key_column, RelationGetRelationName(rel));
+	target.period_attnum = get_attnum(target.relid, period_column);
+	if(target.period_attnum == InvalidAttrNumber)
+		elog(ERROR,"period_reserve: column \"%s\" does not exist in \"%s\"",
+			 period_column, RelationGetRelationName(rel));
+	if(TupleDescAttr(tupdesc, target.key_attnum - 1)->atttypid != key_type)
+		elog(ERROR,"period_reserve: key must be of the type of column \"%s\"",
+			 key_column);
+	if(TupleDescAttr(tupdesc, target.period_attnum - 1)->atttypid != period_type)
+		elog(ERROR,"period_reserve: column \"%s\" must be of type period",
+			 period_column);
+
+	config = (ReserveConfig *) hash_search(reserve_configs, &target, HASH_ENTER, &found);
+	if(found && config->valid)
+		return config;
+
+	if(found && config->probe_plan)
+		SPI_freeplan(config->probe_plan);
+	if(found && config->insert_plan)
+		SPI_freeplan(config->insert_plan);
+	memset(config, 0, sizeof(ReserveConfig));
+	config->target = target;
+	config->key_type = key_type;
+	config->key_collation = TupleDescAttr(tupdesc, target.key_attnum - 1)->attcollation;
+	config->key_typcache = lookup_type_cache(key_type, TYPECACHE_HASH_PROC_FINFO);
+
+	/* the period operators, from the schema of the period type */
+	typtup = SearchSysCache1(TYPEOID, ObjectIdGetDatum(period_type));
+	if(!HeapTupleIsValid(typtup))
+		elog(ERROR,"cache lookup failed for type %u", period_type);
+	nsp = quote_identifier(get_namespace_name(((Form_pg_type) GETSTRUCT(typtup))->typnamespace));
+	ReleaseSysCache(typtup);
+
+	relname = quote_qualified_identifier(get_namespace_name(RelationGetNamespace(rel)),
+										 RelationGetRelationName(rel));
+	key = quote_identifier(key_column);
+	per = quote_identifier(period_column);
+	argtypes[0] = key_type;
+	argtypes[1] = period_type;
+
+	/* the predecessor and the successor, whichever overlaps */
+	query = psprintf(
+		"SELECT n.p FROM ("
+		"(SELECT x.%s AS p FROM ONLY %s x WHERE x.%s = $1 AND x.%s OPERATOR(%s.<=) $2"
+		" ORDER BY x.%s DESC LIMIT 1)"
+		" UNION ALL "
+		"(SELECT x.%s AS p FROM ONLY %s x WHERE x.%s = $1 AND x.%s OPERATOR(%s.>) $2"
+		" ORDER BY x.%s LIMIT 1)) n"
+		" WHERE n.p OPERATOR(%s.&&) $2 LIMIT 1",
+		per, relname, key, per, nsp, per,
+		per, relname, key, per, nsp, per, nsp);
+	config->probe_plan = SPI_prepare(query, 2, argtypes);
+	if(config->probe_plan == NULL)
+		elog(ERROR,"period_reserve: SPI_prepare failed for \"%s\"", query);
+	SPI_keepplan(config->probe_plan);
+
+	query = psprintf("INSERT INTO %s (%s, %s) VALUES ($1, $2)", relname, key, per);
+	config->insert_plan = SPI_prepare(query, 2, argtypes);
+	if(config->insert_plan == NULL)
+		elog(ERROR,"period_reserve: SPI_prepare failed for \"%s\"", query);
+	SPI_keepplan(config->insert_plan);
+
+	config->valid = true;
+	return config;
+}
+
+/* The bucket of width that ts falls in */
+static int64
+reserve_bucket(TimestampTz ts, TimestampTz width)
+{
+#ifdef HAVE_INT64_TIMESTAMP
+	int64 bucket = ts / width;
+
+	if(ts % width < 0)
+		bucket--;
+	return bucket;
+#else
+	return (int64) floor(ts / width);
+#endif
+}
+
+/*
+ * Lock the buckets of width that want touches for key, or the whole key
+ * if that is too many.
+ */
+static void
+reserve_lock(ReserveConfig *config, Datum key, period *want, TimestampTz width)
+{
+	uint32 hash = 0;
+	int64 resource;
+	int64 lo, hi, bucket;
+
+	if(OidIsValid(config->key_typcache->hash_proc_finfo.fn_oid))
+		hash = DatumGetUInt32(FunctionCall1Coll(&config->key_typcache->hash_proc_finfo,
+												config->key_collation, key));
+	resource = ((int64) config->target.relid << 32) | hash;
+
+	if(TIMESTAMP_NOT_FINITE(want->first) || TIMESTAMP_NOT_FINITE(want->next)) {
+		DirectFunctionCall1(pg_advisory_xact_lock_int8, Int64GetDatum(resource));
+		return;
+	}
+	lo = reserve_bucket(want->first, width);
+	hi = reserve_bucket(want->next, width);
+	/* a period ending on a boundary doesn't touch the next bucket */
+	if(hi > lo && hi * width == want->next)
+		hi--;
+	if(hi - lo >= RESERVE_MAX_BUCKETS) {
+		DirectFunctionCall1(pg_advisory_xact_lock_int8, Int64GetDatum(resource));
+		return;
+	}
+
+	DirectFunctionCall1(pg_advisory_xact_lock_shared_int8, Int64GetDatum(resource));
+	hash ^= (uint32) config->target.relid * 0x9E3779B9;
+	for(bucket = lo; bucket <= hi; bucket++)
+		DirectFunctionCall2(pg_advisory_xact_lock_int4, Int32GetDatum((int32) hash),
+							Int32GetDatum((int32) bucket));
+}
+
+/*
+ * period_reserve(table, key_column, key, period_column, want, bucket)
+ *
+ * Insert a row of table with key_column = key and period_column = want,
+ * unless another row with the key has an overlapping period. Returns
+ * whether the row was inserted, and the overlapping period if it wasn't.
+ */
+PG_FUNCTION_INFO_V1(period_reserve);
+Datum
+period_reserve(PG_FUNCTION_ARGS)
+{
+	Oid relid = PG_GETARG_OID(0);
+	char *key_column = text_to_cstring(PG_GETARG_TEXT_PP(1));
+	Datum key = PG_GETARG_DATUM(2);
+	char *period_column = text_to_cstring(PG_GETARG_TEXT_PP(3));
+	period *want = (period*)PG_GETARG_POINTER(4);
+	Interval *span = PG_GETARG_INTERVAL_P(5);
+	period *conflict = NULL;
+	ReserveConfig *config;
+	Relation rel;
+	TupleDesc tupdesc;
+	TimestampTz width;
+	Datum values[2];
+	Datum result[2];
+	bool nulls[2] = { false, false };
+
+	if(get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+		elog(ERROR,"period_reserve: return type must be a row type");
+	tupdesc = BlessTupleDesc(tupdesc);
+
+	if(span->month != 0)
+		elog(ERROR,"period_reserve: the bucket width must not be in months or years");
+#ifdef HAVE_INT64_TIMESTAMP
+	width = span->time + span->day * USECS_PER_DAY;
+#else
+	width = span->time + span->day * (double) SECS_PER_DAY;
+#endif
+	if(width <= 0)
+		elog(ERROR,"period_reserve: the bucket width must be positive");
+
+	rel = relation_open(relid, RowExclusiveLock);
+	if(SPI_connect() != SPI_OK_CONNECT)
+		elog(ERROR,"period_reserve: SPI_connect failed");
+	config = reserve_config(rel, key_column, period_column,
+							get_fn_expr_argtype(fcinfo->flinfo, 2),
+							get_fn_expr_argtype(fcinfo->flinfo, 4));
+
+	/* an empty period overlaps nothing */
+	if(!period_is_empty(want))
+		reserve_lock(config, key, want, width);
+
+	values[0] = key;
+	values[1] = PointerGetDatum(want);
+	if(SPI_execute_snapshot(config->probe_plan, values, NULL, GetLatestSnapshot(),
+							InvalidSnapshot, false, false, 1) != SPI_OK_SELECT)
+		elog(ERROR,"period_reserve: SPI_execute_snapshot failed");
+
+	if(SPI_processed > 0) {
+		bool isnull;
+
+		conflict = (period *) SPI_palloc(sizeof(period));
+		period_copy((period *) DatumGetPointer(SPI_getbinval(SPI_tuptable->vals[0],
+			SPI_tuptable->tupdesc, 1, &isnull)), conflict);
+	} else if(SPI_execute_plan(config->insert_plan, values, NULL, false, 0) != SPI_OK_INSERT)
+		elog(ERROR,"period_reserve: SPI_execute_plan failed");
+	SPI_finish();
+
+	relation_close(rel, NoLock);
+
+	result[0] = BoolGetDatum(conflict == NULL);
+	if(conflict == NULL)
+		nulls[1] = true;
+	else
+		result[1] = PointerGetDatum(conflict);
+	PG_RETURN_DATUM(HeapTupleGetDatum(heap_form_tuple(tupdesc, result, nulls)));
+}
@@ -0,0 +1,441 @@
+/*
+ * retention.c
+ *   Implements history retention: removing, or moving to an archive
+ *   table, the history rows whose period ended before a horizon.
+ *
+ * Policies live in the temporal_retention table. Rows are removed in
+ * small batches taken in period order along a btree on the period
+ * column, each batch its own transaction when run by the background
+ * worker, with a pause in between, so that expiring a year of history
+ * doesn't turn into one huge DELETE. Each batch also records its
+ * progress in the policy row, which temporal_retention_progress shows.
+ *
+ * The worker is registered when the library is in
+ * shared_preload_libraries and temporal.retention_database is set. It
+ * connects as the bootstrap superuser, so each batch runs as the owner
+ * of the table, in a restricted security context, and a policy is only
+ * applied if the owner may remove the rows and write the archive.
+ */
+
+#include "period.h"
+#include "access/htup_details.h"
+#include "access/xact.h"
+#include "catalog/pg_type.h"
+#include "executor/spi.h"
+#include "libpq/pqsignal.h"
+#include "miscadmin.h"
+#include "pgstat.h"
+#include "postmaster/bgworker.h"
+#include "storage/ipc.h"
+#include "storage/latch.h"
+#include "utils/acl.h"
+#include "utils/guc.h"
+#include "utils/lsyscache.h"
+#include "utils/memutils.h"
+#include "utils/snapmgr.h"
+#include "utils/syscache.h"
+
+/* GUCs */
+static char *retention_database = NULL;
+static int retention_naptime = 3600;
+static int retention_delay = 100;
+
+typedef struct
+{
+	Oid relid;
+	Oid owner;				/* of relid, who the batches run as */
+	char *period_column;
+	Oid archive;			/* or InvalidOid to delete */
+	int batch_size;
+	TimestampTz horizon;
+} RetentionPolicy;
+
+static char *retention_catalog(void);
+static int retention_policies(const char *catalog, Oid relid, int elevel,
+							  RetentionPolicy **policies, MemoryContext context);
+static int64 retention_batch(const char *catalog, RetentionPolicy *policy);
+
+/************************************************
+ * Batches
+ ************************************************/
+
+/*
+ * The qualified name of temporal_retention: in the extension's schema,
+ * or found through search_path when installed without CREATE EXTENSION.
+ * The caller is connected to SPI.
+ */
+static char *
+retention_catalog(void)
+{
+	if(SPI_execute("SELECT pg_catalog.quote_ident(n.nspname) FROM pg_catalog.pg_extension e"
+				   " JOIN pg_catalog.pg_namespace n ON n.oid = e.extnamespace"
+				   " WHERE e.extname = 'temporal'", true, 1) != SPI_OK_SELECT)
+		elog(ERROR,"temporal retention: SPI_execute failed");
+	if(SPI_processed == 0)
+		return "temporal_retention";
+	return psprintf("%s.temporal_retention",
+					SPI_getvalue(SPI_tuptable->vals[0], SPI_tuptable->tupdesc, 1));
+}
+
+/*
+ * Read the policies, or just the one for relid if it is valid, into
+ * context, with their horizons as of now. A policy whose table's owner
+ * may not remove its rows, or add them to the archive, is reported at
+ * elevel and left out. The caller is connected to SPI.
+ */
+static int
+retention_policies(const char *catalog, Oid relid, int elevel,
+				   RetentionPolicy **policies, MemoryContext context)
+{
+	Oid argtypes[1] = { OIDOID };
+	Datum values[1];
+	char *query;
+	int n, i;
+
+	values[0] = ObjectIdGetDatum(relid);
+	query = psprintf("SELECT r.relid, r.period_column, r.archive, r.batch_size, now() - r.retention,"
+					 " c.relowner, pg_catalog.pg_get_userbyid(c.relowner)"
+					 " FROM %s r JOIN pg_catalog.pg_class c ON c.oid = r.relid"
+					 " WHERE $1 = 0 OR r.relid = $1 ORDER BY r.relid", catalog);
+	if(SPI_execute_with_args(query, 1, argtypes, values, NULL, true, 0) != SPI_OK_SELECT)
+		elog(ERROR,"temporal retention: SPI_execute failed for \"%s\"", query);
+
+	*policies = (RetentionPolicy *) MemoryContextAlloc(context,
+		Max(SPI_processed, 1) * sizeof(RetentionPolicy));
+	n = 0;
+	for(i = 0; i < SPI_processed; i++) {
+		HeapTuple tuple = SPI_tuptable->vals[i];
+		TupleDesc tupdesc = SPI_tuptable->tupdesc;
+		RetentionPolicy *policy = &(*policies)[n];
+		AclMode needed = ACL_SELECT | ACL_UPDATE | ACL_DELETE;
+		bool isnull;
+
+		policy->relid = DatumGetObjectId(SPI_getbinval(tuple, tupdesc, 1, &isnull));
+		policy->owner = DatumGetObjectId(SPI_getbinval(tuple, tupdesc, 6, &isnull));
+		policy->archive = DatumGetObjectId(SPI_getbinval(tuple, tupdesc, 3, &isnull));
+		if(isnull)
+			policy->archive = InvalidOid;
+
+		/* what the batch does: select the rows for update, delete them, archive them */
+		if(pg_class_aclmask(policy->relid, policy->owner, needed, ACLMASK_ALL) != needed) {
+			elog(elevel,"temporal retention: role \"%s\" may not remove rows from \"%s\"",
+				 SPI_getvalue(tuple, tupdesc, 7), get_rel_name(policy->relid));
+			continue;
+		}
+		if(OidIsValid(policy->archive) &&
+		   pg_class_aclcheck(policy->archive, policy->owner, ACL_INSERT) != ACLCHECK_OK) {
+			elog(elevel,"temporal retention: role \"%s\" may not insert into \"%s\"",
+				 SPI_getvalue(tuple, tupdesc, 7), get_rel_name(policy->archive));
+			continue;
+		}
+
+		policy->period_column = MemoryContextStrdup(context,
+			SPI_getvalue(tuple, tupdesc, 2));
+		policy->batch_size = DatumGetInt32(SPI_getbinval(tuple, tupdesc, 4, &isnull));
+		policy->horizon = DatumGetTimestampTz(SPI_getbinval(tuple, tupdesc, 5, &isnull));
+		n++;
+	}
+	return n;
+}
+
+/*
+ * Remove, or move to the archive, up to batch_size rows whose period
+ * ended before the policy's horizon, in period order, and record the
+ * progress. The rows are removed as the owner of the table, like
+ * VACUUM and REFRESH MATERIALIZED VIEW do, so that triggers and the
+ * archive see the owner rather than whoever runs the batch. Returns the
+ * number of rows removed. The caller is connected to SPI.
+ */
+static int64
+retention_batch(const char *catalog, RetentionPolicy *policy)
+{
+	char *relname;
+	char *per;
+	char *nsp;
+	HeapTuple typtup;
+	Oid period_type;
+	Oid argtypes[4];
+	Datum values[4];
+	TimestampTz start = GetCurrentTimestamp();
+	Oid save_userid;
+	int save_sec_context;
+	long secs;
+	int usecs;
+	int64 removed;
+	bool isnull;
+	char *query;
+
+	relname = quote_qualified_identifier(
+		get_namespace_name(get_rel_namespace(policy->relid)),
+		get_rel_name(policy->relid));
+	per = quote_identifier(policy->period_column);
+
+	/* the period functions, from the schema of the period type */
+	period_type = get_atttype(policy->relid,
+							  get_attnum(policy->relid, policy->period_column));
+	typtup = SearchSysCache1(TYPEOID, ObjectIdGetDatum(period_type));
+	if(!HeapTupleIsValid(typtup))
+		elog(ERROR,"temporal retention: column \"%s\" does not exist in \"%s\"",
+			 policy->period_column, relname);
+	nsp = quote_identifier(get_namespace_name(
+		((Form_pg_type) GETSTRUCT(typtup))->typnamespace));
+	ReleaseSysCache(typtup);
+
+	/* the < bound lets a btree on the period column find the batch */
+	query = psprintf(
+		"WITH batch AS (SELECT t.ctid FROM ONLY %s t"
+		" WHERE t.%s OPERATOR(%s.<) %s.period($1) AND t.%s OPERATOR(%s.<<) %s.period($1)"
+		" ORDER BY t.%s LIMIT $2 FOR UPDATE"
+#if PG_VERSION_NUM >= 90500
+		" SKIP LOCKED"
+#endif
+		"), removed AS (DELETE FROM ONLY %s t"
+		" WHERE t.ctid = ANY (ARRAY(SELECT ctid FROM batch)) RETURNING t.*)"
+		"%s%s%s"
+		" SELECT count(*) FROM removed",
+		relname, per, nsp, nsp, per, nsp, nsp, per, relname,
+		OidIsValid(policy->archive) ? ", archived AS (INSERT INTO " : "",
+		OidIsValid(policy->archive) ? quote_qualified_identifier(
+			get_namespace_name(get_rel_namespace(policy->archive)),
+			get_rel_name(policy->archive)) : "",
+		OidIsValid(policy->archive) ? " SELECT * FROM removed)" : "");
+
+	argtypes[0] = TIMESTAMPTZOID;
+	values[0] = TimestampTzGetDatum(policy->horizon);
+	argtypes[1] = INT4OID;
+	values[1] = Int32GetDatum(policy->batch_size);
+	GetUserIdAndSecContext(&save_userid, &save_sec_context);
+	SetUserIdAndSecContext(policy->owner,
+						   save_sec_context | SECURITY_LOCAL_USERID_CHANGE | SECURITY_RESTRICTED_OPERATION);
+	if(SPI_execute_with_args(query, 2, argtypes, values, NULL, false, 0) != SPI_OK_SELECT)
+		elog(ERROR,"temporal retention: SPI_execute failed for \"%s\"", query);
+	removed = DatumGetInt64(SPI_getbinval(SPI_tuptable->vals[0],
+										  SPI_tuptable->tupdesc, 1, &isnull));
+	SetUserIdAndSecContext(save_userid, save_sec_context);
+
+	TimestampDifference(start, GetCurrentTimestamp(), &secs, &usecs);
+	query = psprintf("UPDATE %s SET horizon = $2, last_batch = pg_catalog.clock_timestamp(),"
+					 " batches = batches + 1, rows_removed = rows_removed + $3,"
+					 " busy = busy + $4 * interval '1 second' WHERE relid = $1", catalog);
+	argtypes[0] = OIDOID;
+	values[0] = ObjectIdGetDatum(policy->relid);
+	argtypes[1] = TIMESTAMPTZOID;
+	values[1] = TimestampTzGetDatum(policy->horizon);
+	argtypes[2] = INT8OID;
+	values[2] = Int64GetDatum(removed);
+	argtypes[3] = FLOAT8OID;
+	values[3] = Float8GetDatum(secs + usecs / 1000000.0);
+	if(SPI_execute_with_args(query, 4, argtypes, values, NULL, false, 0) != SPI_OK_UPDATE)
+		elog(ERROR,"temporal retention: SPI_execute failed for \"%s\"", query);
+
+	return removed;
+}
+
+/*
+ * temporal_retention_apply(table): apply table's policy now, in the
+ * current transaction and without pauses. Returns the rows removed. The
+ * caller must be allowed to delete from the table.
+ */
+PG_FUNCTION_INFO_V1(temporal_retention_apply);
+Datum
+temporal_retention_apply(PG_FUNCTION_ARGS)
+{
+	Oid relid = PG_GETARG_OID(0);
+	RetentionPolicy *policies;
+	char *catalog;
+	int64 total = 0;
+	int64 removed;
+
+	if(pg_class_aclcheck(relid, GetUserId(), ACL_DELETE) != ACLCHECK_OK)
+		elog(ERROR,"temporal_retention_apply: permission denied for \"%s\"", get_rel_name(relid));
+
+	if(SPI_connect() != SPI_OK_CONNECT)
+		elog(ERROR,"temporal_retention_apply: SPI_connect failed");
+
+	catalog = retention_catalog();
+	if(retention_policies(catalog, relid, ERROR, &policies, CurrentMemoryContext) == 0)
+		elog(ERROR,"temporal_retention_apply: no retention policy for \"%s\"",
+			 get_rel_name(relid));
+	do {
+		removed = retention_batch(catalog, &policies[0]);
+		total += removed;
+	} while(removed == policies[0].batch_size);
+
+	SPI_finish();
+	PG_RETURN_INT64(total);
+}
+
+/************************************************
+ * Background worker
+ ************************************************/
+
+#if PG_VERSION_NUM >= 90500
+
+static volatile sig_atomic_t retention_got_sighup = false;
+static volatile sig_atomic_t retention_got_sigterm = false;
+
+PGDLLEXPORT void temporal_retention_main(Datum main_arg);
+
+static void
+retention_sighup(SIGNAL_ARGS)
+{
+	int save_errno = errno;
+
+	retention_got_sighup = true;
+	SetLatch(MyLatch);
+	errno = save_errno;
+}
+
+static void
+retention_sigterm(SIGNAL_ARGS)
+{
+	int save_errno = errno;
+
+	retention_got_sigterm = true;
+	SetLatch(MyLatch);
+	errno = save_errno;
+}
+
+static void
+retention_begin(const char *activity)
+{
+	SetCurrentStatementStartTimestamp();
+	StartTransactionCommand();
+	if(SPI_connect() != SPI_OK_CONNECT)
+		elog(ERROR,"temporal retention: SPI_connect failed");
+	PushActiveSnapshot(GetTransactionSnapshot());
+	pgstat_report_activity(STATE_RUNNING, activity);
+}
+
+static void
+retention_end(void)
+{
+	SPI_finish();
+	PopActiveSnapshot();
+	CommitTransactionCommand();
+	pgstat_report_stat(false);
+	pgstat_report_activity(STATE_IDLE, NULL);
+}
+
+/* Sleep for timeout ms, or until woken; false if we should stop */
+static bool
+retention_sleep(long timeout)
+{
+	int rc;
+
+#if PG_VERSION_NUM >= 100000
+	rc = WaitLatch(MyLatch, WL_LATCH_SET | WL_TIMEOUT | WL_POSTMASTER_DEATH,
+				   timeout, PG_WAIT_EXTENSION);
+#else
+	rc = WaitLatch(MyLatch, WL_LATCH_SET | WL_TIMEOUT | WL_POSTMASTER_DEATH,
+				   timeout);
+#endif
+	ResetLatch(MyLatch);
+	if(rc & WL_POSTMASTER_DEATH)
+		proc_exit(1);
+	CHECK_FOR_INTERRUPTS();
+
+	if(retention_got_sighup) {
+		retention_got_sighup = false;
+		ProcessConfigFile(PGC_SIGHUP);
+	}
+	return !retention_got_sigterm;
+}
+
+/* Apply every policy, a batch per transaction */
+static void
+retention_run(MemoryContext context)
+{
+	RetentionPolicy *policies;
+	char *catalog;
+	int npolicies;
+	int i;
+
+	MemoryContextReset(context);
+
+	retention_begin("temporal retention: reading policies");
+	catalog = MemoryContextStrdup(context, retention_catalog());
+	npolicies = retention_policies(catalog, InvalidOid, WARNING, &policies, context);
+	retention_end();
+
+	for(i = 0; i < npolicies; i++) {
+		int64 removed;
+
+		do {
+			retention_begin("temporal retention: removing history");
+			removed = retention_batch(catalog, &policies[i]);
+			retention_end();
+			if(!retention_sleep(retention_delay))
+				return;
+		} while(removed == policies[i].batch_size);
+	}
+}
+
+void
+temporal_retention_main(Datum main_arg)
+{
+	MemoryContext context;
+
+	pqsignal(SIGHUP, retention_sighup);
+	pqsignal(SIGTERM, retention_sigterm);
+	BackgroundWorkerUnblockSignals();
+
+#if PG_VERSION_NUM >= 110000
+	BackgroundWorkerInitializeConnection(retention_database, NULL, 0);
+#else
+	BackgroundWorkerInitializeConnection(retention_database, NULL);
+#endif
+
+	context = AllocSetContextCreate(TopMemoryContext, "temporal retention",
+									ALLOCSET_DEFAULT_MINSIZE,
+									ALLOCSET_DEFAULT_INITSIZE,
+									ALLOCSET_DEFAULT_MAXSIZE);
+
+	while(!retention_got_sigterm) {
+		retention_run(context);
+		if(!retention_sleep(retention_naptime * 1000L))
+			break;
+	}
+	proc_exit(0);
+}
+
+#endif
+
+/*
+ * Define the GUCs, and register the worker if we're being preloaded and
+ * know which database to work in.
+ */
+void
+temporal_retention_init(void)
+{
+	DefineCustomStringVariable("temporal.retention_database",
+							   "Database in which the history retention worker applies policies.",
+							   NULL, &retention_database, NULL, PGC_POSTMASTER, 0,
+							   NULL, NULL, NULL);
+	DefineCustomIntVariable("temporal.retention_naptime",
+							"Time between history retention runs.",
+							NULL, &retention_naptime, 3600, 1, INT_MAX / 1000,
+							PGC_SIGHUP, GUC_UNIT_S, NULL, NULL, NULL);
+	DefineCustomIntVariable("temporal.retention_delay",
+							"Pause between history retention batches.",
+							NULL, &retention_delay, 100, 0, INT_MAX,
+							PGC_SIGHUP, GUC_UNIT_MS, NULL, NULL, NULL);
+
+#if PG_VERSION_NUM >= 90500
+	if(process_shared_preload_libraries_in_progress && retention_database != NULL) {
+		BackgroundWorker worker;
+
+		memset(&worker, 0, sizeof(worker));
+		worker.bgw_flags = BGWORKER_SHMEM_ACCESS | BGWORKER_BACKEND_DATABASE_CONNECTION;
+		worker.bgw_start_time = BgWorkerStart_RecoveryFinished;
+		worker.bgw_restart_time = 60;
+		snprintf(worker.bgw_library_name, BGW_MAXLEN, "temporal");
+		snprintf(worker.bgw_function_name, BGW_MAXLEN, "temporal_retention_main");
+		snprintf(worker.bgw_name, BGW_MAXLEN, "temporal retention worker");
+#if PG_VERSION_NUM >= 110000
+		snprintf(worker.bgw_type, BGW_MAXLEN, "temporal retention worker");
+#endif
+		RegisterBackgroundWorker(&worker);
+	}
+#endif
+}
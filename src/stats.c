@@ -0,0 +1,308 @@
+/*
+ * stats.c
+ *   Implements the counters behind pg_stat_temporal: how often the GiST
+ *   support functions of gist_period_ops and the period text conversions
+ *   run, and how well the index narrows searches.
+ *
+ * Nothing is counted unless temporal.track_stats is on, so when it's off
+ * an instrumented function only tests a bool. When the library is in
+ * shared_preload_libraries the counters live in shared memory, each
+ * count being one atomic add, and cover the whole server; otherwise they
+ * are kept for the current backend alone.
+ *
+ * A leaf page visit is when consistent runs for a page it didn't just
+ * run for, or for an earlier offset of the same page; it is unmatched if
+ * no key on it passes. Those visits are the descents an internal key
+ * let through for nothing.
+ */
+
+#include "period.h"
+#include "access/htup_details.h"
+#include "funcapi.h"
+#include "miscadmin.h"
+#include "storage/ipc.h"
+#include "storage/lwlock.h"
+#include "storage/shmem.h"
+#include "utils/guc.h"
+#include "utils/timestamp.h"
+#if PG_VERSION_NUM >= 90500
+#include "port/atomics.h"
+#endif
+
+bool temporal_track_stats = false;
+
+/* the counters, leaving room after the strategies of gist_period_ops */
+#define STAT_STRATEGIES 64
+#define STAT_CONSISTENT_INTERNAL 0
+#define STAT_CONSISTENT_LEAF (STAT_CONSISTENT_INTERNAL + STAT_STRATEGIES)
+#define STAT_LEAF_PAGES (STAT_CONSISTENT_LEAF + STAT_STRATEGIES)
+#define STAT_LEAF_PAGES_MATCHED (STAT_LEAF_PAGES + 1)
+#define STAT_PICKSPLIT (STAT_LEAF_PAGES_MATCHED + 1)
+#define STAT_PICKSPLIT_OVERLAPPING (STAT_PICKSPLIT + 1)
+#define STAT_PICKSPLIT_OVERLAP (STAT_PICKSPLIT_OVERLAPPING + 1)
+#define STAT_PERIOD_IN (STAT_PICKSPLIT_OVERLAP + 1)
+#define STAT_PERIOD_OUT (STAT_PERIOD_IN + 1)
+#define STAT_COUNTERS (STAT_PERIOD_OUT + 1)
+
+static const char *const stat_names[] = {
+	"leaf_pages", "leaf_pages_unmatched", "picksplit", "picksplit_overlapping",
+	"picksplit_overlap", "period_in", "period_out"
+};
+
+static uint64 stat_local[STAT_COUNTERS];
+static TimestampTz stat_local_reset = 0;
+
+#if PG_VERSION_NUM >= 90500
+
+typedef struct
+{
+	pg_atomic_uint64 counters[STAT_COUNTERS];
+	pg_atomic_uint64 reset;		/* a TimestampTz */
+} TemporalStats;
+
+static TemporalStats *stat_shared = NULL;
+static shmem_startup_hook_type prev_shmem_startup_hook = NULL;
+#if PG_VERSION_NUM >= 150000
+static shmem_request_hook_type prev_shmem_request_hook = NULL;
+#endif
+
+#endif
+
+/* the leaf page consistent last ran for in this backend */
+static Page stat_leaf_page = NULL;
+static OffsetNumber stat_leaf_offset = InvalidOffsetNumber;
+static bool stat_leaf_matched = false;
+
+static void
+stat_add(int counter, uint64 n)
+{
+#if PG_VERSION_NUM >= 90500
+	if(stat_shared != NULL) {
+		pg_atomic_fetch_add_u64(&stat_shared->counters[counter], n);
+		return;
+	}
+#endif
+	stat_local[counter] += n;
+}
+
+/*
+ * Count a call of gist_period_consistent, which returned result, on the
+ * key at offset of page.
+ */
+void
+temporal_stat_consistent(StrategyNumber strategy, bool leaf, Page page,
+						 OffsetNumber offset, bool result)
+{
+	if(strategy >= STAT_STRATEGIES)
+		strategy = 0;
+	if(!leaf) {
+		stat_add(STAT_CONSISTENT_INTERNAL + strategy, 1);
+		return;
+	}
+	stat_add(STAT_CONSISTENT_LEAF + strategy, 1);
+
+	if(page != stat_leaf_page || offset < stat_leaf_offset) {
+		stat_add(STAT_LEAF_PAGES, 1);
+		stat_leaf_page = page;
+		stat_leaf_matched = false;
+	}
+	stat_leaf_offset = offset;
+	if(result && !stat_leaf_matched) {
+		stat_add(STAT_LEAF_PAGES_MATCHED, 1);
+		stat_leaf_matched = true;
+	}
+}
+
+/*
+ * Count a picksplit into left and right, with the microseconds by which
+ * they overlap when that is finite.
+ */
+void
+temporal_stat_picksplit(period *left, period *right)
+{
+	period overlap;
+
+	stat_add(STAT_PICKSPLIT, 1);
+	period_intersect(left, right, &overlap);
+	if(period_is_empty(&overlap))
+		return;
+	stat_add(STAT_PICKSPLIT_OVERLAPPING, 1);
+	if(!TIMESTAMP_NOT_FINITE(overlap.first) && !TIMESTAMP_NOT_FINITE(overlap.next))
+		stat_add(STAT_PICKSPLIT_OVERLAP, (uint64) (overlap.next - overlap.first));
+}
+
+void
+temporal_stat_period_in(void)
+{
+	stat_add(STAT_PERIOD_IN, 1);
+}
+
+void
+temporal_stat_period_out(void)
+{
+	stat_add(STAT_PERIOD_OUT, 1);
+}
+
+/*
+ * temporal_stats()
+ *
+ * Returns (counter, strategy, value, stats_reset) for each counter, with
+ * a row per strategy for the consistent calls, leaving out the
+ * strategies that haven't been searched for.
+ */
+PG_FUNCTION_INFO_V1(temporal_stats);
+Datum
+temporal_stats(PG_FUNCTION_ARGS)
+{
+	FuncCallContext *funcctx;
+	uint64 *snapshot;
+	int counter;
+
+	if(SRF_IS_FIRSTCALL()) {
+		MemoryContext oldcontext;
+		TupleDesc tupdesc;
+		int i;
+
+		funcctx = SRF_FIRSTCALL_INIT();
+		oldcontext = MemoryContextSwitchTo(funcctx->multi_call_memory_ctx);
+
+		if(get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+			elog(ERROR,"temporal_stats: return type must be a row type");
+		funcctx->tuple_desc = BlessTupleDesc(tupdesc);
+
+		/* the counters and then the time they were reset */
+		snapshot = (uint64 *) palloc((STAT_COUNTERS + 1) * sizeof(uint64));
+		for(i = 0; i < STAT_COUNTERS; i++)
+			snapshot[i] = stat_local[i];
+		snapshot[STAT_COUNTERS] = (uint64) stat_local_reset;
+#if PG_VERSION_NUM >= 90500
+		if(stat_shared != NULL) {
+			for(i = 0; i < STAT_COUNTERS; i++)
+				snapshot[i] = pg_atomic_read_u64(&stat_shared->counters[i]);
+			snapshot[STAT_COUNTERS] = pg_atomic_read_u64(&stat_shared->reset);
+		}
+#endif
+		funcctx->user_fctx = snapshot;
+		MemoryContextSwitchTo(oldcontext);
+	}
+
+	funcctx = SRF_PERCALL_SETUP();
+	snapshot = (uint64 *) funcctx->user_fctx;
+
+	/* skip the strategies never searched for */
+	counter = funcctx->call_cntr;
+	while(counter < STAT_LEAF_PAGES && snapshot[counter] == 0)
+		counter++;
+
+	if(counter < STAT_COUNTERS) {
+		Datum values[4];
+		bool nulls[4] = { false, false, false, false };
+
+		if(counter < STAT_LEAF_PAGES) {
+			values[0] = CStringGetTextDatum(counter < STAT_CONSISTENT_LEAF ?
+											"consistent_internal" : "consistent_leaf");
+			values[1] = Int32GetDatum(counter % STAT_STRATEGIES);
+		} else {
+			values[0] = CStringGetTextDatum(stat_names[counter - STAT_LEAF_PAGES]);
+			nulls[1] = true;
+		}
+		if(counter == STAT_LEAF_PAGES_MATCHED)
+			values[2] = Int64GetDatum(snapshot[STAT_LEAF_PAGES] > snapshot[counter] ?
+									  (int64) (snapshot[STAT_LEAF_PAGES] - snapshot[counter]) : 0);
+		else
+			values[2] = Int64GetDatum((int64) snapshot[counter]);
+		if(snapshot[STAT_COUNTERS] == 0)
+			nulls[3] = true;
+		else
+			values[3] = TimestampTzGetDatum((TimestampTz) snapshot[STAT_COUNTERS]);
+
+		/* carry on from the next counter */
+		funcctx->call_cntr = counter;
+		SRF_RETURN_NEXT(funcctx, HeapTupleGetDatum(heap_form_tuple(funcctx->tuple_desc,
+																   values, nulls)));
+	}
+	SRF_RETURN_DONE(funcctx);
+}
+
+/*
+ * temporal_stats_reset()
+ *
+ * Sets the counters back to zero.
+ */
+PG_FUNCTION_INFO_V1(temporal_stats_reset);
+Datum
+temporal_stats_reset(PG_FUNCTION_ARGS)
+{
+	memset(stat_local, 0, sizeof(stat_local));
+	stat_local_reset = GetCurrentTimestamp();
+#if PG_VERSION_NUM >= 90500
+	if(stat_shared != NULL) {
+		int i;
+
+		for(i = 0; i < STAT_COUNTERS; i++)
+			pg_atomic_write_u64(&stat_shared->counters[i], 0);
+		pg_atomic_write_u64(&stat_shared->reset, (uint64) stat_local_reset);
+	}
+#endif
+	PG_RETURN_VOID();
+}
+
+#if PG_VERSION_NUM >= 90500
+
+#if PG_VERSION_NUM >= 150000
+static void
+stat_shmem_request(void)
+{
+	if(prev_shmem_request_hook)
+		prev_shmem_request_hook();
+	RequestAddinShmemSpace(MAXALIGN(sizeof(TemporalStats)));
+}
+#endif
+
+static void
+stat_shmem_startup(void)
+{
+	bool found;
+	int i;
+
+	if(prev_shmem_startup_hook)
+		prev_shmem_startup_hook();
+
+	LWLockAcquire(AddinShmemInitLock, LW_EXCLUSIVE);
+	stat_shared = (TemporalStats *) ShmemInitStruct("temporal stats", sizeof(TemporalStats),
+													&found);
+	if(!found) {
+		for(i = 0; i < STAT_COUNTERS; i++)
+			pg_atomic_init_u64(&stat_shared->counters[i], 0);
+		pg_atomic_init_u64(&stat_shared->reset, 0);
+	}
+	LWLockRelease(AddinShmemInitLock);
+}
+
+#endif
+
+/*
+ * Define the GUC, and ask for the shared counters if we're being
+ * preloaded.
+ */
+void
+temporal_stats_init(void)
+{
+	DefineCustomBoolVariable("temporal.track_stats",
+							 "Count GiST searches and splits and period conversions for pg_stat_temporal.",
+							 NULL, &temporal_track_stats, false, PGC_SUSET, 0,
+							 NULL, NULL, NULL);
+
+#if PG_VERSION_NUM >= 90500
+	if(process_shared_preload_libraries_in_progress) {
+#if PG_VERSION_NUM >= 150000
+		prev_shmem_request_hook = shmem_request_hook;
+		shmem_request_hook = stat_shmem_request;
+#else
+		RequestAddinShmemSpace(MAXALIGN(sizeof(TemporalStats)));
+#endif
+		prev_shmem_startup_hook = shmem_startup_hook;
+		shmem_startup_hook = stat_shmem_startup;
+	}
+#endif
+}
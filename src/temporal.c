@@ -9,55 +9,34 @@
 
 PG_MODULE_MAGIC;
 
-/* only used when HAVE_INT64_TIMESTAMP is not defined */
-#define DOUBLE_INF ((double)(1.0/0.0))
-
-/* larger than largest valid period input */
-#define MAX_REPR_SIZE 100
-
-/* support functions */
-static TimestampTz period_length(period *p);
-
-static period *period_dup(period *src);
-static period *period_copy(period *src, period *dst);
-
-static bool period_equals(period *p1, period *p2);
-static bool period_is_empty(period *p);
-static TimestampTz prior_timestamptz(TimestampTz ts);
-static TimestampTz next_timestamptz(TimestampTz ts);
-static bool period_adjacent(period *p1, period *p2);
-static bool period_contains(period *p1, period *p2);
-static bool period_overlaps(period *p1, period *p2);
-static bool period_overleft(period *p1, period *p2);
-static bool period_overright(period *p1, period *p2);
-static bool period_before(period *p1, period *p2);
-
-static period *period_empty_period(period *result);
-static period *period_minus(period *p1, period *p2, period *result);
-static period *period_intersect(period *p1, period *p2, period *result);
-static period *period_union(period *p1, period *p2, period *result, bool greedy);
+void _PG_init(void);
 
+void
+_PG_init(void)
+{
+	temporal_retention_init();
+	temporal_partition_init();
+	temporal_stats_init();
+}
 
 static bool gist_period_int_consistent(period *p, period *query,
 	StrategyNumber strategy);
 static bool gist_period_leaf_consistent(period *p, period *query,
 	StrategyNumber strategy);
 
-static int period_compare(period *p1, period *p2);
 static bool period_lessthan_timestamptz(period *p, TimestampTz ts);	/* djg */
 static bool period_greaterthan_timestamptz(period *p, TimestampTz ts); /* djg */
 
-static float period_size_approx(period *p);
-static float period_penalty(period *orig, period *new);
-
-static period *period_dup(period *src)
+period *
+period_dup(period *src)
 {
 	period *dst;
 	dst = (period*) palloc(sizeof(period));
 	return period_copy(src, dst);
 }
 
-static period *period_copy(period *src, period *dst)
+period *
+period_copy(period *src, period *dst)
 {
 	dst->first = src->first;
 	dst->next = src->next;
@@ -74,26 +53,26 @@ static period *period_copy(period *src, period *dst)
 #define STATE_STR2 2
 #define STATE_DONE 3
 
-PG_FUNCTION_INFO_V1(period_in);
-Datum
-period_in(PG_FUNCTION_ARGS)
+/*
+ * Split the text form of a period into the text of its two bounds, and
+ * whether each should be interpreted as inclusive or exclusive, based
+ * on '[' or ')', respectively. str1 and str2 must have room for
+ * MAX_REPR_SIZE bytes. Returns true if the input is the empty period,
+ * in which case nothing else is set.
+ *
+ * This is shared by every period type; only the parsing of the bounds
+ * themselves differs.
+ */
+bool
+period_parse_bounds(char *str, char *str1, char *str2,
+	bool *first_inc, bool *second_inc)
 {
-	char *str = PG_GETARG_CSTRING(0);
-	period *result;
-	char str1[MAX_REPR_SIZE];
-	char str2[MAX_REPR_SIZE];
 	int i, len1=0, len2=0;
 	int state=0;
 	bool empty=false;
-	bool first_inc=false, second_inc=false;
-	TimestampTz ts1, ts2;
 
-	result = (period*) palloc(sizeof(period));
+	*first_inc = *second_inc = false;
 
-	/* parse input so that we have:
-	 *  str1 and str2, and whether each should be interpreted as
-	 *  inclusive or exclusive, based on '[' or ')', respectively.
-	 */
 	for(i=0; str[i] && i < MAX_REPR_SIZE - 1; i++) {
 		if(state == STATE_INIT) {
 			switch(str[i]) {
@@ -105,11 +84,11 @@ period_in(PG_FUNCTION_ARGS)
 				continue;
 			case '[':
 				state = STATE_STR1;
-				first_inc = true;
+				*first_inc = true;
 				continue;
 			case '(':
 				state = STATE_STR1;
-				first_inc = false;
+				*first_inc = false;
 				continue;
 			default:
 				elog(ERROR,"Invalid period input");
@@ -125,12 +104,12 @@ period_in(PG_FUNCTION_ARGS)
 		}
 		else if(state == STATE_STR2) {
 			if(str[i] == ']') {
-				second_inc = true;
+				*second_inc = true;
 				state = STATE_DONE;
 				break;
 			}
 			if(str[i] == ')') {
-				second_inc = false;
+				*second_inc = false;
 				state = STATE_DONE;
 				break;
 			}
@@ -147,7 +126,25 @@ period_in(PG_FUNCTION_ARGS)
 		elog(ERROR,"invalid period input: parse error");
 	}
 
-	if(empty) {
+	return empty;
+}
+
+PG_FUNCTION_INFO_V1(period_in);
+Datum
+period_in(PG_FUNCTION_ARGS)
+{
+	char *str = PG_GETARG_CSTRING(0);
+	period *result;
+	char str1[MAX_REPR_SIZE];
+	char str2[MAX_REPR_SIZE];
+	bool first_inc, second_inc;
+	TimestampTz ts1, ts2;
+
+	if(temporal_track_stats)
+		temporal_stat_period_in();
+	result = (period*) palloc(sizeof(period));
+
+	if(period_parse_bounds(str, str1, str2, &first_inc, &second_inc)) {
 		result->first = (TimestampTz)0;
 		result->next = (TimestampTz)0;
 		PG_RETURN_POINTER(result);
@@ -184,6 +181,8 @@ period_out(PG_FUNCTION_ARGS)
 	char *result;
 	char *ts1,*ts2;
 
+	if(temporal_track_stats)
+		temporal_stat_period_out();
 	result = (char*) palloc(MAX_REPR_SIZE);
 	if(period_is_empty(p))
 		snprintf(result,MAX_REPR_SIZE,"-EMPTY-");
@@ -197,6 +196,60 @@ period_out(PG_FUNCTION_ARGS)
 	PG_RETURN_CSTRING(result);
 }
 
+/*
+ * Parse the text form shared by the types that hold a collection of
+ * periods: a brace-enclosed, comma-separated list, such as
+ * {[2009-01-01, 2009-02-01), -EMPTY-}. The commas inside each period
+ * are skipped by tracking the brackets. Returns a palloc'd array and
+ * sets *count; typname is only used in error messages.
+ */
+period *
+period_parse_list(char *input, const char *typname, int *count)
+{
+	char *str = pstrdup(input);
+	char *ptr = str;
+	char *elem;
+	period *periods;
+	int nalloc = 16;
+	int n = 0;
+	bool inside = false;
+	bool done = false;
+
+	while(*ptr == ' ')
+		ptr++;
+	if(*ptr++ != '{')
+		elog(ERROR,"invalid %s input: expected \"{\"", typname);
+
+	periods = (period *) palloc(nalloc * sizeof(period));
+	for(elem = ptr; *ptr && !done; ptr++) {
+		if(*ptr == '[' || *ptr == '(')
+			inside = true;
+		else if(*ptr == ']' || *ptr == ')')
+			inside = false;
+		else if(!inside && (*ptr == ',' || *ptr == '}')) {
+			done = (*ptr == '}');
+			*ptr = '\0';
+			if(strspn(elem, " ") != strlen(elem)) {
+				if(n >= nalloc) {
+					nalloc *= 2;
+					periods = (period *) repalloc(periods, nalloc * sizeof(period));
+				}
+				period_copy((period *) DatumGetPointer(DirectFunctionCall1(
+					period_in, CStringGetDatum(elem))), &periods[n++]);
+			}
+			else if(!done || n > 0)
+				elog(ERROR,"invalid %s input: empty element", typname);
+			elem = ptr + 1;
+		}
+	}
+	if(!done || strspn(ptr, " ") != strlen(ptr))
+		elog(ERROR,"invalid %s input: expected \"}\"", typname);
+
+	pfree(str);
+	*count = n;
+	return periods;
+}
+
 PG_FUNCTION_INFO_V1(period_oo_timestamptz_timestamptz);
 Datum
 period_oo_timestamptz_timestamptz(PG_FUNCTION_ARGS)
@@ -517,6 +570,106 @@ adjacent_period_period(PG_FUNCTION_ARGS)
 	PG_RETURN_BOOL(period_adjacent(p1,p2));
 }
 
+PG_FUNCTION_INFO_V1(meets_period_period);
+Datum
+meets_period_period(PG_FUNCTION_ARGS)
+{
+	period *p1 = (period*)PG_GETARG_POINTER(0);
+	period *p2 = (period*)PG_GETARG_POINTER(1);
+
+	PG_RETURN_BOOL(period_meets(p1,p2));
+}
+
+PG_FUNCTION_INFO_V1(met_by_period_period);
+Datum
+met_by_period_period(PG_FUNCTION_ARGS)
+{
+	period *p1 = (period*)PG_GETARG_POINTER(0);
+	period *p2 = (period*)PG_GETARG_POINTER(1);
+
+	PG_RETURN_BOOL(period_meets(p2,p1));
+}
+
+PG_FUNCTION_INFO_V1(leftoverlaps_period_period);
+Datum
+leftoverlaps_period_period(PG_FUNCTION_ARGS)
+{
+	period *p1 = (period*)PG_GETARG_POINTER(0);
+	period *p2 = (period*)PG_GETARG_POINTER(1);
+
+	PG_RETURN_BOOL(period_leftoverlaps(p1,p2));
+}
+
+PG_FUNCTION_INFO_V1(rightoverlaps_period_period);
+Datum
+rightoverlaps_period_period(PG_FUNCTION_ARGS)
+{
+	period *p1 = (period*)PG_GETARG_POINTER(0);
+	period *p2 = (period*)PG_GETARG_POINTER(1);
+
+	PG_RETURN_BOOL(period_leftoverlaps(p2,p1));
+}
+
+PG_FUNCTION_INFO_V1(starts_period_period);
+Datum
+starts_period_period(PG_FUNCTION_ARGS)
+{
+	period *p1 = (period*)PG_GETARG_POINTER(0);
+	period *p2 = (period*)PG_GETARG_POINTER(1);
+
+	PG_RETURN_BOOL(period_starts(p1,p2));
+}
+
+PG_FUNCTION_INFO_V1(started_by_period_period);
+Datum
+started_by_period_period(PG_FUNCTION_ARGS)
+{
+	period *p1 = (period*)PG_GETARG_POINTER(0);
+	period *p2 = (period*)PG_GETARG_POINTER(1);
+
+	PG_RETURN_BOOL(period_starts(p2,p1));
+}
+
+PG_FUNCTION_INFO_V1(during_period_period);
+Datum
+during_period_period(PG_FUNCTION_ARGS)
+{
+	period *p1 = (period*)PG_GETARG_POINTER(0);
+	period *p2 = (period*)PG_GETARG_POINTER(1);
+
+	PG_RETURN_BOOL(period_during(p1,p2));
+}
+
+PG_FUNCTION_INFO_V1(includes_period_period);
+Datum
+includes_period_period(PG_FUNCTION_ARGS)
+{
+	period *p1 = (period*)PG_GETARG_POINTER(0);
+	period *p2 = (period*)PG_GETARG_POINTER(1);
+
+	PG_RETURN_BOOL(period_during(p2,p1));
+}
+
+PG_FUNCTION_INFO_V1(finishes_period_period);
+Datum
+finishes_period_period(PG_FUNCTION_ARGS)
+{
+	period *p1 = (period*)PG_GETARG_POINTER(0);
+	period *p2 = (period*)PG_GETARG_POINTER(1);
+
+	PG_RETURN_BOOL(period_finishes(p1,p2));
+}
+
+PG_FUNCTION_INFO_V1(finished_by_period_period);
+Datum
+finished_by_period_period(PG_FUNCTION_ARGS)
+{
+	period *p1 = (period*)PG_GETARG_POINTER(0);
+	period *p2 = (period*)PG_GETARG_POINTER(1);
+
+	PG_RETURN_BOOL(period_finishes(p2,p1));
+}
+
 PG_FUNCTION_INFO_V1(contains_period_timestamptz);
 Datum
 contains_period_timestamptz(PG_FUNCTION_ARGS)
@@ -599,6 +752,15 @@ is_empty_period(PG_FUNCTION_ARGS)
 	PG_RETURN_BOOL(period_is_empty(p));
 }
 
+/* Whether the period has no end, as the current rows in transaction time do */
+PG_FUNCTION_INFO_V1(is_open_ended_period);
+Datum
+is_open_ended_period(PG_FUNCTION_ARGS)
+{
+	period *p = (period*)PG_GETARG_POINTER(0);
+	PG_RETURN_BOOL(!period_is_empty(p) && TIMESTAMP_IS_NOEND(p->next));
+}
+
 /*
  * period functions
  */
@@ -656,6 +818,20 @@ typedef bytea GistEntryVector;
 #endif
 
 
+/* The strategy with a period argument that a tstzrange one stands for */
+static StrategyNumber
+period_strategy(StrategyNumber strategy)
+{
+	switch(strategy) {
+	case 41: return 3;
+	case 42: return 7;
+	case 43: return 8;
+	case 44: return 1;
+	case 45: return 5;
+	}
+	return strategy;
+}
+
 PG_FUNCTION_INFO_V1(gist_period_consistent);
 Datum
 gist_period_consistent(PG_FUNCTION_ARGS)
@@ -666,6 +842,7 @@ gist_period_consistent(PG_FUNCTION_ARGS)
 	period query;
 	period * period_query;
 	TimestampTz t_point_query;
+	bool result;
 
 	switch(strategy) {
 	case 27: //contains(period,t_point)
@@ -675,16 +852,30 @@ gist_period_consistent(PG_FUNCTION_ARGS)
 		query.first = t_point_query;
 		query.next = next_timestamptz(t_point_query);
 		break;
+#if PG_VERSION_NUM >= 90200
+	case 41: //overlaps(period,tstzrange)
+	case 42: //contains(period,tstzrange)
+	case 43: //contained by(period,tstzrange)
+	case 44: //strictly before(period,tstzrange)
+	case 45: //strictly after(period,tstzrange)
+		// convert the range to a period, and search as for one
+		period_from_tstzrange(fcinfo->flinfo, PG_GETARG_DATUM(1), &query);
+		break;
+#endif
 	default:
 		period_query = (period*)PG_GETARG_POINTER(1);
 		query = *period_query;
 	}
 
 	if(GIST_LEAF(entry))
-		PG_RETURN_BOOL(gist_period_leaf_consistent(key, &query, strategy));
+		result = gist_period_leaf_consistent(key, &query, period_strategy(strategy));
 	else
-		PG_RETURN_BOOL(gist_period_int_consistent(key, &query, strategy));
+		result = gist_period_int_consistent(key, &query, period_strategy(strategy));
 
+	if(temporal_track_stats)
+		temporal_stat_consistent(strategy, GIST_LEAF(entry), entry->page, entry->offset,
+								 result);
+	PG_RETURN_BOOL(result);
 }
 
 PG_FUNCTION_INFO_V1(gist_period_union);
@@ -729,318 +920,33 @@ gist_period_decompress(PG_FUNCTION_ARGS)
 	PG_RETURN_POINTER(PG_GETARG_POINTER(0));
 }
 
-PG_FUNCTION_INFO_V1(gist_period_penalty);
-Datum
-gist_period_penalty(PG_FUNCTION_ARGS)
-{
-	period *orig = (period*) DatumGetPointer(((GISTENTRY *) PG_GETARG_POINTER(0))->key);
-	period *new = (period*) DatumGetPointer(((GISTENTRY *) PG_GETARG_POINTER(1))->key);
-	float	   *penalty = (float *) PG_GETARG_POINTER(2);
-
-	return period_penalty(orig, new);
-	PG_RETURN_POINTER(penalty);
-}
-
-float period_size_approx(period *p)
-{
-	/* Divide values by 10ish to avoid overflow in the case of infinity */
-	return (p->next/10) - (p->first/10);
-}
-
-float period_penalty(period *orig, period *new)
-{
-	period union_p;
-	period_union(orig, new, &union_p, true);
-	return period_size_approx(&union_p) - period_size_approx(orig);
-}
-
-
-struct period_gist_sort
-{
-	period *key;
-	OffsetNumber pos;
-};
-
 /*
- * This is only used for the picksplit algorithm, so it's OK to use
- * approximates.
+ * The penalty and picksplit functions are shared with the types
+ * period_template.h generates.
  */
-static int
-period_gist_sort_compare(const void *a, const void *b)
+static period *
+pt_from_datum(Datum d, period *p)
 {
-	float sa = period_size_approx(((struct period_gist_sort *)a)->key);
-	float sb = period_size_approx(((struct period_gist_sort *)b)->key);
-	return (sa > sb) ? 1 : ((sa == sb) ? 0 : -1);
+	*p = *(period*) DatumGetPointer(d);
+	return p;
 }
 
-/*
- * Code was copied from ip4r module:
- *   http://pgfoundry.org/projects/ip4r/
- * Please see that project for details.
- */
-PG_FUNCTION_INFO_V1(gist_period_picksplit);
-Datum
-gist_period_picksplit(PG_FUNCTION_ARGS)
-{
-	GistEntryVector *entryvec = (GistEntryVector *) PG_GETARG_POINTER(0);
-	GIST_SPLITVEC *v = (GIST_SPLITVEC *) PG_GETARG_POINTER(1);
-	GISTENTRY *ent = GISTENTRYVEC(entryvec);
-	OffsetNumber i;
-	int	nbytes;
-	OffsetNumber maxoff;
-	OffsetNumber *listL;
-	OffsetNumber *listR;
-	bool allisequal = true;
-	period pageunion;
-	period *cur;
-	period *unionL;
-	period *unionR;
-	int posL = 0;
-	int posR = 0;
-
-	posL = posR = 0;
-	maxoff = GISTENTRYCOUNT(entryvec) - 1;
-
-	cur = (period *) DatumGetPointer(ent[FirstOffsetNumber].key);
-	pageunion = *cur;
-
-	/* find MBR */
-	for (i = OffsetNumberNext(FirstOffsetNumber); i <= maxoff; i = OffsetNumberNext(i))
-	{
-		cur = (period *) DatumGetPointer(ent[i].key);
-		if (allisequal == true
-			&& (pageunion.first != cur->first || pageunion.next != cur->next))
-			allisequal = false;
-
-		if (cur->first < pageunion.first)
-			pageunion.first = cur->first;
-		if (cur->next > pageunion.next)
-			pageunion.next = cur->next;
-	}
-
-	nbytes = (maxoff + 2) * sizeof(OffsetNumber);
-	listL = (OffsetNumber *) palloc(nbytes);
-	listR = (OffsetNumber *) palloc(nbytes);
-	unionL = (period *) palloc(sizeof(period));
-	unionR = (period *) palloc(sizeof(period));
-	v->spl_ldatum = PointerGetDatum(unionL);
-	v->spl_rdatum = PointerGetDatum(unionR);
-	v->spl_left = listL;
-	v->spl_right = listR;
-
-	if (allisequal)
-	{
-		cur = (period *) DatumGetPointer(ent[OffsetNumberNext(FirstOffsetNumber)].key);
-		if (period_equals(cur, &pageunion))
-		{
-			OffsetNumber split_at = FirstOffsetNumber + (maxoff - FirstOffsetNumber + 1)/2;
-			v->spl_nleft = v->spl_nright = 0;
-			*unionL = pageunion;
-			*unionR = pageunion;
-
-			for (i = FirstOffsetNumber; i < split_at; i = OffsetNumberNext(i))
-				v->spl_left[v->spl_nleft++] = i;
-			for (; i <= maxoff; i = OffsetNumberNext(i))
-				v->spl_right[v->spl_nright++] = i;
-
-			PG_RETURN_POINTER(v);
-		}
-	}
+static Datum
+pt_to_datum(period *p)
+{
+	return PointerGetDatum(period_dup(p));
+}
 
-#define ADDLIST( list_, u_, pos_, num_ ) do { \
-	if ( pos_ ) { \
-		if ( (u_)->next < (cur)->next ) (u_)->next = (cur)->next; \
-		if ( (u_)->first > (cur)->first ) (u_)->first = (cur)->first; \
-	} else { \
-		*(u_) = *(cur); \
-	} \
-	(list_)[(pos_)++] = (num_); \
+#define PT_TYPE period
+#define PT_GIST_FUNC(name) gist_period_##name
+#define PT_GIST_PICKSPLIT_HOOK(l, r) do { \
+	if(temporal_track_stats) \
+		temporal_stat_picksplit((l), (r)); \
 } while(0)
+#define pt_union period_union
+#define pt_equals period_equals
 
-	for (i = FirstOffsetNumber; i <= maxoff; i = OffsetNumberNext(i))
-	{
-		cur = (period *) DatumGetPointer(ent[i].key);
-		if (cur->first - pageunion.first < pageunion.next - cur->next)
-			ADDLIST(listL, unionL, posL, i);
-		else
-			ADDLIST(listR, unionR, posR, i);
-	}
-
-	/* bad disposition, sort by ascending size and resplit */
-	if (posR == 0 || posL == 0)
-	{
-		struct period_gist_sort *arr = (struct period_gist_sort *) palloc(sizeof(struct period_gist_sort) * (maxoff + FirstOffsetNumber));
-
-		for (i = FirstOffsetNumber; i <= maxoff; i = OffsetNumberNext(i))
-		{
-			arr[i].key = (period *) DatumGetPointer(ent[i].key);
-			arr[i].pos = i;
-		}
-
-		qsort(arr + FirstOffsetNumber,
-			  maxoff - FirstOffsetNumber + 1,
-			  sizeof(struct period_gist_sort),
-			  period_gist_sort_compare);
-
-		posL = posR = 0;
-		for (i = FirstOffsetNumber; i <= maxoff; i = OffsetNumberNext(i))
-		{
-			cur = arr[i].key;
-			if (cur->first - pageunion.first < pageunion.next - cur->next)
-			ADDLIST(listL, unionL, posL, arr[i].pos);
-			else if (cur->first - pageunion.first == pageunion.next - cur->next)
-			{
-			if (posL > posR)
-				ADDLIST(listR, unionR, posR, arr[i].pos);
-			else
-				ADDLIST(listL, unionL, posL, arr[i].pos);
-			}
-			else
-			ADDLIST(listR, unionR, posR, arr[i].pos);
-		}
-		pfree(arr);
-	}
-
-	v->spl_nleft = posL;
-	v->spl_nright = posR;
-
-	PG_RETURN_POINTER(v);
-
-#if 0
-	GistEntryVector *entryvec = (GistEntryVector*) PG_GETARG_POINTER(0);
-	GIST_SPLITVEC *v = (GIST_SPLITVEC*) PG_GETARG_POINTER(1);
-	OffsetNumber i, j;
-
-	period	*datum_alpha, *datum_beta;
-	period	datum_l, datum_r;
-
-	period	union_dl, union_dr;
-
-	bool		firsttime;
-	float		size_alpha,
-				size_beta,
-				size_union,
-				size_inter;
-	float		size_waste,
-				waste;
-	float		size_l,
-				size_r;
-	int			nbytes;
-	OffsetNumber seed_1 = 1,
-				seed_2 = 2;
-	OffsetNumber *left,
-			   *right;
-	OffsetNumber maxoff;
-
-#ifdef GIST_DEBUG
-	fprintf(stderr, "picksplit\n");
-#endif
-
-	maxoff = entryvec->n - 2;
-	nbytes = (maxoff + 2) * sizeof(OffsetNumber);
-	v->spl_left = (OffsetNumber *) palloc(nbytes);
-	v->spl_right = (OffsetNumber *) palloc(nbytes);
-
-	firsttime = true;
-	waste = 0.0;
-
-	for (i = FirstOffsetNumber; i < maxoff; i = OffsetNumberNext(i))
-	{
-		datum_alpha = (period *) DatumGetPointer(entryvec->vector[i].key);
-		for (j = OffsetNumberNext(i); j <= maxoff; j = OffsetNumberNext(j))
-		{
-			datum_beta = (period *) DatumGetPointer(entryvec->vector[j].key);
-
-			/* compute the wasted space by unioning these guys */
-			/* size_waste = size_union - size_inter; */
-			size_waste = period_penalty(datum_alpha, datum_beta);
-
-			/*
-			 * are these a more promising split that what we've already seen?
-			 */
-			if (size_waste > waste || firsttime)
-			{
-				waste = size_waste;
-				seed_1 = i;
-				seed_2 = j;
-				firsttime = false;
-			}
-		}
-	}
-
-	left = v->spl_left;
-	v->spl_nleft = 0;
-	right = v->spl_right;
-	v->spl_nright = 0;
-
-	datum_alpha = (period *) DatumGetPointer(entryvec->vector[seed_1].key);
-	period_copy(datum_alpha, &datum_l);
-	size_l = period_size_approx(&datum_l);
-	datum_beta = (period *) DatumGetPointer(entryvec->vector[seed_2].key);
-	period_copy(datum_beta, &datum_r);
-	size_r = period_size_approx(&datum_r);
-
-	/*
-	 * Now split up the regions between the two seeds.	An important property
-	 * of this split algorithm is that the split vector v has the indices of
-	 * items to be split in order in its left and right vectors.  We exploit
-	 * this property by doing a merge in the code that actually splits the
-	 * page.
-	 *
-	 * For efficiency, we also place the new index tuple in this loop. This is
-	 * handled at the very end, when we have placed all the existing tuples
-	 * and i == maxoff + 1.
-	 */
-
-	maxoff = OffsetNumberNext(maxoff);
-	for (i = FirstOffsetNumber; i <= maxoff; i = OffsetNumberNext(i))
-	{
-		/*
-		 * If we've already decided where to place this item, just put it on
-		 * the right list.	Otherwise, we need to figure out which page needs
-		 * the least enlargement in order to store the item.
-		 */
-
-		if (i == seed_1)
-		{
-			*left++ = i;
-			v->spl_nleft++;
-			continue;
-		}
-		else if (i == seed_2)
-		{
-			*right++ = i;
-			v->spl_nright++;
-			continue;
-		}
-
-		/* okay, which page needs least enlargement? */
-		datum_alpha = (period *) DatumGetPointer(entryvec->vector[i].key);
-		period_union(&datum_l, datum_alpha, &union_dl, true);
-		period_union(&datum_r, datum_alpha, &union_dr, true);
-
-		/* pick which page to add it to */
-		if (period_penalty(datum_alpha, &datum_l) < period_penalty(datum_alpha, &datum_r))
-		{
-			period_copy(&union_dl, &datum_l);
-			*left++ = i;
-			v->spl_nleft++;
-		}
-		else
-		{
-			period_copy(&union_dr, &datum_r);
-			*right++ = i;
-			v->spl_nright++;
-		}
-	}
-	*left = *right = FirstOffsetNumber; /* sentinel value, see dosplit() */
-
-	v->spl_ldatum = PointerGetDatum(period_dup(&datum_l));
-	v->spl_rdatum = PointerGetDatum(period_dup(&datum_r));
-
-	PG_RETURN_POINTER(v);
-#endif
-}
+#include "period_gist_template.h"
 
 PG_FUNCTION_INFO_V1(gist_period_same);
 Datum
@@ -1078,6 +984,39 @@ gist_period_int_consistent(period *key, period *query,
 	case 18: // alias for contained by
 	case 28: //contained by(period,t_point)
 		return period_overlaps(key,query);
+	}
+
+	/*
+	 * The remaining strategies are Allen's relations, none of which
+	 * can hold for an empty period on either side.
+	 */
+	if(period_is_empty(key) || period_is_empty(query))
+		return false;
+
+	switch(strategy) {
+	case 30: //meets
+		return key->first < query->first && query->first <= key->next;
+	case 31: //met by
+		return key->first <= query->next && query->next < key->next;
+	case 32: //adjacent
+		return (key->first < query->first && query->first <= key->next) ||
+			(key->first <= query->next && query->next < key->next);
+	case 33: //overlaps, from the left
+		return key->first < query->first && query->first < key->next;
+	case 34: //overlaps, from the right
+		return key->first < query->next && query->next < key->next;
+	case 35: //starts
+		return key->first <= query->first && query->first < key->next;
+	case 36: //started by
+		return key->first <= query->first && query->next < key->next;
+	case 37: //during
+		return period_overlaps(key,query);
+	case 38: //includes
+		return key->first < query->first && query->next < key->next;
+	case 39: //finishes
+		return key->first < query->next && query->next <= key->next;
+	case 40: //finished by
+		return key->first < query->first && query->next <= key->next;
 	default:
 		elog(ERROR,"unrecognized strategy number: %d",strategy);
 		return false;
@@ -1109,6 +1048,28 @@ gist_period_leaf_consistent(period *key, period *query,
 	case 18: // alias for contained by
 	case 28: //contained by(period,t_point)
 		return period_contains(query,key);
+	case 30: //meets
+		return period_meets(key,query);
+	case 31: //met by
+		return period_meets(query,key);
+	case 32: //adjacent
+		return period_meets(key,query) || period_meets(query,key);
+	case 33: //overlaps, from the left
+		return period_leftoverlaps(key,query);
+	case 34: //overlaps, from the right
+		return period_leftoverlaps(query,key);
+	case 35: //starts
+		return period_starts(key,query);
+	case 36: //started by
+		return period_starts(query,key);
+	case 37: //during
+		return period_during(key,query);
+	case 38: //includes
+		return period_during(query,key);
+	case 39: //finishes
+		return period_finishes(key,query);
+	case 40: //finished by
+		return period_finishes(query,key);
 	default:
 		elog(ERROR,"unrecognized strategy number: %d",strategy);
 		return false;
@@ -1252,6 +1213,59 @@ period_before(period *p1, period *p2)
 	return (p1->next <= p2->first);
 }
 
+/*
+ * The rest of Allen's relations. Each is false if either period is
+ * empty, rather than raising an error as period_before does; the
+ * inverse relations are obtained by swapping the arguments. Note that
+ * period_before also holds when p1 meets p2.
+ */
+
+/* p1 ends exactly where p2 begins */
+bool
+period_meets(period *p1, period *p2)
+{
+	if(period_is_empty(p1) || period_is_empty(p2))
+		return false;
+	return (p1->next == p2->first);
+}
+
+/* p1 begins first, and ends inside p2 */
+bool
+period_leftoverlaps(period *p1, period *p2)
+{
+	if(period_is_empty(p1) || period_is_empty(p2))
+		return false;
+	return (p1->first < p2->first && p2->first < p1->next &&
+			p1->next < p2->next);
+}
+
+/* p1 begins with p2, and ends before it */
+bool
+period_starts(period *p1, period *p2)
+{
+	if(period_is_empty(p1) || period_is_empty(p2))
+		return false;
+	return (p1->first == p2->first && p1->next < p2->next);
+}
+
+/* p1 is strictly inside p2, sharing neither end */
+bool
+period_during(period *p1, period *p2)
+{
+	if(period_is_empty(p1) || period_is_empty(p2))
+		return false;
+	return (p2->first < p1->first && p1->next < p2->next);
+}
+
+/* p1 ends with p2, and begins after it */
+bool
+period_finishes(period *p1, period *p2)
+{
+	if(period_is_empty(p1) || period_is_empty(p2))
+		return false;
+	return (p1->next == p2->next && p2->first < p1->first);
+}
+
 period *
 period_empty_period(period *result)
 {
@@ -0,0 +1,29 @@
+/*
+ * tsperiod.c
+ *   Implements the TSPERIOD data type, a period of TIMESTAMP values.
+ */
+
+#include "period.h"
+
+#define PT_NAME tsperiod
+#define PT_BOUND Timestamp
+#define PT_GETARG_BOUND(n) PG_GETARG_TIMESTAMP(n)
+#define PT_BOUND_GET_DATUM(x) TimestampGetDatum(x)
+#define PT_BOUND_IN(str) DatumGetTimestamp(DirectFunctionCall3( \
+	timestamp_in, CStringGetDatum(str), \
+	ObjectIdGetDatum(InvalidOid), Int32GetDatum(-1)))
+#define PT_BOUND_OUT(x) DatumGetCString(DirectFunctionCall1( \
+	timestamp_out, TimestampGetDatum(x)))
+#define PT_BOUND_NOT_FINITE(x) TIMESTAMP_NOT_FINITE(x)
+
+#ifdef HAVE_INT64_TIMESTAMP
+#define PT_BOUND_MAX (DT_NOEND - 1)
+#define PT_BOUND_MIN (DT_NOBEGIN + 1)
+#else
+#define PT_BOUND_MAX DBL_MAX
+#define PT_BOUND_MIN (-DBL_MAX)
+#define PT_BOUND_SUCC(x) nextafter((x), DOUBLE_INF)
+#define PT_BOUND_PRED(x) nextafter((x), -DOUBLE_INF)
+#endif
+
+#include "period_template.h"
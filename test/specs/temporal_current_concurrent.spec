@@ -0,0 +1,54 @@
+# Two transactions changing different components of the same key: the
+# second refresh waits for the first, then sees its rows, also under
+# REPEATABLE READ where its own snapshot wouldn't.
+
+setup
+{
+  CREATE TABLE c1 (k int PRIMARY KEY, a int);
+  CREATE TABLE c2 (k int PRIMARY KEY, b int);
+  CREATE VIEW cv AS SELECT k, a, b FROM c1 NATURAL JOIN c2;
+  CREATE TABLE cur (k int, a int, b int);
+  CREATE TRIGGER c1_current AFTER INSERT OR UPDATE OR DELETE ON c1
+    FOR EACH ROW EXECUTE PROCEDURE temporal_current('cur', 'cv', 'k');
+  CREATE TRIGGER c2_current AFTER INSERT OR UPDATE OR DELETE ON c2
+    FOR EACH ROW EXECUTE PROCEDURE temporal_current('cur', 'cv', 'k');
+  INSERT INTO c1 VALUES (1, 0);
+  INSERT INTO c2 VALUES (1, 0);
+}
+
+teardown
+{
+  DROP TABLE cur;
+  DROP VIEW cv;
+  DROP TABLE c1, c2;
+}
+
+session s1
+step s1b	{ BEGIN; }
+step s1u	{ UPDATE c1 SET a = 1 WHERE k = 1; }
+step s1i	{ INSERT INTO c1 VALUES (2, 2); }
+step s1c	{ COMMIT; }
+
+session s2
+step s2b	{ BEGIN; }
+step s2u	{ UPDATE c2 SET b = 1 WHERE k = 1; }
+step s2i	{ INSERT INTO c2 VALUES (2, 2); }
+step s2c	{ COMMIT; }
+
+session s3
+step s3r	{ SELECT k, a, b FROM cur ORDER BY k; }
+
+session s4
+step s4b	{ BEGIN ISOLATION LEVEL REPEATABLE READ; }
+step s4s	{ SELECT count(*) FROM c1; }
+step s4i	{ INSERT INTO c2 VALUES (2, 2); }
+step s4c	{ COMMIT; }
+
+# without the lock, the key would be inserted twice
+permutation s1b s2b s1u s2u s1c s2c s3r
+# without the lock, neither would see the other's row and the key would be missed
+permutation s1b s2b s1i s2i s1c s2c s3r
+# the same under REPEATABLE READ, waiting for the lock
+permutation s1b s4b s1i s4i s1c s4c s3r
+# and with the other transaction committed after the snapshot, before the lock
+permutation s4b s4s s1b s1i s1c s4i s4c s3r
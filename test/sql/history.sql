@@ -0,0 +1,52 @@
+\set ECHO 0
+BEGIN;
+\i temporal.sql
+\set ECHO all
+
+CREATE TABLE r1_since (k text primary key, att1 text, since timestamptz, log_since timestamptz);
+CREATE TABLE r1_during (k text, att1 text, during period, log_since timestamptz);
+CREATE TABLE r1_since_log (k text, att1 text, since timestamptz, log_during period);
+
+-- transaction time: log each replaced or deleted version
+CREATE TRIGGER r1_since_log_stamp BEFORE UPDATE ON r1_since
+  FOR EACH ROW EXECUTE PROCEDURE temporal_history('r1_since_log', 'log_since', 'log_during');
+CREATE TRIGGER r1_since_log AFTER UPDATE OR DELETE ON r1_since
+  FOR EACH ROW EXECUTE PROCEDURE temporal_history('r1_since_log', 'log_since', 'log_during');
+-- valid time: the old value was valid until now
+CREATE TRIGGER r1_during_stamp BEFORE UPDATE ON r1_since
+  FOR EACH ROW EXECUTE PROCEDURE temporal_history('r1_during', 'since', 'during', 'log_since');
+CREATE TRIGGER r1_during AFTER UPDATE OR DELETE ON r1_since
+  FOR EACH ROW EXECUTE PROCEDURE temporal_history('r1_during', 'since', 'during', 'log_since');
+
+INSERT INTO r1_since VALUES ('a', 'x', '2009-01-01', '2009-01-02'),
+                            ('b', 'y', '2009-01-01', '2009-01-02'),
+                            ('c', 'z', now(), now());
+UPDATE r1_since SET att1 = 'x2' WHERE k = 'a';
+DELETE FROM r1_since WHERE k = 'b';
+-- current only since this transaction, so it has no history yet
+UPDATE r1_since SET att1 = 'z2' WHERE k = 'c';
+select k, att1, since = now() as since_now, log_since = now() as log_since_now
+  from r1_since order by k;
+select k, att1, log_during = period('2009-01-02', now()) as log_during
+  from r1_since_log order by k;
+select k, att1, during = period('2009-01-01', now()) as during, log_since = now() as log_since_now
+  from r1_during order by k;
+
+-- batches: one INSERT ... SELECT per statement
+CREATE TABLE s_since (k integer, since timestamptz);
+CREATE TABLE s_log (k integer, during period);
+CREATE TRIGGER s_stamp BEFORE UPDATE ON s_since
+  FOR EACH ROW EXECUTE PROCEDURE temporal_history('s_log', 'since', 'during');
+CREATE TRIGGER s_log_update AFTER UPDATE ON s_since REFERENCING OLD TABLE AS old_rows
+  FOR EACH STATEMENT EXECUTE PROCEDURE temporal_history('s_log', 'since', 'during');
+CREATE TRIGGER s_log_delete AFTER DELETE ON s_since REFERENCING OLD TABLE AS old_rows
+  FOR EACH STATEMENT EXECUTE PROCEDURE temporal_history('s_log', 'since', 'during');
+INSERT INTO s_since SELECT g, '2009-01-01' FROM generate_series(1, 1000) g;
+UPDATE s_since SET k = k + 1000 WHERE k <= 600;
+DELETE FROM s_since WHERE k > 1000 OR k <= 700;
+select count(*) as logged, sum(k) as sum,
+       bool_and(during = period('2009-01-01', now())) as during
+  from s_log;
+select count(*) as current, bool_and(since = '2009-01-01') as untouched from s_since;
+
+ROLLBACK;
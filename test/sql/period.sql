@@ -5,4 +5,79 @@ BEGIN;
 
 select '[2009-01-01, 2009-03-01)'::period @> '[2009-02-03, 2009-02-07)'::period;
 
+select '[2009-01-01, 2009-02-01)'::period <| '[2009-02-01, 2009-03-01)'::period as meets;
+
+select '[2009-02-01, 2009-03-01)'::period |> '[2009-01-01, 2009-02-01)'::period as met_by;
+
+select '[2009-02-01, 2009-03-01)'::period -|- '[2009-01-01, 2009-02-01)'::period as adjacent;
+
+select '[2009-01-01, 2009-02-15)'::period &&< '[2009-02-01, 2009-03-01)'::period as leftoverlaps;
+
+select '[2009-01-01, 2009-02-15)'::period &&> '[2009-02-01, 2009-03-01)'::period as rightoverlaps;
+
+select '[2009-01-01, 2009-01-15)'::period |<@ '[2009-01-01, 2009-02-01)'::period as starts;
+
+select '[2009-01-01, 2009-01-15)'::period |@> '[2009-01-01, 2009-02-01)'::period as started_by;
+
+select '[2009-01-10, 2009-01-15)'::period <<@ '[2009-01-01, 2009-02-01)'::period as during;
+
+select '[2009-01-01, 2009-02-01)'::period @>> '[2009-01-01, 2009-01-15)'::period as includes;
+
+select '[2009-01-15, 2009-02-01)'::period <@| '[2009-01-01, 2009-02-01)'::period as finishes;
+
+select '[2009-01-01, 2009-02-01)'::period @>| '[2009-01-15, 2009-02-01)'::period as finished_by;
+
+CREATE TABLE allen_test AS
+  SELECT period('2009-01-01'::timestamptz + g * '1 hour'::interval,
+                '2009-01-01'::timestamptz + (g + g % 7 + 1) * '1 hour'::interval) AS p
+  FROM generate_series(0, 999) g;
+
+CREATE INDEX allen_test_idx ON allen_test USING gist (p);
+
+SET enable_seqscan = off;
+
+select count(*) from allen_test where p <| '[2009-01-05 00:00, 2009-01-06 00:00)';
+
+select count(*) from allen_test where p |> '[2009-01-05 00:00, 2009-01-06 00:00)';
+
+select count(*) from allen_test where p -|- '[2009-01-05 00:00, 2009-01-06 00:00)';
+
+select count(*) from allen_test where p &&< '[2009-01-05 00:00, 2009-01-06 00:00)';
+
+select count(*) from allen_test where p &&> '[2009-01-05 00:00, 2009-01-06 00:00)';
+
+select count(*) from allen_test where p |<@ '[2009-01-05 00:00, 2009-01-06 00:00)';
+
+select count(*) from allen_test where p |@> '[2009-01-05 00:00, 2009-01-06 00:00)';
+
+select count(*) from allen_test where p <<@ '[2009-01-05 00:00, 2009-01-06 00:00)';
+
+select count(*) from allen_test where p @>> '[2009-01-05 00:00, 2009-01-06 00:00)';
+
+select count(*) from allen_test where p <@| '[2009-01-05 00:00, 2009-01-06 00:00)';
+
+select count(*) from allen_test where p @>| '[2009-01-05 00:00, 2009-01-06 00:00)';
+
+select count(*) from allen_test where p <| '[2009-01-05 04:00, 2009-01-05 07:00)';
+
+select count(*) from allen_test where p |> '[2009-01-05 04:00, 2009-01-05 07:00)';
+
+select count(*) from allen_test where p -|- '[2009-01-05 04:00, 2009-01-05 07:00)';
+
+select count(*) from allen_test where p &&< '[2009-01-05 04:00, 2009-01-05 07:00)';
+
+select count(*) from allen_test where p &&> '[2009-01-05 04:00, 2009-01-05 07:00)';
+
+select count(*) from allen_test where p |<@ '[2009-01-05 04:00, 2009-01-05 07:00)';
+
+select count(*) from allen_test where p |@> '[2009-01-05 04:00, 2009-01-05 07:00)';
+
+select count(*) from allen_test where p <<@ '[2009-01-05 04:00, 2009-01-05 07:00)';
+
+select count(*) from allen_test where p @>> '[2009-01-05 04:00, 2009-01-05 07:00)';
+
+select count(*) from allen_test where p <@| '[2009-01-05 04:00, 2009-01-05 07:00)';
+
+select count(*) from allen_test where p @>| '[2009-01-05 04:00, 2009-01-05 07:00)';
+
 ROLLBACK;
@@ -0,0 +1,74 @@
+\set ECHO 0
+BEGIN;
+\i temporal.sql
+\set ECHO all
+
+CREATE FUNCTION h(timestamptz) RETURNS float8 LANGUAGE sql
+  AS $$ SELECT date_part('epoch', $1 - '2011-01-01'::timestamptz) / 3600 $$;
+CREATE FUNCTION hp(integer, integer) RETURNS period LANGUAGE sql
+  AS $$ SELECT period('2011-01-01'::timestamptz + $1 * interval '1 hour', '2011-01-01'::timestamptz + $2 * interval '1 hour') $$;
+CREATE TABLE r (k int, v text, p period);
+INSERT INTO r VALUES (1, 'a', hp(0, 10)), (1, 'b', hp(12, 20)), (2, 'c', hp(0, 5)),
+  (3, 'd', hp(0, 4)), (NULL, 'e', hp(0, 3)), (1, 'f', empty_period());
+CREATE TABLE s (k int, w text, p period);
+INSERT INTO s VALUES (1, 'x', hp(2, 4)), (1, 'y', hp(3, 8)), (1, 'z', hp(15, 30)),
+  (2, 'q', hp(5, 9)), (0, 'o', hp(0, 100)), (NULL, 'n', hp(50, 60));
+
+select v, h(first(p)), h(next(p)) from period_normalize(NULL::r, 's', 'k', 'p') where not is_empty(p) order by v, 2;
+select v, is_empty(p) from period_normalize(NULL::r, 's', 'k', 'p') where is_empty(p);
+select v, h(first(p)), h(next(p)) from period_align(NULL::r, 's', 'k', 'p') where not is_empty(p) order by v, 2, 3;
+select w, h(first(p)), h(next(p)) from period_align(NULL::s, 'r', 'k', 'p') order by w, 2;
+-- a sequenced join
+select a.v, b.w, h(first(a.p)), h(next(a.p))
+  from period_align(NULL::r, 's', 'k', 'p') a
+  join period_align(NULL::s, 'r', 'k', 'p') b on a.k = b.k and a.p = b.p
+ order by 1, 2;
+-- without a key
+select count(*) from period_normalize(NULL::r, 's', NULL, 'p');
+SAVEPOINT s;
+select count(*) from period_align(NULL::r, 's', 'k', 'v');
+ROLLBACK TO SAVEPOINT s;
+SAVEPOINT s;
+select count(*) from period_normalize(NULL::r, 's', 'w', 'p');
+ROLLBACK TO SAVEPOINT s;
+
+CREATE TABLE br (k int, v int, p period, valid period);
+INSERT INTO br
+  SELECT i % 5, i, hp((i * 37) % 200, (i * 37) % 200 + 1 + (i * 13) % 30), NULL
+    FROM generate_series(1, 300) i;
+UPDATE br SET valid = p;
+CREATE TABLE bs (k int, w int, p period, valid period);
+INSERT INTO bs
+  SELECT (j * 3) % 5, j, hp((j * 53) % 200, (j * 53) % 200 + 1 + (j * 7) % 40), NULL
+    FROM generate_series(1, 200) j;
+UPDATE bs SET valid = p;
+-- no piece has a bound of a matching row inside it
+select count(*) from period_normalize(NULL::br, 'bs', 'k', 'p') n
+  join bs on bs.k = n.k
+ where (first(bs.p) > first(n.p) and first(bs.p) < next(n.p))
+    or (next(bs.p) > first(n.p) and next(bs.p) < next(n.p));
+-- and the pieces of each row add up to it
+select count(*) from (
+  select v, min(first(p)) f, max(next(p)) n, sum(length(p)) l
+    from period_normalize(NULL::br, 'bs', 'k', 'p') group by v) n
+  join br using (v)
+ where n.f <> first(br.p) or n.n <> next(br.p) or n.l <> length(br.p);
+-- a sequenced join is the pairs of overlapping rows
+select count(*) from br join bs on br.k = bs.k and br.p && bs.p;
+select count(*) from (
+  (select a.v, b.w, a.p
+     from period_align(NULL::br, 'bs', 'k', 'p') a
+     join period_align(NULL::bs, 'br', 'k', 'p') b
+       on a.k = b.k and a.p = b.p and a.p = period_intersect(a.valid, b.valid)
+   except all
+   select br.v, bs.w, period_intersect(br.p, bs.p) from br join bs on br.k = bs.k and br.p && bs.p)
+  union all
+  (select br.v, bs.w, period_intersect(br.p, bs.p) from br join bs on br.k = bs.k and br.p && bs.p
+   except all
+   select a.v, b.w, a.p
+     from period_align(NULL::br, 'bs', 'k', 'p') a
+     join period_align(NULL::bs, 'br', 'k', 'p') b
+       on a.k = b.k and a.p = b.p and a.p = period_intersect(a.valid, b.valid))
+) d;
+
+ROLLBACK;
@@ -0,0 +1,32 @@
+\set ECHO 0
+BEGIN;
+\i temporal.sql
+\set ECHO all
+
+CREATE TABLE price (item int, during period, price numeric);
+CREATE INDEX price_item_during ON price (item, during);
+CREATE CONSTRAINT TRIGGER price_unique AFTER INSERT OR UPDATE ON price
+  FOR EACH ROW EXECUTE PROCEDURE temporal_unique('item', 'during');
+INSERT INTO price VALUES (1, period('2011-01-01', '2012-01-01'), 10),
+                         (1, period('2012-01-01', '2013-01-01'), 11),
+                         (2, period('2011-01-01', '2012-01-01'), 20);
+
+-- a change from March to June splits a row in three
+select period_apply_portion('price', 'item', 1, 'during', period('2011-03-01', '2011-06-01'), 'price = 12');
+select item, first(during)::date, next(during)::date, price from price order by item, during;
+-- a delete across rows, for every item
+select period_apply_portion('price', 'item', NULL::int, 'during', period('2011-12-01', '2012-02-01'), NULL);
+select item, first(during)::date, next(during)::date, price from price order by item, during;
+-- a portion covering whole rows leaves nothing over
+select period_apply_portion('price', 'item', 2, 'during', period('2010-01-01', '2014-01-01'), 'price = price * 2');
+select item, first(during)::date, next(during)::date, price from price order by item, during;
+-- nothing overlaps
+select period_apply_portion('price', 'item', 3, 'during', period('2011-01-01', '2012-01-01'), 'price = 0');
+
+-- identity columns aren't copied, the leftovers get new values
+CREATE TABLE booking (id int GENERATED ALWAYS AS IDENTITY PRIMARY KEY, room int, during period);
+INSERT INTO booking (room, during) VALUES (1, period('2011-01-01', '2011-01-10'));
+select period_apply_portion('booking', 'room', 1, 'during', period('2011-01-03', '2011-01-05'), NULL);
+select id, first(during)::date, next(during)::date from booking order by during;
+
+ROLLBACK;
@@ -0,0 +1,28 @@
+\set ECHO 0
+BEGIN;
+\i temporal.sql
+\set ECHO all
+
+select '{}'::period_archive as none, '{-EMPTY-, -}'::period_archive as empties;
+
+CREATE TABLE archive_test AS
+  SELECT period_archive(array_agg(period('2009-01-01'::timestamptz + g * '1 hour'::interval,
+                                         '2009-01-01'::timestamptz + (g + 1) * '1 hour'::interval))) AS a
+    FROM generate_series(0, 999) g;
+
+-- contiguous periods of equal length take about two bytes each
+select pg_column_size(a) < 4000 as compressed from archive_test;
+select count(*) from archive_test, unnest(a) p;
+select period_array(a) = (select array_agg(period('2009-01-01'::timestamptz + g * '1 hour'::interval,
+                                                  '2009-01-01'::timestamptz + (g + 1) * '1 hour'::interval))
+                            from generate_series(0, 999) g) as roundtrip
+  from archive_test;
+select a @> '2009-01-10 03:30'::timestamptz as ts_in,
+       a @> '2010-01-01'::timestamptz as ts_out,
+       a @> period('2009-01-10 03:00', '2009-01-10 04:00') as one_hour,
+       a @> period('2009-01-10 03:00', '2009-01-10 05:00') as two_hours,
+       a && period('2009-01-10 03:00', '2009-01-10 05:00') as overlaps,
+       a && period('2008-12-01', '2008-12-31') as before
+  from archive_test;
+
+ROLLBACK;
@@ -0,0 +1,69 @@
+\set ECHO 0
+BEGIN;
+\i temporal.sql
+\set ECHO all
+
+-- some element overlaps, contains or is contained by the period
+select a && period('2011-01-03', '2011-01-04') as gap,
+       a && period('2011-01-01 12:00', '2011-01-03') as overlaps,
+       a @> period('2011-01-05 01:00', '2011-01-05 02:00') as contains,
+       a @> '2011-01-05 12:00'::timestamptz as contains_ts,
+       a <@ period('2011-01-04', '2011-01-07') as contained_by,
+       a <@ period('2011-01-01 12:00', '2011-01-05 12:00') as straddles
+  from (select ARRAY[period('2011-01-01', '2011-01-02'), period('2011-01-05', '2011-01-06')] as a) s;
+select ARRAY[empty_period()] <@ period('2011-01-01', '2011-01-02') as empty_contained,
+       '{}'::period[] @> empty_period() as none_contains,
+       ARRAY[NULL::period] && period('2011-01-01', '2011-01-02') as null_overlaps;
+
+-- up to four weekly windows each
+CREATE TABLE maintenance (id integer, w period[]);
+INSERT INTO maintenance
+  SELECT i, array(SELECT period(s, s + (i % 5 + 1) * interval '1 hour')
+                    FROM (SELECT '2011-01-01'::timestamptz + (i % 50) * interval '1 day'
+                                 + (i % 24) * interval '1 hour' + j * interval '7 days' AS s
+                            FROM generate_series(0, i % 4) j) g)
+    FROM generate_series(1, 2000) i;
+INSERT INTO maintenance VALUES (0, '{}'), (-1, ARRAY[empty_period()]), (-2, ARRAY[NULL::period]),
+  (-3, NULL), (-4, ARRAY[period('2011-01-01', 'infinity')]);
+CREATE TABLE probe (q period);
+INSERT INTO probe
+  SELECT period('2011-01-01'::timestamptz + k * interval '13 hours',
+                '2011-01-01'::timestamptz + k * interval '13 hours' + (k % 7) * interval '3 hours')
+    FROM generate_series(0, 99) k;
+CREATE TABLE expected AS
+  SELECT q, array(SELECT id FROM maintenance WHERE w && q ORDER BY id) AS overlaps,
+         array(SELECT id FROM maintenance WHERE w @> q ORDER BY id) AS contains,
+         array(SELECT id FROM maintenance WHERE w @> first(q) ORDER BY id) AS contains_ts,
+         array(SELECT id FROM maintenance WHERE w <@ q ORDER BY id) AS contained_by
+    FROM probe;
+select sum(array_length(overlaps, 1)) > 0 and sum(array_length(contains, 1)) > 0 and
+       sum(array_length(contains_ts, 1)) > 0 and sum(array_length(contained_by, 1)) > 0 as found
+  from expected;
+
+-- the index finds the same rows
+CREATE INDEX maintenance_w ON maintenance USING gist (w);
+ANALYZE maintenance;
+SET enable_seqscan = off;
+CREATE FUNCTION indexed(text) RETURNS boolean LANGUAGE plpgsql AS $$
+DECLARE
+  l text;
+BEGIN
+  FOR l IN EXECUTE 'EXPLAIN (COSTS OFF) ' || $1 LOOP
+    IF l ~ 'Index Cond' THEN
+      RETURN true;
+    END IF;
+  END LOOP;
+  RETURN false;
+END;
+$$;
+select indexed($$select * from maintenance where w && period('2011-01-03', '2011-01-04')$$) as overlaps,
+       indexed($$select * from maintenance where w @> period('2011-01-03', '2011-01-04')$$) as contains,
+       indexed($$select * from maintenance where w @> '2011-01-03'::timestamptz$$) as contains_ts,
+       indexed($$select * from maintenance where w <@ period('2011-01-03', '2011-01-04')$$) as contained_by;
+select bool_and(array(SELECT id FROM maintenance WHERE w && q ORDER BY id) = overlaps) as overlaps,
+       bool_and(array(SELECT id FROM maintenance WHERE w @> q ORDER BY id) = contains) as contains,
+       bool_and(array(SELECT id FROM maintenance WHERE w @> first(q) ORDER BY id) = contains_ts) as contains_ts,
+       bool_and(array(SELECT id FROM maintenance WHERE w <@ q ORDER BY id) = contained_by) as contained_by
+  from expected;
+
+ROLLBACK;
@@ -0,0 +1,50 @@
+\set ECHO 0
+BEGIN;
+\i temporal.sql
+\set ECHO all
+
+select period_array_filter(a, q, '&&') as overlaps, period_array_filter(a, q, '@>') as contains,
+       period_array_filter(a, q, '<@') as contained_by, period_array_count(a, q, '&&') as n
+  from (select ARRAY[period('2011-01-01', '2011-01-01 10:00'), NULL, empty_period(),
+                     period('2011-01-01 12:00', '2011-01-01 20:00'), period('2011-01-01 05:00', '2011-01-01 06:00'),
+                     period('2011-01-01', 'infinity')] as a,
+               period('2011-01-01 04:00', '2011-01-01 08:00') as q) s;
+-- an empty period overlaps nothing, and is contained by everything
+select period_array_filter(a, q, '&&') as overlaps, period_array_filter(a, q, '@>') as contains,
+       period_array_filter(a, q, '<@') as contained_by
+  from (select ARRAY[period('2011-01-01', '2011-01-02'), NULL, empty_period()] as a,
+               empty_period() as q) s;
+select period_array_filter('{}', period('2011-01-01', '2011-01-02'), '&&') as none,
+       period_array_count('{}', period('2011-01-01', '2011-01-02'), '&&') as n;
+SAVEPOINT s;
+select period_array_count('{}', period('2011-01-01', '2011-01-02'), '=');
+ROLLBACK TO SAVEPOINT s;
+
+-- arrays of every length up to 13, so that each tail is covered
+CREATE TABLE arrays (i integer, a period[]);
+INSERT INTO arrays
+  SELECT i, array(SELECT CASE WHEN (i + j) % 11 = 0 THEN NULL
+                              WHEN (i + j) % 7 = 0 THEN empty_period()
+                              ELSE period('2011-01-01'::timestamptz + (i * j * 37 % 100) * interval '1 hour',
+                                          '2011-01-01'::timestamptz + (i * j * 37 % 100 + 1 + (i + j) % 9) * interval '1 hour')
+                         END
+                    FROM generate_series(1, i % 14) j)
+    FROM generate_series(1, 300) i;
+CREATE TABLE probe (q period);
+INSERT INTO probe
+  SELECT period('2011-01-01'::timestamptz + k * interval '5 hours',
+                '2011-01-01'::timestamptz + (k * 5 + 1 + k % 12) * interval '1 hour')
+    FROM generate_series(0, 21) k;
+INSERT INTO probe VALUES (empty_period()), (period('2011-01-02', 'infinity')), (period('-infinity', '2011-01-02'));
+-- the same as the operators on each element
+select count(*) from arrays, probe, unnest(ARRAY['&&', '@>', '<@']) op
+ where period_array_filter(a, q, op) IS DISTINCT FROM
+         array(select o::integer from unnest(a) WITH ORDINALITY u(e, o)
+                where CASE op WHEN '&&' THEN e && q WHEN '@>' THEN e @> q ELSE e <@ q END order by o)
+    or period_array_count(a, q, op) <>
+         (select count(*) from unnest(a) e
+           where CASE op WHEN '&&' THEN e && q WHEN '@>' THEN e @> q ELSE e <@ q END);
+select count(*) > 1000 as matched from arrays, probe, unnest(ARRAY['&&', '@>', '<@']) op
+ where period_array_count(a, q, op) > 0;
+
+ROLLBACK;
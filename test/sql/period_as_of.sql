@@ -0,0 +1,36 @@
+\set ECHO 0
+BEGIN;
+\i temporal.sql
+\set ECHO all
+
+CREATE TABLE r1_since_log (k int, att1 text, log_during period);
+-- ten versions of each key, a day each, the last one current
+INSERT INTO r1_since_log
+  SELECT k, 'v' || v,
+         CASE WHEN v < 10
+           THEN period('2011-01-01'::timestamptz + v * interval '1 day',
+                       '2011-01-01'::timestamptz + (v + 1) * interval '1 day')
+           ELSE period('2011-01-11'::timestamptz, 'infinity'::timestamptz)
+         END
+    FROM generate_series(1, 100) k, generate_series(1, 10) v;
+CREATE INDEX r1_since_log_current ON r1_since_log USING gist (log_during) WHERE is_open_ended(log_during);
+CREATE INDEX r1_since_log_history ON r1_since_log USING gist (log_during) WHERE NOT is_open_ended(log_during);
+
+select is_open_ended(period('2011-01-01', 'infinity')), is_open_ended(period('2011-01-01', '2011-01-02')), is_open_ended(empty_period());
+select count(*), min(att1), max(att1) from period_as_of(NULL::r1_since_log, 'log_during', '2011-01-05 12:00');
+select count(*), min(att1), max(att1) from period_as_of(NULL::r1_since_log, 'log_during', '2012-01-01');
+select count(*) from period_as_of(NULL::r1_since_log, 'log_during', '2010-01-01');
+select att1 from period_as_of(NULL::r1_since_log, 'log_during', '2011-01-03') where k = 42;
+-- the same as @>
+select (select count(*) from period_as_of(NULL::r1_since_log, 'log_during', '2011-01-10 23:59'))
+     = (select count(*) from r1_since_log where log_during @> '2011-01-10 23:59'::timestamptz) as same;
+select k, att1 from period_as_of(NULL::r1_since_log, 'log_during', '2011-01-02') where k = 1;
+SAVEPOINT s;
+select count(*) from period_as_of(NULL::r1_since_log, 'att1', '2011-01-01');
+ROLLBACK TO SAVEPOINT s;
+select count(*) from period_as_of(NULL::r1_since_log, 'nope', '2011-01-01');
+ROLLBACK TO SAVEPOINT s;
+select count(*) from period_as_of(NULL::int, 'log_during', '2011-01-01');
+ROLLBACK TO SAVEPOINT s;
+
+ROLLBACK;
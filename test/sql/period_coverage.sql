@@ -0,0 +1,77 @@
+\set ECHO 0
+BEGIN;
+\i temporal.sql
+\set ECHO all
+
+-- hours of the first of January
+CREATE TABLE shift (k integer, p period);
+INSERT INTO shift VALUES
+  (1, period('2011-01-01 01:00', '2011-01-01 03:00')),
+  (1, period('2011-01-01 05:30', '2011-01-01 06:10')),
+  (2, period('2011-01-01 12:00', '2011-01-01 12:00:01')),
+  (2, period('2011-01-01 23:00', '2011-01-03')),
+  (2, period('2010-12-01', '2010-12-02')),
+  (2, empty_period()),
+  (2, NULL);
+CREATE TABLE shift_coverage AS
+  SELECT k, coverage(p, period('2011-01-01', '2011-01-02'), '1 hour') AS c
+    FROM shift GROUP BY k;
+
+-- a bucket for every hour touched inside the window
+select k, date_part('epoch', covered(c)) / 3600 as hours from shift_coverage order by k;
+
+-- the runs of hours, the last ending with the window
+select count(*) as runs,
+       bool_or(u = period('2011-01-01 01:00', '2011-01-01 03:00')) as first_run,
+       bool_or(u = period('2011-01-01 23:00', '2011-01-02')) as last_run
+  from shift_coverage, unnest(c) u where k in (1, 2);
+
+-- the whole hours touched can match, but nothing that missed them
+select c && period('2011-01-01 02:30', '2011-01-01 02:40') as overlaps,
+       c && period('2011-01-01 03:00', '2011-01-01 05:00') as gap,
+       c && period('2011-01-01 05:00', '2011-01-01 05:10') as same_hour,
+       c && period('2010-12-01', '2010-12-02') as outside,
+       c && empty_period() as empty
+  from shift_coverage where k = 1;
+select c @> period('2011-01-01 01:00', '2011-01-01 03:00') as contains,
+       c @> period('2011-01-01 01:00', '2011-01-01 04:00') as gap,
+       c @> '2011-01-01 06:30'::timestamptz as same_hour,
+       c @> empty_period() as empty
+  from shift_coverage where k = 1;
+-- nothing past the window
+select c @> period('2011-01-01 23:00', '2011-01-03') as past_window from shift_coverage where k = 2;
+
+-- the same as the periods' own operators, apart from the hours they share
+select bool_and(not (s.p && q) or c && q) as overlaps_kept,
+       bool_and(not (s.p @> q) or c @> q) as contains_kept
+  from shift s join shift_coverage using (k),
+       (select period('2011-01-01'::timestamptz + i * interval '10 minutes',
+                      '2011-01-01'::timestamptz + (i + j) * interval '10 minutes') as q
+          from generate_series(0, 143) i, generate_series(0, 12) j) probe
+ where first(s.p) >= '2011-01-01' and next(s.p) <= '2011-01-02';
+
+-- rolled up
+select date_part('epoch', covered(coverage(c))) / 3600 as hours from shift_coverage;
+select (a.c | b.c) @> a.c as union_contains, a.c && b.c as overlaps, a.c @> b.c as contains,
+       covered(a.c | b.c) = (select covered(coverage(c)) from shift_coverage) as same
+  from shift_coverage a, shift_coverage b
+ where a.k = 1 and b.k = 2;
+
+-- as text
+select covered(c::text::period_coverage) = covered(c) and c::text::period_coverage @> c as round_trip
+  from shift_coverage where k = 1;
+select date_part('epoch', covered('[2011-01-01 00:00:00-08, 2011-01-01 04:00:00-08)/01:00:00/6'::period_coverage)) / 3600 as hours;
+select '[2011-01-01 00:00:00-08, 2011-01-01 04:00:00-08)/01:00:00/6'::period_coverage
+       @> period('2011-01-01 01:00', '2011-01-01 03:00') as contains;
+
+SAVEPOINT s;
+select period_coverage(period('2011-01-01', '2011-01-02'), '1 hour') | period_coverage(period('2011-01-01', '2011-01-02'), '2 hours');
+ROLLBACK TO SAVEPOINT s;
+select period_coverage(period('2011-01-01', '2011-02-01'), '1 month');
+ROLLBACK TO SAVEPOINT s;
+select '[2011-01-01 00:00:00-08, 2011-01-01 04:00:00-08)/01:00:00/06'::text::period_coverage;
+ROLLBACK TO SAVEPOINT s;
+select '[2011-01-01 00:00:00-08, 2011-01-01 03:00:00-08)/01:00:00/8'::text::period_coverage;
+ROLLBACK TO SAVEPOINT s;
+
+ROLLBACK;
@@ -0,0 +1,72 @@
+\set ECHO 0
+BEGIN;
+\i temporal.sql
+\set ECHO all
+
+-- jobs of three machines, a few hours long, some of them overlapping
+CREATE TABLE job (i integer, k integer, p period);
+INSERT INTO job
+  SELECT i, i % 3,
+         CASE WHEN i % 17 = 0 THEN NULL
+              WHEN i % 13 = 0 THEN empty_period()
+              ELSE period('2011-01-01'::timestamptz + (i * 37 % 200) * interval '1 hour',
+                          '2011-01-01'::timestamptz + (i * 37 % 200 + i % 7 + 1) * interval '1 hour')
+         END
+    FROM generate_series(1, 300) i;
+
+-- the hours covered, each once
+select date_part('epoch', covered_length(p)) / 3600 as hours from job;
+select k, date_part('epoch', covered_length(p)) / 3600 as hours from job group by k order by k;
+select covered_length(p) is null as all_null from job where p is null;
+
+-- frames sliding over each machine's jobs, against the hours some job
+-- of the frame covers
+with w as (
+  select i,
+         date_part('epoch', covered_length(p) over (partition by k order by i
+                                                    rows between 9 preceding and current row)) / 3600 as trailing,
+         date_part('epoch', covered_length(p) over (partition by k order by i
+                                                    rows between 2 preceding and 2 following)) / 3600 as centered
+    from job),
+b as (
+  select j.i,
+         (select count(distinct h) from job f, generate_series(0, 210) h
+           where f.k = j.k and f.i between j.i - 27 and j.i
+             and f.p @> '2011-01-01'::timestamptz + h * interval '1 hour') as trailing,
+         (select count(distinct h) from job f, generate_series(0, 210) h
+           where f.k = j.k and f.i between j.i - 6 and j.i + 6
+             and f.p @> '2011-01-01'::timestamptz + h * interval '1 hour') as centered
+    from job j)
+select count(*) as rows,
+       bool_and(coalesce(w.trailing, 0) = b.trailing) as trailing,
+       bool_and(coalesce(w.centered, 0) = b.centered) as centered,
+       sum(w.trailing) as trailing_hours,
+       sum(w.centered) as centered_hours
+  from w join b using (i);
+
+-- an open ended period covers an infinite length
+select covered_length(p) is null as infinite from (values (period('2011-01-01', 'infinity')), (period('2010-01-01', '2010-01-02'))) v(p);
+
+-- open ended periods entering and leaving the frame, which splits and
+-- merges spans with an infinite bound, against the plain aggregate over
+-- the rows of each frame
+CREATE TABLE shift (i integer, p period);
+INSERT INTO shift VALUES
+  (1, period('2011-01-01 00:00', 'infinity')),
+  (2, period('2011-01-01 00:00', '2011-01-01 05:00')),
+  (3, period('2011-01-01 03:00', '2011-01-01 08:00')),
+  (4, period('2011-01-01 10:00', '2011-01-01 12:00')),
+  (5, period('-infinity', '2011-01-01 01:00')),
+  (6, period('2011-01-01 11:00', '2011-01-01 14:00')),
+  (7, period('2011-01-01 02:00', '2011-01-01 04:00')),
+  (8, period('2011-01-01 13:00', 'infinity')),
+  (9, period('2011-01-01 06:00', '2011-01-01 07:00')),
+  (10, period('2011-01-01 00:00', '2011-01-01 02:00')),
+  (11, period('2011-01-01 20:00', '2011-01-01 21:00')),
+  (12, period('2011-01-01 05:00', '2011-01-01 09:00'));
+select i,
+       date_part('epoch', covered_length(p) over (order by i rows between 1 preceding and current row)) / 3600 as hours,
+       date_part('epoch', (select covered_length(f.p) from shift f where f.i between s.i - 1 and s.i)) / 3600 as plain
+  from shift s order by i;
+
+ROLLBACK;
@@ -0,0 +1,18 @@
+\set ECHO 0
+BEGIN;
+\i temporal.sql
+\set ECHO all
+
+-- 30 minute slots, each booked many times
+CREATE TABLE booking (id int, slot period);
+INSERT INTO booking
+  SELECT i, period('2011-01-03 09:00'::timestamptz + (i % 16) * interval '30 minutes',
+                   '2011-01-03 09:30'::timestamptz + (i % 16) * interval '30 minutes')
+    FROM generate_series(1, 20000) i;
+CREATE INDEX booking_slot ON booking (slot);
+CREATE INDEX booking_slot_nodedup ON booking (slot) WITH (deduplicate_items = off);
+select pg_relation_size('booking_slot') * 2 < pg_relation_size('booking_slot_nodedup') as smaller;
+SET enable_seqscan = off;
+select count(*) from booking where slot = period('2011-01-03 10:00', '2011-01-03 10:30');
+
+ROLLBACK;
@@ -0,0 +1,45 @@
+\set ECHO 0
+BEGIN;
+\i temporal.sql
+\set ECHO all
+
+select pg_column_size('[2009-01-01, 2009-03-01)'::dperiod) as dsize,
+       pg_column_size('[2009-01-01, 2009-03-01)'::tsperiod) as tssize,
+       pg_column_size('[1, 10)'::iperiod) as isize;
+
+select '[1, 10]'::iperiod as closed, '(1, 10)'::iperiod as open, '-'::iperiod as empty;
+
+select '[2009-01-01, 2009-03-01)'::dperiod @> '2009-02-03'::date as contains,
+       '2009-03-01'::date <@ '[2009-01-01, 2009-03-01)'::dperiod as contained_by,
+       '[2009-01-01, 2009-03-01)'::dperiod <| '[2009-03-01, 2009-04-01)'::dperiod as meets;
+
+select '[2009-01-01 00:00, 2009-01-02 00:00)'::tsperiod && '[2009-01-01 12:00, 2009-01-03 00:00)'::tsperiod as overlaps;
+
+select '[1, 10)'::iperiod - '[5, 20)'::iperiod as minus,
+       period_intersect('[1, 10)'::iperiod, '[5, 20)'::iperiod) as intersect,
+       '[1, 10)'::iperiod + '[10, 20)'::iperiod as union;
+
+select first(p), last(p), next(p) from (select '[3, 7)'::iperiod as p) s;
+
+CREATE TABLE iperiod_test AS
+  SELECT iperiod(g, g + g % 7 + 1) AS p FROM generate_series(0, 999) g;
+
+CREATE INDEX iperiod_test_gist ON iperiod_test USING gist (p);
+
+SET enable_seqscan = off;
+
+select count(*) from iperiod_test where p && '[100, 110)';
+
+select count(*) from iperiod_test where p @> 500::bigint;
+
+select count(*) from iperiod_test where p <| '[500, 510)';
+
+select count(*) from iperiod_test where p <<@ '[100, 200)';
+
+DROP INDEX iperiod_test_gist;
+
+CREATE INDEX iperiod_test_btree ON iperiod_test (p);
+
+select p from iperiod_test where p < '[3, 4)' order by p;
+
+ROLLBACK;
@@ -0,0 +1,42 @@
+\set ECHO 0
+BEGIN;
+\i temporal.sql
+\set ECHO all
+
+-- hour long periods one after another, and some current ones
+CREATE TABLE shift (p period);
+INSERT INTO shift
+  SELECT period('2011-01-03'::timestamptz + i * interval '1 hour',
+                '2011-01-03'::timestamptz + (i + 1) * interval '1 hour')
+    FROM generate_series(0, 1999) i;
+INSERT INTO shift
+  SELECT period('2011-01-03'::timestamptz + i * interval '1 hour', 'infinity')
+    FROM generate_series(0, 99) i;
+CREATE INDEX shift_p ON shift USING gist (p);
+CREATE INDEX shift_p_btree ON shift (p);
+
+select level, tuples, extent_sum, extent_mean, overlap, round(open_ended::numeric, 4) as open_ended
+  from period_gist_stats('shift_p') where level = 0;
+select count(*) as levels, bool_and(fill > 0 and fill <= 1) as filled from period_gist_stats('shift_p');
+-- a downlink for every page below
+select (select tuples from period_gist_stats('shift_p') where level = 1) =
+       (select pages from period_gist_stats('shift_p') where level = 0) as linked;
+
+SAVEPOINT s;
+select * from period_gist_stats('shift_p_btree');
+ROLLBACK TO SAVEPOINT s;
+
+-- the keys are the table's data, so granted the function, a role still needs SELECT on the table
+CREATE ROLE regress_temporal_reader;
+GRANT EXECUTE ON FUNCTION period_gist_stats(regclass) TO regress_temporal_reader;
+SET ROLE regress_temporal_reader;
+SAVEPOINT s;
+select count(*) from period_gist_stats('shift_p');
+ROLLBACK TO SAVEPOINT s;
+RESET ROLE;
+GRANT SELECT ON shift TO regress_temporal_reader;
+SET ROLE regress_temporal_reader;
+select count(*) > 0 as levels from period_gist_stats('shift_p');
+RESET ROLE;
+
+ROLLBACK;
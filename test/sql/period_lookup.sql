@@ -0,0 +1,37 @@
+\set ECHO 0
+BEGIN;
+\i temporal.sql
+\set ECHO all
+
+CREATE TABLE rate (k int, amount int, during period);
+-- a rate per key and week of 2011, with a gap after each fourth week
+INSERT INTO rate
+  SELECT k, k * 100 + w,
+         period('2011-01-01'::timestamptz + w * interval '7 days',
+                '2011-01-01'::timestamptz + (w + 1) * interval '7 days')
+    FROM generate_series(1, 3) k, generate_series(0, 51) w
+   WHERE w % 5 <> 4;
+CREATE INDEX rate_during ON rate (during);
+CREATE TABLE event (id int, at timestamptz);
+INSERT INTO event
+  SELECT i, '2011-01-01'::timestamptz + i * interval '1 hour 7 minutes'
+    FROM generate_series(0, 9999) i;
+
+select count(*), count(DISTINCT probe) from period_lookup(NULL::rate, 'during', (select array_agg(at) from event));
+-- the same as a join on <@
+select count(*) from (
+  (select probe, (matched).k, (matched).amount from period_lookup(NULL::rate, 'during', (select array_agg(at) from event))
+   except all
+   select at, k, amount from event join rate on at <@ during)
+  union all
+  (select at, k, amount from event join rate on at <@ during
+   except all
+   select probe, (matched).k, (matched).amount from period_lookup(NULL::rate, 'during', (select array_agg(at) from event)))
+) d;
+-- unsorted probes, with duplicates, NULL and infinity
+select probe::date, (matched).amount from period_lookup(NULL::rate, 'during',
+  ARRAY['2011-01-20', '2011-01-02', NULL, '2011-01-02', 'infinity', '2011-02-02']::timestamptz[]) order by 1, 2;
+select count(*) from period_lookup(NULL::rate, 'during', '{}');
+select count(*) from period_lookup(NULL::rate, 'during', ARRAY['infinity', '-infinity']::timestamptz[]);
+
+ROLLBACK;
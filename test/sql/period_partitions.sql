@@ -0,0 +1,45 @@
+\set ECHO 0
+BEGIN;
+\i temporal.sql
+\set ECHO all
+
+CREATE TABLE m (k int, during period) PARTITION BY RANGE (first(during));
+select period_partitions('m', '2011-01-01', '2012-01-01', '1 month');
+-- three days each, starting every day of 2011
+INSERT INTO m
+  SELECT i, period('2011-01-01'::timestamptz + i * interval '1 day',
+                   '2011-01-01'::timestamptz + (i + 3) * interval '1 day')
+    FROM generate_series(0, 364) i;
+
+-- the partitions a query scans
+CREATE FUNCTION scanned(text) RETURNS text LANGUAGE plpgsql AS $$
+DECLARE
+  l text;
+  r text[] := '{}';
+BEGIN
+  FOR l IN EXECUTE 'EXPLAIN (COSTS OFF) ' || $1 LOOP
+    IF l ~ 'Scan on m_' THEN
+      r := r || substring(l from 'Scan on (m_[0-9]+)');
+    END IF;
+  END LOOP;
+  RETURN array_to_string(r, ' ');
+END;
+$$;
+
+select scanned($$select * from m where during && period('2011-03-10', '2011-03-20')$$);
+select count(*) from m where during && period('2011-03-10', '2011-03-20');
+select scanned($$select * from m where during @> '2011-06-15'::timestamptz$$);
+select scanned($$select * from m where during <@ period('2011-03-10', '2011-03-20')$$);
+select count(*) from m where during <@ period('2011-03-10', '2011-03-20');
+select scanned($$select * from m where during >> period('2011-11-01', '2011-11-15')$$);
+select scanned($$select * from m where period('2011-11-01', '2011-11-15') << during$$);
+select scanned($$select * from m where during << period('2011-01-20', '2011-02-10')$$);
+-- nothing can be derived from an empty period
+select count(*) from m where during <@ empty_period();
+-- or with pruning off
+SET temporal.partition_pruning = off;
+select scanned($$select * from m where during <@ period('2011-03-10', '2011-03-20')$$);
+select count(*) from m where during && period('2011-03-10', '2011-03-20');
+RESET temporal.partition_pruning;
+
+ROLLBACK;
@@ -0,0 +1,40 @@
+\set ECHO 0
+BEGIN;
+\i temporal.sql
+\set ECHO all
+
+CREATE TABLE booking (room int, during period, note text DEFAULT 'reserved');
+CREATE INDEX booking_room_during ON booking (room, during);
+INSERT INTO booking (room, during) VALUES
+  (1, period('2011-01-03 09:00', '2011-01-03 10:00')),
+  (1, period('2011-01-03 13:00', '2011-01-03 15:00'));
+
+-- free, and next to another booking
+select reserved, conflict is null as no_conflict
+  from period_reserve('booking', 'room', 1, 'during', period('2011-01-03 10:00', '2011-01-03 11:00'));
+-- taken, by the booking before or the one after
+select reserved, conflict = period('2011-01-03 09:00', '2011-01-03 10:00') as conflict
+  from period_reserve('booking', 'room', 1, 'during', period('2011-01-03 08:30', '2011-01-03 09:30'));
+select reserved, conflict = period('2011-01-03 13:00', '2011-01-03 15:00') as conflict
+  from period_reserve('booking', 'room', 1, 'during', period('2011-01-03 12:00', '2011-01-03 13:30'));
+-- the same time in another room
+select reserved from period_reserve('booking', 'room', 2, 'during', period('2011-01-03 08:30', '2011-01-03 09:30'));
+-- spanning many hour long buckets, and open ended
+select reserved, conflict = period('2011-01-03 08:30', '2011-01-03 09:30') as conflict
+  from period_reserve('booking', 'room', 2, 'during', period('2011-01-01', '2011-01-10'), '1 hour');
+select reserved from period_reserve('booking', 'room', 2, 'during', period('2011-02-01', 'infinity'), '1 hour');
+select reserved, conflict = period('2011-02-01', 'infinity') as conflict
+  from period_reserve('booking', 'room', 2, 'during', period('2011-03-01 12:00', '2011-03-01 13:00'), '1 hour');
+
+-- the rows inserted, with defaults for the other columns
+select room, count(*), bool_and(note = 'reserved') as defaults from booking group by room order by room;
+
+SAVEPOINT s;
+select period_reserve('booking', 'room', 1::bigint, 'during', period('2011-01-04', '2011-01-05'));
+ROLLBACK TO SAVEPOINT s;
+select period_reserve('booking', 'room', 1, 'note', period('2011-01-04', '2011-01-05'));
+ROLLBACK TO SAVEPOINT s;
+select period_reserve('booking', 'room', 1, 'during', period('2011-01-04', '2011-01-05'), '1 month');
+ROLLBACK TO SAVEPOINT s;
+
+ROLLBACK;
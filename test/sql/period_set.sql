@@ -0,0 +1,67 @@
+\set ECHO 0
+BEGIN;
+\i temporal.sql
+\set ECHO all
+
+select '{}'::period_set as none, '{-EMPTY-, -}'::period_set as empty,
+       period_set_count('{[2009-01-03, 2009-01-04), [2009-01-01, 2009-01-02), -EMPTY-, [2009-01-01, 2009-01-02)}') as count;
+
+-- book every other hour, latest first, then probe each half hour
+CREATE FUNCTION period_set_test() RETURNS SETOF INTEGER LANGUAGE plpgsql AS $$
+DECLARE
+  s period_set := '{}';
+  t timestamptz := '2009-01-01';
+  hits integer := 0;
+BEGIN
+  FOR i IN REVERSE 999 .. 0 LOOP
+    s := period_set_add(s, period(t + (2 * i) * interval '1 hour', t + (2 * i + 1) * interval '1 hour'));
+  END LOOP;
+  RETURN NEXT period_set_count(s);
+  FOR i IN 0 .. 3999 LOOP
+    IF s @> t + i * interval '30 minutes' THEN
+      hits := hits + 1;
+    END IF;
+  END LOOP;
+  RETURN NEXT hits;
+  s := period_set_remove(s, period(t, t + interval '1 hour'));
+  RETURN NEXT period_set_count(s);
+  RETURN NEXT (s && period(t, t + interval '1 hour'))::integer;
+  RETURN NEXT (s && period(t, t + interval '2 hours 1 second'))::integer;
+END;
+$$;
+select * from period_set_test();
+
+CREATE TABLE period_set_t AS
+  SELECT period_set(array_agg(period('2009-01-01'::timestamptz + g * '1 day'::interval,
+                                     '2009-01-01'::timestamptz + (g + 2) * '1 day'::interval))) AS s
+    FROM generate_series(0, 99, 3) g;
+select period_set_count(s) as count,
+       array_length(period_array(s), 1) as length,
+       s @> period('2009-01-04', '2009-01-06') as contains,
+       s @> period('2009-01-05', '2009-01-07') as spans_gap,
+       s && period('2009-01-03', '2009-01-04') as in_gap
+  from period_set_t;
+
+-- nested windows: one every 10 minutes, each lasting from 10 minutes to a day
+CREATE TABLE period_set_windows AS
+  SELECT period_set(array_agg(period('2009-01-01'::timestamptz + g * '10 minutes'::interval,
+                                     '2009-01-01'::timestamptz + (g + 1 + (g * 37) % 144) * '10 minutes'::interval))) AS s
+    FROM generate_series(0, 999) g;
+select (select count(*) from period_set_containing(s, '2009-01-03 12:05'::timestamptz)) as stab,
+       (select count(*) from period_set_containing(s, period('2009-01-03 12:00', '2009-01-03 13:00'))) as containing,
+       (select count(*) from period_set_overlapping(s, period('2009-01-03 12:00', '2009-01-03 13:00'))) as overlapping
+  from period_set_windows;
+select (select count(*) from generate_series(0, 999) g
+         where period('2009-01-01'::timestamptz + g * '10 minutes'::interval,
+                      '2009-01-01'::timestamptz + (g + 1 + (g * 37) % 144) * '10 minutes'::interval)
+               @> '2009-01-03 12:05'::timestamptz) as stab,
+       (select count(*) from generate_series(0, 999) g
+         where period('2009-01-01'::timestamptz + g * '10 minutes'::interval,
+                      '2009-01-01'::timestamptz + (g + 1 + (g * 37) % 144) * '10 minutes'::interval)
+               @> period('2009-01-03 12:00', '2009-01-03 13:00')) as containing,
+       (select count(*) from generate_series(0, 999) g
+         where period('2009-01-01'::timestamptz + g * '10 minutes'::interval,
+                      '2009-01-01'::timestamptz + (g + 1 + (g * 37) % 144) * '10 minutes'::interval)
+               && period('2009-01-03 12:00', '2009-01-03 13:00')) as overlapping;
+
+ROLLBACK;
@@ -0,0 +1,62 @@
+\set ECHO 0
+BEGIN;
+\i temporal.sql
+\set ECHO all
+
+-- the bounds carry over, however the range writes them
+select tstzrange('2011-01-03', '2011-01-05')::period = period('2011-01-03', '2011-01-05') as co,
+       tstzrange('2011-01-03', '2011-01-05', '[]')::period = period('2011-01-03', '2011-01-05 00:00:00.000001') as cc,
+       tstzrange('2011-01-03', '2011-01-05', '()')::period = period('2011-01-03 00:00:00.000001', '2011-01-05') as oo,
+       tstzrange('2011-01-03', NULL)::period = period('2011-01-03', 'infinity') as unbounded,
+       is_empty('empty'::tstzrange::period) as empty;
+select period('2011-01-03', '2011-01-05')::tstzrange = tstzrange('2011-01-03', '2011-01-05') as co,
+       period('2011-01-03', 'infinity')::tstzrange = tstzrange('2011-01-03', NULL) as unbounded,
+       isempty(empty_period()::tstzrange) as empty;
+
+-- a day each, from the first of January
+CREATE TABLE booking (p period);
+INSERT INTO booking
+  SELECT period('2011-01-01'::timestamptz + i * interval '1 day',
+                '2011-01-01'::timestamptz + (i + 1) * interval '1 day')
+    FROM generate_series(0, 99) i;
+CREATE TABLE closure (r tstzrange);
+INSERT INTO closure VALUES
+  (tstzrange('2011-02-01', '2011-02-03')), (tstzrange('2011-02-01', '2011-02-03', '(]')),
+  (tstzrange('2011-01-10 12:00', '2011-01-11 12:00')), (tstzrange(NULL, '2011-01-05')),
+  (tstzrange('2011-03-01', NULL)), (tstzrange('2011-03-05', '2011-03-06', '[]'));
+
+-- the operators agree with converting the range
+select bool_and((p && r) = (p && r::period) and (r && p) = (r::period && p) and
+                (p @> r) = (p @> r::period) and (r @> p) = (r::period @> p) and
+                (p <@ r) = (p <@ r::period) and (r <@ p) = (r::period <@ p) and
+                (p << r) = (p << r::period) and (r << p) = (r::period << p) and
+                (p >> r) = (p >> r::period) and (r >> p) = (r::period >> p)) as agree
+  from booking, closure;
+
+-- and use the period's index
+CREATE INDEX booking_p ON booking USING gist (p);
+SET enable_seqscan = off;
+CREATE FUNCTION indexed(text) RETURNS boolean LANGUAGE plpgsql AS $$
+DECLARE
+  l text;
+BEGIN
+  FOR l IN EXECUTE 'EXPLAIN (COSTS OFF) ' || $1 LOOP
+    IF l ~ 'Index Cond' THEN
+      RETURN true;
+    END IF;
+  END LOOP;
+  RETURN false;
+END;
+$$;
+select indexed($$select * from booking where p && tstzrange('2011-02-01', '2011-02-03')$$);
+select indexed($$select * from booking where tstzrange('2011-02-01', '2011-02-03') @> p$$);
+select count(*) from booking where p && tstzrange('2011-02-01', '2011-02-03');
+select count(*) from booking where p @> tstzrange('2011-02-01', '2011-02-03');
+select count(*) from booking where p <@ tstzrange('2011-02-01', '2011-02-03');
+select count(*) from booking where p << tstzrange('2011-02-01', '2011-02-03');
+select count(*) from booking where p >> tstzrange('2011-02-01', '2011-02-03');
+select count(*) from booking where p && tstzrange('2011-02-01', '2011-02-03', '(]');
+select count(*) from booking where p @> tstzrange('2011-02-01 10:00', '2011-02-01 11:00');
+select count(*) from booking b, closure c where b.p && c.r;
+
+ROLLBACK;
@@ -0,0 +1,55 @@
+\set ECHO 0
+BEGIN;
+\i temporal.sql
+\set ECHO all
+
+CREATE TABLE r1_since (k text primary key, att1 text, since timestamptz);
+CREATE TABLE r2_since (k text primary key, att2 text, since timestamptz);
+CREATE VIEW r AS SELECT k, att1, att2 FROM r1_since JOIN r2_since USING (k);
+CREATE TABLE r_current (k text primary key, att1 text, att2 text);
+CREATE TRIGGER r1_current AFTER INSERT OR UPDATE OR DELETE ON r1_since
+  FOR EACH ROW EXECUTE PROCEDURE temporal_current('r_current', 'r', 'k');
+CREATE TRIGGER r2_current AFTER INSERT OR UPDATE OR DELETE ON r2_since
+  FOR EACH ROW EXECUTE PROCEDURE temporal_current('r_current', 'r', 'k');
+
+INSERT INTO r1_since VALUES ('a', 'x', now()), ('b', 'y', now()), ('c', 'z', now());
+INSERT INTO r2_since VALUES ('a', 'p', now()), ('c', 'q', now()), ('d', 'r', now());
+select * from r_current order by k;
+UPDATE r1_since SET att1 = 'x2' WHERE k = 'a';
+-- a key change leaves the old key and joins the new one
+UPDATE r1_since SET k = 'd' WHERE k = 'b';
+DELETE FROM r2_since WHERE k = 'c';
+select * from r_current order by k;
+select count(*) from ((table r except all table r_current) union all (table r_current except all table r)) d;
+SAVEPOINT s;
+CREATE TRIGGER r1_bad AFTER INSERT ON r1_since
+  FOR EACH ROW EXECUTE PROCEDURE temporal_current('r_current', 'r', 'id');
+INSERT INTO r1_since VALUES ('e', 'w', now());
+ROLLBACK TO SAVEPOINT s;
+
+-- batches: one DELETE and one INSERT ... SELECT per statement
+CREATE TABLE s1 (k integer primary key, a integer);
+CREATE TABLE s2 (k integer primary key, b integer);
+CREATE VIEW s AS SELECT k, a, b FROM s1 JOIN s2 USING (k);
+CREATE TABLE s_current (k integer primary key, a integer, b integer);
+CREATE TRIGGER s1_insert AFTER INSERT ON s1 REFERENCING NEW TABLE AS new_rows
+  FOR EACH STATEMENT EXECUTE PROCEDURE temporal_current('s_current', 's', 'k');
+CREATE TRIGGER s1_update AFTER UPDATE ON s1 REFERENCING OLD TABLE AS old_rows NEW TABLE AS new_rows
+  FOR EACH STATEMENT EXECUTE PROCEDURE temporal_current('s_current', 's', 'k');
+CREATE TRIGGER s1_delete AFTER DELETE ON s1 REFERENCING OLD TABLE AS old_rows
+  FOR EACH STATEMENT EXECUTE PROCEDURE temporal_current('s_current', 's', 'k');
+CREATE TRIGGER s2_insert AFTER INSERT ON s2 REFERENCING NEW TABLE AS new_rows
+  FOR EACH STATEMENT EXECUTE PROCEDURE temporal_current('s_current', 's', 'k');
+CREATE TRIGGER s2_update AFTER UPDATE ON s2 REFERENCING OLD TABLE AS old_rows NEW TABLE AS new_rows
+  FOR EACH STATEMENT EXECUTE PROCEDURE temporal_current('s_current', 's', 'k');
+CREATE TRIGGER s2_delete AFTER DELETE ON s2 REFERENCING OLD TABLE AS old_rows
+  FOR EACH STATEMENT EXECUTE PROCEDURE temporal_current('s_current', 's', 'k');
+INSERT INTO s1 SELECT g, g FROM generate_series(1, 1000) g;
+INSERT INTO s2 SELECT g, -g FROM generate_series(500, 1500) g;
+UPDATE s1 SET a = a + 1 WHERE k % 3 = 0;
+UPDATE s2 SET k = k + 1000 WHERE k > 900;
+DELETE FROM s1 WHERE k <= 600;
+select count(*) as current, sum(a) as a, sum(b) as b from s_current;
+select count(*) from ((table s except all table s_current) union all (table s_current except all table s)) d;
+
+ROLLBACK;
@@ -0,0 +1,71 @@
+\set ECHO 0
+BEGIN;
+\i temporal.sql
+\set ECHO all
+
+CREATE TABLE available (room int, during period);
+CREATE INDEX available_room_during ON available (room, during);
+CREATE TABLE booking (room int, during period);
+CREATE CONSTRAINT TRIGGER booking_available AFTER INSERT OR UPDATE ON booking
+  FOR EACH ROW EXECUTE PROCEDURE temporal_foreign_key('room', 'during', 'available', 'room', 'during');
+
+-- room 1 is available in three adjacent pieces, then again after a gap
+INSERT INTO available VALUES (1, period('2011-01-01', '2011-01-05')),
+                             (1, period('2011-01-05', '2011-01-10')),
+                             (1, period('2011-01-10', '2011-01-15')),
+                             (1, period('2011-01-20', '2011-01-25')),
+                             (2, period('2011-01-01', '2011-01-10'));
+-- covered by one piece, by several, and not checked
+INSERT INTO booking VALUES (1, period('2011-01-02', '2011-01-04')),
+                           (1, period('2011-01-03', '2011-01-14')),
+                           (1, period('2011-01-05', '2011-01-15')),
+                           (2, period('2011-01-01', '2011-01-10')),
+                           (NULL, period('2000-01-01', '2000-01-02'));
+SAVEPOINT s;
+-- across the gap
+INSERT INTO booking VALUES (1, period('2011-01-14', '2011-01-21'));
+ROLLBACK TO SAVEPOINT s;
+-- starting before the first piece
+INSERT INTO booking VALUES (1, period('2010-12-31', '2011-01-02'));
+ROLLBACK TO SAVEPOINT s;
+-- no parent at all
+INSERT INTO booking VALUES (3, period('2011-01-01', '2011-01-02'));
+ROLLBACK TO SAVEPOINT s;
+-- moved past the end
+UPDATE booking SET during = period('2011-01-05', '2011-01-11') WHERE room = 2;
+ROLLBACK TO SAVEPOINT s;
+-- covered by a long piece before a short one overlapping it
+INSERT INTO available VALUES (4, period('2011-02-01', '2011-02-10')),
+                             (4, period('2011-02-02', '2011-02-03'));
+INSERT INTO booking VALUES (4, period('2011-02-05', '2011-02-08'));
+SAVEPOINT u;
+-- past the end of both
+INSERT INTO booking VALUES (4, period('2011-02-05', '2011-02-12'));
+ROLLBACK TO SAVEPOINT u;
+
+-- check all the new rows of a statement at once
+DROP TRIGGER booking_available ON booking;
+CREATE TRIGGER booking_available_insert AFTER INSERT ON booking
+  REFERENCING NEW TABLE AS new_booking
+  FOR EACH STATEMENT EXECUTE PROCEDURE temporal_foreign_key('room', 'during', 'available', 'room', 'during');
+CREATE TRIGGER booking_available_update AFTER UPDATE ON booking
+  REFERENCING NEW TABLE AS new_booking
+  FOR EACH STATEMENT EXECUTE PROCEDURE temporal_foreign_key('room', 'during', 'available', 'room', 'during');
+INSERT INTO booking
+  SELECT 1, period('2011-01-01'::timestamptz + i * interval '1 hour',
+                   '2011-01-01'::timestamptz + (i + 1) * interval '1 hour')
+    FROM generate_series(0, 14 * 24 - 1) i;
+SAVEPOINT t;
+INSERT INTO booking
+  SELECT 2, period('2011-01-01'::timestamptz + i * interval '1 hour',
+                   '2011-01-01'::timestamptz + (i + 1) * interval '1 hour')
+    FROM generate_series(0, 10 * 24) i;
+ROLLBACK TO SAVEPOINT t;
+UPDATE booking SET during = period(first(during), next(during) + interval '1 day')
+  WHERE room = 1;
+ROLLBACK TO SAVEPOINT t;
+-- the same overlapping pieces, a statement at a time
+INSERT INTO booking VALUES (4, period('2011-02-04', '2011-02-09'));
+select room, count(*) from booking group by room order by room;
+
+ROLLBACK;
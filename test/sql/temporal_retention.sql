@@ -0,0 +1,55 @@
+\set ECHO 0
+BEGIN;
+\i temporal.sql
+\set ECHO all
+
+CREATE TABLE r1_log (k int, att1 text, log_during period);
+CREATE INDEX r1_log_log_during ON r1_log (log_during);
+CREATE TABLE r1_log_archive (LIKE r1_log);
+-- a day of history each, the last ending now
+INSERT INTO r1_log
+  SELECT i % 10, 'x', period(now() - (i + 1) * interval '1 day', now() - i * interval '1 day')
+    FROM generate_series(0, 999) i;
+
+-- keep a year, in batches of 100
+INSERT INTO temporal_retention (relid, period_column, retention, archive, batch_size)
+  VALUES ('r1_log', 'log_during', '365 days', 'r1_log_archive', 100);
+select temporal_retention_apply('r1_log');
+select count(*), bool_and(next(log_during) > now() - interval '365 days') as kept from r1_log;
+select count(*), bool_and(next(log_during) <= now() - interval '365 days') as archived from r1_log_archive;
+select batches, rows_removed, horizon = now() - interval '365 days' as horizon from temporal_retention_progress;
+-- nothing more to do
+select temporal_retention_apply('r1_log');
+-- without an archive, rows are deleted
+UPDATE temporal_retention SET archive = NULL, retention = '100 days';
+select temporal_retention_apply('r1_log');
+select (select count(*) from r1_log) as kept, (select count(*) from r1_log_archive) as archived;
+select batches, rows_removed from temporal_retention_progress;
+
+-- batches run as the owner of the table, who must be able to write the archive
+CREATE ROLE regress_temporal_owner;
+CREATE TABLE r2_log (k int, log_during period);
+CREATE TABLE r2_log_archive (LIKE r2_log);
+CREATE TABLE r2_archived_by (k int, archived_by name);
+CREATE FUNCTION r2_archived_by() RETURNS trigger LANGUAGE plpgsql AS $$
+BEGIN
+  INSERT INTO r2_archived_by VALUES (NEW.k, current_user);
+  RETURN NEW;
+END;
+$$;
+CREATE TRIGGER r2_archived_by AFTER INSERT ON r2_log_archive
+  FOR EACH ROW EXECUTE PROCEDURE r2_archived_by();
+INSERT INTO r2_log
+  SELECT i, period(now() - (i + 1) * interval '1 day', now() - i * interval '1 day')
+    FROM generate_series(0, 9) i;
+ALTER TABLE r2_log OWNER TO regress_temporal_owner;
+INSERT INTO temporal_retention (relid, period_column, retention, archive)
+  VALUES ('r2_log', 'log_during', '5 days', 'r2_log_archive');
+SAVEPOINT s;
+select temporal_retention_apply('r2_log');
+ROLLBACK TO SAVEPOINT s;
+GRANT INSERT ON r2_log_archive, r2_archived_by TO regress_temporal_owner;
+select temporal_retention_apply('r2_log');
+select archived_by, count(*) from r2_archived_by group by archived_by;
+
+ROLLBACK;
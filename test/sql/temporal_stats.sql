@@ -0,0 +1,35 @@
+\set ECHO 0
+BEGIN;
+\i temporal.sql
+\set ECHO all
+
+SET temporal.track_stats = on;
+select count(*) from temporal_stats_reset();
+
+-- ten days, all on one leaf page
+CREATE TABLE visit (p period);
+INSERT INTO visit
+  SELECT period('2011-01-03'::timestamptz + i * interval '1 day',
+                '2011-01-03'::timestamptz + (i + 1) * interval '1 day')
+    FROM generate_series(0, 9) i;
+CREATE INDEX visit_p ON visit USING gist (p);
+SET enable_seqscan = off;
+select count(*) from visit where p && period('2011-01-05', '2011-01-07');
+select count(*) from visit where p && period('2012-01-05', '2012-01-07');
+select counter, strategy, value, stats_reset is not null as reset from pg_stat_temporal;
+
+-- enough to split pages
+INSERT INTO visit
+  SELECT period('2011-01-03'::timestamptz + i * interval '1 hour',
+                '2011-01-03'::timestamptz + (i + 1) * interval '1 hour')
+    FROM generate_series(0, 1999) i;
+select count(*) from visit where p && period('2011-01-05', '2011-01-07');
+select counter, value > 0 as counted from pg_stat_temporal
+ where counter in ('consistent_internal', 'picksplit');
+
+SET temporal.track_stats = off;
+select count(*) from temporal_stats_reset();
+select count(*) from visit where p && period('2011-01-05', '2011-01-07');
+select sum(value) from pg_stat_temporal;
+
+ROLLBACK;
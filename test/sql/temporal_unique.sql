@@ -0,0 +1,43 @@
+\set ECHO 0
+BEGIN;
+\i temporal.sql
+\set ECHO all
+
+CREATE TABLE reservation (room int, during period);
+CREATE INDEX reservation_room_during ON reservation (room, during);
+CREATE CONSTRAINT TRIGGER reservation_unique AFTER INSERT OR UPDATE ON reservation
+  FOR EACH ROW EXECUTE PROCEDURE temporal_unique('room', 'during');
+
+INSERT INTO reservation VALUES (1, period('2011-01-01', '2011-01-05')),
+                               (1, period('2011-01-05', '2011-01-10')),
+                               (2, period('2011-01-01', '2011-01-10'));
+SAVEPOINT s;
+-- overlaps its successor
+INSERT INTO reservation VALUES (1, period('2010-12-25', '2011-01-02'));
+ROLLBACK TO SAVEPOINT s;
+-- overlaps its predecessor
+INSERT INTO reservation VALUES (1, period('2011-01-09', '2011-01-12'));
+ROLLBACK TO SAVEPOINT s;
+-- inside its predecessor
+INSERT INTO reservation VALUES (1, period('2011-01-02', '2011-01-03'));
+ROLLBACK TO SAVEPOINT s;
+-- equal to another row
+INSERT INTO reservation VALUES (2, period('2011-01-01', '2011-01-10'));
+ROLLBACK TO SAVEPOINT s;
+-- two new rows that overlap each other
+INSERT INTO reservation VALUES (4, period('2011-01-01', '2011-01-05')),
+                               (4, period('2011-01-03', '2011-01-08'));
+ROLLBACK TO SAVEPOINT s;
+-- moved onto its neighbour
+UPDATE reservation SET during = period('2011-01-04', '2011-01-06')
+  WHERE room = 1 AND during = period('2011-01-05', '2011-01-10');
+ROLLBACK TO SAVEPOINT s;
+-- adjacent periods, other keys, NULLs and unchanged rows don't conflict
+INSERT INTO reservation VALUES (1, period('2011-01-10', '2011-01-12')),
+                               (3, period('2011-01-01', '2011-01-10')),
+                               (NULL, period('2011-01-01', '2011-01-10')),
+                               (NULL, period('2011-01-01', '2011-01-10'));
+UPDATE reservation SET room = room;
+select room, count(*) from reservation group by room order by room;
+
+ROLLBACK;